@@ -153,7 +153,19 @@
 ; task info with embedded html markup
 ;
 (define (gtt-show-tasks task_list func_list) 
-        (gtt-show (gtt-apply-func-list-to-obj-list func_list task_list))
+        (gtt-show (gtt-apply-func-list-to-obj-list
+                     (gtt-task-fragment-forms func_list) task_list))
+)
+
+; The gtt-task-fragment-forms routine marks the output for each task
+; as a fragment of the page, so that the journal window can show it
+; again by itself when the task changes.  The markers are only written
+; out while links are being shown.
+;
+(define (gtt-task-fragment-forms func_list)
+        (append (list (lambda (task) (gtt-fragment-begin task func_list)))
+                func_list
+                (list gtt-fragment-end))
 )
   
 ; Syntactic sugar for organizing intervals.
@@ -209,6 +221,10 @@
 ; The first member is the date,
 ; The second member is the amount of time spent on the project on that date.
 ; At this point, both members are strings; this may change someday.
+;
+; The objects returned by gtt-hourly-totals, gtt-weekly-totals,
+; gtt-monthly-totals and gtt-yearly-totals are of the same type, so
+; that the getters below work on them as well.
 
 (define (gtt-is-daily-type? daily-obj)  (equal? (cdr daily-obj) "gtt-daily") )
 
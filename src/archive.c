@@ -0,0 +1,533 @@
+/*   per-year archives of old intervals
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <qof.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "archive.h"
+#include "calendar.h"
+#include "cur-proj.h"
+#include "prefs.h"
+#include "proj.h"
+#include "proj_p.h"
+#include "xml-gtt-p.h"
+
+/* An archive file is a text file, one interval per line, with the
+ * fields separated by tabs:
+ *
+ *   task-guid start stop fuzz running
+ *
+ * It holds all of the archived intervals that started in its year,
+ * and is always rewritten as a whole.  A year's file is only ever
+ * rewritten once all of its intervals are in memory: either it was
+ * loaded, or there was no file for the year yet.
+ */
+
+#define A_FIELDS 5
+
+typedef enum
+{
+    ARCHIVE_ON_DISK = 1, /* there's a file, not loaded yet */
+    ARCHIVE_LOADED,      /* all of the year's intervals are in memory */
+} ArchiveState;
+
+static char *archive_base = NULL;     /* the data file */
+static GHashTable *year_state = NULL; /* year to ArchiveState */
+
+/* =========================================================== */
+
+/* This may be called from any thread */
+static int year_of(time_t t)
+{
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    return tm.tm_year + 1900;
+}
+
+static char *archive_path(const char *xml_filepath, int year)
+{
+    return g_strdup_printf("%s.archive-%d", xml_filepath, year);
+}
+
+static ArchiveState get_state(int year)
+{
+    return GPOINTER_TO_INT(g_hash_table_lookup(year_state, GINT_TO_POINTER(year)));
+}
+
+static void set_state(int year, ArchiveState state)
+{
+    g_hash_table_insert(year_state, GINT_TO_POINTER(year), GINT_TO_POINTER(state));
+}
+
+time_t gtt_archive_get_cutoff(void)
+{
+    time_t cutoff;
+    int i;
+
+    if (0 >= config_archive_years)
+        return 0;
+
+    cutoff = gtt_calendar_year_start(time(0));
+    for (i = 0; i < config_archive_years; i++)
+    {
+        cutoff = gtt_calendar_year_start(cutoff - 1);
+    }
+    return cutoff;
+}
+
+/* =========================================================== */
+
+static void load_year(int year)
+{
+    char *path, *text;
+    char **lines;
+    int i;
+
+    path = archive_path(archive_base, year);
+    if (!g_file_get_contents(path, &text, NULL, NULL))
+    {
+        g_warning("can't read the archive %s\n", path);
+        g_free(path);
+        return;
+    }
+    g_free(path);
+
+    lines = g_strsplit(text, "\n", -1);
+    for (i = 0; lines[i]; i++)
+    {
+        char **fields = g_strsplit(lines[i], "\t", -1);
+        GttIntervalRec rec = { 0 };
+        GttTask *tsk = NULL;
+        GUID guid;
+
+        if ((A_FIELDS == g_strv_length(fields)) && string_to_guid(fields[0], &guid))
+            tsk = gtt_task_locate_from_guid(&guid);
+
+        /* The task may be gone.  Otherwise, every interval is loaded,
+         * even if the data file's total doesn't account for it; the
+         * ones the data file has already are skipped. */
+        if (tsk)
+        {
+            rec.start = g_ascii_strtoll(fields[1], NULL, 10);
+            rec.stop = g_ascii_strtoll(fields[2], NULL, 10);
+            rec.fuzz = g_ascii_strtoll(fields[3], NULL, 10);
+            rec.running = (0 != g_ascii_strtoll(fields[4], NULL, 10));
+            gtt_task_load_archived_interval_rec(tsk, &rec);
+        }
+        g_strfreev(fields);
+    }
+
+    g_strfreev(lines);
+    g_free(text);
+}
+
+/* Once all of the archives are loaded, no task should have any
+ * archived time left; if one does, its archive was lost. */
+static void check_leftovers(GList *prjs)
+{
+    GList *pnode, *tnode;
+
+    for (pnode = prjs; pnode; pnode = pnode->next)
+    {
+        GttProject *prj = pnode->data;
+        for (tnode = prj->task_list; tnode; tnode = tnode->next)
+        {
+            GttTask *tsk = tnode->data;
+            if (0 == gtt_task_get_archived_secs(tsk))
+                continue;
+            g_warning(
+                "the archives are missing %d seconds of task %s\n",
+                gtt_task_get_archived_secs(tsk), tsk->memo ? tsk->memo : ""
+            );
+            gtt_task_set_archived_secs(tsk, 0);
+        }
+        check_leftovers(prj->sub_projects);
+    }
+}
+
+static GList *years_on_disk(int first, int last);
+
+/* Load the years in the list that are still on disk.  Unless asked
+ * to fold them back into the data file, or the data turns out not
+ * to match the archives, this doesn't count as a change to the data. */
+static void load_years(GList *years, gboolean fold_back)
+{
+    gboolean was_clean;
+    GList *node, *left;
+
+    was_clean = (GTT_SAVE_CLEAN == gtt_project_list_get_save_state());
+
+    gtt_project_bulk_load_begin();
+    for (node = years; node; node = node->next)
+    {
+        int year = GPOINTER_TO_INT(node->data);
+        if (ARCHIVE_ON_DISK != get_state(year))
+            continue;
+        load_year(year);
+        set_state(year, ARCHIVE_LOADED);
+    }
+    gtt_project_bulk_load_commit();
+
+    if (was_clean && !fold_back)
+        gtt_project_list_mark_saved(gtt_project_list_get_version());
+
+    left = years_on_disk(G_MININT, G_MAXINT);
+    if (!left)
+        check_leftovers(gtt_project_list_get_list(master_list));
+    g_list_free(left);
+}
+
+static GList *years_on_disk(int first, int last)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    GList *years = NULL;
+
+    if (!year_state)
+        return NULL;
+
+    g_hash_table_iter_init(&iter, year_state);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        int year = GPOINTER_TO_INT(key);
+        if ((ARCHIVE_ON_DISK == GPOINTER_TO_INT(value)) && (first <= year) && (year <= last))
+            years = g_list_prepend(years, key);
+    }
+    return years;
+}
+
+void gtt_archive_load_range(time_t start, time_t stop)
+{
+    GList *years;
+
+    /* The range stops just before 'stop' */
+    years = years_on_disk(year_of(start), year_of(MAX(start, stop - 1)));
+    if (years)
+        load_years(years, FALSE);
+    g_list_free(years);
+}
+
+void gtt_archive_load_all(void)
+{
+    GList *years;
+
+    years = years_on_disk(G_MININT, G_MAXINT);
+    if (years)
+        load_years(years, FALSE);
+    g_list_free(years);
+}
+
+/* =========================================================== */
+
+void gtt_archive_open(const char *xml_filepath)
+{
+    char *dirname, *basename, *prefix;
+    const char *name;
+    GList *years;
+    GDir *dir;
+
+    g_free(archive_base);
+    archive_base = g_strdup(xml_filepath);
+    if (year_state)
+        g_hash_table_remove_all(year_state);
+    else
+        year_state = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    dirname = g_path_get_dirname(xml_filepath);
+    basename = g_path_get_basename(xml_filepath);
+    prefix = g_strconcat(basename, ".archive-", NULL);
+    dir = g_dir_open(dirname, 0, NULL);
+    while (dir && (name = g_dir_read_name(dir)))
+    {
+        const char *digits;
+
+        if (!g_str_has_prefix(name, prefix))
+            continue;
+        digits = name + strlen(prefix);
+        if (digits[0] && (strspn(digits, "0123456789") == strlen(digits)))
+            set_state(atoi(digits), ARCHIVE_ON_DISK);
+    }
+    if (dir)
+        g_dir_close(dir);
+    g_free(prefix);
+    g_free(basename);
+    g_free(dirname);
+
+    gtt_project_list_set_archive_hook(gtt_archive_load_range);
+
+    /* Archiving was turned off; bring everything back in */
+    if (0 >= config_archive_years)
+    {
+        years = years_on_disk(G_MININT, G_MAXINT);
+        if (years)
+            load_years(years, TRUE);
+        g_list_free(years);
+    }
+}
+
+/* =========================================================== */
+
+static void old_years(GList *prjs, time_t cutoff, GHashTable *years)
+{
+    GList *pnode, *tnode;
+    guint i;
+
+    for (pnode = prjs; pnode; pnode = pnode->next)
+    {
+        GttProject *prj = pnode->data;
+        for (tnode = prj->task_list; tnode; tnode = tnode->next)
+        {
+            GttTask *tsk = tnode->data;
+
+            /* The intervals are newest first; the old ones are at the end */
+            for (i = tsk->intervals->len; i; i--)
+            {
+                GttIntervalRec *rec = &g_array_index(tsk->intervals, GttIntervalRec, i - 1);
+                if (rec->start >= cutoff)
+                    break;
+                g_hash_table_add(years, GINT_TO_POINTER(year_of(rec->start)));
+            }
+        }
+        old_years(prj->sub_projects, cutoff, years);
+    }
+}
+
+GttXmlSnapshot *gtt_archive_snapshot_new(GList *projects)
+{
+    GHashTableIter iter;
+    GttXmlSnapshot *snap;
+    GHashTable *years;
+    gpointer key, value;
+    time_t cutoff;
+
+    if (!year_state)
+        year_state = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    /* The files of the years that get written have to be loaded
+     * first, or their intervals would be lost. */
+    cutoff = gtt_archive_get_cutoff();
+    years = g_hash_table_new(g_direct_hash, g_direct_equal);
+    if (cutoff)
+    {
+        GList *load;
+
+        old_years(projects, cutoff, years);
+        load = g_hash_table_get_keys(years);
+        load_years(load, FALSE);
+        g_list_free(load);
+    }
+
+    snap = gtt_xml_snapshot_new(projects, cutoff);
+
+    /* From now on, the years written are the ones in memory */
+    g_hash_table_iter_init(&iter, years);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        set_state(GPOINTER_TO_INT(key), ARCHIVE_LOADED);
+    }
+    g_hash_table_destroy(years);
+
+    g_hash_table_iter_init(&iter, year_state);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        int year = GPOINTER_TO_INT(key);
+        if (ARCHIVE_LOADED == GPOINTER_TO_INT(value))
+            g_array_append_val(snap->archive_years, year);
+    }
+    return snap;
+}
+
+/* =========================================================== */
+
+/* Add the intervals to the texts of their years.  Every year with
+ * archived intervals was added by the snapshot; the intervals kept in
+ * the data file only go into the years that have a text. */
+static void put_intervals(GHashTable *texts, const char *guid, GArray *ivls, gboolean archived)
+{
+    guint k;
+
+    for (k = 0; ivls && (k < ivls->len); k++)
+    {
+        GttIntervalRec *rec = &g_array_index(ivls, GttIntervalRec, k);
+        int year = year_of(rec->start);
+        GString *text = g_hash_table_lookup(texts, GINT_TO_POINTER(year));
+
+        if (!text)
+        {
+            g_return_if_fail(!archived);
+            continue;
+        }
+        g_string_append_printf(
+            text, "%s\t%ld\t%ld\t%d\t%d\n", guid, (long) rec->start, (long) rec->stop,
+            rec->fuzz, rec->running ? 1 : 0
+        );
+    }
+}
+
+static void put_archived(GHashTable *texts, guint num, SnapProject *sps, gboolean with_kept)
+{
+    char buff[GUID_ENCODING_LENGTH + 1];
+    guint i, j;
+
+    for (i = 0; i < num; i++)
+    {
+        SnapProject *sp = &sps[i];
+        for (j = 0; j < sp->num_tasks; j++)
+        {
+            SnapTask *st = &sp->tasks[j];
+            if (!st->archived && !with_kept)
+                continue;
+
+            guid_to_string_buff(&st->guid, buff);
+            put_intervals(texts, buff, st->archived, TRUE);
+            if (with_kept)
+                put_intervals(texts, buff, st->intervals, FALSE);
+        }
+        put_archived(texts, sp->num_children, sp->children, with_kept);
+    }
+}
+
+/* The years of the intervals kept in the data file that also have
+ * an archive file to write */
+static void kept_years(GHashTable *years, GArray *archive_years, guint num, SnapProject *sps)
+{
+    guint i, j, k, n;
+
+    for (i = 0; i < num; i++)
+    {
+        SnapProject *sp = &sps[i];
+        for (j = 0; j < sp->num_tasks; j++)
+        {
+            GArray *ivls = sp->tasks[j].intervals;
+            for (k = 0; k < ivls->len; k++)
+            {
+                int year = year_of(g_array_index(ivls, GttIntervalRec, k).start);
+                for (n = 0; n < archive_years->len; n++)
+                {
+                    if (year == g_array_index(archive_years, int, n))
+                        g_hash_table_add(years, GINT_TO_POINTER(year));
+                }
+            }
+        }
+        kept_years(years, archive_years, sp->num_children, sp->children);
+    }
+}
+
+static GttErrCode write_year(const char *xml_filepath, int year, GString *text)
+{
+    char *path, *tmppath;
+    GttErrCode errcode = GTT_NO_ERR;
+
+    path = archive_path(xml_filepath, year);
+
+    /* No intervals left in this year */
+    if (0 == text->len)
+    {
+        if (g_unlink(path) && (ENOENT != errno))
+            errcode = GTT_CANT_WRITE_FILE;
+        g_free(path);
+        return errcode;
+    }
+
+    /* Same as the data file: write to a temp file, then rename */
+    tmppath = g_strconcat(path, ".tmp", NULL);
+    if (!g_file_set_contents(tmppath, text->str, text->len, NULL))
+        errcode = GTT_CANT_OPEN_FILE;
+    else if (g_rename(tmppath, path))
+        errcode = GTT_CANT_WRITE_FILE;
+    g_free(tmppath);
+    g_free(path);
+    return errcode;
+}
+
+static GttErrCode write_texts(const char *xml_filepath, GHashTable *texts)
+{
+    GttErrCode errcode = GTT_NO_ERR;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, texts);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        if (GTT_NO_ERR == errcode)
+            errcode = write_year(xml_filepath, GPOINTER_TO_INT(key), value);
+        g_string_free(value, TRUE);
+    }
+    g_hash_table_destroy(texts);
+    return errcode;
+}
+
+/* Until the data file is written, the years hold the intervals that
+ * go back into the data file as well, so that a failed write loses
+ * nothing; loading skips the ones that turn out to be in both. */
+GttErrCode gtt_archive_write(GttXmlSnapshot *snap, const char *xml_filepath)
+{
+    GHashTable *texts;
+    guint i;
+
+    if (0 == snap->archive_years->len)
+        return GTT_NO_ERR;
+
+    texts = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < snap->archive_years->len; i++)
+    {
+        int year = g_array_index(snap->archive_years, int, i);
+        g_hash_table_insert(texts, GINT_TO_POINTER(year), g_string_new(NULL));
+    }
+    put_archived(texts, snap->num_projects, snap->projects, TRUE);
+    return write_texts(xml_filepath, texts);
+}
+
+/* Once the data file has them, take those intervals out again */
+void gtt_archive_finish(GttXmlSnapshot *snap, const char *xml_filepath)
+{
+    GHashTable *years, *texts;
+    GList *node, *list;
+
+    if (0 == snap->archive_years->len)
+        return;
+
+    years = g_hash_table_new(g_direct_hash, g_direct_equal);
+    kept_years(years, snap->archive_years, snap->num_projects, snap->projects);
+    list = g_hash_table_get_keys(years);
+    g_hash_table_destroy(years);
+    if (!list)
+        return;
+
+    texts = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (node = list; node; node = node->next)
+    {
+        g_hash_table_insert(texts, node->data, g_string_new(NULL));
+    }
+    g_list_free(list);
+    put_archived(texts, snap->num_projects, snap->projects, FALSE);
+
+    /* If this fails, the extra intervals do no harm */
+    write_texts(xml_filepath, texts);
+}
+
+/* ===================== END OF FILE ============================ */
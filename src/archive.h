@@ -0,0 +1,77 @@
+/*   per-year archives of old intervals
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_ARCHIVE_H
+#define GTT_ARCHIVE_H
+
+#include <glib.h>
+#include <time.h>
+
+#include "err-throw.h"
+#include "xml-gtt.h"
+
+/* Intervals that started more than config_archive_years years before
+ * the current one are moved out of the data file, into archive files
+ * next to it, one per year.  An archive file is only read when a
+ * report asks for its year; until then, the data file only keeps the
+ * total of each task's archived intervals, so that the time spent
+ * ever still adds up.  Setting config_archive_years to zero keeps all
+ * of the intervals in the data file, and brings the archived ones
+ * back into it on the next save.
+ *
+ * The gtt_archive_open() routine finds the archive files that go with
+ *    the indicated data file.  It is to be called after the data file
+ *    is read, and forgets about any archives loaded before.
+ *
+ * The gtt_archive_get_cutoff() routine returns the time before which
+ *    intervals are archived, or zero if nothing is.
+ *
+ * The gtt_archive_load_range() routine loads the archived intervals
+ *    of the years that overlap the range from start up to, but not
+ *    including, stop, if they aren't loaded yet.  The
+ *    gtt_archive_load_all() routine loads all of them.  Both must be
+ *    called from the main thread.
+ *
+ * The gtt_archive_snapshot_new() routine takes a snapshot of the
+ *    projects for writing out, as gtt_xml_snapshot_new() does, with
+ *    the old intervals set aside for the archive files.
+ *
+ * The gtt_archive_write() routine writes out the archive files of the
+ *    snapshot.  It must be called before the data file is written, so
+ *    that no interval is ever in neither.  Like
+ *    gtt_xml_snapshot_write(), it may be called from any thread, and
+ *    returns an err-throw.h error.  The years it writes also keep the
+ *    intervals that are going back into the data file, if any, in case
+ *    the data file can't be written.
+ *
+ * The gtt_archive_finish() routine is to be called once the data file
+ *    has been written.  It takes the intervals that are in the data
+ *    file out of the archive files again.
+ */
+
+void gtt_archive_open(const char *xml_filepath);
+time_t gtt_archive_get_cutoff(void);
+
+void gtt_archive_load_range(time_t start, time_t stop);
+void gtt_archive_load_all(void);
+
+GttXmlSnapshot *gtt_archive_snapshot_new(GList *projects);
+GttErrCode gtt_archive_write(GttXmlSnapshot *, const char *xml_filepath);
+void gtt_archive_finish(GttXmlSnapshot *, const char *xml_filepath);
+
+#endif // GTT_ARCHIVE_H
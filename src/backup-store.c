@@ -0,0 +1,511 @@
+/*   deduplicated backups of the data file
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "backup-store.h"
+#include "file-compress.h"
+#include "prefs.h"
+
+/* The store for the data file gnotime is the directory
+ * gnotime.backups, which holds:
+ *
+ *   chunks/ab/abcd...   a chunk, gzipped, named by the sha256 of
+ *                       its uncompressed contents
+ *   versions/<id>       a version: the microseconds since the epoch
+ *                       at which it was saved
+ *
+ * A version is a text file, listing the sha256 and size of the whole
+ * data file, and then those of each of its chunks, in order:
+ *
+ *   gtt-backup 1
+ *   <sha256> <size>
+ *   <sha256> <size>
+ *   ...
+ *
+ * The chunks of a version are always written before the version is,
+ * so that a version never names a missing chunk.  Chunks that no
+ * version names any more are deleted when versions are dropped.
+ */
+
+#define STORE_MAGIC "gtt-backup 1"
+#define HASH_LEN 64 /* a sha256, in hex */
+
+/* A chunk ends where the gear hash of the bytes before it has its
+ * top 13 bits clear, which happens every 8k, on average.  The hash
+ * only depends on the last 64 bytes, so a cut point stays put when
+ * the data before it changes.  Chunks are kept between 2k and 64k. */
+#define CDC_MIN (2 * 1024)
+#define CDC_MAX (64 * 1024)
+#define CDC_WINDOW 64
+#define CDC_MASK (G_GUINT64_CONSTANT(0x1fff) << 51)
+
+/* =========================================================== */
+
+/* The table of random values for the gear hash.  This must never
+ * change, or none of the old chunks will match the new ones. */
+static guint64 gear[256];
+static GOnce gear_once = G_ONCE_INIT;
+
+static gpointer init_gear(gpointer unused)
+{
+    guint64 x = 0, z;
+    int i;
+
+    /* splitmix64 */
+    for (i = 0; i < 256; i++)
+    {
+        x += G_GUINT64_CONSTANT(0x9e3779b97f4a7c15);
+        z = x;
+        z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT(0x94d049bb133111eb);
+        gear[i] = z ^ (z >> 31);
+    }
+    return NULL;
+}
+
+/* Return the length of the chunk at the start of the data */
+static gsize next_cut(const guchar *data, gsize len)
+{
+    guint64 hash = 0;
+    gsize i;
+
+    if (CDC_MIN >= len)
+        return len;
+    if (CDC_MAX < len)
+        len = CDC_MAX;
+
+    for (i = CDC_MIN - CDC_WINDOW; i < len; i++)
+    {
+        hash = (hash << 1) + gear[data[i]];
+        if ((CDC_MIN <= i) && (0 == (hash & CDC_MASK)))
+            return i + 1;
+    }
+    return len;
+}
+
+/* =========================================================== */
+
+static char *store_path(const char *xml_filepath)
+{
+    return g_strconcat(xml_filepath, ".backups", NULL);
+}
+
+static char *chunk_path(const char *store, const char *hash)
+{
+    char prefix[3] = {hash[0], hash[1], 0};
+
+    return g_build_filename(store, "chunks", prefix, hash, NULL);
+}
+
+static char *version_path(const char *store, gint64 id)
+{
+    char name[32];
+
+    g_snprintf(name, sizeof(name), "%" G_GINT64_FORMAT, id);
+    return g_build_filename(store, "versions", name, NULL);
+}
+
+static gint compare_newest_first(gconstpointer a, gconstpointer b)
+{
+    gint64 ia = *(const gint64 *) a;
+    gint64 ib = *(const gint64 *) b;
+
+    return (ia < ib) - (ia > ib);
+}
+
+/* Return the ids of the versions in the store, newest first */
+static GArray *list_ids(const char *store)
+{
+    GArray *ids = g_array_new(FALSE, FALSE, sizeof(gint64));
+    const char *name;
+    char *path, *end;
+    gint64 id;
+    GDir *dir;
+
+    path = g_build_filename(store, "versions", NULL);
+    dir = g_dir_open(path, 0, NULL);
+    g_free(path);
+    if (!dir)
+        return ids;
+
+    while ((name = g_dir_read_name(dir)) != NULL)
+    {
+        id = g_ascii_strtoll(name, &end, 10);
+        if ((0 < id) && ('\0' == *end))
+            g_array_append_val(ids, id);
+    }
+    g_dir_close(dir);
+
+    g_array_sort(ids, compare_newest_first);
+    return ids;
+}
+
+/* Cut a "<sha256> <size>" line in two, leaving the hash in place */
+static gboolean parse_line(char *line, gsize *size)
+{
+    char *end;
+
+    if ((HASH_LEN != strspn(line, "0123456789abcdef")) || (' ' != line[HASH_LEN]))
+        return FALSE;
+
+    line[HASH_LEN] = '\0';
+    *size = g_ascii_strtoull(line + HASH_LEN + 1, &end, 10);
+    return (end != line + HASH_LEN + 1) && ('\0' == *end);
+}
+
+/* Return the lines of a version, from the line that describes the
+ * whole file on, or NULL if it can't be read.  The last line is
+ * empty. */
+static char **read_version(const char *store, gint64 id)
+{
+    char *path, *text;
+    char **lines;
+
+    path = version_path(store, id);
+    if (!g_file_get_contents(path, &text, NULL, NULL))
+        text = NULL;
+    g_free(path);
+    if (!text)
+        return NULL;
+
+    lines = g_strsplit(text, "\n", -1);
+    g_free(text);
+    if ((NULL == lines[0]) || strcmp(lines[0], STORE_MAGIC) || (NULL == lines[1]))
+    {
+        g_strfreev(lines);
+        return NULL;
+    }
+    return lines;
+}
+
+/* =========================================================== */
+
+static gboolean write_chunk(const char *store, const char *hash, const guchar *data, gsize len)
+{
+    GttCompressOut *cout;
+    char *path, *dir, *tmppath;
+    gboolean ok;
+    FILE *fh;
+
+    path = chunk_path(store, hash);
+    if (g_file_test(path, G_FILE_TEST_EXISTS))
+    {
+        g_free(path);
+        return TRUE;
+    }
+
+    dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    /* Same as the data file: write to a temp file, then rename */
+    tmppath = g_strconcat(path, ".tmp", NULL);
+    fh = g_fopen(tmppath, "wb");
+    ok = (NULL != fh);
+    if (fh)
+    {
+        cout = gtt_file_compress_out_new(fh, GTT_COMPRESS_GZIP);
+        ok = cout && gtt_file_compress_out_write(cout, (const char *) data, len);
+        ok = (!cout || gtt_file_compress_out_finish(cout)) && ok;
+        ok = (0 == fclose(fh)) && ok;
+    }
+    ok = ok && (0 == g_rename(tmppath, path));
+    if (!ok)
+        g_unlink(tmppath);
+
+    g_free(tmppath);
+    g_free(path);
+    return ok;
+}
+
+/* Delete the chunks that none of the versions in the store name */
+static void sweep_chunks(const char *store)
+{
+    GHashTable *used;
+    GArray *ids;
+    GDir *dir, *subdir;
+    const char *name, *chunk;
+    char **lines;
+    char *path, *subpath, *chunkpath;
+    gsize size;
+    guint i, j;
+
+    used = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    ids = list_ids(store);
+    for (i = 0; i < ids->len; i++)
+    {
+        lines = read_version(store, g_array_index(ids, gint64, i));
+
+        /* Rather keep too much than lose a chunk that's still used */
+        if (!lines)
+            goto done;
+
+        for (j = 2; lines[j]; j++)
+        {
+            if (parse_line(lines[j], &size))
+                g_hash_table_add(used, g_strdup(lines[j]));
+        }
+        g_strfreev(lines);
+    }
+
+    path = g_build_filename(store, "chunks", NULL);
+    dir = g_dir_open(path, 0, NULL);
+    while (dir && (name = g_dir_read_name(dir)) != NULL)
+    {
+        subpath = g_build_filename(path, name, NULL);
+        subdir = g_dir_open(subpath, 0, NULL);
+        while (subdir && (chunk = g_dir_read_name(subdir)) != NULL)
+        {
+            /* This also catches the temp files of a failed write */
+            if (g_hash_table_contains(used, chunk))
+                continue;
+            chunkpath = g_build_filename(subpath, chunk, NULL);
+            g_unlink(chunkpath);
+            g_free(chunkpath);
+        }
+        if (subdir)
+            g_dir_close(subdir);
+        g_free(subpath);
+    }
+    if (dir)
+        g_dir_close(dir);
+    g_free(path);
+
+done:
+    g_array_free(ids, TRUE);
+    g_hash_table_destroy(used);
+}
+
+/* Drop the versions that are no longer to be kept */
+static void prune(const char *store, GArray *ids)
+{
+    gboolean dropped = FALSE;
+    time_t oldest, t;
+    struct tm tm;
+    int day, last_day = -1;
+    gboolean keep;
+    char *path;
+    gint64 id;
+    guint i;
+
+    oldest = time(0) - (time_t) config_backup_days * 24 * 3600;
+    for (i = 0; i < ids->len; i++)
+    {
+        id = g_array_index(ids, gint64, i);
+        t = id / G_USEC_PER_SEC;
+        localtime_r(&t, &tm);
+        day = tm.tm_year * 1000 + tm.tm_yday;
+
+        /* Going from newest to oldest, the first version seen of
+         * each day is the last one saved on it */
+        keep = (i < (guint) config_backup_versions);
+        keep |= (0 < config_backup_days) && (oldest <= t) && (day != last_day);
+        if (keep)
+        {
+            last_day = day;
+            continue;
+        }
+
+        path = version_path(store, id);
+        g_unlink(path);
+        g_free(path);
+        dropped = TRUE;
+    }
+
+    if (dropped)
+        sweep_chunks(store);
+}
+
+GttErrCode gtt_backup_store_add(const char *xml_filepath)
+{
+    GttErrCode errcode = GTT_NO_ERR;
+    GBytes *bytes;
+    const guchar *data;
+    GString *text;
+    GArray *ids;
+    char **lines;
+    char *store, *path, *hash;
+    gsize len, off, n, size;
+    gint64 id, newest;
+
+    g_once(&gear_once, init_gear, NULL);
+
+    bytes = gtt_file_compress_load(xml_filepath);
+    if (!bytes)
+        return GTT_CANT_OPEN_FILE;
+    data = g_bytes_get_data(bytes, &len);
+
+    store = store_path(xml_filepath);
+    ids = list_ids(store);
+    newest = ids->len ? g_array_index(ids, gint64, 0) : 0;
+
+    /* Saving the same data twice makes no new version */
+    hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, data, len);
+    lines = newest ? read_version(store, newest) : NULL;
+    if (lines && parse_line(lines[1], &size) && (len == size) && !strcmp(lines[1], hash))
+    {
+        g_strfreev(lines);
+        goto done;
+    }
+    g_strfreev(lines);
+
+    text = g_string_new(STORE_MAGIC "\n");
+    g_string_append_printf(text, "%s %" G_GSIZE_FORMAT "\n", hash, len);
+    for (off = 0; off < len; off += n)
+    {
+        char *chunk_hash;
+
+        n = next_cut(data + off, len - off);
+        chunk_hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, data + off, n);
+        if (!write_chunk(store, chunk_hash, data + off, n))
+            errcode = GTT_CANT_WRITE_FILE;
+        g_string_append_printf(text, "%s %" G_GSIZE_FORMAT "\n", chunk_hash, n);
+        g_free(chunk_hash);
+        if (GTT_NO_ERR != errcode)
+            break;
+    }
+
+    /* Two saves in the same microsecond still get two versions */
+    id = MAX(g_get_real_time(), newest + 1);
+    if (GTT_NO_ERR == errcode)
+    {
+        path = g_build_filename(store, "versions", NULL);
+        g_mkdir_with_parents(path, 0700);
+        g_free(path);
+
+        path = version_path(store, id);
+        if (!g_file_set_contents(path, text->str, text->len, NULL))
+            errcode = GTT_CANT_WRITE_FILE;
+        g_free(path);
+    }
+    g_string_free(text, TRUE);
+
+    if (GTT_NO_ERR == errcode)
+    {
+        g_array_prepend_val(ids, id);
+        prune(store, ids);
+    }
+
+done:
+    g_free(hash);
+    g_array_free(ids, TRUE);
+    g_free(store);
+    g_bytes_unref(bytes);
+    return errcode;
+}
+
+/* =========================================================== */
+
+GArray *gtt_backup_store_list(const char *xml_filepath)
+{
+    GArray *versions;
+    GttBackupVersion v;
+    GArray *ids;
+    char **lines;
+    char *store;
+    guint i;
+
+    versions = g_array_new(FALSE, FALSE, sizeof(GttBackupVersion));
+    store = store_path(xml_filepath);
+    ids = list_ids(store);
+    for (i = 0; i < ids->len; i++)
+    {
+        v.id = g_array_index(ids, gint64, i);
+        v.time = v.id / G_USEC_PER_SEC;
+        lines = read_version(store, v.id);
+        if (lines && parse_line(lines[1], &v.size))
+            g_array_append_val(versions, v);
+        g_strfreev(lines);
+    }
+    g_array_free(ids, TRUE);
+    g_free(store);
+    return versions;
+}
+
+gboolean gtt_backup_store_restore(const char *xml_filepath, gint64 id)
+{
+    GChecksum *checksum;
+    GBytes *bytes;
+    const void *data;
+    char **lines;
+    char *store, *path, *tmppath;
+    gsize total = 0, size, want, n;
+    gboolean ok;
+    FILE *fh;
+    guint i;
+
+    store = store_path(xml_filepath);
+    lines = read_version(store, id);
+    if (!lines || !parse_line(lines[1], &size))
+    {
+        g_strfreev(lines);
+        g_free(store);
+        return FALSE;
+    }
+
+    tmppath = g_strconcat(xml_filepath, ".tmp", NULL);
+    fh = g_fopen(tmppath, "wb");
+    ok = (NULL != fh);
+    checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    for (i = 2; ok && lines[i]; i++)
+    {
+        if ('\0' == lines[i][0])
+            continue;
+        ok = parse_line(lines[i], &want);
+        if (!ok)
+            break;
+
+        path = chunk_path(store, lines[i]);
+        bytes = gtt_file_compress_load(path);
+        g_free(path);
+        if (!bytes)
+        {
+            ok = FALSE;
+            break;
+        }
+
+        data = g_bytes_get_data(bytes, &n);
+        ok = (n == want) && (1 == fwrite(data, n, 1, fh));
+        g_checksum_update(checksum, data, n);
+        total += n;
+        g_bytes_unref(bytes);
+    }
+
+    /* A damaged chunk shows up here */
+    ok = ok && (total == size) && !strcmp(g_checksum_get_string(checksum), lines[1]);
+    if (fh)
+        ok = (0 == fclose(fh)) && ok;
+    ok = ok && (0 == g_rename(tmppath, xml_filepath));
+    if (!ok)
+        g_unlink(tmppath);
+
+    g_checksum_free(checksum);
+    g_free(tmppath);
+    g_strfreev(lines);
+    g_free(store);
+    return ok;
+}
+
+/* =========================== END OF FILE ========================= */
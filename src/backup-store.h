@@ -0,0 +1,67 @@
+/*   deduplicated backups of the data file
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_BACKUP_STORE_H
+#define GTT_BACKUP_STORE_H
+
+#include <glib.h>
+#include <time.h>
+
+#include "err-throw.h"
+
+/* Each time the data file is saved, a version of it is added to the
+ * backup store, a directory next to the data file.  The uncompressed
+ * contents of the file are cut into chunks at points picked by the
+ * contents themselves, so that an edit only changes the chunks around
+ * it; each chunk is stored once, compressed, under its hash, and a
+ * version is just the list of its chunks.  A new version thus costs
+ * little more than the part of the file that changed.
+ *
+ * The newest config_backup_versions versions are kept, and beyond
+ * those, the last version of each day, for config_backup_days days.
+ * Setting config_backup_versions to zero turns the store off; full
+ * copies of the data file are then rotated instead, as gtt always
+ * did.  The archive files are not part of the backups.
+ *
+ * The gtt_backup_store_add() routine adds the indicated data file, as
+ *    it is now, to the store, and then drops the versions that are no
+ *    longer to be kept.  It may be called from any thread, but not
+ *    twice at once.
+ *
+ * The gtt_backup_store_list() routine returns the versions of the
+ *    indicated data file in the store, as an array of GttBackupVersion,
+ *    newest first.  The array is empty if there are none.
+ *
+ * The gtt_backup_store_restore() routine overwrites the data file
+ *    with the indicated version.  The restored file is not compressed.
+ *    It returns FALSE if the version could not be put back together;
+ *    the data file is then left alone.
+ */
+
+typedef struct
+{
+    gint64 id;   /* names the version in the store */
+    time_t time; /* when it was saved */
+    gsize size;  /* of the uncompressed data */
+} GttBackupVersion;
+
+GttErrCode gtt_backup_store_add(const char *xml_filepath);
+GArray *gtt_backup_store_list(const char *xml_filepath);
+gboolean gtt_backup_store_restore(const char *xml_filepath, gint64 id);
+
+#endif // GTT_BACKUP_STORE_H
@@ -0,0 +1,660 @@
+/*   binary snapshot of the GnoTime data file
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <qof.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bin-snapshot.h"
+#include "cur-proj.h"
+#include "proj.h"
+#include "proj_p.h"
+#include "xml-gtt-p.h"
+
+/* The file is laid out as follows, with every section a whole
+ * number of 8-byte words, so that the records can be used in place:
+ *
+ *   SnapHeader
+ *   SnapFileProject[num_projects]   in depth-first order: a project,
+ *                                   then its sub-projects
+ *   SnapFileTask[num_tasks]         in the order of their projects
+ *   SnapFileInterval[num_intervals] in the order of their tasks
+ *   GUID[num_guids]
+ *   char[strings_len]               NUL-terminated strings, padded
+ *   char[texts_len]                 NUL-terminated long texts, padded
+ *
+ * Strings are referred to by their offset in the string table; the
+ * string at offset zero is the empty one.  GUIDs are referred to by
+ * their index in the GUID table.
+ *
+ * Descriptions and notes of LONG_TEXT bytes or more go into the long
+ * text section instead, with their length next to their offset, and
+ * are left there when the snapshot is loaded: the projects and tasks
+ * point into the mapped file, so that the pages of a text are only
+ * read in if someone looks at it.
+ */
+
+#define SNAP_MAGIC "GTTSNAP"
+#define SNAP_VERSION 4
+#define LONG_TEXT 256
+#define SNAP_BYTE_ORDER 0x01020304
+
+typedef struct snap_header_s
+{
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 header_size; /* the record sizes, as a check on the layout */
+    guint32 project_size;
+    guint32 task_size;
+    guint32 interval_size;
+    gint64 xml_mtime; /* the xml file this is a copy of */
+    gint64 xml_size;
+    guint32 num_top; /* number of top-level projects */
+    guint32 num_projects;
+    guint32 num_tasks;
+    guint32 num_intervals;
+    guint32 num_guids;
+    guint32 strings_len;
+    guint32 texts_len;
+    guint64 file_size;
+} SnapHeader;
+
+typedef struct snap_file_project_s
+{
+    gdouble billrate;
+    gdouble overtime_rate;
+    gdouble overover_rate;
+    gdouble flat_fee;
+    gint64 estimated_start;
+    gint64 estimated_end;
+    gint64 due_date;
+    guint32 guid;
+    guint32 title;
+    guint32 desc;
+    guint32 notes;
+    guint32 desc_len; /* if not zero, desc is in the long texts */
+    guint32 notes_len;
+    guint32 custid;
+    gint32 id;
+    gint32 min_interval;
+    gint32 auto_merge_interval;
+    gint32 auto_merge_gap;
+    gint32 sizing;
+    gint32 percent_complete;
+    gint32 urgency;
+    gint32 importance;
+    gint32 status;
+    guint32 num_tasks;
+    guint32 num_children;
+} SnapFileProject;
+
+typedef struct snap_file_task_s
+{
+    guint32 guid;
+    guint32 memo;
+    guint32 notes;
+    guint32 notes_len; /* if not zero, notes are in the long texts */
+    gint32 bill_unit;
+    gint32 billable;
+    gint32 billrate;
+    gint32 billstatus;
+    guint32 num_intervals;
+    gint64 archived_secs;
+    gint64 archived_first; /* zero if not known */
+    gint64 archived_last;
+} SnapFileTask;
+
+typedef struct snap_file_interval_s
+{
+    gint64 start;
+    gint64 stop;
+    gint32 fuzz;
+    gint32 running;
+} SnapFileInterval;
+
+#define ALIGN8(N) (((N) + 7) & ~((gsize) 7))
+
+static char *snapshot_path(const char *xml_filepath)
+{
+    return g_strconcat(xml_filepath, ".snapshot", NULL);
+}
+
+/* =========================================================== */
+
+typedef struct snap_out_s
+{
+    GArray *projects;
+    GArray *tasks;
+    GArray *intervals;
+    GArray *guids;
+    GString *strings;
+    GHashTable *string_offsets; /* string to offset+1 in strings */
+    GString *texts;
+} SnapOut;
+
+static guint32 put_guid(SnapOut *out, const GUID *guid)
+{
+    g_array_append_vals(out->guids, guid, 1);
+    return out->guids->len - 1;
+}
+
+/* Memos, in particular, tend to repeat; store each one once */
+static guint32 put_string(SnapOut *out, const char *str)
+{
+    gpointer off;
+
+    if (!str || !str[0])
+        return 0;
+
+    off = g_hash_table_lookup(out->string_offsets, str);
+    if (off)
+        return GPOINTER_TO_UINT(off) - 1;
+
+    off = GUINT_TO_POINTER(out->strings->len + 1);
+    g_hash_table_insert(out->string_offsets, (gpointer) str, off);
+    g_string_append_len(out->strings, str, strlen(str) + 1);
+    return GPOINTER_TO_UINT(off) - 1;
+}
+
+/* Long texts are rarely repeated, and are not looked up */
+static guint32 put_text(SnapOut *out, const char *str, guint32 *len)
+{
+    gsize n = str ? strlen(str) : 0;
+    guint32 off;
+
+    if ((LONG_TEXT > n) || (G_MAXUINT32 <= n))
+    {
+        *len = 0;
+        return put_string(out, str);
+    }
+
+    off = out->texts->len;
+    g_string_append_len(out->texts, str, n + 1);
+    *len = n;
+    return off;
+}
+
+static void put_task(SnapOut *out, const SnapTask *st)
+{
+    SnapFileTask ft;
+    guint i;
+
+    memset(&ft, 0, sizeof(ft));
+    ft.guid = put_guid(out, &st->guid);
+    ft.memo = put_string(out, st->memo);
+    ft.notes = put_text(out, st->notes, &ft.notes_len);
+    ft.bill_unit = st->bill_unit;
+    ft.billable = st->billable;
+    ft.billrate = st->billrate;
+    ft.billstatus = st->billstatus;
+    ft.num_intervals = st->intervals->len;
+    ft.archived_secs = st->archived_secs;
+    ft.archived_first = st->archived_first;
+    ft.archived_last = st->archived_last;
+    g_array_append_val(out->tasks, ft);
+
+    for (i = 0; i < st->intervals->len; i++)
+    {
+        GttIntervalRec *rec = &g_array_index(st->intervals, GttIntervalRec, i);
+        SnapFileInterval fi;
+
+        memset(&fi, 0, sizeof(fi));
+        fi.start = rec->start;
+        fi.stop = rec->stop;
+        fi.fuzz = rec->fuzz;
+        fi.running = rec->running;
+        g_array_append_val(out->intervals, fi);
+    }
+}
+
+static void put_project(SnapOut *out, const SnapProject *sp)
+{
+    SnapFileProject fp;
+    guint i;
+
+    memset(&fp, 0, sizeof(fp));
+    fp.guid = put_guid(out, &sp->guid);
+    fp.title = put_string(out, sp->title);
+    fp.desc = put_text(out, sp->desc, &fp.desc_len);
+    fp.notes = put_text(out, sp->notes, &fp.notes_len);
+    fp.custid = put_string(out, sp->custid);
+    fp.id = sp->id;
+
+    fp.billrate = sp->billrate;
+    fp.overtime_rate = sp->overtime_rate;
+    fp.overover_rate = sp->overover_rate;
+    fp.flat_fee = sp->flat_fee;
+
+    fp.min_interval = sp->min_interval;
+    fp.auto_merge_interval = sp->auto_merge_interval;
+    fp.auto_merge_gap = sp->auto_merge_gap;
+
+    fp.estimated_start = sp->estimated_start;
+    fp.estimated_end = sp->estimated_end;
+    fp.due_date = sp->due_date;
+    fp.sizing = sp->sizing;
+    fp.percent_complete = sp->percent_complete;
+    fp.urgency = sp->urgency;
+    fp.importance = sp->importance;
+    fp.status = sp->status;
+
+    fp.num_tasks = sp->num_tasks;
+    fp.num_children = sp->num_children;
+    g_array_append_val(out->projects, fp);
+
+    for (i = 0; i < sp->num_tasks; i++)
+    {
+        put_task(out, &sp->tasks[i]);
+    }
+    for (i = 0; i < sp->num_children; i++)
+    {
+        put_project(out, &sp->children[i]);
+    }
+}
+
+static gboolean write_section(FILE *fh, const void *data, gsize len)
+{
+    return (0 == len) || (1 == fwrite(data, len, 1, fh));
+}
+
+gboolean gtt_bin_snapshot_write(GttXmlSnapshot *snap, const char *xml_filepath)
+{
+    SnapHeader hdr;
+    SnapOut out;
+    GStatBuf xml_stat;
+    char *path, *tmppath;
+    gboolean ok;
+    FILE *fh;
+    guint i;
+
+    /* The snapshot is only good for the xml file as it is now */
+    if (0 != g_stat(xml_filepath, &xml_stat))
+        return FALSE;
+
+    out.projects = g_array_new(FALSE, FALSE, sizeof(SnapFileProject));
+    out.tasks = g_array_new(FALSE, FALSE, sizeof(SnapFileTask));
+    out.intervals = g_array_new(FALSE, FALSE, sizeof(SnapFileInterval));
+    out.guids = g_array_new(FALSE, FALSE, sizeof(GUID));
+    out.strings = g_string_sized_new(4096);
+    out.string_offsets = g_hash_table_new(g_str_hash, g_str_equal);
+    out.texts = g_string_new(NULL);
+
+    g_string_append_c(out.strings, 0);
+    for (i = 0; i < snap->num_projects; i++)
+    {
+        put_project(&out, &snap->projects[i]);
+    }
+    while (out.strings->len != ALIGN8(out.strings->len))
+        g_string_append_c(out.strings, 0);
+    while (out.texts->len != ALIGN8(out.texts->len))
+        g_string_append_c(out.texts, 0);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+    hdr.version = SNAP_VERSION;
+    hdr.byte_order = SNAP_BYTE_ORDER;
+    hdr.header_size = sizeof(SnapHeader);
+    hdr.project_size = sizeof(SnapFileProject);
+    hdr.task_size = sizeof(SnapFileTask);
+    hdr.interval_size = sizeof(SnapFileInterval);
+    hdr.xml_mtime = xml_stat.st_mtime;
+    hdr.xml_size = xml_stat.st_size;
+    hdr.num_top = snap->num_projects;
+    hdr.num_projects = out.projects->len;
+    hdr.num_tasks = out.tasks->len;
+    hdr.num_intervals = out.intervals->len;
+    hdr.num_guids = out.guids->len;
+    hdr.strings_len = out.strings->len;
+    hdr.texts_len = out.texts->len;
+    hdr.file_size = sizeof(SnapHeader) + (guint64) hdr.num_projects * sizeof(SnapFileProject)
+                    + (guint64) hdr.num_tasks * sizeof(SnapFileTask)
+                    + (guint64) hdr.num_intervals * sizeof(SnapFileInterval)
+                    + (guint64) hdr.num_guids * sizeof(GUID) + hdr.strings_len
+                    + hdr.texts_len;
+
+    /* Same as the xml file: write to a temp file, then rename */
+    path = snapshot_path(xml_filepath);
+    tmppath = g_strconcat(path, ".tmp", NULL);
+    fh = g_fopen(tmppath, "wb");
+    ok = (NULL != fh);
+    if (fh)
+    {
+        ok = write_section(fh, &hdr, sizeof(hdr))
+             && write_section(
+                 fh, out.projects->data, out.projects->len * sizeof(SnapFileProject)
+             )
+             && write_section(fh, out.tasks->data, out.tasks->len * sizeof(SnapFileTask))
+             && write_section(
+                 fh, out.intervals->data, out.intervals->len * sizeof(SnapFileInterval)
+             )
+             && write_section(fh, out.guids->data, out.guids->len * sizeof(GUID))
+             && write_section(fh, out.strings->str, out.strings->len)
+             && write_section(fh, out.texts->str, out.texts->len);
+        ok = (0 == fclose(fh)) && ok;
+    }
+    ok = ok && (0 == g_rename(tmppath, path));
+    if (!ok)
+        g_unlink(tmppath);
+
+    g_free(tmppath);
+    g_free(path);
+    g_hash_table_destroy(out.string_offsets);
+    g_string_free(out.strings, TRUE);
+    g_string_free(out.texts, TRUE);
+    g_array_free(out.guids, TRUE);
+    g_array_free(out.intervals, TRUE);
+    g_array_free(out.tasks, TRUE);
+    g_array_free(out.projects, TRUE);
+    return ok;
+}
+
+/* =========================================================== */
+
+typedef struct snap_in_s
+{
+    const SnapHeader *hdr;
+    const SnapFileProject *projects;
+    const SnapFileTask *tasks;
+    const SnapFileInterval *intervals;
+    const GUID *guids;
+    const char *strings;
+    const char *texts;
+    GBytes *source; /* the mapped file, for the long texts */
+
+    guint32 next_project; /* how far the load has got */
+    guint32 next_task;
+    guint32 next_interval;
+    gboolean failed;
+} SnapIn;
+
+static const GUID *get_guid(SnapIn *in, guint32 idx)
+{
+    if (idx >= in->hdr->num_guids)
+    {
+        in->failed = TRUE;
+        return NULL;
+    }
+    return &in->guids[idx];
+}
+
+static const char *get_string(SnapIn *in, guint32 off)
+{
+    if (off >= in->hdr->strings_len)
+    {
+        in->failed = TRUE;
+        return "";
+    }
+    return in->strings + off;
+}
+
+/* The text itself is not looked at here, so as not to read it in;
+ * the check that the section ends in a NUL keeps it in bounds. */
+static const char *get_text(SnapIn *in, guint32 off, guint32 len)
+{
+    if ((off >= in->hdr->texts_len) || (len >= in->hdr->texts_len - off))
+    {
+        in->failed = TRUE;
+        return NULL;
+    }
+    return in->texts + off;
+}
+
+/* As with the xml reader, empty strings are left at their defaults */
+#define SET_STR(FN, SELF, OFF)                   \
+    {                                            \
+        const char *str = get_string(in, (OFF)); \
+        if (str[0])                              \
+            FN(SELF, str);                       \
+    }
+
+#define SET_TEXT(FN, FN_MAPPED, SELF, OFF, LEN)            \
+    {                                                      \
+        if (LEN)                                           \
+        {                                                  \
+            const char *text = get_text(in, (OFF), (LEN)); \
+            if (text)                                      \
+                FN_MAPPED(SELF, in->source, text);         \
+        }                                                  \
+        else                                               \
+            SET_STR(FN, SELF, OFF);                        \
+    }
+
+static GttTask *get_task(SnapIn *in)
+{
+    const SnapFileTask *ft;
+    const GUID *guid;
+    GttIntervalRec rec;
+    GttTask *tsk;
+    guint32 i;
+
+    ft = &in->tasks[in->next_task++];
+    if (ft->num_intervals > in->hdr->num_intervals - in->next_interval)
+    {
+        in->failed = TRUE;
+        return NULL;
+    }
+
+    tsk = gtt_task_new();
+    guid = get_guid(in, ft->guid);
+    if (guid)
+        gtt_task_set_guid(tsk, guid);
+    SET_STR(gtt_task_set_memo, tsk, ft->memo);
+    SET_TEXT(gtt_task_set_notes, gtt_task_set_notes_mapped, tsk, ft->notes, ft->notes_len);
+    gtt_task_set_bill_unit(tsk, ft->bill_unit);
+    gtt_task_set_billable(tsk, ft->billable);
+    gtt_task_set_billrate(tsk, ft->billrate);
+    gtt_task_set_billstatus(tsk, ft->billstatus);
+    gtt_task_set_archived_secs(tsk, ft->archived_secs);
+    if (ft->archived_last)
+        gtt_task_set_archived_span(tsk, ft->archived_first, ft->archived_last);
+
+    memset(&rec, 0, sizeof(rec));
+    for (i = 0; i < ft->num_intervals; i++)
+    {
+        const SnapFileInterval *fi = &in->intervals[in->next_interval++];
+        rec.start = fi->start;
+        rec.stop = fi->stop;
+        rec.fuzz = fi->fuzz;
+        rec.running = (0 != fi->running);
+        gtt_task_append_interval_rec(tsk, &rec);
+    }
+    return tsk;
+}
+
+static GttProject *get_project(SnapIn *in)
+{
+    const SnapFileProject *fp;
+    const GUID *guid;
+    GttProject *prj;
+    guint32 i;
+
+    if (in->next_project >= in->hdr->num_projects)
+    {
+        in->failed = TRUE;
+        return NULL;
+    }
+    fp = &in->projects[in->next_project++];
+    if (fp->num_tasks > in->hdr->num_tasks - in->next_task)
+    {
+        in->failed = TRUE;
+        return NULL;
+    }
+
+    prj = gtt_project_new();
+    gtt_project_freeze(prj);
+
+    guid = get_guid(in, fp->guid);
+    if (guid)
+        gtt_project_set_guid(prj, guid);
+    gtt_project_set_title(prj, get_string(in, fp->title));
+    SET_TEXT(gtt_project_set_desc, gtt_project_set_desc_mapped, prj, fp->desc, fp->desc_len);
+    SET_TEXT(
+        gtt_project_set_notes, gtt_project_set_notes_mapped, prj, fp->notes, fp->notes_len
+    );
+    SET_STR(gtt_project_set_custid, prj, fp->custid);
+    gtt_project_set_id(prj, fp->id);
+
+    gtt_project_set_billrate(prj, fp->billrate);
+    gtt_project_set_overtime_rate(prj, fp->overtime_rate);
+    gtt_project_set_overover_rate(prj, fp->overover_rate);
+    gtt_project_set_flat_fee(prj, fp->flat_fee);
+
+    gtt_project_set_min_interval(prj, fp->min_interval);
+    gtt_project_set_auto_merge_interval(prj, fp->auto_merge_interval);
+    gtt_project_set_auto_merge_gap(prj, fp->auto_merge_gap);
+
+    gtt_project_set_estimated_start(prj, fp->estimated_start);
+    gtt_project_set_estimated_end(prj, fp->estimated_end);
+    gtt_project_set_due_date(prj, fp->due_date);
+    gtt_project_set_sizing(prj, fp->sizing);
+    gtt_project_set_percent_complete(prj, fp->percent_complete);
+    gtt_project_set_urgency(prj, fp->urgency);
+    gtt_project_set_importance(prj, fp->importance);
+    gtt_project_set_status(prj, fp->status);
+
+    for (i = 0; i < fp->num_tasks && !in->failed; i++)
+    {
+        GttTask *tsk = get_task(in);
+        if (tsk)
+            gtt_project_append_task(prj, tsk);
+    }
+    for (i = 0; i < fp->num_children && !in->failed; i++)
+    {
+        GttProject *child = get_project(in);
+        if (child)
+            gtt_project_append_project(prj, child);
+    }
+
+    gtt_project_thaw(prj);
+    return prj;
+}
+
+/* Check that the file is one of ours, and that the sections
+ * it claims to have are all there. */
+static gboolean snapshot_check(
+    SnapIn *in, const char *data, gsize len, const GStatBuf *xml_stat
+)
+{
+    const SnapHeader *hdr = (const SnapHeader *) data;
+    guint64 off;
+
+    if (len < sizeof(SnapHeader))
+        return FALSE;
+    if (memcmp(hdr->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) || (SNAP_VERSION != hdr->version)
+        || (SNAP_BYTE_ORDER != hdr->byte_order) || (sizeof(SnapHeader) != hdr->header_size)
+        || (sizeof(SnapFileProject) != hdr->project_size)
+        || (sizeof(SnapFileTask) != hdr->task_size)
+        || (sizeof(SnapFileInterval) != hdr->interval_size))
+        return FALSE;
+
+    /* Stale: the xml file was written, or replaced, since */
+    if ((hdr->xml_mtime != (gint64) xml_stat->st_mtime)
+        || (hdr->xml_size != (gint64) xml_stat->st_size))
+        return FALSE;
+
+    off = sizeof(SnapHeader);
+    in->projects = (const SnapFileProject *) (data + off);
+    off += (guint64) hdr->num_projects * sizeof(SnapFileProject);
+    in->tasks = (const SnapFileTask *) (data + off);
+    off += (guint64) hdr->num_tasks * sizeof(SnapFileTask);
+    in->intervals = (const SnapFileInterval *) (data + off);
+    off += (guint64) hdr->num_intervals * sizeof(SnapFileInterval);
+    in->guids = (const GUID *) (data + off);
+    off += (guint64) hdr->num_guids * sizeof(GUID);
+    in->strings = data + off;
+    off += hdr->strings_len;
+    in->texts = data + off;
+    off += hdr->texts_len;
+
+    if ((off != hdr->file_size) || (off != len))
+        return FALSE;
+    if ((0 == hdr->strings_len) || (0 != in->strings[hdr->strings_len - 1]))
+        return FALSE;
+    if ((0 != hdr->texts_len) && (0 != in->texts[hdr->texts_len - 1]))
+        return FALSE;
+
+    in->hdr = hdr;
+    return TRUE;
+}
+
+gboolean gtt_bin_snapshot_read_file(const char *xml_filepath)
+{
+    GList *node, *prjs = NULL;
+    GMappedFile *mfile;
+    GStatBuf xml_stat;
+    SnapIn in;
+    char *path;
+    guint32 i;
+
+    if (0 != g_stat(xml_filepath, &xml_stat))
+        return FALSE;
+
+    path = snapshot_path(xml_filepath);
+    mfile = g_mapped_file_new(path, FALSE, NULL);
+    g_free(path);
+    if (!mfile)
+        return FALSE;
+
+    memset(&in, 0, sizeof(in));
+    if (!snapshot_check(
+            &in, g_mapped_file_get_contents(mfile), g_mapped_file_get_length(mfile), &xml_stat
+        ))
+    {
+        g_mapped_file_unref(mfile);
+        return FALSE;
+    }
+
+    /* The projects hold on to the mapping, for their long texts */
+    in.source = g_mapped_file_get_bytes(mfile);
+
+    /* The commit scrubs the new projects and computes their totals */
+    gtt_project_bulk_load_begin();
+    for (i = 0; i < in.hdr->num_top && !in.failed; i++)
+    {
+        GttProject *prj = get_project(&in);
+        if (prj)
+            prjs = g_list_prepend(prjs, prj);
+    }
+    prjs = g_list_reverse(prjs);
+
+    /* Anything left over means the counts don't add up */
+    if ((in.next_project != in.hdr->num_projects) || (in.next_task != in.hdr->num_tasks)
+        || (in.next_interval != in.hdr->num_intervals))
+        in.failed = TRUE;
+
+    for (node = prjs; node; node = node->next)
+    {
+        if (in.failed)
+            gtt_project_destroy(node->data);
+        else
+            gtt_project_list_append(master_list, node->data);
+    }
+    g_list_free(prjs);
+    gtt_project_bulk_load_commit();
+
+    g_bytes_unref(in.source);
+    g_mapped_file_unref(mfile);
+    return !in.failed;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,57 @@
+/*   binary snapshot of the GnoTime data file
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_BIN_SNAPSHOT_H
+#define GTT_BIN_SNAPSHOT_H
+
+#include <glib.h>
+
+#include "xml-gtt.h"
+
+/* The binary snapshot is a copy of the xml data file, kept next to
+ * it, in a form that can be mapped into memory and loaded without any
+ * text parsing: fixed-width records for the projects, tasks and
+ * intervals, a table of GUIDs and a table of strings.  It is only a
+ * cache; the xml file remains the real thing.  The snapshot records
+ * the modification time and size of the xml file it was written
+ * with, and is ignored if the xml file has changed since.  It is
+ * written in the byte order and layout of the machine, and is ignored
+ * by any other.
+ *
+ * Long descriptions and notes are not read in when the snapshot is
+ * loaded: the projects and tasks point into the mapped file instead,
+ * and hold on to it, so that only the texts that are looked at ever
+ * take up memory.  The file is always replaced by a rename, never
+ * rewritten in place, so that the old mapping stays good.
+ *
+ * The gtt_bin_snapshot_write() routine writes the snapshot out, next
+ *    to the indicated xml file, which must have just been written from
+ *    the same snapshot.  Like gtt_xml_snapshot_write(), it may be
+ *    called from any thread.  It returns FALSE if the snapshot could
+ *    not be written; the xml file is still good.
+ *
+ * The gtt_bin_snapshot_read_file() routine loads the binary snapshot
+ *    for the indicated xml file into the global list of projects, if
+ *    there is one and it is up to date.  It returns FALSE, and loads
+ *    nothing, otherwise.
+ */
+
+gboolean gtt_bin_snapshot_write(GttXmlSnapshot *, const char *xml_filepath);
+gboolean gtt_bin_snapshot_read_file(const char *xml_filepath);
+
+#endif // GTT_BIN_SNAPSHOT_H
@@ -0,0 +1,307 @@
+/*   day, week, month and year boundaries for GnoTime
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calendar.h"
+#include "prefs.h"
+
+/* One local calendar day.  The start is the local midnight,
+ * without the day start offset; the offset is added on lookup,
+ * so that the table doesn't depend on it. */
+typedef struct cal_day_s
+{
+    time_t start; /* local midnight at the start of the day */
+    gint16 yday;  /* day of the year, 0-365 */
+    gint8 mday;   /* day of the month, 1-31 */
+    gint8 wday;   /* day of the week, 0 is sunday */
+} CalDay;
+
+/* The table holds every day of the years first_year to last_year,
+ * in order.  Years are numbered as in struct tm, from 1900. */
+static GArray *days = NULL;
+static int first_year = 0;
+static int last_year = -1;
+static int first_day_number = 0; /* day number of days[0] */
+static time_t table_end = 0;     /* start of the day after the last */
+static guint last_hit = 0;       /* index of the last day looked up */
+
+/* If a time is this many years away from the table, start a new
+ * table around it, instead of filling in all of the years between. */
+#define CAL_MAX_GAP 10
+
+#define CAL_DAY(i) (&g_array_index(days, CalDay, (i)))
+
+/* =========================================================== */
+
+/* Number of days from the start of 1970 to the start of the year */
+static int year_day_number(int year)
+{
+    int y = year + 1900 - 1;
+    return 365 * (year - 70) + (y / 4 - 492) - (y / 100 - 19) + (y / 400 - 4);
+}
+
+/* Append all of the days of the year to the array.  Use the system
+ * routines, so that daylight savings come out right.  Return the
+ * start of the first day of the next year. */
+static time_t cal_build_year(GArray *arr, int year)
+{
+    struct tm tm;
+    time_t start;
+
+    memset(&tm, 0, sizeof(struct tm));
+    tm.tm_year = year;
+    tm.tm_mday = 1;
+
+    while (1)
+    {
+        CalDay day;
+
+        tm.tm_sec = 0;
+        tm.tm_min = 0;
+        tm.tm_hour = 0;
+        tm.tm_isdst = -1;
+        start = mktime(&tm);
+        if (tm.tm_year != year)
+            break;
+
+        day.start = start;
+        day.yday = tm.tm_yday;
+        day.mday = tm.tm_mday;
+        day.wday = tm.tm_wday;
+        g_array_append_val(arr, day);
+        tm.tm_mday++;
+    }
+    return start;
+}
+
+static void cal_reset(int year)
+{
+    if (days)
+        g_array_set_size(days, 0);
+    else
+        days = g_array_new(FALSE, FALSE, sizeof(CalDay));
+
+    first_year = year;
+    last_year = year;
+    first_day_number = year_day_number(year);
+    table_end = cal_build_year(days, year);
+    last_hit = 0;
+}
+
+static void cal_prepend_year(void)
+{
+    GArray *arr = g_array_new(FALSE, FALSE, sizeof(CalDay));
+
+    first_year--;
+    cal_build_year(arr, first_year);
+    g_array_prepend_vals(days, arr->data, arr->len);
+    first_day_number -= arr->len;
+    last_hit += arr->len;
+    g_array_free(arr, TRUE);
+}
+
+static void cal_append_year(void)
+{
+    last_year++;
+    table_end = cal_build_year(days, last_year);
+}
+
+/* Grow the table so that it covers the local time t */
+static void cal_cover(time_t t)
+{
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    if ((NULL == days) || (tm.tm_year < first_year - CAL_MAX_GAP)
+        || (tm.tm_year > last_year + CAL_MAX_GAP))
+    {
+        cal_reset(tm.tm_year);
+        return;
+    }
+    while (tm.tm_year < first_year)
+        cal_prepend_year();
+    while (tm.tm_year > last_year)
+        cal_append_year();
+}
+
+static inline time_t cal_day_end(guint i)
+{
+    return (i + 1 < days->len) ? CAL_DAY(i + 1)->start : table_end;
+}
+
+/* Return the index of the day that contains the local time t.
+ * Lookups tend to come in runs on the same day, so try the last
+ * one found before searching. */
+static guint cal_find(time_t t)
+{
+    guint lo, hi;
+
+    if ((NULL == days) || (0 == days->len) || (t < CAL_DAY(0)->start) || (t >= table_end))
+        cal_cover(t);
+
+    if ((CAL_DAY(last_hit)->start <= t) && (t < cal_day_end(last_hit)))
+        return last_hit;
+
+    lo = 0;
+    hi = days->len;
+    while (hi - lo > 1)
+    {
+        guint mid = (lo + hi) / 2;
+        if (CAL_DAY(mid)->start <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    last_hit = lo;
+    return lo;
+}
+
+/* Return the index of the day with the given day number */
+static guint cal_index(int day_number)
+{
+    while (day_number < first_day_number)
+        cal_prepend_year();
+    while (day_number >= first_day_number + (int) days->len)
+        cal_append_year();
+    return day_number - first_day_number;
+}
+
+static inline guint cal_day_index(time_t t)
+{
+    /* If config_daystart_offset == 3*3600 then the new day
+     * will start at 3AM, for example.  */
+    return cal_find(t - config_daystart_offset);
+}
+
+/* Return the day number of the day that contains t */
+static inline int cal_day_number(time_t t, CalDay *day)
+{
+    guint i = cal_day_index(t);
+    *day = *CAL_DAY(i);
+    return first_day_number + (int) i;
+}
+
+/* =========================================================== */
+
+time_t gtt_calendar_day_start(time_t t)
+{
+    guint i = cal_day_index(t);
+    return CAL_DAY(i)->start + config_daystart_offset;
+}
+
+time_t gtt_calendar_next_day_start(time_t t)
+{
+    return gtt_calendar_day_number_start(gtt_calendar_day_number(t) + 1);
+}
+
+int gtt_calendar_day_number(time_t t)
+{
+    CalDay day;
+    return cal_day_number(t, &day);
+}
+
+time_t gtt_calendar_day_number_start(int day_number)
+{
+    guint i;
+
+    if (NULL == days)
+        cal_reset(70 + day_number / 366);
+    i = cal_index(day_number);
+    return CAL_DAY(i)->start + config_daystart_offset;
+}
+
+time_t gtt_calendar_week_start(time_t t)
+{
+    CalDay day;
+    int dn = cal_day_number(t, &day);
+    int back;
+
+    /* If config_weekstart_offset == 1 then a new week starts
+     * on monday, not sunday. */
+    back = (day.wday - config_weekstart_offset) % 7;
+    if (0 > back)
+        back += 7;
+    return gtt_calendar_day_number_start(dn - back);
+}
+
+time_t gtt_calendar_month_start(time_t t)
+{
+    CalDay day;
+    int dn = cal_day_number(t, &day);
+    return gtt_calendar_day_number_start(dn - (day.mday - 1));
+}
+
+time_t gtt_calendar_year_start(time_t t)
+{
+    CalDay day;
+    int dn = cal_day_number(t, &day);
+    return gtt_calendar_day_number_start(dn - day.yday);
+}
+
+gboolean gtt_calendar_same_day(time_t a, time_t b)
+{
+    guint i = cal_day_index(a);
+
+    b -= config_daystart_offset;
+    return (CAL_DAY(i)->start <= b) && (b < cal_day_end(i));
+}
+
+/* =========================================================== */
+
+gboolean gtt_calendar_check_timezone(time_t now)
+{
+    static time_t last_check = 0;
+    static char *zone_env = NULL;
+    static char *zone_name[2] = { NULL, NULL };
+    static long zone_offset = 0;
+    gboolean changed;
+
+    if ((last_check <= now) && (now < last_check + 60))
+        return FALSE;
+    last_check = now;
+
+    tzset();
+    if (zone_name[0] && (zone_offset == timezone) && (0 == g_strcmp0(zone_env, g_getenv("TZ")))
+        && (0 == g_strcmp0(zone_name[0], tzname[0])) && (0 == g_strcmp0(zone_name[1], tzname[1])))
+        return FALSE;
+
+    /* The very first look only records the zone */
+    changed = (NULL != zone_name[0]);
+
+    g_free(zone_env);
+    g_free(zone_name[0]);
+    g_free(zone_name[1]);
+    zone_env = g_strdup(g_getenv("TZ"));
+    zone_name[0] = g_strdup(tzname[0]);
+    zone_name[1] = g_strdup(tzname[1]);
+    zone_offset = timezone;
+
+    if (changed && days)
+    {
+        g_array_free(days, TRUE);
+        days = NULL;
+    }
+    return changed;
+}
+
+/* ===================== END OF FILE ============================ */
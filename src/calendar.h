@@ -0,0 +1,72 @@
+/*   day, week, month and year boundaries for GnoTime
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_CALENDAR_H
+#define GTT_CALENDAR_H
+
+#include <glib.h>
+#include <time.h>
+
+/* The calendar keeps a table of the local start time of every day,
+ * a few years at a time, so that the day, week, month and year
+ * containing a given time can be found without going through
+ * localtime() and mktime().  All of the routines below honour
+ * config_daystart_offset: with an offset of 3*3600, a day runs from
+ * 3AM to 3AM.  The week start also honours config_weekstart_offset.
+ * Daylight savings are accounted for; a day is not always 24 hours.
+ *
+ * The gtt_calendar_day_start() routine returns the start of the day
+ *    that contains the time t.
+ *
+ * The gtt_calendar_next_day_start() routine returns the start of the
+ *    day following the one that contains the time t.
+ *
+ * The gtt_calendar_week_start(), gtt_calendar_month_start() and
+ *    gtt_calendar_year_start() routines return the start of the first
+ *    day of the week, month and year that contain the time t.
+ *
+ * The gtt_calendar_day_number() routine returns a count of days
+ *    (since the start of 1970) for the day that contains t.  Days
+ *    are numbered consecutively, so that the difference of two day
+ *    numbers is the number of days between them.
+ *
+ * The gtt_calendar_day_number_start() routine returns the start of
+ *    the day with the given day number.
+ *
+ * The gtt_calendar_same_day() routine returns TRUE if the times a and
+ *    b fall on the same day.
+ *
+ * The gtt_calendar_check_timezone() routine looks for a change of the
+ *    time zone, and throws away the tables if there was one.  It looks
+ *    at most once a minute, and returns TRUE if the zone changed.
+ */
+
+time_t gtt_calendar_day_start(time_t t);
+time_t gtt_calendar_next_day_start(time_t t);
+time_t gtt_calendar_week_start(time_t t);
+time_t gtt_calendar_month_start(time_t t);
+time_t gtt_calendar_year_start(time_t t);
+
+int gtt_calendar_day_number(time_t t);
+time_t gtt_calendar_day_number_start(int day_number);
+
+gboolean gtt_calendar_same_day(time_t a, time_t b);
+
+gboolean gtt_calendar_check_timezone(time_t now);
+
+#endif // GTT_CALENDAR_H
@@ -0,0 +1,554 @@
+/*   journal of changes to the GnoTime data file
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <qof.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "archive.h"
+#include "data-journal.h"
+#include "proj.h"
+#include "proj_p.h"
+
+/* The journal is a text file, one record per line, with the fields
+ * separated by tabs.  Strings are escaped, so that they hold neither
+ * tabs nor newlines.  The records are:
+ *
+ *   P guid id title desc notes custid billrate overtime_rate
+ *     overover_rate flat_fee min_interval auto_merge_interval
+ *     auto_merge_gap estimated_start estimated_end due_date sizing
+ *     percent_complete urgency importance status
+ *        the new state of the project's own fields
+ *
+ *   K guid memo notes billable billrate billstatus bill_unit
+ *     num_intervals, and for each interval: start stop fuzz running
+ *        the new state of the task, and all of its intervals
+ *
+ *   T guid stop
+ *        the running interval at the head of the task now stops here
+ *
+ * Every record holds the whole new state of what it describes, so
+ * that replaying a record twice does no harm.
+ */
+
+#define P_FIELDS 22
+#define K_FIELDS 9
+#define T_FIELDS 3
+
+/* Rewrite the data file once the journal gets this big */
+#define JOURNAL_MAX_SIZE (256 * 1024)
+
+/* A task with more intervals than this is not worth journalling;
+ * rewriting the data file costs about the same. */
+#define JOURNAL_MAX_INTERVALS 500
+
+/* Nor is one with intervals that belong in the archives; they
+ * would come back on top of the archives when replayed. */
+static gboolean task_has_old_intervals(GttTask *tsk, time_t cutoff)
+{
+    guint len = tsk->intervals->len;
+    return len && (g_array_index(tsk->intervals, GttIntervalRec, len - 1).start < cutoff);
+}
+
+/* A running timer is journalled at most this often, in seconds */
+#define JOURNAL_TICK_PERIOD 10
+
+static char *journal_path = NULL;
+static char *old_path = NULL; /* records waiting for a rewrite to finish */
+static FILE *journal_fh = NULL;
+static long journal_size = 0;
+static gboolean needs_compaction = FALSE;
+static guint rotate_serial = 0;
+static time_t last_tick = 0;
+
+/* =========================================================== */
+
+static void journal_set_paths(const char *xml_filepath)
+{
+    g_free(journal_path);
+    g_free(old_path);
+    journal_path = g_strconcat(xml_filepath, ".journal", NULL);
+    old_path = g_strconcat(xml_filepath, ".journal.old", NULL);
+}
+
+/* Escape everything but the bytes of UTF-8 sequences */
+static void put_string(GString *rec, const char *str)
+{
+    static char keep[129] = { 0 };
+    char *esc;
+    int i;
+
+    if (0 == keep[0])
+    {
+        for (i = 0; i < 128; i++)
+            keep[i] = (char) (0x80 + i);
+    }
+
+    esc = g_strescape(str ? str : "", keep);
+    g_string_append_c(rec, '\t');
+    g_string_append(rec, esc);
+    g_free(esc);
+}
+
+static void put_long(GString *rec, long val)
+{
+    g_string_append_printf(rec, "\t%ld", val);
+}
+
+static void put_double(GString *rec, double val)
+{
+    char buff[G_ASCII_DTOSTR_BUF_SIZE];
+    g_string_append_c(rec, '\t');
+    g_string_append(rec, g_ascii_dtostr(buff, sizeof(buff), val));
+}
+
+static void put_guid(GString *rec, char type, const GUID *guid)
+{
+    char buff[GUID_ENCODING_LENGTH + 1];
+    guid_to_string_buff(guid, buff);
+    g_string_append_c(rec, type);
+    g_string_append_c(rec, '\t');
+    g_string_append(rec, buff);
+}
+
+static void put_project(GString *rec, GttProject *prj)
+{
+    put_guid(rec, 'P', gtt_project_get_guid(prj));
+    put_long(rec, prj->id);
+    put_string(rec, prj->title);
+    put_string(rec, prj->desc);
+    put_string(rec, prj->notes);
+    put_string(rec, prj->custid);
+    put_double(rec, prj->billrate);
+    put_double(rec, prj->overtime_rate);
+    put_double(rec, prj->overover_rate);
+    put_double(rec, prj->flat_fee);
+    put_long(rec, prj->min_interval);
+    put_long(rec, prj->auto_merge_interval);
+    put_long(rec, prj->auto_merge_gap);
+    put_long(rec, prj->estimated_start);
+    put_long(rec, prj->estimated_end);
+    put_long(rec, prj->due_date);
+    put_long(rec, prj->sizing);
+    put_long(rec, prj->percent_complete);
+    put_long(rec, prj->urgency);
+    put_long(rec, prj->importance);
+    put_long(rec, prj->status);
+    g_string_append_c(rec, '\n');
+}
+
+static void put_task(GString *rec, GttTask *tsk)
+{
+    guint i;
+
+    put_guid(rec, 'K', gtt_task_get_guid(tsk));
+    put_string(rec, tsk->memo);
+    put_string(rec, tsk->notes);
+    put_long(rec, tsk->billable);
+    put_long(rec, tsk->billrate);
+    put_long(rec, tsk->billstatus);
+    put_long(rec, tsk->bill_unit);
+    put_long(rec, tsk->intervals->len);
+    for (i = 0; i < tsk->intervals->len; i++)
+    {
+        GttIntervalRec *ivl = &g_array_index(tsk->intervals, GttIntervalRec, i);
+        put_long(rec, ivl->start);
+        put_long(rec, ivl->stop);
+        put_long(rec, ivl->fuzz);
+        put_long(rec, ivl->running);
+    }
+    g_string_append_c(rec, '\n');
+}
+
+static void put_tick(GString *rec, GttTask *tsk)
+{
+    GttIntervalRec *ivl;
+
+    if (0 == tsk->intervals->len)
+        return;
+    ivl = &g_array_index(tsk->intervals, GttIntervalRec, 0);
+    put_guid(rec, 'T', gtt_task_get_guid(tsk));
+    put_long(rec, ivl->stop);
+    g_string_append_c(rec, '\n');
+}
+
+/* =========================================================== */
+
+gboolean gtt_data_journal_flush(void)
+{
+    GttChangeSet changes;
+    GString *rec;
+    GList *node;
+    time_t now, cutoff;
+
+    gtt_project_list_take_changes(&changes);
+    if (changes.structure)
+        needs_compaction = TRUE;
+
+    if (journal_fh)
+    {
+        rec = g_string_sized_new(1024);
+        cutoff = gtt_archive_get_cutoff();
+        for (node = changes.projects; node; node = node->next)
+        {
+            put_project(rec, node->data);
+        }
+        for (node = changes.tasks; node; node = node->next)
+        {
+            GttTask *tsk = node->data;
+            if ((JOURNAL_MAX_INTERVALS < tsk->intervals->len)
+                || task_has_old_intervals(tsk, cutoff))
+                needs_compaction = TRUE;
+            else
+                put_task(rec, tsk);
+        }
+
+        /* Skip the ticks in between; each one has the whole story */
+        now = time(0);
+        if (changes.ticked && ((now < last_tick) || (now >= last_tick + JOURNAL_TICK_PERIOD)))
+        {
+            for (node = changes.ticked; node; node = node->next)
+            {
+                put_tick(rec, node->data);
+            }
+            last_tick = now;
+        }
+
+        if (rec->len)
+        {
+            if ((1 != fwrite(rec->str, rec->len, 1, journal_fh)) || fflush(journal_fh))
+            {
+                g_warning("can't write the journal %s: %s\n", journal_path, strerror(errno));
+                gtt_data_journal_close();
+            }
+            else
+            {
+                journal_size += rec->len;
+            }
+        }
+        g_string_free(rec, TRUE);
+    }
+
+    g_list_free(changes.projects);
+    g_list_free(changes.tasks);
+    g_list_free(changes.ticked);
+    return needs_compaction;
+}
+
+gboolean gtt_data_journal_wants_compaction(void)
+{
+    return (NULL == journal_fh) || needs_compaction || (JOURNAL_MAX_SIZE < journal_size);
+}
+
+/* =========================================================== */
+
+gboolean gtt_data_journal_open(const char *xml_filepath)
+{
+    GttChangeSet changes;
+
+    gtt_data_journal_close();
+    journal_set_paths(xml_filepath);
+
+    /* Whatever changed until now came from the files */
+    gtt_project_list_take_changes(&changes);
+    g_list_free(changes.projects);
+    g_list_free(changes.tasks);
+    g_list_free(changes.ticked);
+    needs_compaction = FALSE;
+
+    journal_fh = g_fopen(journal_path, "a");
+    if (NULL == journal_fh)
+    {
+        g_warning("can't open the journal %s: %s\n", journal_path, strerror(errno));
+        return FALSE;
+    }
+    fseek(journal_fh, 0, SEEK_END);
+    journal_size = ftell(journal_fh);
+    return TRUE;
+}
+
+void gtt_data_journal_close(void)
+{
+    if (NULL == journal_fh)
+        return;
+    fclose(journal_fh);
+    journal_fh = NULL;
+    journal_size = 0;
+}
+
+/* =========================================================== */
+
+guint gtt_data_journal_rotate(void)
+{
+    char *text;
+    gsize len;
+    FILE *fh;
+
+    gtt_data_journal_flush();
+    needs_compaction = FALSE;
+    rotate_serial++;
+
+    if (NULL == journal_fh)
+        return rotate_serial;
+    gtt_data_journal_close();
+
+    /* If the last rewrite failed, its records are still waiting
+     * in the old journal; add the new ones to them. */
+    if (g_file_test(old_path, G_FILE_TEST_EXISTS))
+    {
+        if (g_file_get_contents(journal_path, &text, &len, NULL))
+        {
+            fh = g_fopen(old_path, "a");
+            if (fh && (0 < len))
+                fwrite(text, len, 1, fh);
+            if (fh)
+                fclose(fh);
+            g_free(text);
+        }
+        g_unlink(journal_path);
+    }
+    else
+    {
+        g_rename(journal_path, old_path);
+    }
+
+    journal_fh = g_fopen(journal_path, "a");
+    journal_size = 0;
+    return rotate_serial;
+}
+
+void gtt_data_journal_compacted(guint serial, gboolean ok)
+{
+    if (!ok)
+    {
+        needs_compaction = TRUE;
+        return;
+    }
+
+    /* A later rotation added records that are not written yet */
+    if ((serial != rotate_serial) || (NULL == old_path))
+        return;
+    g_unlink(old_path);
+}
+
+/* =========================================================== */
+
+static long get_long(char **fields, int i)
+{
+    return (long) g_ascii_strtoll(fields[i], NULL, 10);
+}
+
+static double get_double(char **fields, int i)
+{
+    return g_ascii_strtod(fields[i], NULL);
+}
+
+static char *get_string(char **fields, int i)
+{
+    return g_strcompress(fields[i]);
+}
+
+#define SET_STRING(FN, OBJ, I)               \
+    {                                        \
+        char *str = get_string(fields, (I)); \
+        FN((OBJ), str);                      \
+        g_free(str);                         \
+    }
+
+static gboolean replay_project(char **fields, int nfields)
+{
+    GttProject *prj;
+    GUID guid;
+
+    if ((P_FIELDS != nfields) || !string_to_guid(fields[1], &guid))
+        return FALSE;
+
+    /* A project that isn't there was created after the data file was
+     * written, and dropped by a crash; there's nowhere to put it. */
+    prj = gtt_project_locate_from_guid(&guid);
+    if (!prj)
+        return FALSE;
+
+    if (get_long(fields, 2) != gtt_project_get_id(prj))
+        gtt_project_set_id(prj, get_long(fields, 2));
+    SET_STRING(gtt_project_set_title, prj, 3);
+    SET_STRING(gtt_project_set_desc, prj, 4);
+    SET_STRING(gtt_project_set_notes, prj, 5);
+    SET_STRING(gtt_project_set_custid, prj, 6);
+    gtt_project_set_billrate(prj, get_double(fields, 7));
+    gtt_project_set_overtime_rate(prj, get_double(fields, 8));
+    gtt_project_set_overover_rate(prj, get_double(fields, 9));
+    gtt_project_set_flat_fee(prj, get_double(fields, 10));
+    gtt_project_set_min_interval(prj, get_long(fields, 11));
+    gtt_project_set_auto_merge_interval(prj, get_long(fields, 12));
+    gtt_project_set_auto_merge_gap(prj, get_long(fields, 13));
+    gtt_project_set_estimated_start(prj, get_long(fields, 14));
+    gtt_project_set_estimated_end(prj, get_long(fields, 15));
+    gtt_project_set_due_date(prj, get_long(fields, 16));
+    gtt_project_set_sizing(prj, get_long(fields, 17));
+    gtt_project_set_percent_complete(prj, get_long(fields, 18));
+    gtt_project_set_urgency(prj, get_long(fields, 19));
+    gtt_project_set_importance(prj, get_long(fields, 20));
+    gtt_project_set_status(prj, get_long(fields, 21));
+    return TRUE;
+}
+
+static gboolean replay_task(char **fields, int nfields)
+{
+    GttIntervalRec ivl = { 0 };
+    GttTask *tsk;
+    GUID guid;
+    long i, n;
+
+    if ((K_FIELDS > nfields) || !string_to_guid(fields[1], &guid))
+        return FALSE;
+    n = get_long(fields, 8);
+    if ((0 > n) || (K_FIELDS + 4 * n != nfields))
+        return FALSE;
+
+    tsk = gtt_task_locate_from_guid(&guid);
+    if (!tsk)
+        return FALSE;
+
+    SET_STRING(gtt_task_set_memo, tsk, 2);
+    SET_STRING(gtt_task_set_notes, tsk, 3);
+    gtt_task_set_billable(tsk, get_long(fields, 4));
+    gtt_task_set_billrate(tsk, get_long(fields, 5));
+    gtt_task_set_billstatus(tsk, get_long(fields, 6));
+    gtt_task_set_bill_unit(tsk, get_long(fields, 7));
+
+    gtt_task_clear_intervals(tsk);
+    for (i = 0; i < n; i++)
+    {
+        ivl.start = get_long(fields, K_FIELDS + 4 * i);
+        ivl.stop = get_long(fields, K_FIELDS + 4 * i + 1);
+        ivl.fuzz = get_long(fields, K_FIELDS + 4 * i + 2);
+        ivl.running = (0 != get_long(fields, K_FIELDS + 4 * i + 3));
+        gtt_task_append_interval_rec(tsk, &ivl);
+    }
+    return TRUE;
+}
+
+static gboolean replay_tick(char **fields, int nfields)
+{
+    GttInterval *ivl;
+    GttTask *tsk;
+    GUID guid;
+    time_t stop;
+
+    if ((T_FIELDS != nfields) || !string_to_guid(fields[1], &guid))
+        return FALSE;
+
+    tsk = gtt_task_locate_from_guid(&guid);
+    ivl = gtt_task_get_interval(tsk, 0);
+    if (!ivl || !gtt_interval_is_running(ivl))
+        return FALSE;
+
+    stop = get_long(fields, 2);
+    if (stop > gtt_interval_get_stop(ivl))
+        gtt_interval_set_stop(ivl, stop);
+    return TRUE;
+}
+
+static int replay_file(const char *path)
+{
+    char *text;
+    char **lines;
+    int i, count = 0;
+
+    if (!g_file_get_contents(path, &text, NULL, NULL))
+        return 0;
+
+    /* The last piece is empty, unless a crash cut the last
+     * record short; either way, it's skipped. */
+    lines = g_strsplit(text, "\n", -1);
+    for (i = 0; lines[i] && lines[i + 1]; i++)
+    {
+        char **fields = g_strsplit(lines[i], "\t", -1);
+        int nfields = g_strv_length(fields);
+        gboolean ok = FALSE;
+
+        if (1 < nfields)
+        {
+            switch (fields[0][0])
+            {
+            case 'P':
+                ok = replay_project(fields, nfields);
+                break;
+            case 'K':
+                ok = replay_task(fields, nfields);
+                break;
+            case 'T':
+                ok = replay_tick(fields, nfields);
+                break;
+            }
+        }
+        if (ok)
+            count++;
+        g_strfreev(fields);
+    }
+
+    g_strfreev(lines);
+    g_free(text);
+    return count;
+}
+
+/* =========================================================== */
+
+static void set_aside(const char *path, time_t now)
+{
+    char *aside;
+
+    if (!g_file_test(path, G_FILE_TEST_EXISTS))
+        return;
+    aside = g_strdup_printf("%s.%ld", path, (long) now);
+    if (0 != g_rename(path, aside))
+        g_warning("can't move the journal %s aside: %s\n", path, strerror(errno));
+    g_free(aside);
+}
+
+void gtt_data_journal_set_aside(const char *xml_filepath)
+{
+    time_t now = time(0);
+
+    gtt_data_journal_close();
+    journal_set_paths(xml_filepath);
+    set_aside(old_path, now);
+    set_aside(journal_path, now);
+}
+
+int gtt_data_journal_replay(const char *xml_filepath)
+{
+    int count;
+
+    journal_set_paths(xml_filepath);
+
+    gtt_project_bulk_load_begin();
+    count = replay_file(old_path);
+    count += replay_file(journal_path);
+    gtt_project_bulk_load_commit();
+    return count;
+}
+
+/* ===================== END OF FILE ============================ */
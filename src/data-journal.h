@@ -0,0 +1,81 @@
+/*   journal of changes to the GnoTime data file
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_DATA_JOURNAL_H
+#define GTT_DATA_JOURNAL_H
+
+#include <glib.h>
+
+/* The data journal is a file kept next to the xml data file, to which
+ * the changes made to projects and tasks are appended as they happen:
+ * one short line for a timer tick, or the new state of the project or
+ * task that was changed.  Rewriting the whole data file, which folds
+ * the journal back into it, then only needs to happen once in a while.
+ * On startup, the journal is replayed on top of the data file.
+ *
+ * Changes that move projects or tasks around, or create or destroy
+ * them, are not journalled; they ask for the data file to be
+ * rewritten instead.  All of these routines must be called from the
+ * main thread.
+ *
+ * The gtt_data_journal_replay() routine applies the journal for the
+ *    indicated data file to the projects in memory.  It returns the
+ *    number of changes applied.
+ *
+ * The gtt_data_journal_set_aside() routine renames the journal for
+ *    the indicated data file, and the old records waiting for a
+ *    rewrite, so that they are not replayed.  It is for when the data
+ *    file has been replaced, by a backup or a new file, and the
+ *    changes in the journal no longer apply to it.  The files are
+ *    kept, with the time added to their names.
+ *
+ * The gtt_data_journal_open() routine opens the journal for the
+ *    indicated data file, for appending, and forgets about any changes
+ *    made before.  The gtt_data_journal_close() routine closes it.
+ *
+ * The gtt_data_journal_flush() routine appends the changes made since
+ *    the last flush to the journal.  It returns TRUE if there were
+ *    changes that the journal couldn't take.
+ *
+ * The gtt_data_journal_wants_compaction() routine returns TRUE if the
+ *    data file should be rewritten: because of changes that are not in
+ *    the journal, because the journal got big, or because there is no
+ *    journal.
+ *
+ * The gtt_data_journal_rotate() routine is to be called just before a
+ *    snapshot of the data is taken to rewrite the data file.  It moves
+ *    the records written so far out of the way, and starts a new
+ *    journal.  It returns a serial number for the rewrite.  Once the
+ *    data file has been written, the gtt_data_journal_compacted()
+ *    routine must be called with that number; if the write succeeded,
+ *    the old records are thrown away.
+ */
+
+int gtt_data_journal_replay(const char *xml_filepath);
+void gtt_data_journal_set_aside(const char *xml_filepath);
+
+gboolean gtt_data_journal_open(const char *xml_filepath);
+void gtt_data_journal_close(void);
+
+gboolean gtt_data_journal_flush(void);
+gboolean gtt_data_journal_wants_compaction(void);
+
+guint gtt_data_journal_rotate(void);
+void gtt_data_journal_compacted(guint serial, gboolean ok);
+
+#endif // GTT_DATA_JOURNAL_H
@@ -0,0 +1,474 @@
+/*   compressed data files
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WITH_ZSTD
+#define WITH_ZSTD 0
+#endif
+
+#if WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "file-compress.h"
+
+/* gzip is done with the zlib converter that comes with gio, so it is
+ * always there.  zstd needs libzstd.  Both are driven by hand, one
+ * buffer at a time, between stdio and the caller's buffer. */
+
+#define COMPRESS_BUFSIZE (64 * 1024)
+
+struct gtt_compress_in_s
+{
+    FILE *fh;
+    GttCompression method;
+    GConverter *zlib;
+#if WITH_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+    gboolean eof;      /* nothing more to read from fh */
+    gboolean finished; /* the compressed stream came to its end */
+    size_t pos, end;   /* the unread part of buf */
+    char buf[COMPRESS_BUFSIZE];
+};
+
+struct gtt_compress_out_s
+{
+    FILE *fh;
+    GttCompression method;
+    GConverter *zlib;
+#if WITH_ZSTD
+    ZSTD_CStream *zstd;
+#endif
+    gboolean failed;
+    char buf[COMPRESS_BUFSIZE];
+};
+
+/* =========================================================== */
+
+gboolean gtt_file_compress_available(GttCompression method)
+{
+    switch (method)
+    {
+    case GTT_COMPRESS_NONE:
+    case GTT_COMPRESS_GZIP:
+        return TRUE;
+    case GTT_COMPRESS_ZSTD:
+        return WITH_ZSTD;
+    }
+    return FALSE;
+}
+
+/* =========================================================== */
+
+/* Read more of the file into the input buffer, if it is empty, or
+ * if more is wanted to go with what is left in it. */
+static gboolean fill_input(GttCompressIn *in, gboolean more)
+{
+    size_t n;
+
+    if (in->eof || (in->pos < in->end && !more))
+        return TRUE;
+
+    memmove(in->buf, in->buf + in->pos, in->end - in->pos);
+    in->end -= in->pos;
+    in->pos = 0;
+    if (sizeof(in->buf) == in->end)
+        return FALSE;
+
+    n = fread(in->buf + in->end, 1, sizeof(in->buf) - in->end, in->fh);
+    in->end += n;
+    if (0 == n)
+    {
+        if (ferror(in->fh))
+            return FALSE;
+        in->eof = TRUE;
+    }
+    return TRUE;
+}
+
+static GttCompression detect_method(const char *magic, size_t len)
+{
+    if (2 <= len && 0x1f == (guchar) magic[0] && 0x8b == (guchar) magic[1])
+        return GTT_COMPRESS_GZIP;
+
+    if (4 <= len && 0 == memcmp(magic, "\x28\xb5\x2f\xfd", 4))
+        return GTT_COMPRESS_ZSTD;
+
+    return GTT_COMPRESS_NONE;
+}
+
+GttCompressIn *gtt_file_compress_in_open(const char *filename)
+{
+    GttCompressIn *in;
+
+    in = g_new0(GttCompressIn, 1);
+    in->fh = g_fopen(filename, "rb");
+    if (!in->fh || !fill_input(in, FALSE))
+    {
+        gtt_file_compress_in_close(in);
+        return NULL;
+    }
+
+    in->method = detect_method(in->buf, in->end);
+    switch (in->method)
+    {
+    case GTT_COMPRESS_NONE:
+        break;
+    case GTT_COMPRESS_GZIP:
+        in->zlib = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+        break;
+    case GTT_COMPRESS_ZSTD:
+#if WITH_ZSTD
+        in->zstd = ZSTD_createDStream();
+        if (in->zstd)
+            break;
+#endif
+        gtt_file_compress_in_close(in);
+        return NULL;
+    }
+    return in;
+}
+
+static int gzip_read(GttCompressIn *in, char *buf, int len)
+{
+    GConverterResult res;
+    GConverterFlags flags;
+    gsize nread, nwritten;
+    gboolean more = FALSE;
+    GError *err = NULL;
+
+    for (;;)
+    {
+        if (!fill_input(in, more))
+            return -1;
+
+        flags = in->eof ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS;
+        res = g_converter_convert(
+            in->zlib, in->buf + in->pos, in->end - in->pos, buf, len, flags, &nread,
+            &nwritten, &err
+        );
+        if (G_CONVERTER_ERROR == res)
+        {
+            /* A truncated file ends up here, at the end of the input */
+            more = !in->eof && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT);
+            g_clear_error(&err);
+            if (more)
+                continue;
+            return -1;
+        }
+
+        in->pos += nread;
+        in->finished = (G_CONVERTER_FINISHED == res);
+        if (nwritten)
+            return nwritten;
+        if (in->finished)
+            return 0;
+    }
+}
+
+#if WITH_ZSTD
+static int zstd_read(GttCompressIn *in, char *buf, int len)
+{
+    ZSTD_inBuffer src;
+    ZSTD_outBuffer dst;
+    size_t rc;
+
+    for (;;)
+    {
+        if (!fill_input(in, FALSE))
+            return -1;
+
+        src.src = in->buf;
+        src.size = in->end;
+        src.pos = in->pos;
+        dst.dst = buf;
+        dst.size = len;
+        dst.pos = 0;
+        rc = ZSTD_decompressStream(in->zstd, &dst, &src);
+        if (ZSTD_isError(rc))
+            return -1;
+
+        in->pos = src.pos;
+        in->finished = (0 == rc);
+        if (dst.pos)
+            return dst.pos;
+
+        /* A file that stops in the middle of a frame is damaged */
+        if (in->eof && in->pos == in->end)
+            return in->finished ? 0 : -1;
+    }
+}
+#endif
+
+int gtt_file_compress_in_read(GttCompressIn *in, char *buf, int len)
+{
+    size_t n;
+
+    if (in->finished || 0 >= len)
+        return 0;
+
+    switch (in->method)
+    {
+    case GTT_COMPRESS_NONE:
+        /* The magic number check may have left some in the buffer */
+        if (in->pos < in->end)
+        {
+            n = MIN((size_t) len, in->end - in->pos);
+            memcpy(buf, in->buf + in->pos, n);
+            in->pos += n;
+            return n;
+        }
+        n = fread(buf, 1, len, in->fh);
+        if (0 == n && ferror(in->fh))
+            return -1;
+        return n;
+    case GTT_COMPRESS_GZIP:
+        return gzip_read(in, buf, len);
+    case GTT_COMPRESS_ZSTD:
+#if WITH_ZSTD
+        return zstd_read(in, buf, len);
+#endif
+        break;
+    }
+    return -1;
+}
+
+void gtt_file_compress_in_close(GttCompressIn *in)
+{
+    if (!in)
+        return;
+
+    if (in->zlib)
+        g_object_unref(in->zlib);
+#if WITH_ZSTD
+    ZSTD_freeDStream(in->zstd);
+#endif
+    if (in->fh)
+        fclose(in->fh);
+    g_free(in);
+}
+
+static GBytes *map_file(const char *filename)
+{
+    GMappedFile *map;
+    GBytes *bytes;
+
+    map = g_mapped_file_new(filename, FALSE, NULL);
+    if (!map)
+        return NULL;
+    bytes = g_mapped_file_get_bytes(map);
+    g_mapped_file_unref(map);
+    return bytes;
+}
+
+GBytes *gtt_file_compress_map(const char *filename)
+{
+    GttCompressIn *in;
+    GttCompression method;
+
+    in = gtt_file_compress_in_open(filename);
+    if (!in)
+        return NULL;
+    method = in->method;
+    gtt_file_compress_in_close(in);
+
+    if (GTT_COMPRESS_NONE != method)
+        return NULL;
+    return map_file(filename);
+}
+
+GBytes *gtt_file_compress_load(const char *filename)
+{
+    GttCompressIn *in;
+    GByteArray *data;
+    int n;
+
+    in = gtt_file_compress_in_open(filename);
+    if (!in)
+        return NULL;
+
+    if (GTT_COMPRESS_NONE == in->method)
+    {
+        gtt_file_compress_in_close(in);
+        return map_file(filename);
+    }
+
+    data = g_byte_array_new();
+    do
+    {
+        guint have = data->len;
+        g_byte_array_set_size(data, have + COMPRESS_BUFSIZE);
+        n = gtt_file_compress_in_read(in, (char *) data->data + have, COMPRESS_BUFSIZE);
+        g_byte_array_set_size(data, have + MAX(n, 0));
+    } while (0 < n);
+    gtt_file_compress_in_close(in);
+
+    if (0 > n)
+    {
+        g_byte_array_unref(data);
+        return NULL;
+    }
+    return g_byte_array_free_to_bytes(data);
+}
+
+/* =========================================================== */
+
+GttCompressOut *gtt_file_compress_out_new(FILE *fh, GttCompression method)
+{
+    GttCompressOut *out;
+
+    if (!gtt_file_compress_available(method))
+        return NULL;
+
+    out = g_new0(GttCompressOut, 1);
+    out->fh = fh;
+    out->method = method;
+    switch (method)
+    {
+    case GTT_COMPRESS_NONE:
+        break;
+    case GTT_COMPRESS_GZIP:
+        out->zlib = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+        break;
+    case GTT_COMPRESS_ZSTD:
+#if WITH_ZSTD
+        out->zstd = ZSTD_createCStream();
+        if (out->zstd)
+            break;
+#endif
+        g_free(out);
+        return NULL;
+    }
+    return out;
+}
+
+static gboolean put_bytes(GttCompressOut *out, const char *buf, size_t len)
+{
+    if (len && len != fwrite(buf, 1, len, out->fh))
+        out->failed = TRUE;
+    return !out->failed;
+}
+
+static gboolean gzip_write(GttCompressOut *out, const char *buf, size_t len, gboolean end)
+{
+    GConverterResult res;
+    GConverterFlags flags;
+    gsize nread, nwritten;
+    GError *err = NULL;
+
+    flags = end ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS;
+    while (len || end)
+    {
+        res = g_converter_convert(
+            out->zlib, buf, len, out->buf, sizeof(out->buf), flags, &nread, &nwritten,
+            &err
+        );
+        if (G_CONVERTER_ERROR == res)
+        {
+            g_error_free(err);
+            out->failed = TRUE;
+            return FALSE;
+        }
+        if (!put_bytes(out, out->buf, nwritten))
+            return FALSE;
+
+        buf += nread;
+        len -= nread;
+        if (G_CONVERTER_FINISHED == res)
+            break;
+    }
+    return TRUE;
+}
+
+#if WITH_ZSTD
+static gboolean zstd_write(GttCompressOut *out, const char *buf, size_t len, gboolean end)
+{
+    ZSTD_inBuffer src;
+    ZSTD_outBuffer dst;
+    size_t rc;
+
+    src.src = buf;
+    src.size = len;
+    src.pos = 0;
+    do
+    {
+        dst.dst = out->buf;
+        dst.size = sizeof(out->buf);
+        dst.pos = 0;
+        rc = ZSTD_compressStream2(out->zstd, &dst, &src, end ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(rc))
+        {
+            out->failed = TRUE;
+            return FALSE;
+        }
+        if (!put_bytes(out, out->buf, dst.pos))
+            return FALSE;
+    } while (end ? 0 != rc : src.pos < src.size);
+    return TRUE;
+}
+#endif
+
+static gboolean compress_write(GttCompressOut *out, const char *buf, size_t len, gboolean end)
+{
+    if (out->failed)
+        return FALSE;
+
+    switch (out->method)
+    {
+    case GTT_COMPRESS_NONE:
+        return put_bytes(out, buf, len);
+    case GTT_COMPRESS_GZIP:
+        return gzip_write(out, buf, len, end);
+    case GTT_COMPRESS_ZSTD:
+#if WITH_ZSTD
+        return zstd_write(out, buf, len, end);
+#endif
+        break;
+    }
+    out->failed = TRUE;
+    return FALSE;
+}
+
+gboolean gtt_file_compress_out_write(GttCompressOut *out, const char *buf, size_t len)
+{
+    return compress_write(out, buf, len, FALSE);
+}
+
+gboolean gtt_file_compress_out_finish(GttCompressOut *out)
+{
+    gboolean ok;
+
+    ok = compress_write(out, NULL, 0, TRUE);
+
+    if (out->zlib)
+        g_object_unref(out->zlib);
+#if WITH_ZSTD
+    ZSTD_freeCStream(out->zstd);
+#endif
+    g_free(out);
+    return ok;
+}
+
+/* ===================== END OF FILE ================== */
@@ -0,0 +1,96 @@
+/*   compressed data files
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_FILE_COMPRESS_H
+#define GTT_FILE_COMPRESS_H
+
+#include <glib.h>
+#include <stdio.h>
+
+/* The data file may be written out compressed, with gzip or, if gtt
+ * was built with libzstd, with zstd.  The data is compressed as it is
+ * streamed out, and decompressed as it is streamed in; there is never
+ * a whole copy of the file in memory.  The config_data_compression
+ * preference picks the method used on save; on load, the method is
+ * found from the magic number at the start of the file, so that files
+ * written with any setting, and the backups made of them, can always
+ * be read back.
+ *
+ * The gtt_file_compress_available() routine returns TRUE if this
+ *    build of gtt can read and write the indicated method.
+ *
+ * The gtt_file_compress_in_open() routine opens the indicated file
+ *    for reading, decompressing it if need be.  It returns NULL if
+ *    the file can't be opened, or is compressed with a method this
+ *    build doesn't have.
+ *
+ * The gtt_file_compress_in_read() routine reads up to len bytes of
+ *    the decompressed data.  It returns the number of bytes read,
+ *    zero at the end of the data, or -1 if the file is damaged or
+ *    can't be read.
+ *
+ * The gtt_file_compress_in_close() routine closes the file.
+ *
+ * The gtt_file_compress_load() routine returns the whole of the
+ *    decompressed contents of the file, for readers that need all of
+ *    it at once.  A plain file is mapped rather than copied.  Returns
+ *    NULL if the file can't be read.
+ *
+ * The gtt_file_compress_map() routine maps a plain file into memory,
+ *    without copying it.  Returns NULL if the file is compressed, or
+ *    can't be read.
+ *
+ * The gtt_file_compress_out_new() routine starts writing compressed
+ *    data into the indicated stdio file.  The file is not closed when
+ *    done; its owner must still flush and close it, and check for
+ *    errors as it does so.
+ *
+ * The gtt_file_compress_out_write() routine compresses len bytes, and
+ *    writes out whatever output is ready.  It returns FALSE if the
+ *    write failed.
+ *
+ * The gtt_file_compress_out_finish() routine writes out the rest of
+ *    the compressed data, and frees the stream.  It returns FALSE if
+ *    this or any earlier write failed.
+ *
+ * These may all be called from any thread.
+ */
+
+typedef enum
+{
+    GTT_COMPRESS_NONE = 0,
+    GTT_COMPRESS_GZIP,
+    GTT_COMPRESS_ZSTD,
+} GttCompression;
+
+typedef struct gtt_compress_in_s GttCompressIn;
+typedef struct gtt_compress_out_s GttCompressOut;
+
+gboolean gtt_file_compress_available(GttCompression);
+
+GttCompressIn *gtt_file_compress_in_open(const char *filename);
+int gtt_file_compress_in_read(GttCompressIn *, char *buf, int len);
+void gtt_file_compress_in_close(GttCompressIn *);
+GBytes *gtt_file_compress_load(const char *filename);
+GBytes *gtt_file_compress_map(const char *filename);
+
+GttCompressOut *gtt_file_compress_out_new(FILE *fh, GttCompression);
+gboolean gtt_file_compress_out_write(GttCompressOut *, const char *buf, size_t len);
+gboolean gtt_file_compress_out_finish(GttCompressOut *);
+
+#endif // GTT_FILE_COMPRESS_H
@@ -26,6 +26,7 @@
 
 #include "app.h"
 #include "cur-proj.h"
+#include "file-compress.h"
 #include "gconf-io-p.h"
 #include "gconf-io.h"
 #include "gtt.h"
@@ -158,6 +159,10 @@ void gtt_gconf_load(void)
     config_idle_timeout = GETINT("/Misc/IdleTimeout", 300);
     config_no_project_timeout = GETINT("/Misc/NoProjectTimeout", 300);
     config_autosave_period = GETINT("/Misc/AutosavePeriod", 60);
+    config_archive_years = GETINT("/Misc/ArchiveYears", 0);
+    config_data_compression = GETINT("/Misc/DataCompression", GTT_COMPRESS_NONE);
+    config_backup_versions = GETINT("/Misc/BackupVersions", 50);
+    config_backup_days = GETINT("/Misc/BackupDays", 90);
     config_daystart_offset = GETINT("/Misc/DayStartOffset", 0);
     config_weekstart_offset = GETINT("/Misc/WeekStartOffset", 0);
 
@@ -76,7 +76,7 @@ static SCM do_show_journal(GttGhtml *ghtml, GttProject *prj)
     char *ps;
     gboolean show_links = ghtml->show_links;
 
-    if (NULL == ghtml->write_stream)
+    if (!gtt_ghtml_has_output(ghtml))
         return SCM_UNSPECIFIED;
 
     p = g_string_new(NULL);
@@ -90,14 +90,14 @@ static SCM do_show_journal(GttGhtml *ghtml, GttProject *prj)
         _("Diary Entry"), _("Start"), _("Stop"), _("Elapsed")
     );
 
-    (ghtml->write_stream)(ghtml, p->str, p->len, ghtml->user_data);
+    gtt_ghtml_write(ghtml, p->str, p->len);
 
     for (node = gtt_project_get_tasks(prj); node; node = node->next)
     {
         const char *pp;
         int prt_date = 1;
         time_t prev_stop = 0;
-        GList *in;
+        guint in;
         GttTask *tsk = node->data;
 
         p = g_string_truncate(p, 0);
@@ -115,11 +115,12 @@ static SCM do_show_journal(GttGhtml *ghtml, GttProject *prj)
             p = g_string_append(p, "</a>");
         p = g_string_append(p, "</td>\n</tr>\n");
 
-        (ghtml->write_stream)(ghtml, p->str, p->len, ghtml->user_data);
+        gtt_ghtml_write(ghtml, p->str, p->len);
 
-        for (in = gtt_task_get_intervals(tsk); in; in = in->next)
+        gtt_task_load_archive(tsk, ghtml->window_start, ghtml->window_end);
+        for (in = 0; in < gtt_task_get_num_intervals(tsk); in++)
         {
-            GttInterval *ivl = in->data;
+            GttInterval *ivl = gtt_task_walk_interval(tsk, in);
             time_t start, stop, elapsed;
             start = gtt_interval_get_start(ivl);
             stop = gtt_interval_get_stop(ivl);
@@ -132,7 +133,9 @@ static SCM do_show_journal(GttGhtml *ghtml, GttProject *prj)
             );
             if (show_links)
             {
-                g_string_append_printf(p, "<a href=\"gtt:interval:0x%lx\">", (long) ivl);
+                g_string_append_printf(
+                    p, "<a href=\"gtt:interval:0x%lx:%ld\">", (long) tsk, (long) start
+                );
             }
 
             /* print hour only or date too? */
@@ -161,7 +164,9 @@ static SCM do_show_journal(GttGhtml *ghtml, GttProject *prj)
             );
             if (show_links)
             {
-                g_string_append_printf(p, "<a href=\"gtt:interval:0x%lx\">", (long) ivl);
+                g_string_append_printf(
+                    p, "<a href=\"gtt:interval:0x%lx:%ld\">", (long) tsk, (long) start
+                );
             }
             if (prt_date)
             {
@@ -182,12 +187,12 @@ static SCM do_show_journal(GttGhtml *ghtml, GttProject *prj)
             xxxqof_print_hours_elapsed_buff(buff, 100, elapsed, TRUE);
             p = g_string_append(p, buff);
             p = g_string_append(p, " &nbsp; &nbsp; </td></tr>\n");
-            (ghtml->write_stream)(ghtml, p->str, p->len, ghtml->user_data);
+            gtt_ghtml_write(ghtml, p->str, p->len);
         }
     }
 
     ps = "</table>\n";
-    (ghtml->write_stream)(ghtml, ps, strlen(ps), ghtml->user_data);
+    gtt_ghtml_write(ghtml, ps, strlen(ps));
 
     /* should the free-segment be false or true ??? */
     g_string_free(p, FALSE);
@@ -230,7 +235,7 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
     gboolean output_html = ghtml->show_html;
     gboolean show_links = ghtml->show_links;
 
-    if (NULL == ghtml->write_stream)
+    if (!gtt_ghtml_has_output(ghtml))
         return;
 
     p = g_string_new(NULL);
@@ -340,7 +345,7 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
     }
     p = g_string_append(p, "\n");
 
-    (ghtml->write_stream)(ghtml, p->str, p->len, ghtml->user_data);
+    gtt_ghtml_write(ghtml, p->str, p->len);
 
     for (node = gtt_project_get_tasks(prj); node; node = node->next)
     {
@@ -349,7 +354,7 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
         GttBillRate billrate;
         const char *pp;
         time_t prev_stop = 0;
-        GList *in;
+        guint in;
         GttTask *tsk = node->data;
         int task_secs;
         double hours, value = 0.0, billable_value = 0.0;
@@ -531,13 +536,14 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
             if (output_html)
                 p = g_string_append(p, "</tr>");
             p = g_string_append(p, "\n");
-            (ghtml->write_stream)(ghtml, p->str, p->len, ghtml->user_data);
+            gtt_ghtml_write(ghtml, p->str, p->len);
         }
 
         /* write out intervals */
-        for (in = gtt_task_get_intervals(tsk); in; in = in->next)
+        gtt_task_load_archive(tsk, ghtml->window_start, ghtml->window_end);
+        for (in = 0; in < gtt_task_get_num_intervals(tsk); in++)
         {
-            GttInterval *ivl = in->data;
+            GttInterval *ivl = gtt_task_walk_interval(tsk, in);
             time_t start, stop, elapsed;
             int prt_start_date = 1;
             int prt_stop_date = 1;
@@ -571,7 +577,8 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
                     if (show_links)
                     {
                         g_string_append_printf(
-                            p, "<a href=\"gtt:interval:0x%lx\">", (long) ivl
+                            p, "<a href=\"gtt:interval:0x%lx:%ld\">", (long) tsk,
+                            (long) start
                         );
                     }
                     if (prt_start_date)
@@ -596,7 +603,8 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
                     if (show_links)
                     {
                         g_string_append_printf(
-                            p, "<a href=\"gtt:interval:0x%lx\">", (long) ivl
+                            p, "<a href=\"gtt:interval:0x%lx:%ld\">", (long) tsk,
+                            (long) start
                         );
                     }
                     if (prt_stop_date)
@@ -650,7 +658,7 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
             p = g_string_append(p, ghtml->delim);
             if (0 < p->len)
             {
-                (ghtml->write_stream)(ghtml, p->str, p->len, ghtml->user_data);
+                gtt_ghtml_write(ghtml, p->str, p->len);
             }
         }
 
@@ -662,7 +670,7 @@ static void do_show_table(GttGhtml *ghtml, GttProject *prj, int invoice)
     if (output_html)
     {
         char *ps = "</table>\n";
-        (ghtml->write_stream)(ghtml, ps, strlen(ps), ghtml->user_data);
+        gtt_ghtml_write(ghtml, ps, strlen(ps));
     }
 }
 
@@ -672,12 +680,12 @@ static SCM gtt_hello(void)
 {
     GttGhtml *ghtml = ghtml_guile_global_hack;
     char *p;
-    if (NULL == ghtml->write_stream)
+    if (!gtt_ghtml_has_output(ghtml))
         return SCM_UNSPECIFIED;
 
     p = "Hello World!";
 
-    (ghtml->write_stream)(ghtml, p, strlen(p), ghtml->user_data);
+    gtt_ghtml_write(ghtml, p, strlen(p));
 
     /* maybe we should return something meaningful, like the string? */
     return SCM_UNSPECIFIED;
@@ -766,15 +774,15 @@ static void decode_column(GttGhtml *ghtml, const char *tok)
     {
         TASK_COL(BILLABLE_VALUE);
     }
-    else if (ghtml->write_stream)
+    else if (gtt_ghtml_has_output(ghtml))
     {
         const char *str;
         str = _("unknown token: >>>>");
-        (ghtml->write_stream)(ghtml, str, strlen(str), ghtml->user_data);
+        gtt_ghtml_write(ghtml, str, strlen(str));
         str = tok;
-        (ghtml->write_stream)(ghtml, str, strlen(str), ghtml->user_data);
+        gtt_ghtml_write(ghtml, str, strlen(str));
         str = "<<<<";
-        (ghtml->write_stream)(ghtml, str, strlen(str), ghtml->user_data);
+        gtt_ghtml_write(ghtml, str, strlen(str));
     }
 }
 
@@ -812,6 +820,9 @@ static SCM decode_scm_col_list(GttGhtml *ghtml, SCM col_list)
 static SCM show_journal(SCM junk)
 {
     GttGhtml *ghtml = ghtml_guile_global_hack;
+
+    /* These tables are not made of fragments that can be patched */
+    ghtml->patchable = FALSE;
     do_show_journal(ghtml, ghtml->prj);
     return SCM_UNSPECIFIED;
 }
@@ -820,6 +831,8 @@ static SCM show_table(SCM col_list)
 {
     GttGhtml *ghtml = ghtml_guile_global_hack;
     SCM rc;
+
+    ghtml->patchable = FALSE;
     SCM_ASSERT(scm_is_pair(col_list), col_list, SCM_ARG1, "gtt-show-table");
     rc = decode_scm_col_list(ghtml, col_list);
     do_show_table(ghtml, ghtml->prj, FALSE);
@@ -830,6 +843,8 @@ static SCM show_invoice(SCM col_list)
 {
     GttGhtml *ghtml = ghtml_guile_global_hack;
     SCM rc;
+
+    ghtml->patchable = FALSE;
     SCM_ASSERT(scm_is_pair(col_list), col_list, SCM_ARG1, "gtt-show-invoice");
     rc = decode_scm_col_list(ghtml, col_list);
     do_show_table(ghtml, ghtml->prj, TRUE);
@@ -841,6 +856,8 @@ static SCM show_export(SCM col_list)
     GttGhtml *ghtml = ghtml_guile_global_hack;
 
     SCM rc;
+
+    ghtml->patchable = FALSE;
     SCM_ASSERT(scm_is_pair(col_list), col_list, SCM_ARG1, "gtt-show-export");
     rc = decode_scm_col_list(ghtml, col_list);
 
@@ -32,6 +32,7 @@
 #include <monetary.h>
 
 #include "app.h"
+#include "calendar.h"
 #include "cur-proj.h"
 #include "ghtml-deprecated.h"
 #include "ghtml.h"
@@ -43,6 +44,7 @@
 
 #include <gio/gio.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 /* Design problems:
  * The way this is currently defined, there is no type safety, and
@@ -106,6 +108,14 @@ typedef enum
     GTT_IVL
 } PtrType;
 
+/* Anything read from a task outside of its own fragment of the page
+ * means that the page can't be patched when the task changes. */
+static void note_task_read(GttGhtml *ghtml, GttTask *tsk)
+{
+    if (ghtml && (tsk != ghtml->fragment_task))
+        ghtml->patchable = FALSE;
+}
+
 static SCM do_apply_based_on_type(
     GttGhtml *ghtml, SCM node, PtrType cur_type, SCM (*str_func)(GttGhtml *, const char *),
     SCM (*prj_func)(GttGhtml *, GttProject *), SCM (*tsk_func)(GttGhtml *, GttTask *),
@@ -139,6 +149,7 @@ static SCM do_apply_based_on_type(
         case GTT_TASK:
         {
             GttTask *tsk = (GttTask *) scm_to_ulong(node);
+            note_task_read(ghtml, tsk);
             if (tsk_func)
                 rc = tsk_func(ghtml, tsk);
             break;
@@ -146,6 +157,7 @@ static SCM do_apply_based_on_type(
         case GTT_IVL:
         {
             GttInterval *ivl = (GttInterval *) scm_to_ulong(node);
+            note_task_read(ghtml, gtt_interval_get_parent(ivl));
             if (ivl_func)
                 rc = ivl_func(ghtml, ivl);
             break;
@@ -294,7 +306,7 @@ static SCM do_show_scm(GttGhtml *ghtml, SCM node)
 {
     size_t len;
     char *str = NULL;
-    if (NULL == ghtml->write_stream)
+    if (!gtt_ghtml_has_output(ghtml))
         return SCM_EOL;
 
     /* Need to test for numbers first, since later tests
@@ -320,7 +332,7 @@ static SCM do_show_scm(GttGhtml *ghtml, SCM node)
         {
             sprintf(buf, "%26.18g", x);
         }
-        (ghtml->write_stream)(ghtml, buf, strlen(buf), ghtml->user_data);
+        gtt_ghtml_write(ghtml, buf, strlen(buf));
     }
     else
         /* either a 'symbol or a "quoted string" */
@@ -329,7 +341,7 @@ static SCM do_show_scm(GttGhtml *ghtml, SCM node)
             str = scm_to_locale_string(node);
             len = strlen(str);
             if (0 < len)
-                (ghtml->write_stream)(ghtml, str, len, ghtml->user_data);
+                gtt_ghtml_write(ghtml, str, len);
         }
         else if (scm_is_pair(node))
         {
@@ -350,7 +362,7 @@ static SCM do_show_scm(GttGhtml *ghtml, SCM node)
                 str = _("False");
             else
                 str = _("True");
-            (ghtml->write_stream)(ghtml, str, strlen(str), ghtml->user_data);
+            gtt_ghtml_write(ghtml, str, strlen(str));
         }
         else if (scm_is_null(node))
         {
@@ -452,6 +464,20 @@ static SCM set_links_off(void)
     return do_set_links_off(ghtml);
 }
 
+/* ============================================================== */
+/* Set the window of time the report covers */
+
+static SCM set_report_window(SCM start, SCM end)
+{
+    GttGhtml *ghtml = ghtml_guile_global_hack;
+
+    if (!scm_is_number(start) || !scm_is_number(end))
+        return SCM_EOL;
+    ghtml->window_start = scm_to_long(start);
+    ghtml->window_end = scm_to_long(end);
+    return SCM_EOL;
+}
+
 /* ============================================================== */
 
 static SCM do_include_file_scm(GttGhtml *ghtml, SCM node)
@@ -671,7 +697,7 @@ static SCM ret_tasks(SCM proj_list)
 static SCM do_ret_intervals(GttGhtml *ghtml, GttTask *tsk)
 {
     SCM rc;
-    GList *n, *ivl_list;
+    guint n;
 
     /* Oddball hack to make interval datestamp printing work nicely */
     ghtml->last_ivl_time = 0;
@@ -681,21 +707,13 @@ static SCM do_ret_intervals(GttGhtml *ghtml, GttTask *tsk)
     if (!tsk)
         return rc;
 
-    /* XXX should use g_list_to_scm() here */
-    /* Get list of intervals, then get tail */
-    ivl_list = gtt_task_get_intervals(tsk);
-    if (!ivl_list)
-        return rc;
+    /* The old intervals are only read in when they are asked for */
+    gtt_task_load_archive(tsk, ghtml->window_start, ghtml->window_end);
 
-    for (n = ivl_list; n->next; n = n->next)
+    /* Walk backwards from the oldest, creating a scheme list */
+    for (n = gtt_task_get_num_intervals(tsk); 0 < n; n--)
     {
-    }
-    ivl_list = n;
-
-    /* Walk backwards, creating a scheme list */
-    for (n = ivl_list; n; n = n->prev)
-    {
-        GttInterval *ivl = n->data;
+        GttInterval *ivl = gtt_task_walk_interval(tsk, n - 1);
         SCM node;
 
         node = scm_from_ulong((unsigned long) ivl);
@@ -711,39 +729,39 @@ static SCM ret_intervals(SCM task_list)
 }
 
 /* ============================================================== */
-/* Return a list of date handles for accessing daily totals */
+/* Return a list of date handles for accessing hourly, daily, weekly,
+ * monthly or yearly totals.  They all look like the daily ones, so
+ * that the gtt-daily-* getters work on any of them. */
 
-static SCM do_ret_daily_totals(GttGhtml *ghtml, GttProject *prj)
+static SCM do_ret_totals(GttGhtml *ghtml, GttProject *prj, GttBucketSize size)
 {
     SCM rc, rpt;
     int i;
+    guint j;
     GArray *arr;
-    time_t earliest;
-    struct tm tday;
+    GList *ivls;
 
     /* Get a pointer to null */
     rc = SCM_EOL;
     if (!prj)
         return rc;
 
+    /* The totals add up all of the tasks */
+    ghtml->patchable = FALSE;
+
     /* Get the project data */
-    arr = gtt_project_get_daily_buckets(prj, TRUE);
+    gtt_project_load_archive(prj, ghtml->window_start, ghtml->window_end, TRUE);
+    arr = gtt_project_get_buckets(prj, size, TRUE);
     if (!arr)
         return rc;
-    earliest = gtt_project_get_earliest_start(prj, TRUE);
-
-    /* Format the start date */
-    localtime_r(&earliest, &tday);
-    tday.tm_mday--;
 
     for (i = 0; i < arr->len; i++)
     {
         GttBucket *bu;
         char buff[100];
         SCM node;
-        time_t rptdate, secs;
+        time_t secs;
 
-        tday.tm_mday++;
         bu = &g_array_index(arr, GttBucket, i);
         secs = bu->total;
 
@@ -752,8 +770,18 @@ static SCM do_ret_daily_totals(GttGhtml *ghtml, GttProject *prj)
             continue;
 
         rpt = SCM_EOL;
-        /* Append the list of tasks and intervals for this day */
-        node = g_list_to_scm(bu->intervals, "gtt-interval-list");
+        /* Append the list of tasks and intervals for this day.  The
+         * handles are good for as long as the report's walk runs. */
+        ivls = NULL;
+        for (j = bu->intervals->len; j; j--)
+        {
+            GttBucketInterval *bi = &g_array_index(bu->intervals, GttBucketInterval, j - 1);
+            GttInterval *ivl = gtt_task_walk_find_interval(bi->task, bi->start);
+            if (ivl)
+                ivls = g_list_prepend(ivls, ivl);
+        }
+        node = g_list_to_scm(ivls, "gtt-interval-list");
+        g_list_free(ivls);
         rpt = scm_cons(node, rpt);
         node = g_list_to_scm(bu->tasks, "gtt-task-list");
         rpt = scm_cons(node, rpt);
@@ -765,9 +793,11 @@ static SCM do_ret_daily_totals(GttGhtml *ghtml, GttProject *prj)
         rpt = scm_cons(node, rpt);
 
         /* XXX report date should be time_t in the middle of the interval */
-        /* Print date */
-        rptdate = mktime(&tday);
-        xxxqof_print_date_buff(buff, 100, rptdate);
+        /* Print date, or the time the hour starts */
+        if (GTT_BUCKET_HOUR == size)
+            xxxqof_print_date_time_buff(buff, 100, bu->start);
+        else
+            xxxqof_print_date_buff(buff, 100, bu->start);
         node = scm_from_locale_string(buff);
         rpt = scm_cons(node, rpt);
 
@@ -777,16 +807,28 @@ static SCM do_ret_daily_totals(GttGhtml *ghtml, GttProject *prj)
 
         rc = scm_cons(rpt, rc);
     }
-    g_array_free(arr, TRUE);
+    gtt_buckets_free(arr);
 
     return rc;
 }
 
-static SCM ret_daily_totals(SCM proj_list)
-{
-    GttGhtml *ghtml = ghtml_guile_global_hack;
-    return do_apply_on_project(ghtml, proj_list, do_ret_daily_totals);
-}
+#define RET_TOTALS(RET_FUNC, SIZE)                                    \
+    static SCM RET_FUNC##_scm(GttGhtml *ghtml, GttProject *prj)       \
+    {                                                                 \
+        return do_ret_totals(ghtml, prj, SIZE);                       \
+    }                                                                 \
+                                                                      \
+    static SCM RET_FUNC(SCM proj_list)                                \
+    {                                                                 \
+        GttGhtml *ghtml = ghtml_guile_global_hack;                    \
+        return do_apply_on_project(ghtml, proj_list, RET_FUNC##_scm); \
+    }
+
+RET_TOTALS(ret_hourly_totals, GTT_BUCKET_HOUR)
+RET_TOTALS(ret_daily_totals, GTT_BUCKET_DAY)
+RET_TOTALS(ret_weekly_totals, GTT_BUCKET_WEEK)
+RET_TOTALS(ret_monthly_totals, GTT_BUCKET_MONTH)
+RET_TOTALS(ret_yearly_totals, GTT_BUCKET_YEAR)
 
 /* ============================================================== */
 /* Define a set of subroutines that accept a scheme list of projects,
@@ -841,6 +883,34 @@ RET_PROJECT_ULONG(ret_project_due_date, gtt_project_get_due_date)
 RET_PROJECT_LONG(ret_project_sizing, gtt_project_get_sizing)
 RET_PROJECT_LONG(ret_project_percent, gtt_project_get_percent_complete)
 
+/* ============================================================== */
+/* The time spent on each of the projects, but not on their
+ * sub-projects, between the start and the end time.  The window
+ * is kept here for the duration of the apply. */
+
+static time_t secs_range_start;
+static time_t secs_range_end;
+
+static SCM get_project_secs_range_scm(GttGhtml *ghtml, GttProject *prj)
+{
+    /* The total adds up all of the tasks */
+    ghtml->patchable = FALSE;
+    return scm_from_long(
+        gtt_project_get_secs_range(prj, secs_range_start, secs_range_end, FALSE)
+    );
+}
+
+static SCM ret_project_secs_range(SCM proj_list, SCM start, SCM end)
+{
+    GttGhtml *ghtml = ghtml_guile_global_hack;
+
+    if (!scm_is_number(start) || !scm_is_number(end))
+        return SCM_EOL;
+    secs_range_start = scm_to_long(start);
+    secs_range_end = scm_to_long(end);
+    return do_apply_on_project(ghtml, proj_list, get_project_secs_range_scm);
+}
+
 /* ============================================================== */
 /* Handle ret_project_title_link in the almost-standard way,
  * i.e. as
@@ -1307,8 +1377,10 @@ static SCM get_ivl_start_stop_common_str_scm(
 
     if (ghtml->show_links)
     {
-
-        g_string_append_printf(str, "<a href=\"gtt:interval:0x%lx\">", (long) ivl);
+        g_string_append_printf(
+            str, "<a href=\"gtt:interval:0x%lx:%ld\">", (long) gtt_interval_get_parent(ivl),
+            (long) gtt_interval_get_start(ivl)
+        );
     }
     g_string_append(str, buff);
 
@@ -1510,122 +1582,227 @@ static SCM my_catch_handler(void *data, SCM tag, SCM throw_args)
 static void process_link(GttGhtml *ghtml, const gchar *str)
 {
     /* no-op for now, just copy it into the window  */
-    if (ghtml->write_stream)
-    {
-        (ghtml->write_stream)(ghtml, "<link", 5, ghtml->user_data);
-        size_t nr = strlen(str);
-        (ghtml->write_stream)(ghtml, str, nr, ghtml->user_data);
-        (ghtml->write_stream)(ghtml, ">", 1, ghtml->user_data);
-    }
+    gtt_ghtml_write(ghtml, "<link", 5);
+    gtt_ghtml_write(ghtml, str, strlen(str));
+    gtt_ghtml_write(ghtml, ">", 1);
 }
 
 /* ============================================================== */
+/* Output is gathered into big chunks before it goes to the stream,
+ * as much of it comes a few bytes at a time. */
 
-void gtt_ghtml_display(GttGhtml *ghtml, const char *filepath, GttProject *prj)
+#define GHTML_CHUNK (64 * 1024)
+
+gboolean gtt_ghtml_has_output(GttGhtml *ghtml)
 {
-    GString *template;
-    char *start, *end, *scmstart, *comstart, *linkstart;
-    size_t nr;
+    return ghtml && (ghtml->write_stream || ghtml->take_stream);
+}
 
-    if (!ghtml)
+static void output_flush(GttGhtml *ghtml)
+{
+    if (ghtml->out->len && ghtml->write_stream)
+    {
+        (ghtml->write_stream)(ghtml, ghtml->out->str, ghtml->out->len, ghtml->user_data);
+    }
+    g_string_truncate(ghtml->out, 0);
+}
+
+void gtt_ghtml_write(GttGhtml *ghtml, const char *str, size_t len)
+{
+    if (!gtt_ghtml_has_output(ghtml) || (0 == len))
         return;
-    if (prj)
-        ghtml->prj = prj;
 
-    if (!filepath && (0 == ghtml->open_count))
+    /* Outside of gtt_ghtml_display(), there is no buffer */
+    if (!ghtml->out)
     {
-        if (ghtml->error)
-        {
-            (ghtml->error)(ghtml, 404, NULL, ghtml->user_data);
-        }
+        if (ghtml->write_stream)
+            (ghtml->write_stream)(ghtml, str, len, ghtml->user_data);
         return;
     }
 
-    /* Try to get the ghtml file ... */
-    GFile *html_file = g_file_new_for_path(filepath);
+    ghtml->render_bytes += len;
 
-    GError *error = NULL;
-    GFileInputStream *html_istream = g_file_read(html_file, NULL, &error);
-    // TODO: Error handling seems odd and should be reviewed when refactoring
-    if ((NULL == html_istream) && (0 == ghtml->open_count))
+    /* A fragment being rendered again is kept whole; see gtt_ghtml_patch() */
+    if (!ghtml->take_stream && (0 > ghtml->patch_id) && (ghtml->out->len + len > GHTML_CHUNK))
     {
-        if (ghtml->error)
+        output_flush(ghtml);
+
+        /* No point in copying a big piece */
+        if (len >= GHTML_CHUNK)
         {
-            (ghtml->error)(ghtml, 404, filepath, ghtml->user_data);
+            (ghtml->write_stream)(ghtml, str, len, ghtml->user_data);
+            return;
         }
-        return;
     }
-    ghtml->ref_path = filepath;
+    g_string_append_len(ghtml->out, str, len);
+}
+
+static void output_begin(GttGhtml *ghtml)
+{
+    ghtml->out = g_string_sized_new(GHTML_CHUNK);
+    ghtml->render_start = g_get_monotonic_time();
+    ghtml->render_bytes = 0;
+}
+
+static void output_end(GttGhtml *ghtml)
+{
+    size_t len = ghtml->out->len;
 
-    /* Read in the whole file.  Hopefully its not huge */
-    template = g_string_new(NULL);
-    while (TRUE)
+    if (ghtml->take_stream)
     {
-#define BUFF_SIZE 4000
-        char buff[BUFF_SIZE + 1];
-        const gsize bytes_read
-            = g_input_stream_read(G_INPUT_STREAM(html_istream), buff, BUFF_SIZE, NULL, &error);
-        if (0 == bytes_read)
-        {
-            break; // EOF
-        }
-        if (0 > bytes_read)
-        {
-            g_warning("Failed to read HTML file: %s", error->message);
+        (ghtml->take_stream)(ghtml, g_string_free(ghtml->out, FALSE), len, ghtml->user_data);
+    }
+    else
+    {
+        output_flush(ghtml);
+        g_string_free(ghtml->out, TRUE);
+    }
+    ghtml->out = NULL;
 
-            g_error_free(error);
-            error = NULL;
+    ghtml->render_usecs = g_get_monotonic_time() - ghtml->render_start;
+    g_debug(
+        "%s: %" G_GSIZE_FORMAT " bytes in %" G_GINT64_FORMAT " usecs", ghtml->ref_path,
+        ghtml->render_bytes, ghtml->render_usecs
+    );
+}
 
-            break;
-        }
+gsize gtt_ghtml_get_render_bytes(GttGhtml *ghtml)
+{
+    if (!ghtml)
+        return 0;
+    return ghtml->render_bytes;
+}
 
-        buff[bytes_read] = 0x0;
-        g_string_append(template, buff);
-    }
+gint64 gtt_ghtml_get_render_time(GttGhtml *ghtml)
+{
+    if (!ghtml)
+        return 0;
+    return ghtml->render_usecs;
+}
 
-    if (FALSE == g_input_stream_close(G_INPUT_STREAM(html_istream), NULL, &error))
-    {
-        g_warning("Failed to close HTML file: %s", error->message);
+/* ============================================================== */
+/* A template is a ghtml file, cut up once into the literal text to
+ * be copied out, the <link> tags, and the scheme fragments, which are
+ * read into lists of forms there and then.  Templates are cached by
+ * path for as long as the file keeps the same mtime and size, and
+ * the cache is shared by every GttGhtml, so that showing a report
+ * again reads neither the file nor any scheme. */
 
-        g_error_free(error);
-        error = NULL;
-    }
+typedef enum
+{
+    SEG_TEXT, /* literal text */
+    SEG_LINK, /* a <link> tag, from after the "<link" on */
+    SEG_SCM,  /* a scheme fragment */
+} SegmentType;
 
-    g_object_unref(html_istream);
-    html_istream = NULL;
-    g_object_unref(html_file);
-    html_file = NULL;
+typedef struct
+{
+    SegmentType type;
+    const char *str; /* points into the template's text */
+    size_t len;
+    SCM forms; /* the fragment, read in, or #f if that failed */
+} Segment;
 
-    /* ugh. gag. choke. puke. */
-    ghtml_guile_global_hack = ghtml;
+typedef struct
+{
+    int refs;
+    gint64 mtime;
+    goffset size;
+    char *text;
+    GArray *segments;
+} Template;
 
-#ifdef DEBUG
-    /* Load predefined scheme forms. We do this here only when debugging,
-     * since they may have changed since just a few minutes ago. */
-    scm_c_primitive_load(gtt_ghtml_resolve_path("gtt.scm", NULL));
-#endif
+static GHashTable *template_cache = NULL; /* path to Template */
 
-    /* Now open the output stream for writing */
-    if (ghtml->open_stream && (0 == ghtml->open_count))
+static void template_unref(Template *tmpl)
+{
+    guint i;
+
+    if (--tmpl->refs)
+        return;
+    for (i = 0; i < tmpl->segments->len; i++)
     {
-        (ghtml->open_stream)(ghtml, ghtml->user_data);
+        Segment *seg = &g_array_index(tmpl->segments, Segment, i);
+        if ((SEG_SCM == seg->type) && scm_is_true(seg->forms))
+            scm_gc_unprotect_object(seg->forms);
     }
+    g_array_free(tmpl->segments, TRUE);
+    g_free(tmpl->text);
+    g_free(tmpl);
+}
 
-    ghtml->open_count++;
+static SCM read_forms(void *data)
+{
+    SCM port, form, forms = SCM_EOL;
 
-    /* Loop over input text, looking for scheme markup and
-     * sgml comments. */
-    start = template->str;
-    while (start)
+    port = scm_open_input_string(scm_from_locale_string(data));
+    while (!scm_is_eq(form = scm_read(port), SCM_EOF_VAL))
+        forms = scm_cons(form, forms);
+    return scm_reverse_x(forms, SCM_EOL);
+}
+
+/* A fragment that can't be read is kept as text; the error is then
+ * reported when it is run, as it would have been before. */
+static SCM read_failed(void *data, SCM tag, SCM throw_args)
+{
+    return SCM_BOOL_F;
+}
+
+static SCM eval_segment(void *data)
+{
+    Segment *seg = data;
+    SCM forms, rc = SCM_UNSPECIFIED;
+
+    if (scm_is_false(seg->forms))
+        return scm_c_eval_string(seg->str);
+
+    for (forms = seg->forms; scm_is_pair(forms); forms = SCM_CDR(forms))
+        rc = scm_primitive_eval(SCM_CAR(forms));
+    return rc;
+}
+
+static void add_segment(Template *tmpl, SegmentType type, const char *str, size_t len)
+{
+    Segment seg;
+
+    if ((SEG_TEXT == type) && (0 == len))
+        return;
+
+    seg.type = type;
+    seg.str = str;
+    seg.len = len;
+    seg.forms = SCM_BOOL_F;
+    if (SEG_SCM == type)
     {
-        /* Look for scheme markup */
-        scmstart = strstr(start, "<?scm");
+        seg.forms = scm_c_catch(
+            SCM_BOOL_T, read_forms, (void *) str, read_failed, NULL, NULL, NULL
+        );
+        if (scm_is_true(seg.forms))
+            scm_gc_protect_object(seg.forms);
+    }
+    g_array_append_val(tmpl->segments, seg);
+}
 
-        /* Look for comments, and blow past them. */
-        comstart = strstr(start, "<!--");
+/* Cut the text up, looking for scheme markup, sgml comments, which
+ * are dropped, and <link> tags.  Each kind of markup is only looked
+ * for again once the text before it has been used up, so that the
+ * text is scanned just once. */
+static void cut_template(Template *tmpl)
+{
+    char *start, *end, *scmstart, *comstart, *linkstart;
 
-        /* Look for <link>, and try to handle stylesheets. */
-        linkstart = strstr(start, "<link");
+    start = tmpl->text;
+    scmstart = strstr(start, "<?scm");
+    comstart = strstr(start, "<!--");
+    linkstart = strstr(start, "<link");
+    while (start)
+    {
+        if (scmstart && scmstart < start)
+            scmstart = strstr(start, "<?scm");
+        if (comstart && comstart < start)
+            comstart = strstr(start, "<!--");
+        if (linkstart && linkstart < start)
+            linkstart = strstr(start, "<link");
 
         /* which comes first ? */
         end = 0;
@@ -1636,7 +1813,7 @@ void gtt_ghtml_display(GttGhtml *ghtml, const char *filepath, GttProject *prj)
         if (linkstart && linkstart < end)
             end = linkstart;
 
-        /* Look for comments, and blow past them. */
+        /* Blow past comments */
         if (comstart && comstart == end)
         {
             end = strstr(comstart, "-->");
@@ -1644,18 +1821,11 @@ void gtt_ghtml_display(GttGhtml *ghtml, const char *filepath, GttProject *prj)
             {
                 end += 3;
             }
-
-            /* write everything that we got before the markup */
-            if (ghtml->write_stream)
-            {
-                nr = comstart - start;
-                (ghtml->write_stream)(ghtml, start, nr, ghtml->user_data);
-            }
+            add_segment(tmpl, SEG_TEXT, start, comstart - start);
             start = end;
             continue;
         }
 
-        /* Look for <link>, and try to handle stylesheets. */
         if (linkstart && linkstart == end)
         {
             end = strstr(linkstart, ">");
@@ -1664,16 +1834,8 @@ void gtt_ghtml_display(GttGhtml *ghtml, const char *filepath, GttProject *prj)
                 *end = 0;
                 end += 1;
             }
-
-            /* write everything that we got before the markup */
-            if (ghtml->write_stream)
-            {
-                nr = linkstart - start;
-                (ghtml->write_stream)(ghtml, start, nr, ghtml->user_data);
-            }
-
-            /* dispatch and handle */
-            process_link(ghtml, linkstart + 5);
+            add_segment(tmpl, SEG_TEXT, start, linkstart - start);
+            add_segment(tmpl, SEG_LINK, linkstart + 5, strlen(linkstart + 5));
             start = end;
             continue;
         }
@@ -1687,40 +1849,315 @@ void gtt_ghtml_display(GttGhtml *ghtml, const char *filepath, GttProject *prj)
                 *end = 0;
                 end += 2;
             }
+            add_segment(tmpl, SEG_TEXT, start, scmstart - start);
+            add_segment(tmpl, SEG_SCM, scmstart + 5, strlen(scmstart + 5));
+            start = end;
+            continue;
+        }
 
-            /* write everything that we got before the markup */
-            if (ghtml->write_stream)
-            {
-                nr = scmstart - start;
-                (ghtml->write_stream)(ghtml, start, nr, ghtml->user_data);
-            }
+        /* If we got to here, we didn't find any tags. */
+        add_segment(tmpl, SEG_TEXT, start, strlen(start));
+        break;
+    }
+}
 
-            /* dispatch and handle */
-            scmstart += 5;
-            captured_stack = SCM_BOOL_F;
-            scm_c_catch(
-                SCM_BOOL_T, (scm_t_catch_body) scm_c_eval_string, scmstart, my_catch_handler,
-                NULL, my_preunwind_handler, NULL
-            );
+/* Return the template for the file, with a reference held on it, or
+ * NULL if the file can't be read. */
+static Template *template_get(const char *filepath)
+{
+    Template *tmpl;
+    GStatBuf st;
+    char *text;
 
-            start = end;
-            continue;
+    if (!template_cache)
+    {
+        template_cache = g_hash_table_new_full(
+            g_str_hash, g_str_equal, g_free, (GDestroyNotify) template_unref
+        );
+    }
+
+    if (0 != g_stat(filepath, &st))
+    {
+        g_hash_table_remove(template_cache, filepath);
+        return NULL;
+    }
+
+    tmpl = g_hash_table_lookup(template_cache, filepath);
+    if (tmpl && (tmpl->mtime == (gint64) st.st_mtime) && (tmpl->size == st.st_size))
+    {
+        tmpl->refs++;
+        return tmpl;
+    }
+
+    /* A template that is still being shown keeps its own reference */
+    g_hash_table_remove(template_cache, filepath);
+    if (!g_file_get_contents(filepath, &text, NULL, NULL))
+        return NULL;
+
+    tmpl = g_new0(Template, 1);
+    tmpl->refs = 2; /* the cache's, and the caller's */
+    tmpl->mtime = st.st_mtime;
+    tmpl->size = st.st_size;
+    tmpl->text = text;
+    tmpl->segments = g_array_new(FALSE, FALSE, sizeof(Segment));
+    cut_template(tmpl);
+    g_hash_table_insert(template_cache, g_strdup(filepath), tmpl);
+    return tmpl;
+}
+
+/* ============================================================== */
+/* Fragments of the page.  gtt-show-tasks wraps the forms it applies
+ * to each task between gtt-fragment-begin and gtt-fragment-end, which
+ * write the markers, and remember the task and the forms; the forms
+ * can then be applied to the task again by gtt_ghtml_patch(). */
+
+typedef struct
+{
+    GttTask *tsk;
+    SCM forms; /* what gtt-show-tasks was given */
+} Fragment;
+
+static int fragment_id(GttGhtml *ghtml)
+{
+    if (0 <= ghtml->patch_id)
+        return ghtml->patch_id;
+    return ghtml->fragments->len - 1;
+}
+
+static SCM fragment_begin(SCM task, SCM forms)
+{
+    GttGhtml *ghtml = ghtml_guile_global_hack;
+    char buff[40];
+
+    /* A task shown within another task's fragment is part of it */
+    if (ghtml->fragment_task)
+    {
+        ghtml->fragment_depth++;
+        return SCM_EOL;
+    }
+    if (!ghtml->show_links || !ghtml->fragments || !scm_is_number(task))
+        return SCM_EOL;
+
+    ghtml->fragment_task = (GttTask *) scm_to_ulong(task);
+    if (0 > ghtml->patch_id)
+    {
+        Fragment frag;
+        frag.tsk = ghtml->fragment_task;
+        frag.forms = scm_gc_protect_object(forms);
+        g_array_append_val(ghtml->fragments, frag);
+    }
+
+    g_snprintf(buff, sizeof(buff), "<!--gtt-fragment %d-->", fragment_id(ghtml));
+    return scm_from_locale_string(buff);
+}
+
+static SCM fragment_end(SCM task)
+{
+    GttGhtml *ghtml = ghtml_guile_global_hack;
+    char buff[40];
+
+    if (ghtml->fragment_depth)
+    {
+        ghtml->fragment_depth--;
+        return SCM_EOL;
+    }
+    if (!ghtml->fragment_task)
+        return SCM_EOL;
+    ghtml->fragment_task = NULL;
+
+    g_snprintf(buff, sizeof(buff), "<!--/gtt-fragment %d-->", fragment_id(ghtml));
+    return scm_from_locale_string(buff);
+}
+
+static void fragments_clear(GttGhtml *ghtml)
+{
+    guint i;
+
+    for (i = 0; i < ghtml->fragments->len; i++)
+        scm_gc_unprotect_object(g_array_index(ghtml->fragments, Fragment, i).forms);
+    g_array_set_size(ghtml->fragments, 0);
+}
+
+static void fragments_begin(GttGhtml *ghtml)
+{
+    if (!ghtml->fragments)
+        ghtml->fragments = g_array_new(FALSE, FALSE, sizeof(Fragment));
+    fragments_clear(ghtml);
+    ghtml->fragment_task = NULL;
+    ghtml->fragment_depth = 0;
+    ghtml->patch_id = -1;
+    ghtml->patchable = TRUE;
+    ghtml->render_day = gtt_calendar_day_start(time(0));
+}
+
+static SCM eval_fragment(void *data)
+{
+    Fragment *frag = data;
+    SCM show = scm_variable_ref(scm_c_lookup("gtt-show-tasks"));
+
+    scm_call_2(show, scm_list_1(scm_from_ulong((unsigned long) frag->tsk)), frag->forms);
+    return SCM_BOOL_T;
+}
+
+/* ============================================================== */
+
+void gtt_ghtml_display(GttGhtml *ghtml, const char *filepath, GttProject *prj)
+{
+    Template *tmpl;
+    guint i;
+
+    if (!ghtml)
+        return;
+    if (prj)
+        ghtml->prj = prj;
+
+    if (!filepath && (0 == ghtml->open_count))
+    {
+        if (ghtml->error)
+        {
+            (ghtml->error)(ghtml, 404, NULL, ghtml->user_data);
         }
+        return;
+    }
 
-        /* If we got to here, we didn't find any tags. Just output */
-        if (ghtml->write_stream)
+    /* Try to get the ghtml file ... */
+    tmpl = filepath ? template_get(filepath) : NULL;
+    if (!tmpl)
+    {
+        if (ghtml->error && (0 == ghtml->open_count))
         {
-            nr = strlen(start);
-            (ghtml->write_stream)(ghtml, start, nr, ghtml->user_data);
+            (ghtml->error)(ghtml, 404, filepath, ghtml->user_data);
+        }
+        return;
+    }
+    ghtml->ref_path = filepath;
+
+    /* ugh. gag. choke. puke. */
+    ghtml_guile_global_hack = ghtml;
+
+#ifdef DEBUG
+    /* Load predefined scheme forms. We do this here only when debugging,
+     * since they may have changed since just a few minutes ago. */
+    scm_c_primitive_load(gtt_ghtml_resolve_path("gtt.scm", NULL));
+#endif
+
+    /* Now open the output stream for writing */
+    if (ghtml->open_stream && (0 == ghtml->open_count))
+    {
+        (ghtml->open_stream)(ghtml, ghtml->user_data);
+    }
+    if (0 == ghtml->open_count)
+    {
+        output_begin(ghtml);
+        fragments_begin(ghtml);
+        gtt_interval_walk_begin();
+        ghtml->window_start = 0;
+        ghtml->window_end = 0;
+    }
+
+    ghtml->open_count++;
+
+    for (i = 0; i < tmpl->segments->len; i++)
+    {
+        Segment *seg = &g_array_index(tmpl->segments, Segment, i);
+
+        switch (seg->type)
+        {
+        case SEG_TEXT:
+            gtt_ghtml_write(ghtml, seg->str, seg->len);
+            break;
+
+        case SEG_LINK:
+            process_link(ghtml, seg->str);
+            break;
+
+        case SEG_SCM:
+            captured_stack = SCM_BOOL_F;
+            scm_c_catch(
+                SCM_BOOL_T, eval_segment, seg, my_catch_handler, NULL, my_preunwind_handler,
+                NULL
+            );
+            break;
         }
-        break;
     }
 
     ghtml->open_count--;
+    if (0 == ghtml->open_count)
+    {
+        /* An error may have cut a fragment short */
+        if (ghtml->fragment_task)
+            ghtml->patchable = FALSE;
+        gtt_interval_walk_end();
+        output_end(ghtml);
+    }
     if (ghtml->close_stream && (0 == ghtml->open_count))
     {
         (ghtml->close_stream)(ghtml, ghtml->user_data);
     }
+    template_unref(tmpl);
+}
+
+gboolean gtt_ghtml_patch(GttGhtml *ghtml, GList *tasks, GttGhtmlPatch patch, gpointer ud)
+{
+    GPtrArray *pieces;
+    GArray *ids;
+    gboolean ok = TRUE;
+    guint i;
+
+    if (!ghtml || !patch || !ghtml->fragments || ghtml->open_count)
+        return FALSE;
+    if (!ghtml->patchable || (ghtml->render_day != gtt_calendar_day_start(time(0))))
+        return FALSE;
+
+    ghtml_guile_global_hack = ghtml;
+    pieces = g_ptr_array_new();
+    ids = g_array_new(FALSE, FALSE, sizeof(int));
+    gtt_interval_walk_begin();
+
+    /* Render all of them before handing any over, as one of them
+     * may yet turn out to depend on something outside of it. */
+    for (i = 0; ok && (i < ghtml->fragments->len); i++)
+    {
+        Fragment *frag = &g_array_index(ghtml->fragments, Fragment, i);
+        int id = i;
+        SCM rc;
+
+        if (!g_list_find(tasks, frag->tsk))
+            continue;
+
+        ghtml->patch_id = id;
+        ghtml->out = g_string_new(NULL);
+        captured_stack = SCM_BOOL_F;
+        rc = scm_c_catch(
+            SCM_BOOL_T, eval_fragment, frag, my_catch_handler, NULL, my_preunwind_handler, NULL
+        );
+        if (scm_is_false(rc) || ghtml->fragment_task)
+            ok = FALSE;
+        ghtml->fragment_task = NULL;
+        ghtml->fragment_depth = 0;
+
+        g_ptr_array_add(pieces, ghtml->out);
+        g_array_append_val(ids, id);
+        ghtml->out = NULL;
+    }
+    ghtml->patch_id = -1;
+    gtt_interval_walk_end();
+
+    ok = ok && ghtml->patchable;
+    for (i = 0; i < pieces->len; i++)
+    {
+        GString *str = g_ptr_array_index(pieces, i);
+        if (ok)
+            (patch)(ghtml, g_array_index(ids, int, i), str->str, str->len, ud);
+        g_string_free(str, TRUE);
+    }
+    g_ptr_array_free(pieces, TRUE);
+    g_array_free(ids, TRUE);
+
+    /* The page stays as it was; show it anew next time */
+    if (!ok)
+        ghtml->patchable = FALSE;
+    return ok;
 }
 
 /* ============================================================== */
@@ -1740,13 +2177,20 @@ static void register_procs(void)
     scm_c_define_gsubr("gtt-projects", 0, 0, 0, ret_projects);
     scm_c_define_gsubr("gtt-query-results", 0, 0, 0, ret_query_projects);
     scm_c_define_gsubr("gtt-did-query", 0, 0, 0, ret_did_query);
+    scm_c_define_gsubr("gtt-fragment-begin", 2, 0, 0, fragment_begin);
+    scm_c_define_gsubr("gtt-fragment-end", 1, 0, 0, fragment_end);
 
     scm_c_define_gsubr("gtt-tasks", 1, 0, 0, ret_tasks);
     scm_c_define_gsubr("gtt-intervals", 1, 0, 0, ret_intervals);
+    scm_c_define_gsubr("gtt-hourly-totals", 1, 0, 0, ret_hourly_totals);
     scm_c_define_gsubr("gtt-daily-totals", 1, 0, 0, ret_daily_totals);
+    scm_c_define_gsubr("gtt-weekly-totals", 1, 0, 0, ret_weekly_totals);
+    scm_c_define_gsubr("gtt-monthly-totals", 1, 0, 0, ret_monthly_totals);
+    scm_c_define_gsubr("gtt-yearly-totals", 1, 0, 0, ret_yearly_totals);
 
     scm_c_define_gsubr("gtt-links-on", 0, 0, 0, set_links_on);
     scm_c_define_gsubr("gtt-links-off", 0, 0, 0, set_links_off);
+    scm_c_define_gsubr("gtt-report-window", 2, 0, 0, set_report_window);
 
     scm_c_define_gsubr("gtt-project-subprojects", 1, 0, 0, ret_project_subprjs);
     scm_c_define_gsubr("gtt-project-parent", 1, 0, 0, ret_project_parent);
@@ -1762,6 +2206,7 @@ static void register_procs(void)
     scm_c_define_gsubr("gtt-project-due-date", 1, 0, 0, ret_project_due_date);
     scm_c_define_gsubr("gtt-project-sizing", 1, 0, 0, ret_project_sizing);
     scm_c_define_gsubr("gtt-project-percent-complete", 1, 0, 0, ret_project_percent);
+    scm_c_define_gsubr("gtt-project-secs-range", 3, 0, 0, ret_project_secs_range);
 
     scm_c_define_gsubr("gtt-task-memo", 1, 0, 0, ret_task_memo);
     scm_c_define_gsubr("gtt-task-notes", 1, 0, 0, ret_task_notes);
@@ -1817,6 +2262,9 @@ GttGhtml *gtt_ghtml_new(void)
     p->show_links = TRUE;
     p->really_hide_links = FALSE;
     p->last_ivl_time = 0;
+    p->fragments = NULL;
+    p->patch_id = -1;
+    p->patchable = FALSE;
 
     gtt_ghtml_deprecated_init(p);
 
@@ -1830,6 +2278,11 @@ void gtt_ghtml_destroy(GttGhtml *p)
 
     if (p->query_result)
         g_list_free(p->query_result);
+    if (p->fragments)
+    {
+        fragments_clear(p);
+        g_array_free(p->fragments, TRUE);
+    }
     g_free(p);
 }
 
@@ -1845,6 +2298,14 @@ void gtt_ghtml_set_stream(
     p->write_stream = wr;
     p->close_stream = cl;
     p->error = er;
+    p->take_stream = NULL;
+}
+
+void gtt_ghtml_set_take_stream(GttGhtml *p, GttGhtmlTakeStream tk)
+{
+    if (!p)
+        return;
+    p->take_stream = tk;
 }
 
 /* This sets the over-ride flag, so that no internal links are shown,
@@ -31,8 +31,21 @@
  * can be sent anywhere desired. For example, this could, in theory
  * be used inside a cgi-bin script.  (This is a plannned, multi-user,
  * web-based version that we hope to code up someday).  Currently,
- * the stream is used to push data into GtkHTML, and also to fwrite()
- * for the save-to-file function.
+ * the stream is used to push data into the web view, and also to
+ * write out the save-to-file function.
+ *
+ * The output is gathered into a buffer, and handed to write_stream
+ * in chunks of GHTML_CHUNK bytes or so, rather than a few bytes at a
+ * time.  A stream that wants the whole of the output at once can set
+ * take_stream instead, which is given the buffer itself at the end,
+ * to keep and free.
+ *
+ * While links are shown, each task shown with gtt-show-tasks is
+ * marked in the output as a fragment of the page, between the html
+ * comments <!--gtt-fragment N--> and <!--/gtt-fragment N-->.  What
+ * goes into each fragment is remembered, so that when a task changes,
+ * only its fragments need to be rendered again and patched into the
+ * page; see gtt_ghtml_patch().
  *
  * The X that can be Y is not the true X.
  */
@@ -45,9 +58,18 @@ struct gtt_ghtml_s
     void (*open_stream)(GttGhtml *, gpointer);
     void (*write_stream)(GttGhtml *, const char *, size_t len, gpointer);
     void (*close_stream)(GttGhtml *, gpointer);
+    void (*take_stream)(GttGhtml *, char *, size_t len, gpointer);
     void (*error)(GttGhtml *, int errcode, const char *msg, gpointer);
     gpointer user_data;
 
+    /* output not yet handed to the stream, while a file is shown */
+    GString *out;
+
+    /* how much the last file shown came to, and how long it took */
+    gint64 render_start;
+    gsize render_bytes;
+    gint64 render_usecs;
+
     /* open_count and ref_path used for recursive file includes */
     int open_count;
     const char *ref_path;
@@ -67,6 +89,21 @@ struct gtt_ghtml_s
 
     time_t last_ivl_time; /* hack for pretty-printing interval dates */
 
+    /* The window of time the report asked for; the archived intervals
+     * in it are read in before intervals are listed or totalled.  The
+     * window is empty, and nothing archived is read, unless set. */
+    time_t window_start;
+    time_t window_end;
+
+    /* The fragments of the last file shown, and whether they hold
+     * all that depends on the tasks in them. */
+    GArray *fragments;
+    GttTask *fragment_task; /* whose fragment is being rendered */
+    int fragment_depth;     /* of fragments within that one */
+    int patch_id;           /* of the fragment being rendered again */
+    gboolean patchable;
+    time_t render_day;
+
     /* ------------------------------------------------------ */
     /* Deprecated portion of this struct -- will go away someday. */
     /* Used only by ghtml-deprecated.c */
@@ -98,17 +135,51 @@ typedef void (*GttGhtmlOpenStream)(GttGhtml *, gpointer);
 typedef void (*GttGhtmlWriteStream)(GttGhtml *, const char *, size_t len, gpointer);
 typedef void (*GttGhtmlCloseStream)(GttGhtml *, gpointer);
 typedef void (*GttGhtmlError)(GttGhtml *, int errcode, const char *msg, gpointer);
+typedef void (*GttGhtmlTakeStream)(GttGhtml *, char *str, size_t len, gpointer);
 
 void gtt_ghtml_set_stream(
     GttGhtml *, gpointer user_data, GttGhtmlOpenStream, GttGhtmlWriteStream,
     GttGhtmlCloseStream, GttGhtmlError
 );
 
+/** The gtt_ghtml_set_take_stream() routine sets the routine that is
+ *     given the whole output, once it is done, instead of having it
+ *     written out bit by bit.  The string is the routine's to free.
+ *     Setting the stream with gtt_ghtml_set_stream() clears it.
+ */
+void gtt_ghtml_set_take_stream(GttGhtml *, GttGhtmlTakeStream);
+
+/** The gtt_ghtml_write() routine adds text to the output.  The
+ *     gtt_ghtml_has_output() routine returns FALSE if the output goes
+ *     nowhere, so that there's no need to produce it.
+ */
+void gtt_ghtml_write(GttGhtml *, const char *str, size_t len);
+gboolean gtt_ghtml_has_output(GttGhtml *);
+
+/** The gtt_ghtml_get_render_bytes() and gtt_ghtml_get_render_time()
+ *     routines return the size of the output of the last file shown,
+ *     and the time it took, in microseconds.
+ */
+gsize gtt_ghtml_get_render_bytes(GttGhtml *);
+gint64 gtt_ghtml_get_render_time(GttGhtml *);
+
 /** The gtt_ghtml_display() routine will parse the indicated gtt file,
  *     and output standard HTML to the indicated stream.
  */
 void gtt_ghtml_display(GttGhtml *, const char *path_frag, GttProject *prj);
 
+/** The gtt_ghtml_patch() routine renders again the fragments of the
+ *     file last shown that show any of the indicated tasks.  Each one
+ *     is handed to the patch routine with the number of the fragment
+ *     it replaces, markers included.  It returns FALSE, and hands over
+ *     nothing, if the page can't be patched: if anything outside of the
+ *     fragments depends on what is in the tasks, or the day has changed
+ *     since.  The whole file must then be shown again.
+ */
+typedef void (*GttGhtmlPatch)(GttGhtml *, int id, const char *str, size_t len, gpointer);
+
+gboolean gtt_ghtml_patch(GttGhtml *, GList *tasks, GttGhtmlPatch, gpointer);
+
 /** The gtt_gthml_show_links() routine will set a flag indicating whether
  *     the output html should include internal <a href> links.  Normally,
  *     this should be set to TRUE when displaying in the internal browser,
@@ -254,6 +254,10 @@ void gtt_gsettings_save(void)
         gtt_gsettings_set_int(misc, "idle-timeout", config_idle_timeout);
         gtt_gsettings_set_int(misc, "no-project-timeout", config_no_project_timeout);
         gtt_gsettings_set_int(misc, "autosave-period", config_autosave_period);
+        gtt_gsettings_set_int(misc, "archive-years", config_archive_years);
+        gtt_gsettings_set_int(misc, "data-compression", config_data_compression);
+        gtt_gsettings_set_int(misc, "backup-versions", config_backup_versions);
+        gtt_gsettings_set_int(misc, "backup-days", config_backup_days);
         gtt_gsettings_set_int(misc, "timer-running", timer_is_running());
         gtt_gsettings_set_int(misc, "curr-project", gtt_project_get_id(cur_proj));
         gtt_gsettings_set_int(misc, "num-projects", -1);
@@ -342,6 +346,10 @@ void gtt_gsettings_load(void)
         config_idle_timeout = g_settings_get_int(misc, "idle-timeout");
         config_no_project_timeout = g_settings_get_int(misc, "no-project-timeout");
         config_autosave_period = g_settings_get_int(misc, "autosave-period");
+        config_archive_years = g_settings_get_int(misc, "archive-years");
+        config_data_compression = g_settings_get_int(misc, "data-compression");
+        config_backup_versions = g_settings_get_int(misc, "backup-versions");
+        config_backup_days = g_settings_get_int(misc, "backup-days");
         config_daystart_offset = g_settings_get_int(misc, "day-start-offset");
         config_weekstart_offset = g_settings_get_int(misc, "week-start-offset");
 
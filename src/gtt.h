@@ -50,6 +50,14 @@ void save_properties(void);
  */
 void save_projects(void);
 
+/* The save_projects_in_background() routine is like save_projects(),
+ * except that it only takes a snapshot of the data, and leaves the
+ * writing to a worker thread, so as not to hold up the GUI.  Any
+ * error is set, and reported, once the write is done.  If an earlier
+ * one is still busy writing, it does nothing.
+ */
+void save_projects_in_background(void);
+
 /* The read_data() routine will load the project data file
    and setup the interface with the new data
  */
@@ -37,6 +37,7 @@
 #include "proj.h"
 #include "props-invl.h"
 #include "props-task.h"
+#include "report-cache.h"
 #include "util.h"
 
 #include <gio/gio.h>
@@ -50,10 +51,11 @@ typedef struct wiggy_s
 {
     GttGhtml *gh;
     WebKitWebView *web_view;
-    GString *html_content;
     GtkWidget *top;
     GttProject *prj;
     char *filepath; /* file containing report template */
+    char *cache_key; /* for the page being rendered */
+    gboolean loading; /* a new page is going into the web view */
 
     /* Interval edit menu widgets */
     GttInterval *interval;
@@ -92,35 +94,23 @@ do_show_report(const char *, GttPlugin *, KvpFrame *, GttProject *, gboolean, GL
 /* ============================================================== */
 /* Routines that take html and mash it into browser. */
 
-static void wiggy_open(GttGhtml *pl, gpointer ud)
+static void wiggy_load(Wiggy *wig, const char *html)
 {
-    Wiggy *wig = (Wiggy *) ud;
-
-    if (wig->html_content != NULL)
-        g_string_free(wig->html_content, TRUE);
-
-    wig->html_content = g_string_new(NULL);
+    // Until it is in, the page can't be patched.
+    wig->loading = TRUE;
+    webkit_web_view_load_html(wig->web_view, html, NULL);
 }
 
-static void wiggy_close(GttGhtml *pl, gpointer ud)
+static void wiggy_take(GttGhtml *pl, char *str, size_t len, gpointer ud)
 {
     Wiggy *wig = (Wiggy *) ud;
 
-    // Finish the string and load it up into the web view.
-    gchar *str = g_string_free(wig->html_content, FALSE);
-    wig->html_content = NULL;
-
-    webkit_web_view_load_html(wig->web_view, str, NULL);
-
-    g_free(str);
-}
-
-static void wiggy_write(GttGhtml *pl, const char *str, size_t len, gpointer ud)
-{
-    Wiggy *wig = (Wiggy *) ud;
+    // ghtml hands over the finished page; load it up into the web view.
+    wiggy_load(wig, str);
 
-    // Append to the HTML content buffer.
-    g_string_append_len(wig->html_content, str, len);
+    // Keep it, in case the same report is asked for again.
+    gtt_report_cache_add(wig->cache_key, str, len);
+    wig->cache_key = NULL;
 }
 
 static void wiggy_error(GttGhtml *pl, int err, const char *msg, gpointer ud)
@@ -146,11 +136,17 @@ static void wiggy_error(GttGhtml *pl, int err, const char *msg, gpointer ud)
         g_string_append(stream, "</h1></body></html>");
     }
 
-    webkit_web_view_load_html(wig->web_view, stream->str, NULL);
+    wiggy_load(wig, stream->str);
 
     g_string_free(stream, TRUE);
 }
 
+static void wiggy_set_stream(Wiggy *wig)
+{
+    gtt_ghtml_set_stream(wig->gh, wig, NULL, NULL, NULL, wiggy_error);
+    gtt_ghtml_set_take_stream(wig->gh, wiggy_take);
+}
+
 /* ============================================================== */
 /* Routine that take html and mash it into a file. */
 
@@ -241,7 +237,7 @@ static void save_to_gio(Wiggy *wig, const char *filename)
         g_clear_object(&wig->ofile);
 
         /* Reset the html out handlers back to the browser */
-        gtt_ghtml_set_stream(wig->gh, wig, wiggy_open, wiggy_write, wiggy_close, wiggy_error);
+        wiggy_set_stream(wig);
     }
 }
 
@@ -284,11 +280,123 @@ static void save_to_file(Wiggy *wig, const char *uri)
 /* ============================================================== */
 /* engine callbacks */
 
+/* Shows the report, from the report cache if it is there */
+static void wiggy_display(Wiggy *wig, gboolean use_cache)
+{
+    const char *html;
+
+    g_free(wig->cache_key);
+    wig->cache_key =
+        gtt_report_cache_key(wig->filepath, wig->prj, wig->gh->kvp, wig->gh->did_query);
+
+    html = use_cache ? gtt_report_cache_lookup(wig->cache_key) : NULL;
+    if (html)
+    {
+        wiggy_load(wig, html);
+        return;
+    }
+
+    gtt_ghtml_display(wig->gh, wig->filepath, wig->prj);
+}
+
+/* Swaps what is between the markers of a fragment of the page for
+ * the new html.  Gives up if the markers can't be found, or if they
+ * don't hold a whole piece of the page between them. */
+static const char *patch_script =
+    "function gttPatch(id, html) {"
+    "  var it = document.createNodeIterator(document, NodeFilter.SHOW_COMMENT);"
+    "  var begin = null, end = null, n;"
+    "  while ((n = it.nextNode())) {"
+    "    if (n.data == 'gtt-fragment ' + id) begin = n;"
+    "    else if (n.data == '/gtt-fragment ' + id) { end = n; break; }"
+    "  }"
+    "  if (!begin || !end || (begin.parentNode != end.parentNode)) return false;"
+    "  var range = document.createRange();"
+    "  range.setStartBefore(begin);"
+    "  range.setEndAfter(end);"
+    "  var frag = range.createContextualFragment(html);"
+    "  range.deleteContents();"
+    "  range.insertNode(frag);"
+    "  return true;"
+    "}";
+
+static void wiggy_patch_piece(GttGhtml *pl, int id, const char *str, size_t len, gpointer ud)
+{
+    GString *js = (GString *) ud;
+    size_t i;
+
+    g_string_append_printf(js, "gttPatch(%d, \"", id);
+    for (i = 0; i < len; i++)
+    {
+        unsigned char c = str[i];
+        if (('"' == c) || ('\\' == c))
+        {
+            g_string_append_c(js, '\\');
+            g_string_append_c(js, c);
+        }
+        else if (0x20 > c)
+            g_string_append_printf(js, "\\u%04x", c);
+        else
+            g_string_append_c(js, c);
+    }
+    g_string_append(js, "\") && ");
+}
+
+static void wiggy_patch_done(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Wiggy *wig = (Wiggy *) data;
+    WebKitJavascriptResult *js_result;
+    gboolean ok;
+
+    /* An error means the window went away; nothing to do then */
+    js_result = webkit_web_view_run_javascript_finish(WEBKIT_WEB_VIEW(obj), res, NULL);
+    if (!js_result)
+        return;
+    ok = jsc_value_to_boolean(webkit_javascript_result_get_js_value(js_result));
+    webkit_javascript_result_unref(js_result);
+
+    if (!ok)
+        wiggy_display(wig, TRUE);
+}
+
+/* Renders again just the parts of the page that show the tasks, and
+ * patches them into the page.  Returns FALSE if that can't be done. */
+static gboolean wiggy_patch(Wiggy *wig, GList *tasks)
+{
+    GString *js;
+
+    if (wig->loading)
+        return FALSE;
+
+    /* Nothing to patch in, as long as the page as a whole still holds */
+    if (!tasks)
+        return gtt_ghtml_patch(wig->gh, NULL, wiggy_patch_piece, NULL);
+
+    js = g_string_new("(function() {");
+    g_string_append(js, patch_script);
+    g_string_append(js, "return ");
+    if (!gtt_ghtml_patch(wig->gh, tasks, wiggy_patch_piece, js))
+    {
+        g_string_free(js, TRUE);
+        return FALSE;
+    }
+    g_string_append(js, "true; })()");
+
+    webkit_web_view_run_javascript(wig->web_view, js->str, NULL, wiggy_patch_done, wig);
+    g_string_free(js, TRUE);
+    return TRUE;
+}
+
 static void redraw(GttProject *prj, gpointer data)
 {
     Wiggy *wig = (Wiggy *) data;
+    GList *tasks;
 
-    gtt_ghtml_display(wig->gh, wig->filepath, wig->prj);
+    /* When only some tasks changed, only they need showing again */
+    if (gtt_project_get_changed_tasks(prj, &tasks) && wiggy_patch(wig, tasks))
+        return;
+
+    wiggy_display(wig, TRUE);
 }
 
 /* ============================================================== */
@@ -733,12 +841,29 @@ static void on_close_clicked_cb(GtkWidget *w, gpointer data)
 
 static void destroy_cb(GtkWidget *ob, gpointer data)
 {
+    Wiggy *wig = (Wiggy *) data;
+
+    if (wig->prj)
+        gtt_project_remove_notifier(wig->prj, redraw, wig);
+
+    g_free(wig->cache_key);
+    wig->cache_key = NULL;
+}
+
+static void load_changed_cb(WebKitWebView *web_view, WebKitLoadEvent load_event, gpointer data)
+{
+    Wiggy *wig = (Wiggy *) data;
+
+    if (WEBKIT_LOAD_FINISHED == load_event)
+        wig->loading = FALSE;
 }
 
 static void on_refresh_clicked_cb(GtkWidget *w, gpointer data)
 {
     Wiggy *wig = (Wiggy *) data;
-    redraw(wig->prj, data);
+
+    /* Asked for outright, so render it anew */
+    wiggy_display(wig, FALSE);
 }
 
 /* ============================================================== */
@@ -772,21 +897,24 @@ static gboolean decide_policy_cb(
 
         Wiggy *const wig = (Wiggy *) user_data;
         gpointer addr = NULL;
-        char *str;
+        char *str, *end = NULL;
 
         /* h4x0r al3rt -- bare-naked pointer refernces ! */
         /* decode the address buried in the URL (if its there) */
         str = strstr(url, "0x");
         if (str)
         {
-            addr = (gpointer) strtoul(str, NULL, 16);
+            addr = (gpointer) strtoul(str, &end, 16);
         }
 
         if (0 == strncmp(url, "gtt:interval", 12))
         {
-            wig->interval = addr;
+            /* Intervals are named by their task and start time */
+            wig->interval = NULL;
+            if (addr && end && (':' == *end))
+                wig->interval = gtt_task_find_interval(addr, strtol(end + 1, NULL, 10));
             wig->task = NULL;
-            if (addr)
+            if (wig->interval)
                 interval_popup_cb(wig);
         }
         else if (0 == strncmp(url, "gtt:task", 8))
@@ -1341,7 +1469,7 @@ static void do_show_report(
     gtk_container_add(GTK_CONTAINER(jnl_viewport), GTK_WIDGET(wig->web_view));
 
     wig->gh = gtt_ghtml_new();
-    gtt_ghtml_set_stream(wig->gh, wig, wiggy_open, wiggy_write, wiggy_close, wiggy_error);
+    wiggy_set_stream(wig);
 
     /* ---------------------------------------------------- */
     /* Signals for the browser, and the Journal window */
@@ -1379,6 +1507,8 @@ static void do_show_report(
 
     g_signal_connect(G_OBJECT(wig->web_view), "context-menu", G_CALLBACK(context_menu_cb), wig);
 
+    g_signal_connect(G_OBJECT(wig->web_view), "load-changed", G_CALLBACK(load_changed_cb), wig);
+
     g_signal_connect(
         G_OBJECT(wig->web_view), "focus_out_event", G_CALLBACK(hover_loose_focus), wig
     );
@@ -1441,7 +1571,7 @@ static void do_show_report(
     /* XXX should add notifiers for prjlist too ?? Yes we should */
     if (prj)
         gtt_project_add_notifier(prj, redraw, wig);
-    gtt_ghtml_display(wig->gh, report, prj);
+    wiggy_display(wig, TRUE);
 
     /* Can only set editable *after* there's content in the window */
     // gtk_html_set_editable (wig->html, TRUE);
@@ -38,7 +38,11 @@
 #include <qof.h>
 
 #include "app.h"
+#include "archive.h"
+#include "backup-store.h"
+#include "bin-snapshot.h"
 #include "cur-proj.h"
+#include "data-journal.h"
 #include "err-throw.h"
 #include "file-io.h"
 #include "gtt.h"
@@ -49,6 +53,7 @@
 #include "proj.h"
 #include "timer.h"
 #include "toolbar.h"
+#include "util.h"
 #include "xml-gtt.h"
 
 #if WITH_DBUS
@@ -59,6 +64,24 @@ char *first_proj_title = NULL; /* command line over-ride */
 
 static gboolean first_time_ever = FALSE; /* has gtt ever run before? */
 
+/* The data file is written with the save lock held, so that an
+ * autosave running in the background and a save or a read in the
+ * main thread never get in each other's way. */
+static GMutex save_lock;
+static gboolean autosave_running = FALSE;
+
+/* The data version last written to the file, under the save lock.
+ * The autosave takes its snapshot before it gets the lock, so a
+ * save in the main thread may get there first with newer data;
+ * the older snapshot must not be written over it then. */
+static guint written_version = 0;
+
+/* Without a journal, and when the only change is the timer moving
+ * the running interval along, the autosave writes the file this
+ * often, instead of on every round. */
+#define TICK_SAVE_PERIOD (5 * 60)
+static time_t last_save_time = 0;
+
 GttProjectList *master_list = NULL;
 
 const char *gtt_gettext(const char *s)
@@ -289,7 +312,7 @@ static gboolean backups_exist(const char *xml_filepath)
     gboolean result = FALSE;
 
     const gchar *file_name = NULL;
-    while ((file_name = g_dir_read_name(data_dir)) != NULL)
+    while (data_dir && (file_name = g_dir_read_name(data_dir)) != NULL)
     {
         if (strcmp(data_file_name, file_name) != 0)
         {
@@ -300,17 +323,107 @@ static gboolean backups_exist(const char *xml_filepath)
 
     g_object_unref(data_file);
     g_object_unref(data_dir_file);
-    g_object_unref(data_dir);
+    if (data_dir)
+        g_dir_close(data_dir);
     g_free(data_dir_path);
     g_free(data_file_name);
     return result;
 }
 
+static void backup_version_activated(
+    GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *col, gpointer dialog
+)
+{
+    gtk_dialog_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+}
+
+/* Let the user pick one of the versions in the backup store.  This
+ * returns GTK_RESPONSE_ACCEPT, with the id of the version picked, or
+ * GTK_RESPONSE_REJECT to pick a backup file by hand instead. */
+static gint choose_backup_version(GArray *versions, gint64 *id)
+{
+    enum
+    {
+        COL_SAVED,
+        COL_SIZE,
+        COL_ID,
+        N_COLS
+    };
+    GtkListStore *store;
+    GtkTreeSelection *selection;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    GtkWidget *dialog, *scroll, *view;
+    char date[100];
+    char *size;
+    gint response;
+    guint i;
+
+    store = gtk_list_store_new(N_COLS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT64);
+    for (i = 0; i < versions->len; i++)
+    {
+        GttBackupVersion *v = &g_array_index(versions, GttBackupVersion, i);
+
+        xxxqof_print_date_time_buff(date, sizeof(date), v->time);
+        size = g_format_size(v->size);
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter, COL_SAVED, date, COL_SIZE, size, COL_ID, v->id, -1);
+        g_free(size);
+    }
+
+    dialog = gtk_dialog_new_with_buttons(
+        _("Choose a backup"), NULL, GTK_DIALOG_MODAL, _("Other file..."), GTK_RESPONSE_REJECT,
+        GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL, _("Restore"), GTK_RESPONSE_ACCEPT, NULL
+    );
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 400, 300);
+
+    view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+    g_object_unref(store);
+    gtk_tree_view_insert_column_with_attributes(
+        GTK_TREE_VIEW(view), -1, _("Saved"), gtk_cell_renderer_text_new(), "text", COL_SAVED,
+        NULL
+    );
+    gtk_tree_view_insert_column_with_attributes(
+        GTK_TREE_VIEW(view), -1, _("Size"), gtk_cell_renderer_text_new(), "text", COL_SIZE,
+        NULL
+    );
+    g_signal_connect(view, "row-activated", G_CALLBACK(backup_version_activated), dialog);
+
+    /* The newest version is picked, unless the user says otherwise */
+    selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(view));
+    gtk_tree_selection_set_mode(selection, GTK_SELECTION_BROWSE);
+    if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(store), &iter))
+        gtk_tree_selection_select_iter(selection, &iter);
+
+    scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(
+        GTK_SCROLLED_WINDOW(scroll), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC
+    );
+    gtk_container_add(GTK_CONTAINER(scroll), view);
+    gtk_box_pack_start(
+        GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), scroll, TRUE, TRUE, 0
+    );
+    gtk_widget_show_all(dialog);
+
+    response = gtk_dialog_run(GTK_DIALOG(dialog));
+    if (GTK_RESPONSE_ACCEPT == response)
+    {
+        if (gtk_tree_selection_get_selected(selection, &model, &iter))
+            gtk_tree_model_get(model, &iter, COL_ID, id, -1);
+        else
+            response = GTK_RESPONSE_CANCEL;
+    }
+    gtk_widget_destroy(dialog);
+    return response;
+}
+
 static gboolean try_restoring_backup(char *xml_filepath)
 {
 
     GtkWidget *mb;
-    gboolean have_backups = backups_exist(xml_filepath);
+    GArray *versions = gtt_backup_store_list(xml_filepath);
+    gboolean have_backups = versions->len || backups_exist(xml_filepath);
 
     gchar *qmsg = g_strdup_printf(
         "It was not possible to load the data file \"%s\". What do you want to do?",
@@ -336,9 +449,41 @@ static gboolean try_restoring_backup(char *xml_filepath)
     GFile *backup_file = NULL;
     GError *error = NULL;
     gboolean copy_success = FALSE;
+    gint64 version;
+
+    /* Versions in the backup store come first; older backups may
+     * still be around as files, and can be picked by hand. */
+    if ((GTK_RESPONSE_NO == response) && versions->len)
+    {
+        response = choose_backup_version(versions, &version);
+        if (GTK_RESPONSE_ACCEPT == response)
+        {
+            if (!gtt_backup_store_restore(xml_filepath, version))
+            {
+                mb = gtk_message_dialog_new(
+                    NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                    _("Could not restore the backup.")
+                );
+                gtk_dialog_run(GTK_DIALOG(mb));
+                gtk_widget_destroy(mb);
+            }
+            else
+            {
+                /* The journal's changes were made on top of the file
+                 * that failed to load, not on top of the backup */
+                gtt_data_journal_set_aside(xml_filepath);
+            }
+            g_array_free(versions, TRUE);
+            return TRUE;
+        }
+        response = (GTK_RESPONSE_REJECT == response) ? GTK_RESPONSE_NO : GTK_RESPONSE_CANCEL;
+    }
+    g_array_free(versions, TRUE);
+
     switch (response)
     {
     case GTK_RESPONSE_YES:
+        gtt_data_journal_set_aside(xml_filepath);
         return FALSE;
 
     case GTK_RESPONSE_NO:
@@ -351,6 +496,7 @@ static gboolean try_restoring_backup(char *xml_filepath)
             );
             if (copy_success)
             {
+                gtt_data_journal_set_aside(xml_filepath);
                 return TRUE;
             }
             else
@@ -383,11 +529,24 @@ static gboolean read_data_file(char *xml_filepath, GError **error)
 
     /* Try ... */
     gtt_err_set_code(GTT_NO_ERR);
-    gtt_xml_read_file(xml_filepath);
+    g_mutex_lock(&save_lock);
+    if (!gtt_bin_snapshot_read_file(xml_filepath))
+        gtt_xml_read_file(xml_filepath);
+    g_mutex_unlock(&save_lock);
 
     /* Catch ... */
     xml_errcode = gtt_err_get_code();
 
+    /* What was just read needs no saving; what the journal adds
+     * on top of it does, eventually. */
+    if (GTT_NO_ERR == xml_errcode)
+    {
+        gtt_project_list_mark_saved(gtt_project_list_get_version());
+        last_save_time = time(0);
+        gtt_archive_open(xml_filepath);
+        gtt_data_journal_replay(xml_filepath);
+    }
+
     read_is_ok = (GTT_NO_ERR == xml_errcode);
 
     /* If the xml file read bombed because the file doesn't exist,
@@ -414,6 +573,7 @@ static gboolean read_data_file(char *xml_filepath, GError **error)
 
     if (read_is_ok)
     {
+        gtt_data_journal_open(xml_filepath);
         post_read_data();
         return TRUE;
     }
@@ -427,11 +587,28 @@ static gboolean read_data_file(char *xml_filepath, GError **error)
     return FALSE;
 }
 
+/* Append the latest changes to the journal, once the main loop
+ * is idle.  If they're more than the journal can take, write out
+ * the whole data file. */
+static gboolean flush_journal(gpointer data)
+{
+    if (gtt_data_journal_flush())
+        save_projects_in_background();
+    return FALSE;
+}
+
+static void journal_changed(void)
+{
+    g_idle_add(flush_journal, NULL);
+}
+
 void read_data(gboolean reloading)
 {
     char *xml_filepath;
     GError *error = NULL;
 
+    gtt_project_list_set_change_hook(journal_changed);
+
     if (reloading)
     {
         notes_area_set_project(global_na, NULL);
@@ -536,6 +713,13 @@ static void beta_run_or_abort(GtkWidget *w, gint butnum)
  * as to which copies it keeps, and which it discards; fiddling with
  * the algo will result in the tail end copies being whacked incorrectly.
  * It took me some work to get this right.
+ *
+ * The copies are made by renaming, so each keeps the compression
+ * that the data file was saved with (see file-compress.h), and can
+ * be restored by copying it back as it is.
+ *
+ * This is only used when the backup store is turned off; see
+ * backup-store.h.
  */
 static void make_backup(const char *filename)
 {
@@ -601,6 +785,60 @@ static void make_backup(const char *filename)
     g_free(new_name);
 }
 
+/* Write the snapshot of the indicated data version out to the data
+ * file.  This may run in a worker thread, and so must not touch
+ * anything but its arguments and what the save lock guards. */
+static GttErrCode write_projects(GttXmlSnapshot *snap, guint version, const char *xml_filepath)
+{
+    GttErrCode errcode;
+
+    g_mutex_lock(&save_lock);
+
+    /* Newer data is already in the file */
+    if (version < written_version)
+    {
+        g_mutex_unlock(&save_lock);
+        return GTT_NO_ERR;
+    }
+
+    if (0 >= config_backup_versions)
+        make_backup(xml_filepath);
+
+    /* The archives go first, so that the intervals moved out of
+     * the data file are never lost. */
+    errcode = gtt_archive_write(snap, xml_filepath);
+    if (GTT_NO_ERR == errcode)
+        errcode = gtt_xml_snapshot_write(snap, xml_filepath);
+
+    /* Try to handle a bizzare missing-directory error
+     * by creating the directory, and trying again. */
+    if (GTT_CANT_OPEN_FILE == errcode)
+    {
+        create_data_dir(xml_filepath);
+        errcode = gtt_archive_write(snap, xml_filepath);
+        if (GTT_NO_ERR == errcode)
+            errcode = gtt_xml_snapshot_write(snap, xml_filepath);
+    }
+
+    if (GTT_NO_ERR == errcode)
+        gtt_archive_finish(snap, xml_filepath);
+
+    /* The binary copy is only there to speed up the next start;
+     * if it can't be written, the xml file is read instead. */
+    if (GTT_NO_ERR == errcode)
+        gtt_bin_snapshot_write(snap, xml_filepath);
+
+    /* Likewise, a failed backup doesn't make the save fail */
+    if ((GTT_NO_ERR == errcode) && (0 < config_backup_versions))
+        gtt_backup_store_add(xml_filepath);
+
+    if (GTT_NO_ERR == errcode)
+        written_version = version;
+    g_mutex_unlock(&save_lock);
+
+    return errcode;
+}
+
 /* save_all() saves both data and config file, and does this
  * without involving the GUI.
  * It is a bit sloppy, in that if we get two errors in a row,
@@ -609,23 +847,33 @@ static void make_backup(const char *filename)
 
 char *save_all(void)
 {
+    GttXmlSnapshot *snap;
     GttErrCode errcode;
     char *errmsg = NULL;
     char *xml_filepath;
+    guint version, serial;
 
     xml_filepath = resolve_path(config_data_url);
 
-    make_backup(xml_filepath);
-
     /* Try ... */
-    gtt_err_set_code(GTT_NO_ERR);
-    gtt_xml_write_file(xml_filepath);
-
-    /* Catch */
-    errcode = gtt_err_get_code();
-    if (GTT_NO_ERR != errcode)
+    if (GTT_SAVE_CLEAN != gtt_project_list_get_save_state())
     {
-        errmsg = gtt_err_to_string(errcode, xml_filepath);
+        version = gtt_project_list_get_version();
+        serial = gtt_data_journal_rotate();
+        snap = gtt_archive_snapshot_new(gtt_project_list_get_list(master_list));
+        errcode = write_projects(snap, version, xml_filepath);
+        gtt_xml_snapshot_free(snap);
+        gtt_data_journal_compacted(serial, GTT_NO_ERR == errcode);
+
+        /* Catch */
+        if (GTT_NO_ERR != errcode)
+        {
+            errmsg = gtt_err_to_string(errcode, xml_filepath);
+        }
+        else
+        {
+            gtt_project_list_mark_saved(version);
+        }
     }
     g_free(xml_filepath);
 
@@ -669,48 +917,136 @@ void save_properties(void)
     }
 }
 
+static void report_save_error(GttErrCode errcode, const char *xml_filepath)
+{
+    char *errmsg = gtt_err_to_string(errcode, xml_filepath);
+
+    GtkWidget *mb;
+    mb = gtk_message_dialog_new(
+        NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_CLOSE, "%s", errmsg
+    );
+    g_signal_connect(G_OBJECT(mb), "response", G_CALLBACK(gtk_widget_destroy), mb);
+    gtk_widget_show(mb);
+    g_free(errmsg);
+}
+
 /* Save project data, use GUI to indicate problem */
 
 void save_projects(void)
 {
+    GttXmlSnapshot *snap;
     GttErrCode errcode;
     char *xml_filepath;
+    guint version, serial;
+
+    /* Nothing changed since the last save */
+    if (GTT_SAVE_CLEAN == gtt_project_list_get_save_state())
+        return;
 
     /* Try ... */
     xml_filepath = resolve_path(config_data_url);
-    make_backup(xml_filepath);
-
-    gtt_err_set_code(GTT_NO_ERR);
-    gtt_xml_write_file(xml_filepath);
-
-    /* Try to handle a bizzare missing-directory error
-     * by creating the directory, and trying again. */
-    errcode = gtt_err_get_code();
-    if (GTT_CANT_OPEN_FILE == errcode)
-    {
-        create_data_dir(xml_filepath);
-        gtt_err_set_code(GTT_NO_ERR);
-        gtt_xml_write_file(xml_filepath);
-    }
+    version = gtt_project_list_get_version();
+    serial = gtt_data_journal_rotate();
+    snap = gtt_archive_snapshot_new(gtt_project_list_get_list(master_list));
+    errcode = write_projects(snap, version, xml_filepath);
+    gtt_xml_snapshot_free(snap);
+    gtt_data_journal_compacted(serial, GTT_NO_ERR == errcode);
 
     /* Catch */
-    errcode = gtt_err_get_code();
+    gtt_err_set_code(errcode);
     if (GTT_NO_ERR != errcode)
     {
-        char *errmsg = gtt_err_to_string(errcode, xml_filepath);
-
-        GtkWidget *mb;
-        mb = gtk_message_dialog_new(
-            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_CLOSE, "%s", errmsg
-        );
-        g_signal_connect(G_OBJECT(mb), "response", G_CALLBACK(gtk_widget_destroy), mb);
-        gtk_widget_show(mb);
-        g_free(errmsg);
+        report_save_error(errcode, xml_filepath);
+    }
+    else
+    {
+        gtt_project_list_mark_saved(version);
+        last_save_time = time(0);
     }
 
     g_free(xml_filepath);
 }
 
+typedef struct save_job_s
+{
+    GttXmlSnapshot *snap;
+    guint version; /* the data version in the snapshot */
+    guint serial;  /* the journal rotation for the snapshot */
+    char *xml_filepath;
+    GttErrCode errcode;
+} SaveJob;
+
+/* Back in the main thread, once the worker is done */
+static gboolean save_in_background_done(gpointer data)
+{
+    SaveJob *job = data;
+
+    gtt_xml_snapshot_free(job->snap);
+    gtt_data_journal_compacted(job->serial, GTT_NO_ERR == job->errcode);
+    gtt_err_set_code(job->errcode);
+    if (GTT_NO_ERR != job->errcode)
+    {
+        report_save_error(job->errcode, job->xml_filepath);
+    }
+    else
+    {
+        gtt_project_list_mark_saved(job->version);
+        last_save_time = time(0);
+    }
+
+    g_free(job->xml_filepath);
+    g_free(job);
+    autosave_running = FALSE;
+    return FALSE;
+}
+
+static gpointer save_in_background_thread(gpointer data)
+{
+    SaveJob *job = data;
+
+    job->errcode = write_projects(job->snap, job->version, job->xml_filepath);
+    g_idle_add(save_in_background_done, job);
+    return NULL;
+}
+
+void save_projects_in_background(void)
+{
+    SaveJob *job;
+
+    /* If the last one hasn't finished yet, this one can wait
+     * for the next time around. */
+    if (autosave_running)
+        return;
+
+    /* As long as the changes are safe in the journal,
+     * the data file can wait. */
+    gtt_data_journal_flush();
+    if (!gtt_data_journal_wants_compaction())
+        return;
+
+    switch (gtt_project_list_get_save_state())
+    {
+    case GTT_SAVE_CLEAN:
+        return;
+    case GTT_SAVE_TICKED:
+        /* Don't rewrite the whole file just because the clock
+         * moved; once in a while is enough. */
+        if (time(0) < last_save_time + TICK_SAVE_PERIOD)
+            return;
+        break;
+    case GTT_SAVE_DIRTY:
+        break;
+    }
+    autosave_running = TRUE;
+
+    job = g_new0(SaveJob, 1);
+    job->version = gtt_project_list_get_version();
+    job->serial = gtt_data_journal_rotate();
+    job->xml_filepath = resolve_path(config_data_url);
+    job->snap = gtt_archive_snapshot_new(gtt_project_list_get_list(master_list));
+    g_thread_unref(g_thread_new("gnotime-autosave", save_in_background_thread, job));
+}
+
 /*
  * session management
  */
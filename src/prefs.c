@@ -26,8 +26,10 @@
 #include "app.h"
 #include "cur-proj.h"
 #include "dialog.h"
+#include "file-compress.h"
 #include "gtt.h"
 #include "prefs.h"
+#include "report-cache.h"
 #include "timer.h"
 #include "toolbar.h"
 #include "util.h"
@@ -81,6 +83,11 @@ int config_time_format = TIME_FORMAT_LOCALE;
 char *config_currency_symbol = NULL;
 int config_currency_use_locale = 1;
 
+int config_data_compression = GTT_COMPRESS_NONE;
+int config_archive_years = 0;
+int config_backup_versions = 50;
+int config_backup_days = 90;
+
 char *config_data_url = NULL;
 
 typedef struct _PrefsDialog
@@ -140,6 +147,10 @@ typedef struct _PrefsDialog
     GtkEntry *daystart_secs;
     GtkComboBox *daystart_menu;
     GtkComboBox *weekstart_menu;
+    GtkComboBox *compression_menu;
+    GtkEntry *archive_years;
+    GtkEntry *backup_versions;
+    GtkEntry *backup_days;
 
     GtkRadioButton *time_format_am_pm;
     GtkRadioButton *time_format_24_hs;
@@ -332,9 +343,18 @@ static void toolbar_sensitive_cb(GtkWidget *w, PrefsDialog *odlg)
 
 /* ============================================================== */
 
+/* The data file is to be rewritten, with a new compression method,
+ * or with a new archive cutoff */
+static gboolean rewrite_data = FALSE;
+
 static gboolean save_on_idle_cb()
 {
     save_properties();
+    if (rewrite_data)
+    {
+        rewrite_data = FALSE;
+        save_projects();
+    }
 
     // Return FALSE for call-once semantics.
     return FALSE;
@@ -517,6 +537,28 @@ static void prefs_set(PrefsDialog *odlg)
         int day = gtk_combo_box_get_active(odlg->weekstart_menu);
         SET_VAL(config_weekstart_offset, day);
 
+        /* Rewrite the data file the new way right away, rather than
+         * leaving it the old way until the next edit */
+        int method = gtk_combo_box_get_active(odlg->compression_menu);
+        if (gtt_file_compress_available(method) && (config_data_compression != method))
+        {
+            config_data_compression = method;
+            gtt_project_list_mark_dirty();
+            rewrite_data = TRUE;
+        }
+
+        /* Likewise, move intervals into or out of the archives now */
+        int years = MAX(0, atoi(gtk_entry_get_text(odlg->archive_years)));
+        if (config_archive_years != years)
+        {
+            config_archive_years = years;
+            gtt_project_list_mark_dirty();
+            rewrite_data = TRUE;
+        }
+
+        config_backup_versions = MAX(0, atoi(gtk_entry_get_text(odlg->backup_versions)));
+        config_backup_days = MAX(0, atoi(gtk_entry_get_text(odlg->backup_days)));
+
         if (change)
         {
             /* Need to recompute everything, including the bining */
@@ -547,6 +589,9 @@ static void prefs_set(PrefsDialog *odlg)
         }
     }
 
+    // The reports show times and money the way the preferences say.
+    gtt_report_cache_clear();
+
     // Schedule a save-to-file to be called from the main loop promptly.
     // Doing it this way instead of a direct call gives Gtk a chance to
     // first react to any changes, e.g. recalculate columns widths.
@@ -692,6 +737,18 @@ static void options_dialog_set(PrefsDialog *odlg)
     int day = config_weekstart_offset;
     gtk_combo_box_set_active(odlg->weekstart_menu, day);
 
+    /* The menu items are in the same order as GttCompression */
+    gtk_combo_box_set_active(odlg->compression_menu, config_data_compression);
+
+    g_snprintf(s, sizeof(s), "%d", config_archive_years);
+    gtk_entry_set_text(odlg->archive_years, s);
+
+    g_snprintf(s, sizeof(s), "%d", config_backup_versions);
+    gtk_entry_set_text(odlg->backup_versions, s);
+
+    g_snprintf(s, sizeof(s), "%d", config_backup_days);
+    gtk_entry_set_text(odlg->backup_days, s);
+
     switch (config_time_format)
     {
     case TIME_FORMAT_AM_PM:
@@ -912,6 +969,28 @@ static void misc_options(PrefsDialog *dlg)
 
     w = GETWID("weekstart combobox");
     dlg->weekstart_menu = GTK_COMBO_BOX(w);
+
+    w = GETWID("compression combobox");
+    dlg->compression_menu = GTK_COMBO_BOX(w);
+
+    /* Grey out zstd, if this build can't write it */
+    if (!gtt_file_compress_available(GTT_COMPRESS_ZSTD))
+    {
+        GtkTreeModel *model = gtk_combo_box_get_model(dlg->compression_menu);
+        GtkTreeIter iter;
+
+        if (gtk_tree_model_iter_nth_child(model, &iter, NULL, GTT_COMPRESS_ZSTD))
+            gtk_list_store_set(GTK_LIST_STORE(model), &iter, 1, FALSE, -1);
+    }
+
+    w = GETWID("archive years entry");
+    dlg->archive_years = GTK_ENTRY(w);
+
+    w = GETWID("backup versions entry");
+    dlg->backup_versions = GTK_ENTRY(w);
+
+    w = GETWID("backup days entry");
+    dlg->backup_days = GTK_ENTRY(w);
 }
 
 static void time_format_options(PrefsDialog *dlg)
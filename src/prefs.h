@@ -69,6 +69,12 @@ extern int config_time_format;
 
 extern char *config_currency_symbol;
 extern int config_currency_use_locale;
+
+extern int config_data_compression;
+extern int config_archive_years;
+extern int config_backup_versions;
+extern int config_backup_days;
+
 #define TIME_FORMAT_AM_PM 1
 #define TIME_FORMAT_24_HS 2
 #define TIME_FORMAT_LOCALE 3
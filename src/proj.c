@@ -27,12 +27,14 @@
 
 #include <qof.h>
 
+#include "calendar.h"
 #include "err-throw.h"
 #include "log.h"
 #include "prefs.h" /* XXX tmp hack for config_* */
 #include "proj.h"
 #include "proj_p.h"
 #include "query.h" /* temp hack for query */
+#include "string-pool.h"
 
 #define _(X) gettext(X)
 
@@ -52,15 +54,300 @@ GttProjectList *global_plist = NULL;
 
 QofBook *global_book = NULL;
 
+/* Lookup tables, so that finding a project by its id, or a project
+ * or task by its GUID, doesn't take a walk over the whole tree.
+ * Every live project and task is entered here when it is created,
+ * and removed when it is destroyed. */
+static GHashTable *project_id_table = NULL;
+static GHashTable *project_guid_table = NULL;
+static GHashTable *task_guid_table = NULL;
+
+static void lookup_tables_init(void)
+{
+    if (project_id_table)
+        return;
+    project_id_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    project_guid_table = g_hash_table_new(guid_hash_to_guint, guid_g_hash_table_equal);
+    task_guid_table = g_hash_table_new(guid_hash_to_guint, guid_g_hash_table_equal);
+}
+
+/* Remove the entry for key, but only if it points at this object;
+ * a duplicate id may have taken over the slot. */
+static void lookup_table_remove(GHashTable *table, gconstpointer key, gpointer obj)
+{
+    if (table && (obj == g_hash_table_lookup(table, key)))
+        g_hash_table_remove(table, key);
+}
+
+/* Projects changed during a bulk load, to be fixed up at commit */
+static int bulk_load_depth = 0;
+static GList *bulk_touched = NULL;
+
+static void proj_bulk_touch(GttProject *proj)
+{
+    if (proj->bulk_touched)
+        return;
+    proj->bulk_touched = TRUE;
+    bulk_touched = g_list_prepend(bulk_touched, proj);
+}
+
+/* Change counters, so that the save code can tell if there is
+ * anything to save.  Every change bumps data_version; the changes
+ * other than the ticking of a running timer also set edit_version.
+ * saved_version is the last data_version that was written out. */
+static guint data_version = 0;
+static guint edit_version = 0;
+static guint saved_version = 0;
+
+static inline void data_changed(void)
+{
+    edit_version = ++data_version;
+}
+
+/* The projects and tasks changed since the last call to
+ * gtt_project_list_take_changes(), for the data journal.  Changes
+ * made during a bulk load are not recorded; they came from a file. */
+static GList *changed_projects = NULL;
+static GList *changed_tasks = NULL;
+static gboolean changed_structure = FALSE;
+static gboolean changes_noted = FALSE;
+static GttChangeHook change_hook = NULL;
+
+/* Loads the archived intervals; see gtt_project_load_archive() */
+static GttArchiveHook archive_hook = NULL;
+
+/* Tasks that walks have made handles in; the handles that were not
+ * handed out for keeps are freed when the outermost walk ends. */
+static guint walk_depth = 0;
+static GHashTable *walk_tasks = NULL;
+
+static void note_change(void)
+{
+    if (changes_noted)
+        return;
+    changes_noted = TRUE;
+    if (change_hook)
+        (change_hook)();
+}
+
+/* Bumped by every change other than to the tasks, so that notifiers
+ * can tell when knowing which tasks changed is not enough; see
+ * gtt_project_get_changed_tasks(). */
+static guint layout_version = 0;
+
+/* The project's own fields changed */
+static void proj_changed(GttProject *proj)
+{
+    data_changed();
+    layout_version++;
+    if (bulk_load_depth || proj->journal_pending)
+        return;
+    proj->journal_pending = TRUE;
+    changed_projects = g_list_prepend(changed_projects, proj);
+    note_change();
+}
+
+/* The task's fields or intervals changed; how is GTT_SAVE_TICKED
+ * if only the stop time of the running interval moved. */
+static void task_changed(GttTask *tsk, GttSaveState how)
+{
+    GttProject *prj;
+
+    if (GTT_SAVE_TICKED == how)
+        data_version++;
+    else
+        data_changed();
+
+    /* Only projects that someone listens to need to keep track */
+    for (prj = tsk->parent; prj; prj = prj->parent)
+    {
+        if (prj->listeners && !g_list_find(prj->notify_tasks, tsk))
+            prj->notify_tasks = g_list_prepend(prj->notify_tasks, tsk);
+    }
+    if (bulk_load_depth || !tsk->parent || (tsk->journal_state >= how))
+        return;
+    if (GTT_SAVE_CLEAN == tsk->journal_state)
+        changed_tasks = g_list_prepend(changed_tasks, tsk);
+    tsk->journal_state = how;
+    note_change();
+}
+
+/* Projects or tasks were added, removed or moved around */
+static void structure_changed(void)
+{
+    data_changed();
+    layout_version++;
+    if (bulk_load_depth)
+        return;
+    changed_structure = TRUE;
+    note_change();
+}
+
 static void proj_refresh_time(GttProject *proj);
 static void proj_modified(GttProject *proj);
+static void proj_notify(GttProject *proj);
+static void proj_run_listeners(GttProject *proj);
 static int task_suspend(GttTask *tsk);
 static void gtt_interval_unhook(GttInterval *ivl);
+static void task_accum(GttTask *tsk, const GttIntervalRec *rec, int sign);
+static void proj_mark_all_dirty(GttProject *proj);
+static void proj_invalidate_totals(GttProject *proj);
+static void proj_invalidate_sums(GttProject *proj);
+static void time_index_free(GttTimeIndex *idx);
+static void proj_drop_own_index(GttProject *proj);
+static gboolean proj_move_stop(GttProject *proj, time_t start, time_t was, time_t now);
+
+/* ============================================================= */
+/* The intervals of a task live in an array of GttIntervalRec,
+ * sorted by start time, newest first.  Handles (GttInterval) are
+ * created only when someone outside asks for one, and are kept
+ * pointing at the right slot as records are inserted and removed.
+ */
+
+#define IVL_REC(tsk, i) (&g_array_index((tsk)->intervals, GttIntervalRec, (i)))
+
+static GttIntervalRec *ivl_rec(GttInterval *ivl)
+{
+    if (ivl->parent)
+        return IVL_REC(ivl->parent, ivl->idx);
+    return &ivl->rec;
+}
+
+/* Point the handles of the slots [from, to) back at their slots */
+static void task_fix_handles(GttTask *tsk, guint from, guint to)
+{
+    guint i;
+    for (i = from; (i < to) && (i < tsk->intervals->len); i++)
+    {
+        GttIntervalRec *rec = IVL_REC(tsk, i);
+        if (rec->handle)
+        {
+            rec->handle->parent = tsk;
+            rec->handle->idx = i;
+        }
+    }
+}
+
+/* Return the slot at which an interval with this start time belongs */
+static guint task_find_slot(GttTask *tsk, time_t start)
+{
+    guint lo = 0;
+    guint hi = tsk->intervals->len;
+
+    while (lo < hi)
+    {
+        guint mid = (lo + hi) / 2;
+        if (IVL_REC(tsk, mid)->start >= start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static guint task_ivl_insert_at(GttTask *tsk, guint idx, const GttIntervalRec *rec)
+{
+    task_accum(tsk, rec, 1);
+    g_array_insert_vals(tsk->intervals, idx, rec, 1);
+    task_fix_handles(tsk, idx, tsk->intervals->len);
+    return idx;
+}
+
+static guint task_ivl_insert(GttTask *tsk, const GttIntervalRec *rec)
+{
+    return task_ivl_insert_at(tsk, task_find_slot(tsk, rec->start), rec);
+}
+
+/* Remove the record from the array.  Its handle, if any, is freed. */
+static void task_ivl_remove(GttTask *tsk, guint idx)
+{
+    GttIntervalRec *rec = IVL_REC(tsk, idx);
+    task_accum(tsk, rec, -1);
+    if (rec->handle)
+        g_free(rec->handle);
+    g_array_remove_index(tsk->intervals, idx);
+    task_fix_handles(tsk, idx, tsk->intervals->len);
+}
+
+/* The start time of the record changed; move it to its proper slot */
+static guint task_ivl_resort(GttTask *tsk, guint idx)
+{
+    GttIntervalRec rec = *IVL_REC(tsk, idx);
+    guint slot;
+
+    g_array_remove_index(tsk->intervals, idx);
+    slot = task_find_slot(tsk, rec.start);
+    g_array_insert_vals(tsk->intervals, slot, &rec, 1);
+    task_fix_handles(tsk, MIN(idx, slot), MAX(idx, slot) + 1);
+    return slot;
+}
+
+static GttInterval *task_ivl_peek(GttTask *tsk, guint idx)
+{
+    GttIntervalRec *rec = IVL_REC(tsk, idx);
+    if (NULL == rec->handle)
+    {
+        rec->handle = g_new0(GttInterval, 1);
+        rec->handle->parent = tsk;
+        rec->handle->idx = idx;
+    }
+    return rec->handle;
+}
+
+static GttInterval *task_ivl_handle(GttTask *tsk, guint idx)
+{
+    GttInterval *ivl = task_ivl_peek(tsk, idx);
+    ivl->held = TRUE;
+    return ivl;
+}
+
+static void task_ivl_clear(GttTask *tsk)
+{
+    guint i;
+    for (i = 0; i < tsk->intervals->len; i++)
+    {
+        GttIntervalRec *rec = IVL_REC(tsk, i);
+        task_accum(tsk, rec, -1);
+        if (rec->handle)
+            g_free(rec->handle);
+    }
+    g_array_set_size(tsk->intervals, 0);
+}
+
+static gint ivl_rec_cmp(gconstpointer a, gconstpointer b)
+{
+    const GttIntervalRec *ra = a;
+    const GttIntervalRec *rb = b;
+    if (ra->start > rb->start)
+        return -1;
+    if (ra->start < rb->start)
+        return 1;
+    return 0;
+}
 
 /* ============================================================= */
 
 static int next_free_id = 1;
 
+/* Let go of a text that may point into a mapped file */
+static void drop_text(char **text, GBytes **source)
+{
+    if (*source)
+        g_bytes_unref(*source);
+    else
+        g_free(*text);
+    *text = NULL;
+    *source = NULL;
+}
+
+/* A text in a mapped file is shared, rather than copied */
+static void copy_text(char **text, GBytes **source, char *from, GBytes *from_source)
+{
+    drop_text(text, source);
+    *source = from_source ? g_bytes_ref(from_source) : NULL;
+    *text = from_source ? from : g_strdup(from);
+}
+
 GttProject *gtt_project_new(void)
 {
     GttProject *proj;
@@ -98,6 +385,8 @@ GttProject *gtt_project_new(void)
     proj->being_destroyed = FALSE;
     proj->frozen = FALSE;
     proj->dirty_time = FALSE;
+    proj->dirty_totals = TRUE;
+    proj->dirty_index = TRUE;
 
     proj->secs_ever = 0;
     proj->secs_day = 0;
@@ -111,6 +400,10 @@ GttProject *gtt_project_new(void)
     next_free_id++;
 
     qof_instance_init(&proj->inst, GTT_PROJECT_ID, global_book);
+
+    lookup_tables_init();
+    g_hash_table_insert(project_id_table, GINT_TO_POINTER(proj->id), proj);
+    g_hash_table_insert(project_guid_table, (gpointer) gtt_project_get_guid(proj), proj);
     return proj;
 }
 
@@ -142,12 +435,10 @@ GttProject *gtt_project_dup(GttProject *proj)
     p = gtt_project_new();
 
     g_free(p->title);
-    g_free(p->desc);
-    g_free(p->notes);
 
     p->title = g_strdup(proj->title);
-    p->desc = g_strdup(proj->desc);
-    p->notes = g_strdup(proj->notes);
+    copy_text(&p->desc, &p->desc_source, proj->desc, proj->desc_source);
+    copy_text(&p->notes, &p->notes_source, proj->notes, proj->notes_source);
     if (proj->custid)
         p->custid = g_strdup(proj->custid);
 
@@ -184,9 +475,12 @@ GttProject *gtt_project_dup(GttProject *proj)
 /* remove the project from any lists, etc. */
 void gtt_project_remove(GttProject *p)
 {
+    structure_changed();
+
     /* if we are in someone elses list, remove */
     if (p->parent)
     {
+        proj_invalidate_totals(p->parent);
         p->parent->sub_projects = g_list_remove(p->parent->sub_projects, p);
         p->parent = NULL;
     }
@@ -204,18 +498,19 @@ void gtt_project_destroy(GttProject *proj)
 
     proj->being_destroyed = TRUE;
     gtt_project_remove(proj);
+    lookup_table_remove(project_id_table, GINT_TO_POINTER(proj->id), proj);
+    lookup_table_remove(project_guid_table, gtt_project_get_guid(proj), proj);
+    if (proj->bulk_touched)
+        bulk_touched = g_list_remove(bulk_touched, proj);
+    if (proj->journal_pending)
+        changed_projects = g_list_remove(changed_projects, proj);
 
     if (proj->title)
         g_free(proj->title);
     proj->title = NULL;
 
-    if (proj->desc)
-        g_free(proj->desc);
-    proj->desc = NULL;
-
-    if (proj->notes)
-        g_free(proj->desc);
-    proj->notes = NULL;
+    drop_text(&proj->desc, &proj->desc_source);
+    drop_text(&proj->notes, &proj->notes_source);
 
     if (proj->custid)
         g_free(proj->custid);
@@ -252,14 +547,21 @@ void gtt_project_destroy(GttProject *proj)
         }
         if (proj->listeners)
             g_list_free(proj->listeners);
+        proj->listeners = NULL;
+        g_list_free(proj->notify_tasks);
+        proj->notify_tasks = NULL;
     }
     proj->private_data = NULL;
+    time_index_free(proj->own_index);
+    time_index_free(proj->tree_index);
     g_free(proj);
 }
 
 void gtt_project_set_guid(GttProject *prj, const GUID *guid)
 {
+    lookup_table_remove(project_guid_table, gtt_project_get_guid(prj), prj);
     qof_entity_set_guid(&prj->inst.entity, guid);
+    g_hash_table_insert(project_guid_table, (gpointer) gtt_project_get_guid(prj), prj);
 }
 
 const GUID *gtt_project_get_guid(GttProject *prj)
@@ -285,33 +587,51 @@ void gtt_project_set_title(GttProject *proj, const char *t)
     proj_modified(proj);
 }
 
+/* The new text is copied before the old one is let go of, in case
+ * it points into the old one's mapped file. */
 void gtt_project_set_desc(GttProject *proj, const char *d)
 {
+    char *str;
     if (!proj)
         return;
-    if (proj->desc)
-        g_free(proj->desc);
-    if (!d)
-    {
-        proj->desc = g_strdup("");
-        return;
-    }
-    proj->desc = g_strdup(d);
-    proj_modified(proj);
+    str = g_strdup(d ? d : "");
+    drop_text(&proj->desc, &proj->desc_source);
+    proj->desc = str;
+    if (d)
+        proj_modified(proj);
 }
 
 void gtt_project_set_notes(GttProject *proj, const char *d)
 {
+    char *str;
     if (!proj)
         return;
-    if (proj->notes)
-        g_free(proj->notes);
-    if (!d)
-    {
-        proj->notes = g_strdup("");
+    str = g_strdup(d ? d : "");
+    drop_text(&proj->notes, &proj->notes_source);
+    proj->notes = str;
+    if (d)
+        proj_modified(proj);
+}
+
+void gtt_project_set_desc_mapped(GttProject *proj, GBytes *source, const char *d)
+{
+    if (!proj || !source || !d)
         return;
-    }
-    proj->notes = g_strdup(d);
+    g_bytes_ref(source);
+    drop_text(&proj->desc, &proj->desc_source);
+    proj->desc = (char *) d;
+    proj->desc_source = source;
+    proj_modified(proj);
+}
+
+void gtt_project_set_notes_mapped(GttProject *proj, GBytes *source, const char *d)
+{
+    if (!proj || !source || !d)
+        return;
+    g_bytes_ref(source);
+    drop_text(&proj->notes, &proj->notes_source);
+    proj->notes = (char *) d;
+    proj->notes_source = source;
     proj_modified(proj);
 }
 
@@ -423,6 +743,7 @@ void gtt_project_set_min_interval(GttProject *proj, int r)
     if (!proj)
         return;
     proj->min_interval = r;
+    proj_mark_all_dirty(proj);
     proj_modified(proj);
 }
 
@@ -438,6 +759,7 @@ void gtt_project_set_auto_merge_interval(GttProject *proj, int r)
     if (!proj)
         return;
     proj->auto_merge_interval = r;
+    proj_mark_all_dirty(proj);
     proj_modified(proj);
 }
 
@@ -453,6 +775,7 @@ void gtt_project_set_auto_merge_gap(GttProject *proj, int r)
     if (!proj)
         return;
     proj->auto_merge_gap = r;
+    proj_mark_all_dirty(proj);
     proj_modified(proj);
 }
 
@@ -608,9 +931,11 @@ void gtt_project_set_id(GttProject *proj, int new_id)
     if (!proj)
         return;
 
-    if (gtt_project_locate_from_id(new_id))
+    if (!bulk_load_depth)
     {
-        g_warning("a project with id =%d already exists\n", new_id);
+        GttProject *other = gtt_project_locate_from_id(new_id);
+        if (other && (other != proj))
+            g_warning("a project with id =%d already exists\n", new_id);
     }
 
     /* We try to conserve id numbers by seeing if this was a fresh
@@ -619,7 +944,10 @@ void gtt_project_set_id(GttProject *proj, int new_id)
     if ((proj->id + 1) == next_free_id)
         next_free_id--;
 
+    lookup_table_remove(project_id_table, GINT_TO_POINTER(proj->id), proj);
     proj->id = new_id;
+    proj_changed(proj);
+    g_hash_table_insert(project_id_table, GINT_TO_POINTER(new_id), proj);
     if (new_id >= next_free_id)
         next_free_id = new_id + 1;
 }
@@ -636,100 +964,320 @@ int gtt_project_get_id(GttProject *proj)
 
 static time_t get_midnight(time_t last)
 {
-    struct tm lt;
-    time_t midnight;
-
     if (0 >= last)
     {
         last = time(0);
     }
+    return gtt_calendar_day_start(last);
+}
 
-    /* If config_daystart_offset == 3*3600 then the new day
-     * will start at 3AM, for example.  */
-    last -= config_daystart_offset;
+/* =========================================================== */
+/* The secs_day, secs_week etc. totals are maintained by applying the
+ * change of every interval edit to them, instead of recomputing them
+ * from scratch.  This works as long as the day, week, month and year
+ * boundaries stay put; when the clock crosses midnight, the boundaries
+ * move, the generation is bumped, and each project recomputes its
+ * totals the next time it is refreshed.
+ */
 
-    memcpy(&lt, localtime(&last), sizeof(struct tm));
-    lt.tm_sec = 0;
-    lt.tm_min = 0;
-    lt.tm_hour = 0;
-    midnight = mktime(&lt);
+typedef struct period_bounds_s
+{
+    time_t midnight;
+    time_t yesterday;
+    time_t sunday;
+    time_t lastweek;
+    time_t month;
+    time_t newyear;
+    time_t next_midnight; /* the bounds are good until this time */
+    guint generation;     /* changes whenever the bounds move */
+} PeriodBounds;
 
-    midnight += config_daystart_offset;
+static PeriodBounds period_bounds = { 0 };
 
-    return midnight;
+static void period_bounds_reset(time_t now)
+{
+    period_bounds.midnight = gtt_calendar_day_start(now);
+    period_bounds.yesterday = gtt_calendar_day_start(period_bounds.midnight - 1);
+    period_bounds.sunday = gtt_calendar_week_start(now);
+    period_bounds.lastweek = gtt_calendar_week_start(period_bounds.sunday - 1);
+    period_bounds.month = gtt_calendar_month_start(now);
+    period_bounds.newyear = gtt_calendar_year_start(now);
+    period_bounds.next_midnight = gtt_calendar_next_day_start(now);
+    period_bounds.generation++;
 }
 
-static time_t get_sunday(time_t last)
+/* Make sure the bounds are valid for the given time.  Return TRUE
+ * if they had to be moved. */
+static gboolean period_bounds_check(time_t now)
 {
-    struct tm lt;
-    time_t sunday;
+    if ((0 == period_bounds.generation) || (now < period_bounds.midnight)
+        || (now >= period_bounds.next_midnight) || gtt_calendar_check_timezone(now))
+    {
+        period_bounds_reset(now);
+        return TRUE;
+    }
+    return FALSE;
+}
 
-    if (0 >= last)
+/* Return how much of [start, stop) lies within [lo, hi) */
+static inline time_t overlap(time_t start, time_t stop, time_t lo, time_t hi)
+{
+    if (start < lo)
+        start = lo;
+    if (stop > hi)
+        stop = hi;
+    return (stop > start) ? (stop - start) : 0;
+}
+
+/* Add (sign = 1) or subtract (sign = -1) one interval to the
+ * project's own totals */
+static void proj_add_secs(GttProject *proj, time_t start, time_t stop, int sign)
+{
+    const PeriodBounds *pb = &period_bounds;
+
+    proj->secs_ever += sign * (stop - start);
+
+    /* Most intervals are old, and don't touch any of the periods */
+    if ((stop <= pb->yesterday) && (stop <= pb->lastweek) && (stop <= pb->month)
+        && (stop <= pb->newyear))
+        return;
+
+    proj->secs_day += sign * overlap(start, stop, pb->midnight, stop);
+    proj->secs_yesterday += sign * overlap(start, stop, pb->yesterday, pb->midnight);
+    proj->secs_week += sign * overlap(start, stop, pb->sunday, stop);
+    proj->secs_lastweek += sign * overlap(start, stop, pb->lastweek, pb->sunday);
+    proj->secs_month += sign * overlap(start, stop, pb->month, stop);
+    proj->secs_year += sign * overlap(start, stop, pb->newyear, stop);
+}
+
+/* Add or subtract one interval to the totals, and throw away the
+ * time index, which it is a part of */
+static void proj_accum_secs(GttProject *proj, time_t start, time_t stop, int sign)
+{
+    if (bulk_load_depth)
     {
-        last = time(0);
+        proj_bulk_touch(proj);
+        return;
     }
+    if (0 == period_bounds.generation)
+        period_bounds_reset(time(0));
+    proj_invalidate_totals(proj);
+    proj_drop_own_index(proj);
+    proj_add_secs(proj, start, stop, sign);
+}
 
-    memcpy(&lt, localtime(&last), sizeof(struct tm));
-    lt.tm_sec = 0;
-    lt.tm_min = 0;
-    lt.tm_hour = 0;
-    lt.tm_mday -= lt.tm_wday;
-    sunday = mktime(&lt);
+/* The timer moved the stop of a running interval from 'was' to 'now'.
+ * That happens every few seconds, so the time indexes are patched up
+ * rather than thrown away. */
+static void proj_tick_secs(GttProject *proj, time_t start, time_t was, time_t now)
+{
+    if (bulk_load_depth || !proj_move_stop(proj, start, was, now))
+    {
+        proj_accum_secs(proj, start, was, -1);
+        proj_accum_secs(proj, start, now, 1);
+        return;
+    }
+    if (0 == period_bounds.generation)
+        period_bounds_reset(time(0));
+    proj_invalidate_sums(proj);
+    proj_add_secs(proj, start, was, -1);
+    proj_add_secs(proj, start, now, 1);
+}
 
-    /* If config_weekstart_offset == 1 then a new week starts
-     * on monday, not sunday. */
-    sunday += 24 * 3600 * config_weekstart_offset + config_daystart_offset;
+/* Archived intervals are older than any of the periods; they only
+ * count towards secs_ever */
+static void proj_accum_archived(GttProject *proj, int secs)
+{
+    if (bulk_load_depth)
+    {
+        proj_bulk_touch(proj);
+        return;
+    }
+    proj_invalidate_totals(proj);
+    proj->secs_ever += secs;
+}
 
-    return sunday;
+/* Widen the task's dirty window, the span of start times of the
+ * intervals that need to be looked at by the next scrub */
+static void task_mark_dirty(GttTask *tsk, time_t start, time_t stop)
+{
+    if (tsk->dirty_start > tsk->dirty_stop)
+    {
+        tsk->dirty_start = start;
+        tsk->dirty_stop = stop;
+        return;
+    }
+    if (start < tsk->dirty_start)
+        tsk->dirty_start = start;
+    if (stop > tsk->dirty_stop)
+        tsk->dirty_stop = stop;
 }
 
-static time_t get_month(time_t last)
+static void task_mark_all_dirty(GttTask *tsk)
 {
-    struct tm lt;
-    time_t first;
+    guint n = tsk->intervals->len;
+    if (n)
+        task_mark_dirty(tsk, IVL_REC(tsk, n - 1)->start, IVL_REC(tsk, 0)->start);
+}
 
-    if (0 >= last)
+/* The scrub settings changed; every interval needs another look */
+static void proj_mark_all_dirty(GttProject *proj)
+{
+    GList *node;
+    for (node = proj->task_list; node; node = node->next)
     {
-        last = time(0);
+        task_mark_all_dirty(node->data);
     }
+}
 
-    memcpy(&lt, localtime(&last), sizeof(struct tm));
-    lt.tm_sec = 0;
-    lt.tm_min = 0;
-    lt.tm_hour = 0;
-    lt.tm_mday = 1;
-    first = mktime(&lt);
+static void task_add_secs(GttTask *tsk, const GttIntervalRec *rec, int sign)
+{
+    task_mark_dirty(tsk, rec->start, rec->start);
+    tsk->secs_ever += sign * (rec->stop - rec->start);
+    if (tsk->parent)
+        proj_accum_secs(tsk->parent, rec->start, rec->stop, sign);
+}
 
-    first += config_daystart_offset;
-    return first;
+/* The running interval's stop moved up from 'was' */
+static void task_tick_secs(GttTask *tsk, const GttIntervalRec *rec, time_t was)
+{
+    task_mark_dirty(tsk, rec->start, rec->start);
+    tsk->secs_ever += rec->stop - was;
+    if (tsk->parent)
+        proj_tick_secs(tsk->parent, rec->start, was, rec->stop);
 }
 
-static time_t get_newyear(time_t last)
+static void task_accum(GttTask *tsk, const GttIntervalRec *rec, int sign)
 {
-    struct tm lt;
-    time_t newyear;
+    task_changed(tsk, GTT_SAVE_DIRTY);
+    task_add_secs(tsk, rec, sign);
+}
 
-    if (0 >= last)
+/* Add or subtract all of the task's intervals to its project's totals;
+ * used when the task joins or leaves the project. */
+static void task_accum_all(GttTask *tsk, int sign)
+{
+    guint i;
+
+    if (!tsk->parent)
+        return;
+
+    /* The new project may scrub differently */
+    if (0 < sign)
+        task_mark_all_dirty(tsk);
+    for (i = 0; i < tsk->intervals->len; i++)
     {
-        last = time(0);
+        GttIntervalRec *rec = IVL_REC(tsk, i);
+        proj_accum_secs(tsk->parent, rec->start, rec->stop, sign);
+    }
+    proj_accum_archived(tsk->parent, sign * tsk->archived_secs);
+}
+
+/* Change the task's total of archived intervals */
+static void task_accum_archived(GttTask *tsk, int secs)
+{
+    tsk->archived_secs += secs;
+    tsk->secs_ever += secs;
+    if (tsk->parent)
+        proj_accum_archived(tsk->parent, secs);
+}
+
+/* The archived intervals of the task are about to be moved to another
+ * task; they have to be loaded first, or they'd end up in the wrong
+ * place when they are. */
+static void task_load_archive(GttTask *tsk)
+{
+    if (tsk && tsk->archived_secs && archive_hook)
+        (archive_hook)(0, time(0));
+}
+
+/* Does the task have archived intervals in the range that aren't
+ * loaded?  Without a span, there is no telling. */
+static gboolean task_has_archived(GttTask *tsk, time_t start, time_t stop)
+{
+    if (0 == tsk->archived_secs)
+        return FALSE;
+    if (0 == tsk->archived_last)
+        return TRUE;
+    return (start < tsk->archived_last) && (tsk->archived_first < stop);
+}
+
+void gtt_task_load_archive(GttTask *tsk, time_t start, time_t stop)
+{
+    if (!tsk || !archive_hook || (stop <= start))
+        return;
+    if (task_has_archived(tsk, start, stop))
+        (archive_hook)(start, stop);
+}
+
+/* The earliest start and latest stop of the archived intervals that
+ * aren't loaded.  Returns FALSE if some task doesn't know them. */
+static gboolean proj_archived_span(
+    GttProject *proj, gboolean include_subprojects, gboolean *found, time_t *first,
+    time_t *last
+)
+{
+    GList *node;
+
+    for (node = proj->task_list; node; node = node->next)
+    {
+        GttTask *tsk = node->data;
+        if (0 == tsk->archived_secs)
+            continue;
+        if (0 == tsk->archived_last)
+            return FALSE;
+        *first = *found ? MIN(*first, tsk->archived_first) : tsk->archived_first;
+        *last = *found ? MAX(*last, tsk->archived_last) : tsk->archived_last;
+        *found = TRUE;
+    }
+    if (!include_subprojects)
+        return TRUE;
+    for (node = proj->sub_projects; node; node = node->next)
+    {
+        if (!proj_archived_span(node->data, TRUE, found, first, last))
+            return FALSE;
     }
+    return TRUE;
+}
+
+/* Does the project have any archived intervals in the range that
+ * aren't loaded? */
+static gboolean proj_has_archived(
+    GttProject *proj, time_t start, time_t stop, gboolean include_subprojects
+)
+{
+    GList *node;
 
-    memcpy(&lt, localtime(&last), sizeof(struct tm));
-    lt.tm_sec = 0;
-    lt.tm_min = 0;
-    lt.tm_hour = 0;
-    lt.tm_mday -= lt.tm_yday;
-    newyear = mktime(&lt);
+    for (node = proj->task_list; node; node = node->next)
+    {
+        if (task_has_archived(node->data, start, stop))
+            return TRUE;
+    }
+    if (!include_subprojects)
+        return FALSE;
+    for (node = proj->sub_projects; node; node = node->next)
+    {
+        if (proj_has_archived(node->data, start, stop, TRUE))
+            return TRUE;
+    }
+    return FALSE;
+}
 
-    newyear += config_daystart_offset;
-    return newyear;
+void gtt_project_load_archive(
+    GttProject *proj, time_t start, time_t stop, gboolean include_subprojects
+)
+{
+    if (!proj || !archive_hook || (stop <= start))
+        return;
+    if (proj_has_archived(proj, start, stop, include_subprojects))
+        (archive_hook)(start, stop);
 }
 
 void gtt_project_compat_set_secs(GttProject *proj, int sever, int sday, time_t last)
 {
     time_t midnight;
     GttTask *tsk;
-    GttInterval *ivl;
+    GttIntervalRec rec = { 0 };
 
     /* Get the midnight of the last update */
     midnight = get_midnight(last);
@@ -739,17 +1287,15 @@ void gtt_project_compat_set_secs(GttProject *proj, int sever, int sday, time_t l
     tsk = gtt_task_new();
     gtt_task_set_memo(tsk, _("Old GTT Tasks"));
 
-    ivl = gtt_interval_new();
-    ivl->stop = midnight - 1;
-    ivl->start = midnight - 1 - sever + sday;
-    gtt_task_add_interval(tsk, ivl);
+    rec.stop = midnight - 1;
+    rec.start = midnight - 1 - sever + sday;
+    task_ivl_insert(tsk, &rec);
 
     if (0 < sday)
     {
-        ivl = gtt_interval_new();
-        ivl->start = midnight + 1;
-        ivl->stop = midnight + sday + 1;
-        gtt_task_add_interval(tsk, ivl);
+        rec.start = midnight + 1;
+        rec.stop = midnight + sday + 1;
+        task_ivl_insert(tsk, &rec);
     }
 
     gtt_project_append_task(proj, tsk);
@@ -779,6 +1325,7 @@ void gtt_project_append_project(GttProject *proj, GttProject *child)
 
     proj->sub_projects = g_list_append(proj->sub_projects, child);
     child->parent = proj;
+    proj_invalidate_totals(proj);
 }
 
 void gtt_project_insert_before(GttProject *p, GttProject *before_me)
@@ -818,6 +1365,7 @@ void gtt_project_insert_before(GttProject *p, GttProject *before_me)
         else
         {
             GList *sub;
+            proj_invalidate_totals(before_me->parent);
             sub = before_me->parent->sub_projects;
             pos = g_list_index(sub, before_me);
 
@@ -875,6 +1423,7 @@ void gtt_project_insert_after(GttProject *p, GttProject *after_me)
         else
         {
             GList *sub;
+            proj_invalidate_totals(after_me->parent);
             sub = after_me->parent->sub_projects;
             pos = g_list_index(sub, after_me);
 
@@ -917,9 +1466,12 @@ void gtt_project_reparent(GttProject *proj, GttProject *parent, int position)
         old_list = &global_plist->prj_list;
     }
 
+    structure_changed();
+    proj_invalidate_totals(proj->parent);
     *old_list = g_list_remove(*old_list, proj);
     *new_list = g_list_insert(*new_list, proj, position);
     proj->parent = parent;
+    proj_invalidate_totals(parent);
 }
 
 void gtt_project_append_task(GttProject *proj, GttTask *task)
@@ -930,12 +1482,31 @@ void gtt_project_append_task(GttProject *proj, GttTask *task)
     /* if task has a different parent, then reparent */
     if (task->parent)
     {
+        task_accum_all(task, -1);
         task->parent->task_list = g_list_remove(task->parent->task_list, task);
+        task->parent->task_tail = NULL;
         proj_refresh_time(task->parent);
     }
 
-    proj->task_list = g_list_append(proj->task_list, task);
+    structure_changed();
+
+    /* During a bulk load, avoid walking the list to find its end */
+    if (bulk_load_depth)
+    {
+        if (!proj->task_tail)
+            proj->task_tail = g_list_last(proj->task_list);
+        if (proj->task_tail)
+            proj->task_tail = g_list_append(proj->task_tail, task)->next;
+        else
+            proj->task_list = proj->task_tail = g_list_append(NULL, task);
+        proj_bulk_touch(proj);
+    }
+    else
+    {
+        proj->task_list = g_list_append(proj->task_list, task);
+    }
     task->parent = proj;
+    task_accum_all(task, 1);
     proj_refresh_time(proj);
 }
 
@@ -948,10 +1519,14 @@ void gtt_project_prepend_task(GttProject *proj, GttTask *task)
     /* if task has a different parent, then reparent */
     if (task->parent)
     {
+        task_accum_all(task, -1);
         task->parent->task_list = g_list_remove(task->parent->task_list, task);
+        task->parent->task_tail = NULL;
         proj_refresh_time(task->parent);
     }
 
+    structure_changed();
+
     /* avoid misplaced running intervals, stop the task */
     if (proj->task_list)
     {
@@ -960,8 +1535,10 @@ void gtt_project_prepend_task(GttProject *proj, GttTask *task)
     }
 
     proj->task_list = g_list_prepend(proj->task_list, task);
+    proj->task_tail = NULL;
     proj->current_task = task;
     task->parent = proj;
+    task_accum_all(task, 1);
 
     if (is_running)
         gtt_project_timer_start(proj);
@@ -1033,9 +1610,9 @@ GttInterval *gtt_project_get_first_interval(GttProject *proj)
     tsk = proj->task_list->data;
     if (!tsk)
         return NULL;
-    if (!tsk->interval_list)
+    if (0 == tsk->intervals->len)
         return NULL;
-    return (tsk->interval_list->data);
+    return task_ivl_handle(tsk, 0);
 }
 
 /* =========================================================== */
@@ -1064,125 +1641,467 @@ int gtt_project_foreach(GttProject *prj, GttProjectCB cb, gpointer data)
     return rc;
 }
 
-static int prj_total_secs_day(GttProject *prj, gpointer data)
+/* The sub-tree totals (and the sub-tree time index) are cached in
+ * each project.  Any change to a project's own totals marks it, and
+ * all of its ancestors, as dirty; the cached totals of a dirty project
+ * are rebuilt from its own totals and those of its children the next
+ * time they are asked for.  Since a dirty project always has dirty
+ * ancestors, the walk up the tree can stop at the first project that
+ * is already dirty.
+ */
+static void proj_invalidate_totals(GttProject *proj)
 {
-    *((int *) data) += prj->secs_day;
-    return 1;
+    while (proj && !(proj->dirty_totals && proj->dirty_index))
+    {
+        proj->dirty_totals = TRUE;
+        proj->dirty_index = TRUE;
+        proj = proj->parent;
+    }
 }
 
-static int prj_total_secs_yesterday(GttProject *prj, gpointer data)
+/* Like proj_invalidate_totals(), but leaves the time index alone */
+static void proj_invalidate_sums(GttProject *proj)
 {
-    *((int *) data) += prj->secs_yesterday;
-    return 1;
+    while (proj && !proj->dirty_totals)
+    {
+        proj->dirty_totals = TRUE;
+        proj = proj->parent;
+    }
 }
 
-static int prj_total_secs_week(GttProject *prj, gpointer data)
+static void proj_update_totals(GttProject *proj)
 {
-    *((int *) data) += prj->secs_week;
-    return 1;
-}
+    GList *node;
 
-static int prj_total_secs_lastweek(GttProject *prj, gpointer data)
-{
-    *((int *) data) += prj->secs_lastweek;
-    return 1;
-}
+    if (!proj->dirty_totals)
+        return;
 
-static int prj_total_secs_month(GttProject *prj, gpointer data)
-{
-    *((int *) data) += prj->secs_month;
-    return 1;
-}
+    proj->total_secs_ever = proj->secs_ever;
+    proj->total_secs_year = proj->secs_year;
+    proj->total_secs_month = proj->secs_month;
+    proj->total_secs_week = proj->secs_week;
+    proj->total_secs_lastweek = proj->secs_lastweek;
+    proj->total_secs_day = proj->secs_day;
+    proj->total_secs_yesterday = proj->secs_yesterday;
+    proj->total_secs_current = gtt_project_get_secs_current(proj);
 
-static int prj_total_secs_year(GttProject *prj, gpointer data)
-{
-    *((int *) data) += prj->secs_year;
-    return 1;
-}
-
-static int prj_total_secs_ever(GttProject *prj, gpointer data)
-{
-    *((int *) data) += prj->secs_ever;
-    return 1;
-}
-
-static int prj_total_secs_current(GttProject *prj, gpointer data)
-{
-    *((int *) data) += gtt_project_get_secs_current(prj);
-    return 1;
+    for (node = proj->sub_projects; node; node = node->next)
+    {
+        GttProject *subprj = node->data;
+        proj_update_totals(subprj);
+        proj->total_secs_ever += subprj->total_secs_ever;
+        proj->total_secs_year += subprj->total_secs_year;
+        proj->total_secs_month += subprj->total_secs_month;
+        proj->total_secs_week += subprj->total_secs_week;
+        proj->total_secs_lastweek += subprj->total_secs_lastweek;
+        proj->total_secs_day += subprj->total_secs_day;
+        proj->total_secs_yesterday += subprj->total_secs_yesterday;
+        proj->total_secs_current += subprj->total_secs_current;
+    }
+    proj->dirty_totals = FALSE;
 }
 
 /* this routine adds up total day-secs for this project, and its sub-projects */
 int gtt_project_total_secs_day(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_day, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_day;
 }
 
 int gtt_project_total_secs_yesterday(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_yesterday, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_yesterday;
 }
 
 int gtt_project_total_secs_week(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_week, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_week;
 }
 
 int gtt_project_total_secs_lastweek(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_lastweek, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_lastweek;
 }
 
 int gtt_project_total_secs_month(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_month, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_month;
 }
 
 int gtt_project_total_secs_year(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_year, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_year;
 }
 
 int gtt_project_total_secs_ever(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_ever, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_ever;
 }
 
 int gtt_project_total_secs_current(GttProject *proj)
 {
-    int total = 0;
     if (!proj)
         return 0;
-    gtt_project_foreach(proj, prj_total_secs_current, &total);
-    return total;
+    proj_update_totals(proj);
+    return proj->total_secs_current;
+}
+
+/* =========================================================== */
+/* The time index.  The time that a set of intervals spends inside of
+ * a window [lo, hi) is the sum, over all the intervals, of
+ * clamp(stop) - clamp(start), where clamp() pins a time to [lo, hi].
+ * With the start and the stop times each kept sorted, along with
+ * running sums, both halves of that come out of two binary searches.
+ * The index is built when first needed, and thrown away whenever the
+ * intervals it covers change.  The one exception is the timer moving
+ * the stop of a running interval up: rebuilding the index for that
+ * every few seconds would cost more than all of the queries.  Instead,
+ * the move is noted down next to the sorted stops, and the queries
+ * make up for it.
+ */
+
+#define TIME_INDEX_MAX_MOVES 8
+
+typedef struct
+{
+    time_t start; /* of the interval */
+    time_t was;   /* its stop, as it is in the sorted stops */
+    time_t now;   /* where the stop has since moved to */
+} StopMove;
+
+struct gtt_time_index_s
+{
+    guint len;
+    time_t *starts;    /* all start times, ascending */
+    time_t *stops;     /* all stop times, ascending */
+    gint64 *start_sum; /* start_sum[i] is the sum of starts[0 .. i-1] */
+    gint64 *stop_sum;  /* likewise, for the stops */
+    guint n_moves;
+    StopMove moves[TIME_INDEX_MAX_MOVES]; /* stops moved since the sort */
+};
+
+static void time_index_free(GttTimeIndex *idx)
+{
+    if (!idx)
+        return;
+    g_free(idx->starts);
+    g_free(idx->stops);
+    g_free(idx->start_sum);
+    g_free(idx->stop_sum);
+    g_free(idx);
+}
+
+/* Note down that the stop of an interval moved up.  Returns FALSE if
+ * the index has to be rebuilt instead. */
+static gboolean time_index_move_stop(GttTimeIndex *idx, time_t start, time_t was, time_t now)
+{
+    guint i;
+
+    if (now < was)
+        return FALSE;
+    for (i = 0; i < idx->n_moves; i++)
+    {
+        StopMove *mv = &idx->moves[i];
+        if ((mv->start == start) && (mv->now == was))
+        {
+            mv->now = now;
+            return TRUE;
+        }
+    }
+    if (TIME_INDEX_MAX_MOVES == idx->n_moves)
+        return FALSE;
+    idx->moves[i].start = start;
+    idx->moves[i].was = was;
+    idx->moves[i].now = now;
+    idx->n_moves++;
+    return TRUE;
+}
+
+/* Patch up every index that the project's interval is a part of: the
+ * project's own, and the sub-tree indexes of it and its ancestors.
+ * Returns FALSE if that can't be done, and they have to be rebuilt. */
+static gboolean proj_move_stop(GttProject *proj, time_t start, time_t was, time_t now)
+{
+    GttProject *p;
+
+    /* Check first, so that none are patched if any can't be */
+    if (proj->own_index && (TIME_INDEX_MAX_MOVES == proj->own_index->n_moves))
+        return FALSE;
+    for (p = proj; p; p = p->parent)
+    {
+        if (p->tree_index && (TIME_INDEX_MAX_MOVES == p->tree_index->n_moves))
+            return FALSE;
+    }
+    if (now < was)
+        return FALSE;
+
+    if (proj->own_index)
+        time_index_move_stop(proj->own_index, start, was, now);
+    for (p = proj; p; p = p->parent)
+    {
+        if (p->tree_index)
+            time_index_move_stop(p->tree_index, start, was, now);
+    }
+    return TRUE;
+}
+
+static void proj_drop_own_index(GttProject *proj)
+{
+    time_index_free(proj->own_index);
+    proj->own_index = NULL;
+}
+
+static GttTimeIndex *time_index_new(guint len)
+{
+    GttTimeIndex *idx = g_new0(GttTimeIndex, 1);
+    idx->starts = g_new(time_t, len + 1);
+    idx->stops = g_new(time_t, len + 1);
+    idx->start_sum = g_new(gint64, len + 1);
+    idx->stop_sum = g_new(gint64, len + 1);
+    return idx;
+}
+
+static int time_cmp(const void *a, const void *b)
+{
+    time_t ta = *(const time_t *) a;
+    time_t tb = *(const time_t *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+/* Sort the filled-in times, and compute the running sums */
+static void time_index_finish(GttTimeIndex *idx)
+{
+    guint i;
+
+    qsort(idx->starts, idx->len, sizeof(time_t), time_cmp);
+    qsort(idx->stops, idx->len, sizeof(time_t), time_cmp);
+
+    idx->start_sum[0] = 0;
+    idx->stop_sum[0] = 0;
+    for (i = 0; i < idx->len; i++)
+    {
+        idx->start_sum[i + 1] = idx->start_sum[i] + idx->starts[i];
+        idx->stop_sum[i + 1] = idx->stop_sum[i] + idx->stops[i];
+    }
+}
+
+static guint proj_num_intervals(GttProject *proj)
+{
+    GList *node;
+    guint n = 0;
+
+    for (node = proj->task_list; node; node = node->next)
+    {
+        GttTask *tsk = node->data;
+        n += tsk->intervals->len;
+    }
+    return n;
+}
+
+static void time_index_add_project(GttTimeIndex *idx, GttProject *proj)
+{
+    GList *node;
+    guint i;
+
+    for (node = proj->task_list; node; node = node->next)
+    {
+        GttTask *tsk = node->data;
+        for (i = 0; i < tsk->intervals->len; i++)
+        {
+            GttIntervalRec *ivl = IVL_REC(tsk, i);
+            idx->starts[idx->len] = ivl->start;
+            idx->stops[idx->len] = ivl->stop;
+            idx->len++;
+        }
+    }
+}
+
+/* Return the first slot holding a time that is not before t */
+static guint time_index_search(const time_t *times, guint len, time_t t)
+{
+    guint lo = 0;
+    guint hi = len;
+
+    while (lo < hi)
+    {
+        guint mid = (lo + hi) / 2;
+        if (times[mid] < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Copy a sub-project's index into the one being built.  The moved
+ * stops are put where they moved to; the copies get sorted anyway. */
+static void time_index_add_index(GttTimeIndex *idx, const GttTimeIndex *sub)
+{
+    time_t *stops = idx->stops + idx->len;
+    guint i, j;
+
+    memcpy(idx->starts + idx->len, sub->starts, sub->len * sizeof(time_t));
+    memcpy(stops, sub->stops, sub->len * sizeof(time_t));
+    idx->len += sub->len;
+
+    for (i = 0; i < sub->n_moves; i++)
+    {
+        const StopMove *mv = &sub->moves[i];
+
+        /* Skip over any equal stops that were already moved */
+        j = time_index_search(sub->stops, sub->len, mv->was);
+        while ((j < sub->len) && (sub->stops[j] == mv->was) && (stops[j] != mv->was))
+            j++;
+        if ((j < sub->len) && (stops[j] == mv->was))
+            stops[j] = mv->now;
+    }
+}
+
+static GttTimeIndex *proj_get_own_index(GttProject *proj)
+{
+    if (!proj->own_index)
+    {
+        proj->own_index = time_index_new(proj_num_intervals(proj));
+        time_index_add_project(proj->own_index, proj);
+        time_index_finish(proj->own_index);
+    }
+    return proj->own_index;
+}
+
+static GttTimeIndex *proj_get_index(GttProject *proj, gboolean include_subprojects)
+{
+    GttTimeIndex *idx;
+    GList *node;
+    guint n;
+
+    if (!include_subprojects)
+        return proj_get_own_index(proj);
+    if (!proj->dirty_index)
+        return proj->tree_index ? proj->tree_index : proj_get_own_index(proj);
+
+    time_index_free(proj->tree_index);
+    proj->tree_index = NULL;
+
+    /* Projects without children just use their own index */
+    idx = proj_get_own_index(proj);
+    if (proj->sub_projects)
+    {
+        n = idx->len;
+        for (node = proj->sub_projects; node; node = node->next)
+        {
+            n += proj_get_index(node->data, TRUE)->len;
+        }
+
+        proj->tree_index = time_index_new(n);
+        idx = proj->tree_index;
+        time_index_add_project(idx, proj);
+        for (node = proj->sub_projects; node; node = node->next)
+        {
+            time_index_add_index(idx, proj_get_index(node->data, TRUE));
+        }
+        time_index_finish(idx);
+    }
+    proj->dirty_index = FALSE;
+    return idx;
+}
+
+/* Return the sum of all the times, each one clamped to [lo, hi] */
+static gint64 time_index_clamp_sum(
+    const time_t *times, const gint64 *sums, guint len, time_t lo, time_t hi
+)
+{
+    guint a = time_index_search(times, len, lo);
+    guint b = time_index_search(times, len, hi);
+
+    return ((gint64) a * lo) + (sums[b] - sums[a]) + ((gint64) (len - b) * hi);
+}
+
+int gtt_project_get_secs_range(
+    GttProject *proj, time_t start, time_t end, gboolean include_subprojects
+)
+{
+    GttTimeIndex *idx;
+    gint64 secs;
+    guint i;
+
+    if (!proj || (end <= start))
+        return 0;
+
+    gtt_project_load_archive(proj, start, end, include_subprojects);
+    idx = proj_get_index(proj, include_subprojects);
+    secs = time_index_clamp_sum(idx->stops, idx->stop_sum, idx->len, start, end)
+           - time_index_clamp_sum(idx->starts, idx->start_sum, idx->len, start, end);
+
+    /* Make up for the stops that moved since the index was sorted */
+    for (i = 0; i < idx->n_moves; i++)
+    {
+        secs += CLAMP(idx->moves[i].now, start, end) - CLAMP(idx->moves[i].was, start, end);
+    }
+    return secs;
+}
+
+gboolean gtt_project_get_time_span(
+    GttProject *proj, gboolean include_subprojects, time_t *earliest, time_t *latest
+)
+{
+    GttTimeIndex *idx;
+    gboolean archived = FALSE;
+    time_t first = 0, last = 0;
+    guint i;
+
+    if (!proj)
+        return FALSE;
+
+    /* Archived intervals that aren't loaded count too.  The data file
+     * keeps their span; only if it doesn't is there no telling which
+     * years they are in without reading them. */
+    if (!proj_archived_span(proj, include_subprojects, &archived, &first, &last))
+    {
+        gtt_project_load_archive(proj, 0, time(0), include_subprojects);
+        archived = FALSE;
+        proj_archived_span(proj, include_subprojects, &archived, &first, &last);
+    }
+
+    idx = proj_get_index(proj, include_subprojects);
+    if (idx->len)
+    {
+        first = archived ? MIN(first, idx->starts[0]) : idx->starts[0];
+        last = archived ? MAX(last, idx->stops[idx->len - 1]) : idx->stops[idx->len - 1];
+
+        /* Stops only ever move up */
+        for (i = 0; i < idx->n_moves; i++)
+        {
+            last = MAX(last, idx->moves[i].now);
+        }
+    }
+    else if (!archived)
+        return FALSE;
+
+    if (earliest)
+        *earliest = first;
+    if (latest)
+        *latest = last;
+    return TRUE;
 }
 
 int gtt_project_get_secs_day(GttProject *proj)
@@ -1321,295 +2240,246 @@ int gtt_project_list_total(void)
  *     (but only do this if the nearest is in the same day).
  */
 
-static GttInterval *get_closest(GList *node)
+static GttInterval *get_closest(GttTask *tsk, guint idx)
 {
-    if (node->next)
-        return node->next->data;
-    if (node->prev)
-        return node->prev->data;
+    if (idx + 1 < tsk->intervals->len)
+        return task_ivl_handle(tsk, idx + 1);
+    if (0 < idx)
+        return task_ivl_handle(tsk, idx - 1);
     return NULL;
 }
 
+/* Merge the interval in slot idx into the more recent one above it.
+ * Return the slot of the merged interval, or -1 if there is none. */
+static int task_ivl_merge_up(GttTask *tsk, guint idx)
+{
+    int more_fuzz;
+    int ivl_len;
+    GttIntervalRec *ivl, *merge;
+
+    if ((0 == idx) || (idx >= tsk->intervals->len))
+        return -1;
+    ivl = IVL_REC(tsk, idx);
+    merge = IVL_REC(tsk, idx - 1);
+
+    /* the fuzz is the gap between stop and start times */
+    more_fuzz = merge->start - ivl->stop;
+    ivl_len = ivl->stop - ivl->start;
+    if (more_fuzz > ivl_len)
+        more_fuzz = ivl_len;
+
+    task_accum(tsk, merge, -1);
+    merge->start -= ivl_len;
+    task_accum(tsk, merge, 1);
+    if (ivl->fuzz > merge->fuzz)
+        merge->fuzz = ivl->fuzz;
+    if (more_fuzz > merge->fuzz)
+        merge->fuzz = more_fuzz;
+
+    task_ivl_remove(tsk, idx);
+    return task_ivl_resort(tsk, idx - 1);
+}
+
+/* Same as above, but merge into the older interval below */
+static int task_ivl_merge_down(GttTask *tsk, guint idx)
+{
+    int more_fuzz;
+    int ivl_len;
+    GttIntervalRec *ivl, *merge;
+
+    if (idx + 1 >= tsk->intervals->len)
+        return -1;
+    ivl = IVL_REC(tsk, idx);
+    merge = IVL_REC(tsk, idx + 1);
+
+    /* the fuzz is the gap between stop and start times */
+    more_fuzz = ivl->start - merge->stop;
+    ivl_len = ivl->stop - ivl->start;
+    if (more_fuzz > ivl_len)
+        more_fuzz = ivl_len;
+
+    task_accum(tsk, merge, -1);
+    merge->stop += ivl_len;
+    task_accum(tsk, merge, 1);
+    if (ivl->fuzz > merge->fuzz)
+        merge->fuzz = ivl->fuzz;
+    if (more_fuzz > merge->fuzz)
+        merge->fuzz = more_fuzz;
+
+    task_ivl_remove(tsk, idx);
+    return idx;
+}
+
+/* Scrubbing works in a single pass, from older to newer intervals,
+ * over just the slots whose start times fall into the task's dirty
+ * window, plus one neighbour on each side.  If the last change in
+ * the pass was at the newer edge of the window, the pass carries on
+ * until an interval is left unchanged. */
 static GttInterval *scrub_intervals(GttTask *tsk, GttInterval *handle)
 {
     GttProject *prj;
-    GList *node;
     int mini, merge, mgap;
-    int not_done = TRUE;
+    int i, lo, hi;
+    gboolean changed;
     int save_freeze;
 
+    /* Nothing changed since the last scrub */
+    if (tsk->dirty_start > tsk->dirty_stop)
+        return handle;
+
     /* Prevent recursion */
     prj = tsk->parent;
     g_return_val_if_fail(prj, FALSE);
     save_freeze = prj->frozen;
     prj->frozen = TRUE;
 
-    /* First, eliminate very short intervals */
     mini = prj->min_interval;
-    while (not_done)
+    merge = prj->auto_merge_interval;
+    mgap = prj->auto_merge_gap;
+
+    /* The slots are sorted by start time, newest first */
+    lo = (int) task_find_slot(tsk, tsk->dirty_stop + 1) - 1;
+    hi = (int) task_find_slot(tsk, tsk->dirty_start);
+    if (lo < 0)
+        lo = 0;
+    if (hi > (int) tsk->intervals->len - 1)
+        hi = (int) tsk->intervals->len - 1;
+    tsk->dirty_start = 1;
+    tsk->dirty_stop = 0;
+
+    changed = FALSE;
+    i = hi;
+    while ((0 <= i) && ((lo <= i) || changed))
     {
-        not_done = FALSE;
-        for (node = tsk->interval_list; node; node = node->next)
+        GttIntervalRec *ivl = IVL_REC(tsk, i);
+        GttIntervalRec *older = NULL;
+        GttIntervalRec *newer = NULL;
+        gboolean is_handle = (handle && (handle == ivl->handle));
+        int len = ivl->stop - ivl->start;
+        int gap_up = 1000000000;
+        int gap_down = 1000000000;
+        int do_merge = FALSE;
+        int rc;
+
+        changed = FALSE;
+
+        /* Should never see negative intervals */
+        if ((0 > len) || ivl->running)
         {
-            GttInterval *ivl = node->data;
-            int len = ivl->stop - ivl->start;
-
-            /* Should never see negative intervals */
-            g_return_val_if_fail((0 <= len), handle);
-            if ((FALSE == ivl->running) && (len <= mini)
-                && (0 != ivl->start)) /* don't whack new ivls */
-            {
-                if (handle == ivl)
-                    handle = get_closest(node);
-                tsk->interval_list = g_list_remove(tsk->interval_list, ivl);
-                ivl->parent = NULL;
-                g_free(ivl);
-                not_done = TRUE;
-                break;
-            }
+            i--;
+            continue;
         }
-    }
+        if (i + 1 < (int) tsk->intervals->len)
+            older = IVL_REC(tsk, i + 1);
+        if (0 < i)
+            newer = IVL_REC(tsk, i - 1);
 
-    /* Merge intervals with small gaps between them */
-    mgap = prj->auto_merge_gap;
-    not_done = TRUE;
-    while (not_done)
-    {
-        not_done = FALSE;
-        for (node = tsk->interval_list; node; node = node->next)
+        /* Discard very short intervals; don't whack new ones */
+        if ((len <= mini) && (0 != ivl->start))
         {
-            GttInterval *ivl = node->data;
-            GttInterval *nivl;
-            int gap;
+            if (is_handle)
+                handle = get_closest(tsk, i);
+            task_ivl_remove(tsk, i);
+            changed = TRUE;
+            i--;
+            continue;
+        }
 
-            if (ivl->running)
-                continue;
-            if (!node->next)
-                break;
-            nivl = node->next->data;
-            gap = ivl->start - nivl->stop;
-            if (0 > gap)
-                continue; /* out of order ivls */
-            if ((mgap > gap) || (ivl->fuzz > gap) || (nivl->fuzz > gap))
+        /* Merge with the older interval, if the gap between them is
+         * small.  The merged interval may now be short enough to be
+         * merged again, so look at this slot again. */
+        if (older && (ivl->start >= older->stop))
+        {
+            int gap = ivl->start - older->stop;
+            if ((mgap > gap) || (ivl->fuzz > gap) || (older->fuzz > gap))
             {
-                GttInterval *rc = gtt_interval_merge_down(ivl);
-                if (handle == ivl)
-                    handle = rc;
-                not_done = TRUE;
-                break;
+                rc = task_ivl_merge_down(tsk, i);
+                if (is_handle)
+                    handle = task_ivl_handle(tsk, rc);
+                changed = TRUE;
+                continue;
             }
         }
-    }
 
-    /* Merge short intervals into neighbors */
-    merge = prj->auto_merge_interval;
-    not_done = TRUE;
-    while (not_done)
-    {
-        not_done = FALSE;
-        for (node = tsk->interval_list; node; node = node->next)
+        /* Merge short intervals into the nearest neighbour,
+         * but only if that neighbour is in the same day */
+        if ((len > merge) || (0 == ivl->start))
+        {
+            i--;
+            continue;
+        }
+        if (older && gtt_calendar_same_day(ivl->start, older->stop))
         {
-            GttInterval *ivl = node->data;
-            int gap_up = 1000000000;
-            int gap_down = 1000000000;
-            int do_merge = FALSE;
-            int len;
+            gap_down = ivl->start - older->stop;
+            do_merge = TRUE;
+        }
+        if (newer && gtt_calendar_same_day(newer->start, ivl->stop))
+        {
+            gap_up = newer->start - ivl->stop;
+            do_merge = TRUE;
+        }
+        if (!do_merge)
+        {
+            i--;
+            continue;
+        }
 
-            if (ivl->running)
-                continue;
-            if (0 == ivl->start)
-                continue; /* brand-new ivl */
-            len = ivl->stop - ivl->start;
-            if (len > merge)
-                continue;
-            if (node->next)
-            {
-                GttInterval *nivl = node->next->data;
-
-                /* Merge only if the intervals are in the same day */
-                if (get_midnight(ivl->start) == get_midnight(nivl->stop))
-                {
-                    gap_down = ivl->start - nivl->stop;
-                    do_merge = TRUE;
-                }
-            }
-            if (node->prev)
-            {
-                GttInterval *nivl = node->prev->data;
-
-                /* Merge only if the intervals are in the same day */
-                if (get_midnight(nivl->start) == get_midnight(ivl->stop))
-                {
-                    gap_up = nivl->start - ivl->stop;
-                    do_merge = TRUE;
-                }
-            }
-            if (!do_merge)
-                continue;
-            if (gap_up < gap_down)
-            {
-                GttInterval *rc = gtt_interval_merge_up(ivl);
-                if (handle == ivl)
-                    handle = rc;
-            }
-            else
-            {
-                GttInterval *rc = gtt_interval_merge_down(ivl);
-                if (handle == ivl)
-                    handle = rc;
-            }
-            not_done = TRUE;
-            break;
+        if (gap_up < gap_down)
+            rc = task_ivl_merge_up(tsk, i);
+        else
+            rc = task_ivl_merge_down(tsk, i);
+        if (0 > rc)
+        {
+            i--;
+            continue;
         }
+        if (is_handle)
+            handle = task_ivl_handle(tsk, rc);
+        changed = TRUE;
+        i = rc;
     }
 
+    /* The merges above marked the task dirty again; it isn't */
+    tsk->dirty_start = 1;
+    tsk->dirty_stop = 0;
+
     prj->frozen = save_freeze;
     return handle;
 }
 
+/* Recompute the time totals from scratch.  Needed only when the
+ * period boundaries have moved; otherwise, the totals are kept up
+ * to date as the intervals change. */
 static void project_compute_secs(GttProject *proj)
 {
-    int total_ever = 0;
-    int total_day = 0;
-    int total_yesterday = 0;
-    int total_week = 0;
-    int total_lastweek = 0;
-    int total_month = 0;
-    int total_year = 0;
-    time_t midnight, sunday, month, newyear;
-    GList *tsk_node, *ivl_node, *prj_node;
+    GList *tsk_node;
+    guint i;
 
     if (!proj)
         return;
 
-    /* Total up the subprojects first */
-    for (prj_node = proj->sub_projects; prj_node; prj_node = prj_node->next)
-    {
-        GttProject *prj = prj_node->data;
-        project_compute_secs(prj);
-    }
-
-    midnight = get_midnight(-1);
-    sunday = get_sunday(-1);
-    month = get_month(-1);
-    newyear = get_newyear(-1);
+    proj->secs_ever = 0;
+    proj->secs_day = 0;
+    proj->secs_yesterday = 0;
+    proj->secs_week = 0;
+    proj->secs_lastweek = 0;
+    proj->secs_month = 0;
+    proj->secs_year = 0;
 
-    /* Total up time spent in various tasks.
-     * XXX None of these total handle daylight savings correctly.
-     */
     for (tsk_node = proj->task_list; tsk_node; tsk_node = tsk_node->next)
     {
         GttTask *task = tsk_node->data;
-        scrub_intervals(task, NULL);
-        for (ivl_node = task->interval_list; ivl_node; ivl_node = ivl_node->next)
+        for (i = 0; i < task->intervals->len; i++)
         {
-            GttInterval *ivl = ivl_node->data;
-            total_ever += ivl->stop - ivl->start;
-
-            /* Accum time today. */
-            if (ivl->start >= midnight)
-            {
-                total_day += ivl->stop - ivl->start;
-            }
-            else if (ivl->stop > midnight)
-            {
-                total_day += ivl->stop - midnight;
-            }
-
-            /* Accum time yesterday. */
-            if (ivl->start < midnight)
-            {
-                if (ivl->start >= midnight - 24 * 3600)
-                {
-                    if (ivl->stop <= midnight)
-                    {
-                        total_yesterday += ivl->stop - ivl->start;
-                    }
-                    else
-                    {
-                        total_yesterday += midnight - ivl->start;
-                    }
-                }
-                else /* else .. it started before midnight yesterday */
-                    if (ivl->stop > midnight - 24 * 3600)
-                    {
-                        if (ivl->stop <= midnight)
-                        {
-                            total_yesterday += ivl->stop - (midnight - 24 * 3600);
-                        }
-                        else
-                        {
-                            total_yesterday += 24 * 3600;
-                        }
-                    }
-            }
-
-            /* Accum time this week. */
-            if (ivl->start >= sunday)
-            {
-                total_week += ivl->stop - ivl->start;
-            }
-            else if (ivl->stop > sunday)
-            {
-                total_week += ivl->stop - sunday;
-            }
-
-            /* Accum time last week. */
-            if (ivl->start < sunday)
-            {
-                if (ivl->start >= sunday - 7 * 24 * 3600)
-                {
-                    if (ivl->stop <= sunday)
-                    {
-                        total_lastweek += ivl->stop - ivl->start;
-                    }
-                    else
-                    {
-                        total_lastweek += sunday - ivl->start;
-                    }
-                }
-                else /* else .. it started before sunday last week */
-                    if (ivl->stop > sunday - 7 * 24 * 3600)
-                    {
-                        if (ivl->stop <= sunday)
-                        {
-                            total_lastweek += ivl->stop - (sunday - 7 * 24 * 3600);
-                        }
-                        else
-                        {
-                            total_lastweek += 7 * 24 * 3600;
-                        }
-                    }
-            }
-
-            /* Accum time this month */
-            if (ivl->start >= month)
-            {
-                total_month += ivl->stop - ivl->start;
-            }
-            else if (ivl->stop > month)
-            {
-                total_month += ivl->stop - month;
-            }
-            if (ivl->start >= newyear)
-            {
-                total_year += ivl->stop - ivl->start;
-            }
-            else if (ivl->stop > newyear)
-            {
-                total_year += ivl->stop - newyear;
-            }
+            GttIntervalRec *ivl = IVL_REC(task, i);
+            proj_accum_secs(proj, ivl->start, ivl->stop, 1);
         }
+        proj->secs_ever += task->archived_secs;
     }
 
-    proj->secs_ever = total_ever;
-    proj->secs_day = total_day;
-    proj->secs_yesterday = total_yesterday;
-    proj->secs_week = total_week;
-    proj->secs_lastweek = total_lastweek;
-    proj->secs_month = total_month;
-    proj->secs_year = total_year;
+    proj->secs_generation = period_bounds.generation;
     proj->dirty_time = FALSE;
+    proj_invalidate_totals(proj);
 }
 
 static void children_modified(GttProject *prj)
@@ -1622,16 +2492,32 @@ static void children_modified(GttProject *prj)
         GttProject *subprj = node->data;
         children_modified(subprj);
     }
-    proj_modified(prj);
+    proj_notify(prj);
+}
+
+static void project_invalidate_secs(GttProject *prj)
+{
+    GList *node;
+    for (node = prj->sub_projects; node; node = node->next)
+    {
+        GttProject *subprj = node->data;
+        project_invalidate_secs(subprj);
+    }
+    prj->dirty_time = TRUE;
+    proj_refresh_time(prj);
 }
 
 void gtt_project_list_compute_secs(void)
 {
     GList *node;
+
+    /* The day start or the date may have changed */
+    period_bounds_reset(time(0));
+
     for (node = global_plist->prj_list; node; node = node->next)
     {
         GttProject *prj = node->data;
-        proj_refresh_time(prj);
+        project_invalidate_secs(prj);
         children_modified(prj);
     }
 }
@@ -1646,12 +2532,25 @@ void gtt_project_add_notifier(GttProject *prj, GttProjectChanged cb, gpointer us
     if (!prj || !cb)
         return;
 
+    /* Changes are tracked from when the first one listens */
+    if (!prj->listeners)
+        prj->notify_layout = layout_version;
+
     ntf = g_new0(Notifier, 1);
     ntf->func = cb;
     ntf->user_data = user_stuff;
     prj->listeners = g_list_append(prj->listeners, ntf);
 }
 
+gboolean gtt_project_get_changed_tasks(GttProject *prj, GList **tasks)
+{
+    *tasks = NULL;
+    if (!prj || (prj->notify_layout != layout_version))
+        return FALSE;
+    *tasks = prj->notify_tasks;
+    return TRUE;
+}
+
 void gtt_project_remove_notifier(GttProject *prj, GttProjectChanged cb, gpointer user_stuff)
 {
     Notifier *ntf;
@@ -1672,6 +2571,11 @@ void gtt_project_remove_notifier(GttProject *prj, GttProjectChanged cb, gpointer
         prj->listeners = g_list_remove(prj->listeners, ntf);
         g_free(ntf);
     }
+    if (!prj->listeners)
+    {
+        g_list_free(prj->notify_tasks);
+        prj->notify_tasks = NULL;
+    }
 }
 
 void gtt_project_freeze(GttProject *prj)
@@ -1689,6 +2593,41 @@ void gtt_project_thaw(GttProject *prj)
     proj_refresh_time(prj);
 }
 
+void gtt_project_bulk_load_begin(void)
+{
+    bulk_load_depth++;
+}
+
+void gtt_project_bulk_load_commit(void)
+{
+    GList *node, *touched;
+
+    g_return_if_fail(0 < bulk_load_depth);
+    bulk_load_depth--;
+    if (bulk_load_depth)
+        return;
+
+    touched = g_list_reverse(bulk_touched);
+    bulk_touched = NULL;
+
+    for (node = touched; node; node = node->next)
+    {
+        GttProject *prj = node->data;
+        prj->bulk_touched = FALSE;
+        prj->task_tail = NULL;
+        prj->dirty_time = TRUE;
+        proj_drop_own_index(prj);
+    }
+
+    /* One scrub and recompute for each project.  Projects that
+     * are still frozen get theirs when they are thawed. */
+    for (node = touched; node; node = node->next)
+    {
+        proj_refresh_time(node->data);
+    }
+    g_list_free(touched);
+}
+
 void gtt_task_freeze(GttTask *tsk)
 {
     if (!tsk || !tsk->parent)
@@ -1721,44 +2660,81 @@ GttInterval *gtt_interval_thaw(GttInterval *ivl)
     return ivl;
 }
 
-static void proj_refresh_time(GttProject *proj)
+static void proj_refresh_time(GttProject *proj)
+{
+    GList *node;
+
+    if (!proj)
+        return;
+    if (proj->being_destroyed)
+        return;
+    if (bulk_load_depth)
+    {
+        proj_bulk_touch(proj);
+        return;
+    }
+
+    /* The current task may have changed */
+    proj_invalidate_totals(proj);
+    if (proj->frozen)
+        return;
+
+    /* Scrub away short intervals and gaps left by the last edit */
+    for (node = proj->task_list; node; node = node->next)
+    {
+        GttTask *task = node->data;
+        scrub_intervals(task, NULL);
+    }
+
+    period_bounds_check(time(0));
+    if (proj->dirty_time || (proj->secs_generation != period_bounds.generation))
+        project_compute_secs(proj);
+
+    /* let listeners know that the times have changed */
+    proj_run_listeners(proj);
+}
+
+static void proj_run_listeners(GttProject *proj)
 {
     GList *node;
 
-    if (!proj)
-        return;
-    if (proj->being_destroyed)
-        return;
-    proj->dirty_time = TRUE;
-    if (proj->frozen)
-        return;
-    project_compute_secs(proj);
-
-    /* let listeners know that the times have changed */
     for (node = proj->listeners; node; node = node->next)
     {
         Notifier *ntf = node->data;
         (ntf->func)(proj, ntf->user_data);
     }
+
+    g_list_free(proj->notify_tasks);
+    proj->notify_tasks = NULL;
+    proj->notify_layout = layout_version;
 }
 
 static void proj_modified(GttProject *proj)
 {
-    GList *node;
+    if (!proj)
+        return;
+    proj_changed(proj);
+    proj_notify(proj);
+}
+
+/* Same as above, for a change to one of the project's tasks */
+static void task_modified(GttTask *tsk)
+{
+    task_changed(tsk, GTT_SAVE_DIRTY);
+    proj_notify(tsk->parent);
+}
 
+static void proj_notify(GttProject *proj)
+{
     if (!proj)
         return;
     if (proj->being_destroyed)
         return;
-    if (proj->frozen)
+    if (proj->frozen || bulk_load_depth)
         return;
 
     /* let listeners know that the times have changed */
-    for (node = proj->listeners; node; node = node->next)
-    {
-        Notifier *ntf = node->data;
-        (ntf->func)(proj, ntf->user_data);
-    }
+    proj_run_listeners(proj);
 }
 
 /* =========================================================== */
@@ -1766,8 +2742,7 @@ static void proj_modified(GttProject *proj)
 void gtt_clear_daily_counter(GttProject *proj)
 {
     time_t midnight;
-    int not_done = TRUE;
-    GList *tsk_node, *in;
+    GList *tsk_node;
     int is_running;
 
     if (!proj)
@@ -1785,24 +2760,12 @@ void gtt_clear_daily_counter(GttProject *proj)
     {
         GttTask *task = tsk_node->data;
 
-        not_done = TRUE;
-        while (not_done)
+        /* only nuke the ones that started after midnight.
+         * The ones that started before midnight remain.
+         * These are all at the head of the array. */
+        while (task->intervals->len && (IVL_REC(task, 0)->start >= midnight))
         {
-            not_done = FALSE;
-            for (in = task->interval_list; in; in = in->next)
-            {
-                GttInterval *ivl = in->data;
-
-                /* only nuke the ones that started after midnight.
-                 * The ones that started before midnight remain */
-                if (ivl->start >= midnight)
-                {
-                    task->interval_list = g_list_remove(task->interval_list, ivl);
-                    g_free(ivl);
-                    not_done = TRUE;
-                    break;
-                }
-            }
+            task_ivl_remove(task, 0);
         }
     }
     gtt_project_thaw(proj);
@@ -1815,7 +2778,8 @@ void gtt_clear_daily_counter(GttProject *proj)
 void gtt_project_timer_start(GttProject *proj)
 {
     GttTask *task;
-    GttInterval *ival;
+    GttIntervalRec *ival;
+    GttIntervalRec rec = { 0 };
     time_t now;
 
     if (!proj)
@@ -1847,32 +2811,32 @@ void gtt_project_timer_start(GttProject *proj)
     }
 
     now = time(0);
+    data_changed();
 
     /* only add a new interval if there's been a bit of a gap,
      * otherwise, reuse the most recent running interval.  */
-    if (task->interval_list)
+    if (task->intervals->len)
     {
         int delta;
-        ival = task->interval_list->data;
+        ival = IVL_REC(task, 0);
         delta = now - ival->stop;
 
         if (delta <= proj->auto_merge_gap)
         {
-
+            task_accum(task, ival, -1);
             ival->start += delta;
             ival->fuzz += delta;
             ival->stop = now;
             ival->running = TRUE;
+            task_accum(task, ival, 1);
             return;
         }
     }
 
-    ival = g_new0(GttInterval, 1);
-    ival->start = now;
-    ival->stop = ival->start;
-    ival->running = TRUE;
-    task->interval_list = g_list_prepend(task->interval_list, ival);
-    ival->parent = task;
+    rec.start = now;
+    rec.stop = rec.start;
+    rec.running = TRUE;
+    task_ivl_insert(task, &rec);
 
     /* don't add the task until after we've done above */
     if (NULL == proj->task_list)
@@ -1884,8 +2848,8 @@ void gtt_project_timer_start(GttProject *proj)
 void gtt_project_timer_update(GttProject *proj)
 {
     GttTask *task;
-    GttInterval *ival;
-    time_t prev_update, now, diff;
+    GttIntervalRec *ival;
+    time_t now, was;
 
     if (!proj)
         return;
@@ -1901,10 +2865,9 @@ void gtt_project_timer_update(GttProject *proj)
 
     /* Its possible that there are no intervals (which implies
      * that the timer isn't running). */
-    if (NULL == task->interval_list)
+    if (0 == task->intervals->len)
         return;
-    ival = task->interval_list->data;
-    g_return_if_fail(ival);
+    ival = IVL_REC(task, 0);
 
     /* If timer isn't running, do nothing.  Normally,
      * this function should never be called when timer is stopped,
@@ -1916,22 +2879,21 @@ void gtt_project_timer_update(GttProject *proj)
 
     /* compute the delta change, update cached data */
     now = time(0);
+    period_bounds_check(now);
 
-    /* hack alert -- why aren't we checking a midnight rollover? */
-    prev_update = ival->stop;
+    was = ival->stop;
     ival->stop = now;
-    diff = now - prev_update;
-    proj->secs_ever += diff;
-    proj->secs_day += diff;
-    proj->secs_week += diff;
-    proj->secs_month += diff;
-    proj->secs_year += diff;
+    task_tick_secs(task, ival, was);
+    task_changed(task, GTT_SAVE_TICKED);
+
+    /* If we just went past midnight, the old totals are useless */
+    if (proj->secs_generation != period_bounds.generation)
+        project_compute_secs(proj);
 }
 
 void gtt_project_timer_stop(GttProject *proj)
 {
     GttTask *task;
-    GttInterval *ival;
 
     if (!proj)
         return;
@@ -1946,11 +2908,10 @@ void gtt_project_timer_stop(GttProject *proj)
 
     /* its 'legal' to have no intervals, which implies
      * that the timer isn't running anyway. */
-    if (task->interval_list)
+    if (task->intervals->len)
     {
-        ival = task->interval_list->data;
-        g_return_if_fail(ival);
-        ival->running = FALSE;
+        IVL_REC(task, 0)->running = FALSE;
+        task_changed(task, GTT_SAVE_DIRTY);
     }
 
     /* When we stop the timer, call proj_refresh_time(),
@@ -2039,20 +3000,36 @@ gboolean gtt_project_obj_register(void)
 
 /* =========================================================== */
 
+/* Notes that point into a mapped file are not in the string pool */
+static void drop_task_notes(GttTask *task)
+{
+    if (task->notes_source)
+        g_bytes_unref(task->notes_source);
+    else
+        gtt_string_pool_unref(task->notes);
+    task->notes = NULL;
+    task->notes_source = NULL;
+}
+
 GttTask *gtt_task_new(void)
 {
     GttTask *task;
 
     task = g_new0(GttTask, 1);
     task->parent = NULL;
-    task->memo = g_strdup(_("New Diary Entry"));
-    task->notes = g_strdup("");
+    task->memo = gtt_string_pool_intern(_("New Diary Entry"));
+    task->notes = gtt_string_pool_intern("");
     task->billable = GTT_BILLABLE;
     task->billrate = GTT_REGULAR;
     task->billstatus = GTT_BILL, task->bill_unit = 900;
-    task->interval_list = NULL;
+    task->intervals = g_array_new(FALSE, FALSE, sizeof(GttIntervalRec));
+    task->dirty_start = 1;
+    task->dirty_stop = 0;
 
     qof_instance_init(&task->inst, GTT_TASK_ID, global_book);
+
+    lookup_tables_init();
+    g_hash_table_insert(task_guid_table, (gpointer) gtt_task_get_guid(task), task);
     return task;
 }
 
@@ -2065,17 +3042,24 @@ GttTask *gtt_task_copy(GttTask *old)
 
     task = g_new0(GttTask, 1);
     task->parent = NULL;
-    task->memo = g_strdup(old->memo);
-    task->notes = g_strdup(old->notes);
+    task->memo = gtt_string_pool_ref(old->memo);
+    if (old->notes_source)
+        task->notes_source = g_bytes_ref(old->notes_source);
+    task->notes = old->notes_source ? old->notes : gtt_string_pool_ref(old->notes);
 
     /* inherit the properties ... important for user */
     task->billable = old->billable;
     task->billrate = old->billrate;
     task->billstatus = old->billstatus;
     task->bill_unit = old->bill_unit;
-    task->interval_list = NULL;
+    task->intervals = g_array_new(FALSE, FALSE, sizeof(GttIntervalRec));
+    task->dirty_start = 1;
+    task->dirty_stop = 0;
 
     qof_instance_init(&task->inst, GTT_TASK_ID, global_book);
+
+    lookup_tables_init();
+    g_hash_table_insert(task_guid_table, (gpointer) gtt_task_get_guid(task), task);
     return task;
 }
 
@@ -2084,16 +3068,17 @@ static int task_suspend(GttTask *tsk)
     int is_running = 0;
 
     /* avoid misplaced running intervals, stop the task */
-    if (tsk->interval_list)
+    if (tsk->intervals->len)
     {
-        GttInterval *first_ivl;
-        first_ivl = (GttInterval *) (tsk->interval_list->data);
+        GttIntervalRec *first_ivl;
+        first_ivl = IVL_REC(tsk, 0);
         is_running = first_ivl->running;
         if (is_running)
         {
             /* don't call stop here, avoid dispatching redraw events */
             gtt_project_timer_update(tsk->parent);
-            first_ivl->running = FALSE;
+            IVL_REC(tsk, 0)->running = FALSE;
+            task_changed(tsk, GTT_SAVE_DIRTY);
         }
     }
     return is_running;
@@ -2108,29 +3093,32 @@ void gtt_task_destroy(GttTask *task)
     is_running = task_suspend(task);
     if (task->parent)
     {
+        structure_changed();
+        task_accum_all(task, -1);
         task->parent->task_list = g_list_remove(task->parent->task_list, task);
+        task->parent->task_tail = NULL;
         if (is_running)
             gtt_project_timer_start(task->parent);
         proj_refresh_time(task->parent);
         task->parent = NULL;
     }
+    lookup_table_remove(task_guid_table, gtt_task_get_guid(task), task);
+    if (walk_tasks)
+        g_hash_table_remove(walk_tasks, task);
 
-    if (task->memo)
-        g_free(task->memo);
+    gtt_string_pool_unref(task->memo);
     task->memo = NULL;
-    if (task->notes)
-        g_free(task->notes);
-    task->notes = NULL;
-    if (task->interval_list)
+    drop_task_notes(task);
+    if (task->intervals)
     {
-        GList *node;
-        for (node = task->interval_list; node; node = node->next)
-        {
-            /* free the individual intervals */
-            g_free(node->data);
-        }
-        g_list_free(task->interval_list);
-        task->interval_list = NULL;
+        task_ivl_clear(task);
+        g_array_free(task->intervals, TRUE);
+        task->intervals = NULL;
+    }
+    if (task->journal_state)
+    {
+        changed_tasks = g_list_remove(changed_tasks, task);
+        task->journal_state = GTT_SAVE_CLEAN;
     }
 }
 
@@ -2146,7 +3134,10 @@ void gtt_task_remove(GttTask *task)
 
     if (project)
     {
+        structure_changed();
+        task_accum_all(task, -1);
         project->task_list = g_list_remove(project->task_list, task);
+        project->task_tail = NULL;
         gtt_project_set_current_task(project, gtt_project_get_first_task(project));
         if (is_running)
             gtt_project_timer_start(project);
@@ -2170,10 +3161,13 @@ void gtt_task_insert(GttTask *where, GttTask *insertee)
 
     gtt_task_remove(insertee);
     is_running = task_suspend(where);
+    structure_changed();
 
     insertee->parent = prj;
+    task_accum_all(insertee, 1);
     idx = g_list_index(prj->task_list, where);
     prj->task_list = g_list_insert(prj->task_list, insertee, idx);
+    prj->task_tail = NULL;
 
     if (is_running)
         gtt_project_timer_start(prj);
@@ -2197,7 +3191,6 @@ GttTask *gtt_task_new_insert(GttTask *old)
     task->billrate = old->billrate;
     task->billstatus = old->billstatus;
     task->bill_unit = old->bill_unit;
-    task->interval_list = NULL;
 
     /* chain into place */
     prj = old->parent;
@@ -2207,9 +3200,11 @@ GttTask *gtt_task_new_insert(GttTask *old)
 
     /* avoid misplaced running intervals, stop the task */
     is_running = task_suspend(old);
+    structure_changed();
 
     idx = g_list_index(prj->task_list, old);
     prj->task_list = g_list_insert(prj->task_list, task, idx);
+    prj->task_tail = NULL;
     prj->current_task = task;
 
     if (is_running)
@@ -2220,7 +3215,9 @@ GttTask *gtt_task_new_insert(GttTask *old)
 
 void gtt_task_set_guid(GttTask *tsk, const GUID *guid)
 {
+    lookup_table_remove(task_guid_table, gtt_task_get_guid(tsk), tsk);
     qof_entity_set_guid(&tsk->inst.entity, guid);
+    g_hash_table_insert(task_guid_table, (gpointer) gtt_task_get_guid(tsk), tsk);
 }
 
 const GUID *gtt_task_get_guid(GttTask *tsk)
@@ -2233,49 +3230,143 @@ void gtt_task_add_interval(GttTask *tsk, GttInterval *ival)
     if (!tsk || !ival)
         return;
     gtt_interval_unhook(ival);
-    tsk->interval_list = g_list_prepend(tsk->interval_list, ival);
-    ival->parent = tsk;
+    ival->rec.handle = ival;
+    task_ivl_insert(tsk, &ival->rec);
     proj_refresh_time(tsk->parent);
 }
 
 void gtt_task_append_interval(GttTask *tsk, GttInterval *ival)
 {
-    if (!tsk || !ival)
+    gtt_task_add_interval(tsk, ival);
+}
+
+void gtt_task_append_interval_rec(GttTask *tsk, const GttIntervalRec *rec)
+{
+    GttIntervalRec copy;
+
+    if (!tsk || !rec)
         return;
-    gtt_interval_unhook(ival);
-    tsk->interval_list = g_list_append(tsk->interval_list, ival);
-    ival->parent = tsk;
+    copy = *rec;
+    copy.handle = NULL;
+    task_ivl_insert(tsk, &copy);
     proj_refresh_time(tsk->parent);
 }
 
+void gtt_task_clear_intervals(GttTask *tsk)
+{
+    if (!tsk)
+        return;
+    task_ivl_clear(tsk);
+    proj_refresh_time(tsk->parent);
+}
+
+void gtt_task_set_archived_secs(GttTask *tsk, int secs)
+{
+    if (!tsk)
+        return;
+    task_changed(tsk, GTT_SAVE_DIRTY);
+    task_accum_archived(tsk, secs - tsk->archived_secs);
+    proj_refresh_time(tsk->parent);
+}
+
+int gtt_task_get_archived_secs(GttTask *tsk)
+{
+    if (!tsk)
+        return 0;
+    return tsk->archived_secs;
+}
+
+void gtt_task_set_archived_span(GttTask *tsk, time_t first, time_t last)
+{
+    if (!tsk)
+        return;
+    task_changed(tsk, GTT_SAVE_DIRTY);
+    tsk->archived_first = first;
+    tsk->archived_last = last;
+}
+
+gboolean gtt_task_get_archived_span(GttTask *tsk, time_t *first, time_t *last)
+{
+    if (!tsk || !tsk->archived_last)
+        return FALSE;
+    if (first)
+        *first = tsk->archived_first;
+    if (last)
+        *last = tsk->archived_last;
+    return TRUE;
+}
+
+gboolean gtt_task_load_archived_interval_rec(GttTask *tsk, const GttIntervalRec *rec)
+{
+    guint i;
+    int secs;
+
+    if (!tsk || !rec)
+        return FALSE;
+
+    /* Already there, e.g. because the data file was restored from a
+     * backup made before the interval was archived */
+    i = task_find_slot(tsk, rec->start);
+    while (i && (IVL_REC(tsk, i - 1)->start == rec->start))
+    {
+        if (IVL_REC(tsk, --i)->stop == rec->stop)
+            return FALSE;
+    }
+
+    secs = rec->stop - rec->start;
+    if (secs > tsk->archived_secs)
+    {
+        g_warning(
+            "the archives hold more time than the data file says for task %s\n",
+            tsk->memo ? tsk->memo : ""
+        );
+        secs = tsk->archived_secs;
+    }
+    task_accum_archived(tsk, -secs);
+    gtt_task_append_interval_rec(tsk, rec);
+    return TRUE;
+}
+
+/* Memos and notes live in the string pool; look up the new
+ * string before letting go of the old one, in case they are the same. */
 void gtt_task_set_memo(GttTask *tsk, const char *m)
 {
+    const char *old;
     if (!tsk)
         return;
-    if (tsk->memo)
-        g_free(tsk->memo);
+    old = tsk->memo;
     if (!m)
     {
-        tsk->memo = g_strdup("");
+        tsk->memo = gtt_string_pool_intern("");
+        gtt_string_pool_unref(old);
         return;
     }
-    tsk->memo = g_strdup(m);
-    proj_modified(tsk->parent);
+    tsk->memo = gtt_string_pool_intern(m);
+    gtt_string_pool_unref(old);
+    task_modified(tsk);
 }
 
 void gtt_task_set_notes(GttTask *tsk, const char *m)
 {
+    const char *str;
     if (!tsk)
         return;
-    if (tsk->notes)
-        g_free(tsk->notes);
-    if (!m)
-    {
-        tsk->notes = g_strdup("");
+    str = gtt_string_pool_intern(m ? m : "");
+    drop_task_notes(tsk);
+    tsk->notes = str;
+    if (m)
+        task_modified(tsk);
+}
+
+void gtt_task_set_notes_mapped(GttTask *tsk, GBytes *source, const char *m)
+{
+    if (!tsk || !source || !m)
         return;
-    }
-    tsk->notes = g_strdup(m);
-    proj_modified(tsk->parent);
+    g_bytes_ref(source);
+    drop_task_notes(tsk);
+    tsk->notes = m;
+    tsk->notes_source = source;
+    task_modified(tsk);
 }
 
 const char *gtt_task_get_memo(GttTask *tsk)
@@ -2297,7 +3388,7 @@ void gtt_task_set_billable(GttTask *tsk, GttBillable b)
     if (!tsk)
         return;
     tsk->billable = b;
-    proj_modified(tsk->parent);
+    task_modified(tsk);
 }
 
 GttBillable gtt_task_get_billable(GttTask *tsk)
@@ -2312,7 +3403,7 @@ void gtt_task_set_billrate(GttTask *tsk, GttBillRate b)
     if (!tsk)
         return;
     tsk->billrate = b;
-    proj_modified(tsk->parent);
+    task_modified(tsk);
 }
 
 GttBillRate gtt_task_get_billrate(GttTask *tsk)
@@ -2327,7 +3418,7 @@ void gtt_task_set_billstatus(GttTask *tsk, GttBillStatus b)
     if (!tsk)
         return;
     tsk->billstatus = b;
-    proj_modified(tsk->parent);
+    task_modified(tsk);
 }
 
 GttBillStatus gtt_task_get_billstatus(GttTask *tsk)
@@ -2342,7 +3433,7 @@ void gtt_task_set_bill_unit(GttTask *tsk, int b)
     if (!tsk)
         return;
     tsk->bill_unit = b;
-    proj_modified(tsk->parent);
+    task_modified(tsk);
 }
 
 int gtt_task_get_bill_unit(GttTask *tsk)
@@ -2352,11 +3443,84 @@ int gtt_task_get_bill_unit(GttTask *tsk)
     return tsk->bill_unit;
 }
 
-GList *gtt_task_get_intervals(GttTask *tsk)
+guint gtt_task_get_num_intervals(GttTask *tsk)
+{
+    if (!tsk)
+        return 0;
+    return tsk->intervals->len;
+}
+
+GttInterval *gtt_task_get_interval(GttTask *tsk, guint n)
 {
+    if (!tsk || (n >= tsk->intervals->len))
+        return NULL;
+    return task_ivl_handle(tsk, n);
+}
+
+void gtt_interval_walk_begin(void)
+{
+    if (NULL == walk_tasks)
+        walk_tasks = g_hash_table_new(g_direct_hash, g_direct_equal);
+    walk_depth++;
+}
+
+static void walk_release(gpointer key, gpointer value, gpointer data)
+{
+    GttTask *tsk = key;
+    guint i;
+
+    for (i = 0; i < tsk->intervals->len; i++)
+    {
+        GttIntervalRec *rec = IVL_REC(tsk, i);
+        if (rec->handle && !rec->handle->held)
+        {
+            g_free(rec->handle);
+            rec->handle = NULL;
+        }
+    }
+}
+
+void gtt_interval_walk_end(void)
+{
+    g_return_if_fail(0 < walk_depth);
+    if (0 < --walk_depth)
+        return;
+    g_hash_table_foreach(walk_tasks, walk_release, NULL);
+    g_hash_table_remove_all(walk_tasks);
+}
+
+GttInterval *gtt_task_walk_interval(GttTask *tsk, guint n)
+{
+    if (!tsk || (n >= tsk->intervals->len))
+        return NULL;
+    if (0 == walk_depth)
+        return task_ivl_handle(tsk, n);
+    g_hash_table_add(walk_tasks, tsk);
+    return task_ivl_peek(tsk, n);
+}
+
+GttInterval *gtt_task_find_interval(GttTask *tsk, time_t start)
+{
+    guint slot;
+
     if (!tsk)
         return NULL;
-    return tsk->interval_list;
+    slot = task_find_slot(tsk, start);
+    if ((0 == slot) || (IVL_REC(tsk, slot - 1)->start != start))
+        return NULL;
+    return task_ivl_handle(tsk, slot - 1);
+}
+
+GttInterval *gtt_task_walk_find_interval(GttTask *tsk, time_t start)
+{
+    guint slot;
+
+    if (!tsk)
+        return NULL;
+    slot = task_find_slot(tsk, start);
+    if ((0 == slot) || (IVL_REC(tsk, slot - 1)->start != start))
+        return NULL;
+    return gtt_task_walk_interval(tsk, slot - 1);
 }
 
 gboolean gtt_task_is_first_task(GttTask *tsk)
@@ -2400,6 +3564,7 @@ void gtt_task_merge_up(GttTask *tsk)
     prj = tsk->parent;
     if (!prj || !prj->task_list)
         return;
+    task_load_archive(tsk);
 
     node = g_list_find(prj->task_list, tsk);
     if (!node)
@@ -2410,59 +3575,47 @@ void gtt_task_merge_up(GttTask *tsk)
         return;
 
     mtask = node->data;
+    structure_changed();
 
-    for (node = tsk->interval_list; node; node = node->next)
-    {
-        GttInterval *ivl = node->data;
-        ivl->parent = mtask;
-    }
-    mtask->interval_list = g_list_concat(mtask->interval_list, tsk->interval_list);
-    tsk->interval_list = NULL;
+    g_array_append_vals(mtask->intervals, tsk->intervals->data, tsk->intervals->len);
+    g_array_set_size(tsk->intervals, 0);
+    mtask->secs_ever += tsk->secs_ever;
+    mtask->archived_secs += tsk->archived_secs;
+    tsk->secs_ever = 0;
+    tsk->archived_secs = 0;
+    proj_invalidate_totals(prj);
+    g_array_sort(mtask->intervals, ivl_rec_cmp);
+    task_fix_handles(mtask, 0, mtask->intervals->len);
+    task_mark_all_dirty(mtask);
 }
 
 /* =========================================================== */
 
 int gtt_task_get_secs_ever(GttTask *tsk)
 {
-    GList *node;
-    int total = 0;
-
-    for (node = tsk->interval_list; node; node = node->next)
-    {
-        GttInterval *ivl = node->data;
-        total += ivl->stop - ivl->start;
-    }
-    return total;
+    return tsk->secs_ever;
 }
 
 time_t gtt_task_get_secs_earliest(GttTask *tsk)
 {
-    GList *node;
-    if (NULL == tsk->interval_list)
+    if (0 == tsk->intervals->len)
         return 0;
 
-    time_t earliest = INT_MAX;
-
-    for (node = tsk->interval_list; node; node = node->next)
-    {
-        GttInterval *ivl = node->data;
-        if (ivl->start < earliest)
-            earliest = ivl->start;
-    }
-    return earliest;
+    /* The array is sorted, oldest last */
+    return IVL_REC(tsk, tsk->intervals->len - 1)->start;
 }
 
 time_t gtt_task_get_secs_latest(GttTask *tsk)
 {
-    GList *node;
-    if (NULL == tsk->interval_list)
+    guint i;
+    if (0 == tsk->intervals->len)
         return 0;
 
     time_t latest = INT_MIN;
 
-    for (node = tsk->interval_list; node; node = node->next)
+    for (i = 0; i < tsk->intervals->len; i++)
     {
-        GttInterval *ivl = node->data;
+        GttIntervalRec *ivl = IVL_REC(tsk, i);
         if (ivl->stop > latest)
             latest = ivl->stop;
     }
@@ -2476,10 +3629,12 @@ GttInterval *gtt_interval_new(void)
     GttInterval *ivl;
     ivl = g_new0(GttInterval, 1);
     ivl->parent = NULL;
-    ivl->start = 0;
-    ivl->stop = 0;
-    ivl->running = FALSE;
-    ivl->fuzz = 0;
+    ivl->rec.start = 0;
+    ivl->rec.stop = 0;
+    ivl->rec.running = FALSE;
+    ivl->rec.fuzz = 0;
+    ivl->rec.handle = ivl;
+    ivl->held = TRUE;
     return ivl;
 }
 
@@ -2493,81 +3648,103 @@ void gtt_interval_destroy(GttInterval *ivl)
 
 static void gtt_interval_unhook(GttInterval *ivl)
 {
-    if (NULL == ivl->parent)
+    GttTask *prnt = ivl->parent;
+    guint idx = ivl->idx;
+
+    if (NULL == prnt)
         return;
 
-    /* Unhook myself from the chain */
-    ivl->parent->interval_list = g_list_remove(ivl->parent->interval_list, ivl);
-    proj_refresh_time(ivl->parent->parent);
+    /* Take a copy of my data, and unhook myself from the array */
+    ivl->rec = *IVL_REC(prnt, idx);
+    task_accum(prnt, &ivl->rec, -1);
+    g_array_remove_index(prnt->intervals, idx);
+    task_fix_handles(prnt, idx, prnt->intervals->len);
     ivl->parent = NULL;
+    proj_refresh_time(prnt->parent);
 }
 
 void gtt_interval_set_start(GttInterval *ivl, time_t st)
 {
+    GttIntervalRec *rec;
     if (!ivl)
         return;
-    ivl->start = st;
-    if (st > ivl->stop)
-        ivl->stop = st;
+    rec = ivl_rec(ivl);
     if (ivl->parent)
+        task_accum(ivl->parent, rec, -1);
+    rec->start = st;
+    if (st > rec->stop)
+        rec->stop = st;
+    if (ivl->parent)
+    {
+        task_accum(ivl->parent, rec, 1);
+        task_ivl_resort(ivl->parent, ivl->idx);
         proj_refresh_time(ivl->parent->parent);
+    }
 }
 
 void gtt_interval_set_stop(GttInterval *ivl, time_t st)
 {
+    GttIntervalRec *rec;
     if (!ivl)
         return;
-    ivl->stop = st;
-    if (st < ivl->start)
-        ivl->start = st;
+    rec = ivl_rec(ivl);
+    if (ivl->parent)
+        task_accum(ivl->parent, rec, -1);
+    rec->stop = st;
+    if (st < rec->start)
+        rec->start = st;
     if (ivl->parent)
+    {
+        task_accum(ivl->parent, rec, 1);
+        task_ivl_resort(ivl->parent, ivl->idx);
         proj_refresh_time(ivl->parent->parent);
+    }
 }
 
 void gtt_interval_set_fuzz(GttInterval *ivl, int st)
 {
     if (!ivl)
         return;
-    ivl->fuzz = st;
+    ivl_rec(ivl)->fuzz = st;
     if (ivl->parent)
-        proj_modified(ivl->parent->parent);
+        task_modified(ivl->parent);
 }
 
 void gtt_interval_set_running(GttInterval *ivl, gboolean st)
 {
     if (!ivl)
         return;
-    ivl->running = st;
+    ivl_rec(ivl)->running = st;
     if (ivl->parent)
-        proj_modified(ivl->parent->parent);
+        task_modified(ivl->parent);
 }
 
 time_t gtt_interval_get_start(GttInterval *ivl)
 {
     if (!ivl)
         return 0;
-    return ivl->start;
+    return ivl_rec(ivl)->start;
 }
 
 time_t gtt_interval_get_stop(GttInterval *ivl)
 {
     if (!ivl)
         return 0;
-    return ivl->stop;
+    return ivl_rec(ivl)->stop;
 }
 
 int gtt_interval_get_fuzz(GttInterval *ivl)
 {
     if (!ivl)
         return 0;
-    return ivl->fuzz;
+    return ivl_rec(ivl)->fuzz;
 }
 
 gboolean gtt_interval_is_running(GttInterval *ivl)
 {
     if (!ivl)
         return FALSE;
-    return (gboolean) ivl->running;
+    return (gboolean) ivl_rec(ivl)->running;
 }
 
 GttTask *gtt_interval_get_parent(GttInterval *ivl)
@@ -2579,20 +3756,20 @@ GttTask *gtt_interval_get_parent(GttInterval *ivl)
 
 gboolean gtt_interval_is_first_interval(GttInterval *ivl)
 {
-    if (!ivl || !ivl->parent || !ivl->parent->interval_list)
+    if (!ivl || !ivl->parent || !ivl->parent->intervals->len)
         return TRUE;
 
-    if ((GttInterval *) ivl->parent->interval_list->data == ivl)
+    if (0 == ivl->idx)
         return TRUE;
     return FALSE;
 }
 
 gboolean gtt_interval_is_last_interval(GttInterval *ivl)
 {
-    if (!ivl || !ivl->parent || !ivl->parent->interval_list)
+    if (!ivl || !ivl->parent || !ivl->parent->intervals->len)
         return TRUE;
 
-    if ((GttInterval *) ((g_list_last(ivl->parent->interval_list))->data) == ivl)
+    if (ivl->parent->intervals->len - 1 == ivl->idx)
         return TRUE;
     return FALSE;
 }
@@ -2601,9 +3778,9 @@ gboolean gtt_interval_is_last_interval(GttInterval *ivl)
 
 GttInterval *gtt_interval_new_insert_after(GttInterval *where)
 {
-    GttInterval *ivl;
+    GttIntervalRec rec;
     GttTask *tsk;
-    int idx;
+    guint idx;
 
     if (!where)
         return NULL;
@@ -2613,15 +3790,13 @@ GttInterval *gtt_interval_new_insert_after(GttInterval *where)
         return NULL;
 
     /* clone the other interval */
-    ivl = g_new0(GttInterval, 1);
-    ivl->parent = tsk;
-    ivl->start = where->start;
-    ivl->stop = where->stop;
-    ivl->running = FALSE;
-    ivl->fuzz = where->fuzz;
+    rec = *ivl_rec(where);
+    rec.running = FALSE;
+    rec.handle = NULL;
 
-    idx = g_list_index(tsk->interval_list, where);
-    tsk->interval_list = g_list_insert(tsk->interval_list, ivl, idx);
+    /* The clone has the same start time, so it sorts right
+     * next to the original. */
+    idx = task_ivl_insert_at(tsk, where->idx, &rec);
 
     /* Don't do a refresh, since the refresh will probably
      * cull this interval for being to short, or merge it,
@@ -2629,16 +3804,14 @@ GttInterval *gtt_interval_new_insert_after(GttInterval *where)
      */
     /* proj_refresh_time (tsk->parent); */
 
-    return ivl;
+    return task_ivl_handle(tsk, idx);
 }
 
 GttInterval *gtt_interval_merge_up(GttInterval *ivl)
 {
-    int more_fuzz;
-    int ivl_len;
-    GList *node;
     GttInterval *merge;
     GttTask *prnt;
+    int slot;
 
     if (!ivl)
         return NULL;
@@ -2646,46 +3819,20 @@ GttInterval *gtt_interval_merge_up(GttInterval *ivl)
     if (!prnt)
         return NULL;
 
-    for (node = prnt->interval_list; node; node = node->next)
-    {
-        if (ivl == node->data)
-            break;
-    }
-    if (!node)
-        return NULL;
-    node = node->prev;
-    if (!node)
-        return NULL;
-
-    merge = node->data;
-    if (!merge)
+    slot = task_ivl_merge_up(prnt, ivl->idx);
+    if (0 > slot)
         return NULL;
 
-    /* the fuzz is the gap between stop and start times */
-    more_fuzz = merge->start - ivl->stop;
-    ivl_len = ivl->stop - ivl->start;
-    if (more_fuzz > ivl_len)
-        more_fuzz = ivl_len;
-
-    merge->start -= ivl_len;
-    if (ivl->fuzz > merge->fuzz)
-        merge->fuzz = ivl->fuzz;
-    if (more_fuzz > merge->fuzz)
-        merge->fuzz = more_fuzz;
-
-    gtt_interval_destroy(ivl);
-
+    merge = task_ivl_handle(prnt, slot);
     proj_refresh_time(prnt->parent);
     return merge;
 }
 
 GttInterval *gtt_interval_merge_down(GttInterval *ivl)
 {
-    int more_fuzz;
-    int ivl_len;
-    GList *node;
     GttInterval *merge;
     GttTask *prnt;
+    int slot;
 
     if (!ivl)
         return NULL;
@@ -2693,34 +3840,11 @@ GttInterval *gtt_interval_merge_down(GttInterval *ivl)
     if (!prnt)
         return NULL;
 
-    for (node = prnt->interval_list; node; node = node->next)
-    {
-        if (ivl == node->data)
-            break;
-    }
-    if (!node)
-        return NULL;
-    node = node->next;
-    if (!node)
-        return NULL;
-
-    merge = node->data;
-    if (!merge)
+    slot = task_ivl_merge_down(prnt, ivl->idx);
+    if (0 > slot)
         return NULL;
 
-    /* the fuzz is the gap between stop and start times */
-    more_fuzz = ivl->start - merge->stop;
-    ivl_len = ivl->stop - ivl->start;
-    if (more_fuzz > ivl_len)
-        more_fuzz = ivl_len;
-
-    merge->stop += ivl_len;
-    if (ivl->fuzz > merge->fuzz)
-        merge->fuzz = ivl->fuzz;
-    if (more_fuzz > merge->fuzz)
-        merge->fuzz = more_fuzz;
-    gtt_interval_destroy(ivl);
-
+    merge = task_ivl_handle(prnt, slot);
     proj_refresh_time(prnt->parent);
     return merge;
 }
@@ -2729,10 +3853,10 @@ void gtt_interval_split(GttInterval *ivl, GttTask *newtask)
 {
     int is_running = 0;
     gint idx;
+    guint split, i;
     GttProject *prj;
     GttTask *prnt;
-    GList *node;
-    GttInterval *first_ivl;
+    GttIntervalRec *first_ivl;
 
     if (!ivl || !newtask)
         return;
@@ -2742,47 +3866,51 @@ void gtt_interval_split(GttInterval *ivl, GttTask *newtask)
     prj = prnt->parent;
     if (!prj)
         return;
-    node = g_list_find(prnt->interval_list, ivl);
-    if (!node)
-        return;
+    task_load_archive(prnt);
 
     gtt_task_remove(newtask);
 
     /* avoid misplaced running intervals, stop the task */
-    first_ivl = (GttInterval *) (prnt->interval_list->data);
+    first_ivl = IVL_REC(prnt, 0);
     is_running = first_ivl->running;
     if (is_running)
     {
         /* don't call stop here, avoid dispatching redraw events */
         gtt_project_timer_update(prj);
-        first_ivl->running = FALSE;
+        IVL_REC(prnt, 0)->running = FALSE;
+        task_changed(prnt, GTT_SAVE_DIRTY);
     }
 
     /* chain the new task into proper order in the parent project */
+    structure_changed();
+    task_ivl_clear(newtask);
     idx = g_list_index(prj->task_list, prnt);
     idx++;
     prj->task_list = g_list_insert(prj->task_list, newtask, idx);
+    prj->task_tail = NULL;
     newtask->parent = prj;
 
-    /* Rechain the intervals.  We do this by hand, since it
-     * seems that glib doesn't provide this function. */
-    if (node->prev)
-    {
-        node->prev->next = NULL;
-        node->prev = NULL;
-    }
-    else
+    /* Move this interval, and all the older ones after it,
+     * over to the new task.  The project totals don't change. */
+    split = ivl->idx;
+    g_array_append_vals(
+        newtask->intervals, IVL_REC(prnt, split), prnt->intervals->len - split
+    );
+    g_array_set_size(prnt->intervals, split);
+    task_fix_handles(newtask, 0, newtask->intervals->len);
+    for (i = 0; i < newtask->intervals->len; i++)
     {
-        prnt->interval_list = NULL;
+        GttIntervalRec *rec = IVL_REC(newtask, i);
+        newtask->secs_ever += rec->stop - rec->start;
     }
 
-    newtask->interval_list = node;
-
-    for (; node; node = node->next)
-    {
-        GttInterval *nivl = node->data;
-        nivl->parent = newtask;
-    }
+    /* Whatever couldn't be loaded from the archive is older still */
+    newtask->archived_secs += prnt->archived_secs;
+    newtask->secs_ever += prnt->archived_secs;
+    prnt->secs_ever -= newtask->secs_ever;
+    prnt->archived_secs = 0;
+    task_mark_all_dirty(prnt);
+    task_mark_all_dirty(newtask);
 
     if (is_running)
         gtt_project_timer_start(prj);
@@ -2825,9 +3953,77 @@ void gtt_project_list_destroy(GttProjectList *gpl)
     g_free(gpl);
 }
 
+guint gtt_project_list_get_version(void)
+{
+    return data_version;
+}
+
+GttSaveState gtt_project_list_get_save_state(void)
+{
+    if (saved_version == data_version)
+        return GTT_SAVE_CLEAN;
+    if (edit_version <= saved_version)
+        return GTT_SAVE_TICKED;
+    return GTT_SAVE_DIRTY;
+}
+
+void gtt_project_list_mark_dirty(void)
+{
+    data_changed();
+}
+
+void gtt_project_list_mark_saved(guint version)
+{
+    /* A slow background save may finish after a later one */
+    if (version > saved_version)
+        saved_version = version;
+}
+
+void gtt_project_list_set_change_hook(GttChangeHook hook)
+{
+    change_hook = hook;
+}
+
+void gtt_project_list_set_archive_hook(GttArchiveHook hook)
+{
+    archive_hook = hook;
+}
+
+void gtt_project_list_take_changes(GttChangeSet *changes)
+{
+    GList *node;
+
+    changes->projects = g_list_reverse(changed_projects);
+    changes->tasks = NULL;
+    changes->ticked = NULL;
+    changes->structure = changed_structure;
+
+    for (node = changes->projects; node; node = node->next)
+    {
+        GttProject *prj = node->data;
+        prj->journal_pending = FALSE;
+    }
+    for (node = changed_tasks; node; node = node->next)
+    {
+        GttTask *tsk = node->data;
+        if (GTT_SAVE_TICKED == tsk->journal_state)
+            changes->ticked = g_list_prepend(changes->ticked, tsk);
+        else
+            changes->tasks = g_list_prepend(changes->tasks, tsk);
+        tsk->journal_state = GTT_SAVE_CLEAN;
+    }
+    g_list_free(changed_tasks);
+
+    changed_projects = NULL;
+    changed_tasks = NULL;
+    changed_structure = FALSE;
+    changes_noted = FALSE;
+}
+
 static GList *project_list_sort(GList *prjs, int(cmp)(const void *, const void *))
 {
     GList *node;
+    structure_changed();
     prjs = g_list_sort(prjs, cmp);
     for (node = prjs; node; node = node->next)
     {
@@ -2843,29 +4039,25 @@ static GList *project_list_sort(GList *prjs, int(cmp)(const void *, const void *
 /* -------------------- */
 /* given id, walk the tree of projects till we find it. */
 
-static GttProject *locate_from_id(GList *prj_list, int prj_id)
+GttProject *gtt_project_locate_from_id(int prj_id)
 {
-    GList *node;
-    for (node = prj_list; node; node = node->next)
-    {
-        GttProject *prj = node->data;
-        if (prj_id == prj->id)
-            return prj;
+    if (!project_id_table)
+        return NULL;
+    return g_hash_table_lookup(project_id_table, GINT_TO_POINTER(prj_id));
+}
 
-        /* recurse to handle sub-projects */
-        if (prj->sub_projects)
-        {
-            prj = locate_from_id(prj->sub_projects, prj_id);
-            if (prj)
-                return prj;
-        }
-    }
-    return NULL; /* not found */
+GttProject *gtt_project_locate_from_guid(const GUID *guid)
+{
+    if (!project_guid_table || !guid)
+        return NULL;
+    return g_hash_table_lookup(project_guid_table, guid);
 }
 
-GttProject *gtt_project_locate_from_id(int prj_id)
+GttTask *gtt_task_locate_from_guid(const GUID *guid)
 {
-    return locate_from_id(global_plist->prj_list, prj_id);
+    if (!task_guid_table || !guid)
+        return NULL;
+    return g_hash_table_lookup(task_guid_table, guid);
 }
 
 /* ==================================================================== */
@@ -143,6 +143,16 @@ void gtt_project_set_desc(GttProject *, const char *);
 void gtt_project_set_notes(GttProject *, const char *);
 void gtt_project_set_custid(GttProject *, const char *);
 
+/* The gtt_project_set_desc_mapped() and gtt_project_set_notes_mapped()
+ *    routines set the indicated text, which must be a NUL-terminated
+ *    string inside the source, a mapped file.  The text is not copied:
+ *    the project holds on to the source instead, so that the pages of
+ *    long texts are only read in if the text is ever looked at.  These
+ *    are meant for loaders.
+ */
+void gtt_project_set_desc_mapped(GttProject *, GBytes *source, const char *);
+void gtt_project_set_notes_mapped(GttProject *, GBytes *source, const char *);
+
 /* These two routines return the title & desc strings.
  * Do *not* free these strings when done.  Note that
  * are freed when project is deleted. */
@@ -236,9 +246,15 @@ GttProjectStatus gtt_project_get_status(GttProject *);
 void gtt_project_set_id(GttProject *, int id);
 int gtt_project_get_id(GttProject *);
 
-/* return a project, given only its id; NULL if not found */
+/* return a project, given only its id; NULL if not found.
+ * These lookups go through hash tables kept up to date as projects
+ * and tasks are created and destroyed, so they don't walk the tree. */
 GttProject *gtt_project_locate_from_id(int prj_id);
 
+/* return a project or task, given only its GUID; NULL if not found */
+GttProject *gtt_project_locate_from_guid(const GUID *guid);
+GttTask *gtt_task_locate_from_guid(const GUID *guid);
+
 /* The gtt_project_add_notifier() routine allows anoter component
  *    (e.g. a GUI) to add a signal that will be called whenever the
  *    time associated with a project changes. (except timers ???)
@@ -269,6 +285,30 @@ GttInterval *gtt_interval_thaw(GttInterval *ivl);
 void gtt_project_add_notifier(GttProject *, GttProjectChanged, gpointer);
 void gtt_project_remove_notifier(GttProject *, GttProjectChanged, gpointer);
 
+/* The gtt_project_get_changed_tasks() routine, called from a notifier,
+ *    returns the tasks of the project and of its sub-projects that have
+ *    changed since the project's notifiers last ran.  It returns FALSE
+ *    if more than those tasks may have changed: a project, or how the
+ *    projects and tasks are laid out.  The list belongs to the project,
+ *    and is only good while the notifier runs.
+ */
+gboolean gtt_project_get_changed_tasks(GttProject *, GList **tasks);
+
+/* The gtt_project_bulk_load_begin() routine puts the engine into
+ *    bulk-load mode, for use while reading in a data file.  Until the
+ *    matching commit, intervals are not scrubbed, time totals are not
+ *    recomputed, notifiers are not invoked, and project id's are not
+ *    checked for collisions.  Tasks appended to a project go straight
+ *    onto the end of its task list.
+ *
+ * The gtt_project_bulk_load_commit() routine ends bulk-load mode.
+ *    Every project that was touched during the load is scrubbed and
+ *    has its totals recomputed, once, and its notifiers are invoked.
+ *    Calls may be nested; only the outermost commit does the work.
+ */
+void gtt_project_bulk_load_begin(void);
+void gtt_project_bulk_load_commit(void);
+
 /* These functions provide a generic place to hang arbitrary data
  *     on the project (used by the GUI).
  */
@@ -287,6 +327,7 @@ void gtt_project_set_private_data(GttProject *, gpointer);
  *    it continues until each interval has been visited.
  *    This routines does *NOT* visit subprojects.
  *    This routine returns the value of the last callback.
+ *    The intervals are walked as by gtt_task_walk_interval().
  *
  * The gtt_project_foreach_subproject_interval() routine works just
  *    like gtt_project_foreach_interval(), except that it also
@@ -297,6 +338,25 @@ int gtt_project_foreach(GttProject *, GttProjectCB, gpointer);
 int gtt_project_foreach_interval(GttProject *, GttIntervalCB, gpointer);
 int gtt_project_foreach_subproject_interval(GttProject *, GttIntervalCB, gpointer);
 
+/* The gtt_interval_walk_begin() and gtt_interval_walk_end() routines
+ *    bracket a walk over many intervals, such as a report or a query.
+ *    Walks may nest.
+ *
+ * The gtt_task_walk_interval() routine is like gtt_task_get_interval(),
+ *    except that, inside a walk, the handle it returns is only good
+ *    until the outermost walk ends; handles that were not also handed
+ *    out by the other routines are freed then.  Outside of a walk it
+ *    is the same as gtt_task_get_interval().
+ *
+ * The gtt_task_walk_find_interval() routine is to
+ *    gtt_task_find_interval() what gtt_task_walk_interval() is to
+ *    gtt_task_get_interval().
+ */
+void gtt_interval_walk_begin(void);
+void gtt_interval_walk_end(void);
+GttInterval *gtt_task_walk_interval(GttTask *, guint n);
+GttInterval *gtt_task_walk_find_interval(GttTask *, time_t start);
+
 /* -------------------------------------------------------- */
 /* Project Manipulation */
 
@@ -347,6 +407,20 @@ int gtt_project_total_secs_month(GttProject *proj);
 int gtt_project_total_secs_year(GttProject *proj);
 int gtt_project_total_secs_ever(GttProject *proj);
 
+/* The gtt_project_get_secs_range() routine returns the number of
+ *    seconds spent on this project between 'start' and 'end'.
+ *    Intervals that straddle the window are counted only for the
+ *    part that lies inside of it.  If 'include_subprojects' is TRUE,
+ *    then the time spent on sub-projects is included as well.
+ *    The answer comes from an index that is kept with the project,
+ *    so asking about any window costs O(log n), not a scan over
+ *    every interval.  The archived intervals of the years that the
+ *    window reaches into are loaded first.
+ */
+int gtt_project_get_secs_range(
+    GttProject *proj, time_t start, time_t end, gboolean include_subprojects
+);
+
 void gtt_project_list_compute_secs(void);
 
 /* The gtt_project_total() routine returns the total
@@ -439,6 +513,86 @@ GList *gtt_project_list_get_list(GttProjectList *);
 /* Append project to the project list */
 void gtt_project_list_append(GttProjectList *, GttProject *p);
 
+/* The gtt_project_list_get_version() routine returns a counter that
+ *    is bumped by every change to the projects, their tasks and their
+ *    intervals, including the ticking of a running timer.
+ *
+ * The gtt_project_list_get_save_state() routine tells if anything has
+ *    changed since the last version marked as saved, and if so, if the
+ *    only change is the timer moving the running interval along.
+ *
+ * The gtt_project_list_mark_saved() routine records that the data, as
+ *    of the indicated version, has been written out.
+ *
+ * The gtt_project_list_mark_dirty() routine records that the data file
+ *    has to be written out in full, even though the data didn't
+ *    change, e.g. because the way the file is written did.
+ */
+typedef enum
+{
+    GTT_SAVE_CLEAN = 0, /* nothing to save */
+    GTT_SAVE_TICKED,    /* only the running interval changed */
+    GTT_SAVE_DIRTY      /* anything else changed */
+} GttSaveState;
+
+guint gtt_project_list_get_version(void);
+GttSaveState gtt_project_list_get_save_state(void);
+void gtt_project_list_mark_saved(guint version);
+void gtt_project_list_mark_dirty(void);
+
+/* The engine keeps track of which projects and tasks were changed,
+ * so that the changes can be written to the data journal.
+ *
+ * The gtt_project_list_set_change_hook() routine sets a routine that
+ *    is called when a change is made, the first one since the last
+ *    gtt_project_list_take_changes().
+ *
+ * The gtt_project_list_take_changes() routine fills in the projects
+ *    whose own fields changed, the tasks whose fields or intervals
+ *    changed, and the tasks whose running interval merely ticked
+ *    along, in the order in which they were first changed.  The
+ *    structure flag is set if projects or tasks were created, moved
+ *    or destroyed; such changes aren't listed.  The caller must free
+ *    the lists, and starts over with a clean slate.
+ */
+typedef void (*GttChangeHook)(void);
+
+typedef struct gtt_change_set_s
+{
+    GList *projects;    /* projects whose own fields changed */
+    GList *tasks;       /* tasks whose fields or intervals changed */
+    GList *ticked;      /* tasks whose running interval ticked */
+    gboolean structure; /* projects or tasks were added or moved */
+} GttChangeSet;
+
+void gtt_project_list_set_change_hook(GttChangeHook hook);
+void gtt_project_list_take_changes(GttChangeSet *changes);
+
+/* The gtt_project_list_set_archive_hook() routine sets a routine that
+ *    loads the archived intervals of the years that overlap the range
+ *    from start to stop.  It is called before an edit that moves the
+ *    intervals of a task with archived intervals over to another task,
+ *    and by the routines below.
+ *
+ * The gtt_project_load_archive() routine loads the archived intervals
+ *    in the range from start to stop, if the project, or with
+ *    'include_subprojects', any of its sub-projects, has archived
+ *    intervals that aren't loaded.  Queries over a range of time call
+ *    it before looking at the intervals.
+ *
+ * The gtt_task_load_archive() routine loads the archived intervals in
+ *    the range from start to stop, if the task has any there that
+ *    aren't loaded.  Reports call it, with the time window the report
+ *    asked for, before listing the intervals of the task.
+ */
+typedef void (*GttArchiveHook)(time_t start, time_t stop);
+
+void gtt_project_list_set_archive_hook(GttArchiveHook hook);
+void gtt_project_load_archive(
+    GttProject *proj, time_t start, time_t stop, gboolean include_subprojects
+);
+void gtt_task_load_archive(GttTask *tsk, time_t start, time_t stop);
+
 /* The 'sort' functions have a sort-of wacky interface.
  * They will sort the list of projects passed as an argument,
  *
@@ -502,6 +656,7 @@ const GUID *gtt_task_get_guid(GttTask *);
 void gtt_task_set_memo(GttTask *, const char *);
 const char *gtt_task_get_memo(GttTask *);
 void gtt_task_set_notes(GttTask *, const char *);
+void gtt_task_set_notes_mapped(GttTask *, GBytes *source, const char *);
 const char *gtt_task_get_notes(GttTask *);
 
 void gtt_task_set_billable(GttTask *, GttBillable);
@@ -546,7 +701,24 @@ gboolean gtt_task_is_first_task(GttTask *);
 gboolean gtt_task_is_last_task(GttTask *);
 GttProject *gtt_task_get_parent(GttTask *);
 
-GList *gtt_task_get_intervals(GttTask *);
+/* The gtt_task_get_num_intervals() routine returns the number of
+ *    intervals in the task.
+ *
+ * The gtt_task_get_interval() routine returns the n'th interval of
+ *    the task, counting from the most recent one (n==0), which is the
+ *    currently running interval, or the last one to have run.
+ *    Intervals are kept sorted by start time.
+ *
+ * The gtt_task_find_interval() routine returns the interval of the
+ *    task that starts at the given time, or NULL if there is none.
+ *
+ * The gtt_task_add_interval() and gtt_task_append_interval() routines
+ *    move the interval into this task, at the place given by its
+ *    start time.
+ */
+guint gtt_task_get_num_intervals(GttTask *);
+GttInterval *gtt_task_get_interval(GttTask *, guint n);
+GttInterval *gtt_task_find_interval(GttTask *, time_t start);
 void gtt_task_add_interval(GttTask *, GttInterval *);
 void gtt_task_append_interval(GttTask *, GttInterval *);
 
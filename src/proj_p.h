@@ -27,6 +27,9 @@
 #include "proj.h"
 #include "timer.h"
 
+/* sorted start and stop times of a set of intervals; see proj.c */
+typedef struct gtt_time_index_s GttTimeIndex;
+
 struct gtt_project_list_s
 {
     // XXX this should belong to a QOF book
@@ -45,6 +48,11 @@ struct gtt_project_s
     char *notes;  /* long description */
     char *custid; /* customer id (TBD -- index to addresbook) */
 
+    /* If set, desc or notes point into this mapped file, rather
+     * than to a string of their own; see gtt_project_set_notes_mapped() */
+    GBytes *desc_source;
+    GBytes *notes_source;
+
     int min_interval;        /* smallest recorded interval */
     int auto_merge_interval; /* merge intervals smaller than this */
     int auto_merge_gap;      /* merge gaps smaller than this */
@@ -64,6 +72,7 @@ struct gtt_project_s
     GttProjectStatus status; /* overall project status */
 
     GList *task_list;      /* annotated chunks of time */
+    GList *task_tail;      /* last node of task_list, during bulk loads */
     GttTask *current_task; /* a pointer to the currently active task */
 
     /* hack alert -- the project heriarachy should probably be
@@ -80,6 +89,8 @@ struct gtt_project_s
      * by a GObject callback; once this whole struct is a GObject.
      */
     GList *listeners; /* listeners for change events */
+    GList *notify_tasks; /* tasks changed since the listeners last ran */
+    guint notify_layout;  /* whether anything else changed, too */
 
     /* miscellaneous -- used by GUI to display */
     gpointer *private_data;
@@ -89,6 +100,16 @@ struct gtt_project_s
     int being_destroyed : 1; /* project is being destroyed */
     int frozen : 1;          /* defer recomputes of time totals */
     int dirty_time : 1;      /* the time totals are wrong */
+    int dirty_totals : 1;    /* the sub-tree totals are wrong */
+    int dirty_index : 1;     /* the sub-tree time index is wrong */
+    int bulk_touched : 1;    /* changed during the current bulk load */
+    int journal_pending : 1; /* changed since the last journal flush */
+
+    /* The secs_* totals below are kept up to date incrementally, as
+     * intervals are added, removed and changed.  They are relative to
+     * the day, week, month and year boundaries that were current when
+     * they were last computed; secs_generation records which ones. */
+    guint secs_generation;
 
     int secs_ever;      /* seconds spend on this project */
     int secs_year;      /* seconds spent on this project this year */
@@ -97,40 +118,129 @@ struct gtt_project_s
     int secs_lastweek;  /* seconds spent on this project last week */
     int secs_day;       /* seconds spent on this project today */
     int secs_yesterday; /* seconds spent on this project yesterday */
+
+    /* Cached totals of this project plus all of its sub-projects */
+    int total_secs_ever;
+    int total_secs_year;
+    int total_secs_month;
+    int total_secs_week;
+    int total_secs_lastweek;
+    int total_secs_day;
+    int total_secs_yesterday;
+    int total_secs_current;
+
+    GttTimeIndex *own_index;  /* index over this project's intervals */
+    GttTimeIndex *tree_index; /* same, plus those of all sub-projects */
+};
+
+/* one start-stop interval, as stored in the interval array of a task */
+typedef struct gtt_interval_rec_s GttIntervalRec;
+
+struct gtt_interval_rec_s
+{
+    time_t start;         /* when the timer started */
+    time_t stop;          /* if stopped, shows when timer stopped,
+                           * if running, then the most recent log point */
+    int fuzz;             /* how fuzzy the start time is.  In
+                           * seconds, typically 300, 3600 or 1/2 day */
+    unsigned running : 1; /* boolean: is the timer running? */
+    GttInterval *handle;  /* handle given out for this slot, or NULL */
 };
 
 /* A 'task' is a group of start-stops that have a common 'memo'
- * associated with them.   Note that by definition, the 'current',
- * active interval is the one at the head of the list.
+ * associated with them.  The intervals are stored by value in an
+ * array, sorted by start time, newest first.  Note that by definition,
+ * the 'current', active interval is the one at the head of the array.
+ * The memo and notes are shared strings, from the string pool,
+ * except for notes that point into a mapped file, as with projects.
  */
 struct gtt_task_s
 {
     QofInstance inst;
 
-    GttProject *parent;       /* parent project */
-    char *memo;               /* invoiceable memo (customer sees this) */
-    char *notes;              /* internal notes (office private) */
-    GttBillable billable;     /* if fees can be collected for this task */
-    GttBillRate billrate;     /* hourly rate at which to bill */
-    GttBillStatus billstatus; /* disposition of this item */
-    int bill_unit;            /* billable unit, in seconds */
-    GList *interval_list;     /* collection of start-stop's */
+    GttProject *parent;         /* parent project */
+    const char *memo;           /* invoiceable memo (customer sees this) */
+    const char *notes;          /* internal notes (office private) */
+    GBytes *notes_source;       /* mapped file the notes are in, if any */
+    GttBillable billable;       /* if fees can be collected for this task */
+    GttBillRate billrate;       /* hourly rate at which to bill */
+    GttBillStatus billstatus;   /* disposition of this item */
+    int bill_unit;              /* billable unit, in seconds */
+    GArray *intervals;          /* GttIntervalRec's, newest first */
+    int secs_ever;              /* total of all the intervals, archived or not */
+    int archived_secs;          /* total of the intervals in archive files */
+    time_t archived_first;      /* earliest start and latest stop of those, */
+    time_t archived_last;       /*  or zero if not known */
+    time_t dirty_start;         /* start times of the intervals changed */
+    time_t dirty_stop;          /*  since the last scrub; empty if start > stop */
+    GttSaveState journal_state; /* changes not yet in the data journal */
 };
 
-/* one start-stop interval */
+/* A handle onto one interval.  The engine itself works on the records
+ * in GttTask->intervals; handles are only created on demand, for code
+ * (the GUI, the reports) that needs to hold on to a single interval.
+ * A handle stays valid while its interval is moved around inside the
+ * array, and is freed when the interval is deleted (scrubbed, merged).
+ */
 struct gtt_interval_s
 {
-    GttTask *parent; /* who I belong to */
-    time_t start;    /* when the timer started */
-    time_t stop;     /* if stopped, shows when timer stopped,
-                      * if running, then the most recent log point */
-    int fuzz;        /* how fuzzy the start time is.  In
-                      * seconds, typically 300, 3600 or 1/2 day */
-    int running : 1; /* boolean: is the timer running? */
+    GttTask *parent;    /* who I belong to */
+    guint idx;          /* my slot in parent->intervals */
+    GttIntervalRec rec; /* storage used while not part of a task */
+    unsigned held : 1;  /* handed out to a caller, not just to a walk */
 };
 
 /* Should not be used by outsiders; these are dangerous routines */
 void gtt_project_set_guid(GttProject *, const GUID *);
 void gtt_task_set_guid(GttTask *, const GUID *);
 
+/* The gtt_task_append_interval_rec() routine copies the record into
+ *    the task's interval array, without creating a handle for it.
+ *    Used by the file loaders.
+ */
+void gtt_task_append_interval_rec(GttTask *, const GttIntervalRec *);
+
+/* Intervals older than a cutoff may be kept in archive files, and
+ * not loaded; the task only keeps their total.
+ *
+ * The gtt_task_set_archived_secs() routine sets the total of the
+ *    task's archived intervals, as read from the data file.
+ *
+ * The gtt_task_get_archived_secs() routine returns the total of the
+ *    task's archived intervals that aren't loaded.
+ *
+ * The gtt_task_set_archived_span() routine sets the earliest start and
+ *    the latest stop of the task's archived intervals, as read from
+ *    the data file.  The gtt_task_get_archived_span() routine gets
+ *    them; it returns FALSE if they are not known, i.e. the data file
+ *    didn't have them.
+ *
+ * The gtt_task_load_archived_interval_rec() routine adds an interval
+ *    read from an archive file to the task, as with
+ *    gtt_task_append_interval_rec(), taking its time off of the
+ *    archived total.  An interval the task already has is skipped,
+ *    and FALSE returned.  If the archives hold more time than the
+ *    total says, a warning is given, and the total stops at zero.
+ */
+void gtt_task_set_archived_secs(GttTask *, int secs);
+int gtt_task_get_archived_secs(GttTask *);
+void gtt_task_set_archived_span(GttTask *, time_t first, time_t last);
+gboolean gtt_task_get_archived_span(GttTask *, time_t *first, time_t *last);
+gboolean gtt_task_load_archived_interval_rec(GttTask *, const GttIntervalRec *);
+
+/* The gtt_task_clear_intervals() routine removes all of the task's
+ *    intervals.  Used when replaying the data journal.
+ */
+void gtt_task_clear_intervals(GttTask *);
+
+/* The gtt_project_get_time_span() routine finds the earliest start
+ *    and latest stop of all of the project's intervals, using the
+ *    project's time index, and the spans of the archived intervals
+ *    that aren't loaded.  Only if a task's span is not known are its
+ *    archives loaded.  Returns FALSE if there are no intervals.
+ */
+gboolean gtt_project_get_time_span(
+    GttProject *, gboolean include_subprojects, time_t *earliest, time_t *latest
+);
+
 #endif // GTT_PROJ_P_H
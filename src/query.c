@@ -20,225 +20,215 @@
 
 #include <glib.h>
 #include <limits.h>
+#include <stdlib.h>
 
-#include "prefs.h" /* XXX tmp hack for global config_daystart */
+#include "calendar.h"
 #include "proj.h"
 #include "proj_p.h"
 #include "query.h"
 
 /* ========================================================== */
-
-typedef struct DayArray_s
+/* The intervals are gathered up and sorted by start time, and then
+ * dealt out into buckets in a single pass.  As the starts only go
+ * up, the bucket for the next interval is always the current one or
+ * one after it; an interval that runs on past its first bucket adds
+ * the buckets it runs into as it goes.  Only buckets with intervals
+ * in them are made. */
+
+typedef struct
 {
-    int array_len;      /* same as number of days */
-    GArray *buckets;    /* holds array of GttBucket */
-    int start_cday;     /* day since 1900 */
-    struct tm start_tm; /* start time struct */
-} DayArray;
+    GttTask *tsk;
+    time_t start;
+    time_t stop;
+} StreamEntry;
 
-static inline int yearday_to_centuryday(int yday, int year)
+typedef struct
 {
-    int cd;
-    cd = 365 * year + (year - 1) / 4 + yday;
-    cd -= (year - 1) / 100; /* year that are multiple of 100 are not leap years */
-    return cd;
-}
+    GArray *stream;     /* of StreamEntry */
+    GArray *buckets;    /* of GttBucket, in order of time */
+    GPtrArray *seen;    /* the set of tasks in each bucket */
+    GttBucketSize size; /* of the buckets */
+} BucketRun;
 
-/* ========================================================== */
-/** Sort list of tasks into daily bins */
-
-static int day_bin(GttInterval *ivl, gpointer data)
+static int gather_interval(GttInterval *ivl, gpointer data)
 {
-    DayArray *da = data;
-    time_t start, start_off, stop, end_of_day;
-    struct tm stm;
-    int century_day, arr_day;
-    GttTask *tsk;
+    BucketRun *run = data;
+    StreamEntry ent;
 
-    tsk = gtt_interval_get_parent(ivl);
-    start = gtt_interval_get_start(ivl);
-    stop = gtt_interval_get_stop(ivl);
+    ent.tsk = gtt_interval_get_parent(ivl);
+    ent.start = gtt_interval_get_start(ivl);
+    ent.stop = gtt_interval_get_stop(ivl);
+    g_array_append_val(run->stream, ent);
+    return 1;
+}
 
-    /* Get the starting point in array based on day-of-century */
-    start_off = start - config_daystart_offset;
-    localtime_r(&start_off, &stm);
-    century_day = yearday_to_centuryday(stm.tm_yday, stm.tm_year);
-    arr_day = century_day - da->start_cday;
+static int stream_cmp(const void *a, const void *b)
+{
+    time_t ta = ((const StreamEntry *) a)->start;
+    time_t tb = ((const StreamEntry *) b)->start;
+    return (ta > tb) - (ta < tb);
+}
 
-    /* Loop over days until last day in interval */
-    stm.tm_sec = 0;
-    stm.tm_min = 0;
-    stm.tm_hour = 0;
+/* Find the bounds of the bucket that holds the time t.  The calendar
+ * gets things like day-light savings right; a day is not always
+ * 24*3600 seconds, nor a month 30 days. */
+static void bucket_bounds(GttBucketSize size, time_t t, time_t *start, time_t *end)
+{
+    time_t day_end;
+    int i;
 
-    while (1)
+    switch (size)
     {
-        /* Check error bounds, should never happen */
-        if ((0 > arr_day) || (arr_day >= da->array_len))
-        {
-            return 1;
-        }
-        GttBucket *bu;
-        bu = &g_array_index(da->buckets, GttBucket, arr_day);
-
-        stm.tm_mday++;
-        end_of_day = mktime(&stm);
-        /* config_daystart_offset==3*3600 means new day starts at 3AM */
-        end_of_day += config_daystart_offset;
-
-        if (stop < end_of_day)
-        {
-            bu->total += stop - start;
-            bu->intervals = g_list_append(bu->intervals, ivl);
-
-            /* Avoid duplicate tasks by checking if same as last */
-            if (!bu->tasks || (bu->tasks->data != tsk))
-            {
-                bu->tasks = g_list_prepend(bu->tasks, tsk);
-            }
-            return 1;
-        }
-        else
-        {
-            bu->total += end_of_day - start;
-            bu->intervals = g_list_append(bu->intervals, ivl);
-
-            /* Avoid duplicate tasks by checking if same as last */
-            if (!bu->tasks || (bu->tasks->data != tsk))
-            {
-                bu->tasks = g_list_prepend(bu->tasks, tsk);
-            }
-        }
-        arr_day++;
-        start = end_of_day;
+    case GTT_BUCKET_HOUR:
+        *start = gtt_calendar_day_start(t);
+        day_end = gtt_calendar_next_day_start(t);
+        *start += ((t - *start) / 3600) * 3600;
+        *end = MIN(*start + 3600, day_end);
+        break;
+
+    case GTT_BUCKET_DAY:
+        *start = gtt_calendar_day_start(t);
+        *end = gtt_calendar_next_day_start(t);
+        break;
+
+    case GTT_BUCKET_WEEK:
+        *start = gtt_calendar_week_start(t);
+        *end = *start;
+        for (i = 0; i < 7; i++)
+            *end = gtt_calendar_next_day_start(*end);
+        break;
+
+    case GTT_BUCKET_MONTH:
+        *start = gtt_calendar_month_start(t);
+        *end = gtt_calendar_month_start(*start + 32 * 24 * 3600);
+        break;
+
+    case GTT_BUCKET_YEAR:
+        *start = gtt_calendar_year_start(t);
+        *end = gtt_calendar_year_start(*start + 367 * 24 * 3600);
+        break;
     }
-
-    return 1;
 }
 
-/* ========================================================== */
-/** Set up the DayArray object so that the length (in days) is known,
- *  and so that the start day is known
- */
-static void count_days(DayArray *da, GttProject *proj, gboolean include_subprojects)
+static void
+bucket_add(BucketRun *run, guint i, const StreamEntry *ent, time_t start, time_t stop)
 {
-    time_t start, stop;
-    int num_days;
+    GttBucket *bu = &g_array_index(run->buckets, GttBucket, i);
+    GHashTable *seen = g_ptr_array_index(run->seen, i);
+    GttBucketInterval bi;
 
-    /* Figure out how many days in the array */
-    start = gtt_project_get_earliest_start(proj, include_subprojects);
-    stop = gtt_project_get_latest_stop(proj, include_subprojects);
-    num_days = (stop - start) / (24 * 3600);
-    num_days += 2; /* two midnights might be crossed */
+    bi.task = ent->tsk;
+    bi.start = ent->start;
+    bu->total += stop - start;
+    g_array_append_val(bu->intervals, bi);
 
-    da->array_len = num_days + 1;
+    if (!g_hash_table_contains(seen, ent->tsk))
+    {
+        g_hash_table_add(seen, ent->tsk);
+        bu->tasks = g_list_prepend(bu->tasks, ent->tsk);
+    }
+}
 
-    localtime_r(&start, &da->start_tm);
+static void bucket_append(BucketRun *run, time_t t)
+{
+    GttBucket bu = { 0 };
 
-    da->start_cday = yearday_to_centuryday(da->start_tm.tm_yday, da->start_tm.tm_year);
+    bucket_bounds(run->size, t, &bu.start, &bu.end);
+    bu.intervals = g_array_new(FALSE, FALSE, sizeof(GttBucketInterval));
+    g_array_append_val(run->buckets, bu);
+    g_ptr_array_add(run->seen, g_hash_table_new(g_direct_hash, g_direct_equal));
 }
 
-static void run_daily_bins(DayArray *da, GttProject *proj, gboolean include_subprojects)
+static void run_buckets(BucketRun *run)
 {
-    int i;
+    guint cur = 0;
+    guint i, n;
 
-    /* apply recursively */
-    if (include_subprojects)
-    {
-        gtt_project_foreach_subproject_interval(proj, day_bin, da);
-    }
-    else
+    for (n = 0; n < run->stream->len; n++)
     {
-        gtt_project_foreach_interval(proj, day_bin, da);
-    }
-
-    /* Clean up the taks lists by removing duplicates */
-    for (i = 0; i < da->array_len; i++)
-    {
-        GttBucket *bu;
-        GList *node;
-        bu = &g_array_index(da->buckets, GttBucket, i);
+        const StreamEntry *ent = &g_array_index(run->stream, StreamEntry, n);
+        time_t start = ent->start;
 
-        /* Reverse the list, since they went in backwards */
-        bu->tasks = g_list_reverse(bu->tasks);
+        /* Move up to the bucket that the interval starts in */
+        while ((cur < run->buckets->len)
+               && (g_array_index(run->buckets, GttBucket, cur).end <= start))
+        {
+            cur++;
+        }
+        if (cur == run->buckets->len)
+            bucket_append(run, start);
 
-        /* Scrub out duplicate task entries */
-        for (node = bu->tasks; node; node = node->next)
+        /* Deal it out into that bucket, and the ones it runs into */
+        i = cur;
+        while (1)
         {
-            GList *sode;
-        rerun:
-            for (sode = node->next; sode; sode = sode->next)
+            time_t end = g_array_index(run->buckets, GttBucket, i).end;
+
+            if (ent->stop <= end)
             {
-                if (sode->data == node->data)
-                {
-                    sode = g_list_delete_link(node, sode);
-                    goto rerun;
-                }
+                bucket_add(run, i, ent, start, ent->stop);
+                break;
             }
+            bucket_add(run, i, ent, start, end);
+            start = end;
+            i++;
+            if (i == run->buckets->len)
+                bucket_append(run, start);
         }
     }
-}
 
-/* ========================================================== */
-/** Initialize array of buckets */
-
-static void init_bins(DayArray *da)
-{
-    time_t start_of_day, end_of_day;
-    struct tm stm;
-    int i;
-
-    /* Use system routines to get things like day-light savings
-     * correct.  Otherwise, we could just have += 24*3600 */
-    stm = da->start_tm;
-    stm.tm_sec = 0;
-    stm.tm_min = 0;
-    stm.tm_hour = 0;
-
-    end_of_day = mktime(&stm);
-    /* config_daystart_offset==3*3600 means new day starts at 3AM */
-    end_of_day += config_daystart_offset;
-    for (i = 0; i < da->array_len; i++)
+    /* The task lists went in backwards */
+    for (i = 0; i < run->buckets->len; i++)
     {
-        GttBucket *bu;
-        bu = &g_array_index(da->buckets, GttBucket, i);
-
-        start_of_day = end_of_day;
-        stm.tm_mday++;
-        end_of_day = mktime(&stm);
-        end_of_day += config_daystart_offset;
-
-        bu->start = start_of_day;
-        bu->end = end_of_day;
-        bu->total = 0;
-        bu->tasks = NULL;
-        bu->intervals = NULL;
+        GttBucket *bu = &g_array_index(run->buckets, GttBucket, i);
+        bu->tasks = g_list_reverse(bu->tasks);
     }
 }
 
-/* ========================================================== */
-
-GArray *gtt_project_get_daily_buckets(GttProject *proj, gboolean include_subprojects)
+GArray *gtt_project_get_buckets(
+    GttProject *proj, GttBucketSize size, gboolean include_subprojects
+)
 {
-    DayArray da;
-    GArray *arr = NULL;
+    BucketRun run;
 
     if (!proj)
         return NULL;
 
-    /* Figure out how many days in the array */
-    count_days(&da, proj, include_subprojects);
-    if (0 > da.array_len)
-        return NULL;
+    run.stream = g_array_new(FALSE, FALSE, sizeof(StreamEntry));
+    run.buckets = g_array_new(FALSE, TRUE, sizeof(GttBucket));
+    run.seen = g_ptr_array_new_with_free_func((GDestroyNotify) g_hash_table_destroy);
+    run.size = size;
 
-    /* Alloc the array, fill it in, return the results */
-    arr = g_array_new(FALSE, TRUE, sizeof(GttBucket));
-    g_array_set_size(arr, da.array_len);
+    /* Only the task and times are copied out, so the walk can end
+     * here; nothing in the buckets points at an interval handle */
+    gtt_interval_walk_begin();
+    if (include_subprojects)
+        gtt_project_foreach_subproject_interval(proj, gather_interval, &run);
+    else
+        gtt_project_foreach_interval(proj, gather_interval, &run);
+    gtt_interval_walk_end();
+    qsort(run.stream->data, run.stream->len, sizeof(StreamEntry), stream_cmp);
 
-    da.buckets = arr;
-    init_bins(&da);
-    run_daily_bins(&da, proj, include_subprojects);
+    run_buckets(&run);
 
-    return arr;
+    g_array_free(run.stream, TRUE);
+    g_ptr_array_free(run.seen, TRUE);
+    return run.buckets;
+}
+
+void gtt_buckets_free(GArray *buckets)
+{
+    guint i;
+
+    if (!buckets)
+        return;
+    for (i = 0; i < buckets->len; i++)
+    {
+        GttBucket *bu = &g_array_index(buckets, GttBucket, i);
+        g_list_free(bu->tasks);
+        g_array_free(bu->intervals, TRUE);
+    }
+    g_array_free(buckets, TRUE);
 }
 
 /* ========================================================== */
@@ -246,24 +236,28 @@ GArray *gtt_project_get_daily_buckets(GttProject *proj, gboolean include_subproj
 int gtt_project_foreach_interval(GttProject *proj, GttIntervalCB cb, gpointer data)
 {
     int rc = 1;
-    GList *tnode, *inode;
+    GList *tnode;
+    guint i;
 
     /* Get the list of tasks, and walk the list.  We are not
      * going to assume that the list is ordered in any way.
      */
+    gtt_interval_walk_begin();
     tnode = gtt_project_get_tasks(proj);
     for (; tnode; tnode = tnode->next)
     {
         GttTask *tsk = tnode->data;
-        inode = gtt_task_get_intervals(tsk);
-        for (; inode; inode = inode->next)
+        for (i = 0; i < gtt_task_get_num_intervals(tsk); i++)
         {
-            GttInterval *iv = inode->data;
+            GttInterval *iv = gtt_task_walk_interval(tsk, i);
             rc = cb(iv, data);
             if (0 == rc)
-                return rc;
+                break;
         }
+        if (0 == rc)
+            break;
     }
+    gtt_interval_walk_end();
     return rc;
 }
 
@@ -290,59 +284,22 @@ int gtt_project_foreach_subproject_interval(GttProject *proj, GttIntervalCB cb,
 
 /* ========================================================== */
 
-static int cmp_earliest(GttInterval *ivl, gpointer data)
-{
-    time_t *earliest = data;
-    time_t s = gtt_interval_get_start(ivl);
-    if (s < *earliest)
-        *earliest = s;
-    return 1;
-}
-
-static int cmp_latest(GttInterval *ivl, gpointer data)
-{
-    time_t *latest = data;
-    time_t s = gtt_interval_get_stop(ivl);
-    if (s > *latest)
-        *latest = s;
-    return 1;
-}
+/* The earliest start and latest stop come straight out of the
+ * project's time index, without looking at every interval. */
 
 time_t gtt_project_get_earliest_start(GttProject *proj, gboolean include_subprojects)
 {
-    time_t earliest;
+    time_t earliest = INT_MAX;
 
-    earliest = INT_MAX;
-    if (!proj)
-        return earliest;
-
-    if (include_subprojects)
-    {
-        gtt_project_foreach_subproject_interval(proj, cmp_earliest, &earliest);
-    }
-    else
-    {
-        gtt_project_foreach_interval(proj, cmp_earliest, &earliest);
-    }
+    gtt_project_get_time_span(proj, include_subprojects, &earliest, NULL);
     return earliest;
 }
 
 time_t gtt_project_get_latest_stop(GttProject *proj, gboolean include_subprojects)
 {
-    time_t latest;
+    time_t latest = 0;
 
-    latest = 0;
-    if (!proj)
-        return latest;
-
-    if (include_subprojects)
-    {
-        gtt_project_foreach_subproject_interval(proj, cmp_latest, &latest);
-    }
-    else
-    {
-        gtt_project_foreach_interval(proj, cmp_latest, &latest);
-    }
+    gtt_project_get_time_span(proj, include_subprojects, NULL, &latest);
     return latest;
 }
 
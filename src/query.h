@@ -38,14 +38,32 @@
  */
 
 typedef struct GttBucket_s GttBucket;
+typedef struct GttBucketInterval_s GttBucketInterval;
+
+typedef enum
+{
+    GTT_BUCKET_HOUR,
+    GTT_BUCKET_DAY,
+    GTT_BUCKET_WEEK,
+    GTT_BUCKET_MONTH,
+    GTT_BUCKET_YEAR,
+} GttBucketSize;
 
 struct GttBucket_s
 {
-    time_t start;     /* Start time that defines this bucket */
-    time_t end;       /* End time that defines this bucket */
-    time_t total;     /* Total amount of time in the bucket */
-    GList *tasks;     /* List of GttTasks in the bucket */
-    GList *intervals; /* List of GttIntervals in the bucket */
+    time_t start;      /* Start time that defines this bucket */
+    time_t end;        /* End time that defines this bucket */
+    time_t total;      /* Total amount of time in the bucket */
+    GList *tasks;      /* List of GttTasks in the bucket */
+    GArray *intervals; /* Of GttBucketInterval, for each interval in it */
+};
+
+/* An interval in a bucket is named by its task and its start time;
+ * gtt_task_walk_find_interval() turns that back into an interval. */
+struct GttBucketInterval_s
+{
+    GttTask *task;
+    time_t start;
 };
 
 /* The following routines are needed to implement a
@@ -63,24 +81,29 @@ struct GttBucket_s
  *    If 'include_subprojects' is TRUE, then subprojects are
  *    included in the search for the latest stop.
  *
- * The gtt_project_get_daily_buckets() routine returns
- *    a GArray of GttBucket.  Each bucket will record a start
- *    and stop time for the bucket, the total number of seconds
- *    spent on the project, in that bucket, and a list of the tasks
- *    and intervals in that bucket.  The buckets are ordered
- *    one per day, day by day; that is, each element
- *    of the array corresponds to one day.  Day 0
- *    corresponds to the earliest day for which there
- *    is data for this project.  The length of the array
- *    is sufficient to hold data for all non-zero days.
- *    The array should be freed when it is no longer needed.
- *    Use the gtt_project_get_earliest_start() routine to
- *    find out what day 0 correpinds to in calendar time.
- *    If 'include_subprojects' is TRUE, then subprojects are
- *    included in the day totals.
+ * The gtt_project_get_buckets() routine returns a GArray of
+ *    GttBucket, one for each hour, day, week, month or year, as
+ *    indicated by 'size', in which time was spent on the project.
+ *    Each bucket records its start and end time, the number of
+ *    seconds spent on the project in it, and the lists of the tasks
+ *    and of the intervals in it, each task listed once.  An interval
+ *    that runs over into the next bucket is in both.  The buckets are
+ *    in order of time; buckets with no intervals in them are left
+ *    out.  Weeks start on the day set in the preferences.  If
+ *    'include_subprojects' is TRUE, then subprojects are included in
+ *    the totals.  Only the archived intervals that are loaded count;
+ *    see gtt_project_load_archive().  Returns NULL if proj is NULL.
+ *
+ * The gtt_buckets_free() routine frees the array returned by
+ *    gtt_project_get_buckets(), along with the lists in it.  The
+ *    buckets hold no interval handles, so they may be kept for as
+ *    long as the tasks in them are.
  */
 
-GArray *gtt_project_get_daily_buckets(GttProject *proj, gboolean include_subprojects);
+GArray *gtt_project_get_buckets(
+    GttProject *proj, GttBucketSize size, gboolean include_subprojects
+);
+void gtt_buckets_free(GArray *buckets);
 
 time_t gtt_project_get_earliest_start(GttProject *proj, gboolean include_subprojects);
 
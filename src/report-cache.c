@@ -0,0 +1,169 @@
+/*   cache of rendered reports
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <qof.h>
+#include <string.h>
+
+#include "calendar.h"
+#include "proj.h"
+#include "report-cache.h"
+
+/* A report takes some tens of kilobytes of html, a big journal a
+ * megabyte or two; the cache holds a good handful of them. */
+#define REPORT_CACHE_MAX (16 * 1024 * 1024)
+
+typedef struct report_entry_s
+{
+    char *key;
+    char *html;
+    size_t len;
+    GList *link; /* in lru */
+} ReportEntry;
+
+/* Maps keys to the ReportEntry holding them */
+static GHashTable *cache = NULL;
+
+/* The entries, the one used last at the head */
+static GQueue lru = G_QUEUE_INIT;
+static size_t cache_bytes = 0;
+
+/* What the cached reports were made from */
+static guint cache_version = 0;
+static time_t cache_day = 0;
+
+static void entry_free(gpointer data)
+{
+    ReportEntry *entry = data;
+
+    g_queue_delete_link(&lru, entry->link);
+    cache_bytes -= entry->len;
+    g_free(entry->key);
+    g_free(entry->html);
+    g_free(entry);
+}
+
+/* Drops all of the reports if the data or the day they show have
+ * changed since they were made. */
+static void check_fresh(void)
+{
+    guint version = gtt_project_list_get_version();
+    time_t day = gtt_calendar_day_start(time(0));
+
+    if ((version == cache_version) && (day == cache_day))
+        return;
+    gtt_report_cache_clear();
+    cache_version = version;
+    cache_day = day;
+}
+
+char *gtt_report_cache_key(
+    const char *report, GttProject *prj, KvpFrame *kvpf, gboolean did_query
+)
+{
+    GStatBuf sb;
+    GString *key;
+
+    if (!report || (0 != g_stat(report, &sb)))
+        return NULL;
+
+    /* An edited template must not show the old page */
+    key = g_string_new(report);
+    g_string_append_printf(
+        key, "\n%" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n", (gint64) sb.st_mtime,
+        (gint64) sb.st_size
+    );
+
+    if (prj)
+    {
+        char buff[GUID_ENCODING_LENGTH + 1];
+        guid_to_string_buff(gtt_project_get_guid(prj), buff);
+        g_string_append(key, buff);
+    }
+
+    g_string_append(key, did_query ? "\nquery\n" : "\n\n");
+    if (kvpf)
+    {
+        char *form = kvp_frame_to_string(kvpf);
+        g_string_append(key, form);
+        g_free(form);
+    }
+
+    return g_string_free(key, FALSE);
+}
+
+const char *gtt_report_cache_lookup(const char *key)
+{
+    ReportEntry *entry;
+
+    if (!key || !cache)
+        return NULL;
+    check_fresh();
+
+    entry = g_hash_table_lookup(cache, key);
+    if (!entry)
+        return NULL;
+
+    g_queue_unlink(&lru, entry->link);
+    g_queue_push_head_link(&lru, entry->link);
+    return entry->html;
+}
+
+void gtt_report_cache_add(char *key, char *html, size_t len)
+{
+    ReportEntry *entry;
+
+    if (!key || !html || (REPORT_CACHE_MAX < len))
+    {
+        g_free(key);
+        g_free(html);
+        return;
+    }
+
+    if (!cache)
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, entry_free);
+    check_fresh();
+
+    /* Make room, dropping the reports used least lately */
+    g_hash_table_remove(cache, key);
+    while (REPORT_CACHE_MAX - len < cache_bytes)
+    {
+        entry = g_queue_peek_tail(&lru);
+        g_hash_table_remove(cache, entry->key);
+    }
+
+    entry = g_new0(ReportEntry, 1);
+    entry->key = key;
+    entry->html = html;
+    entry->len = len;
+    g_queue_push_head(&lru, entry);
+    entry->link = lru.head;
+    cache_bytes += len;
+    g_hash_table_insert(cache, entry->key, entry);
+}
+
+void gtt_report_cache_clear(void)
+{
+    if (cache)
+        g_hash_table_remove_all(cache);
+}
+
+/* ===================== END OF FILE ============================ */
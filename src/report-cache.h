@@ -0,0 +1,61 @@
+/*   cache of rendered reports
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_REPORT_CACHE_H
+#define GTT_REPORT_CACHE_H
+
+#include <glib.h>
+#include <qof.h>
+
+#include "proj.h"
+
+/* The report cache keeps the html of the reports shown lately, so
+ * that showing the same report again does not have to run the whole
+ * template through ghtml and guile.  A report is found by its template
+ * file, the project it is linked to, and the form parameters it was
+ * run with.  All of the cached reports are dropped as soon as any of
+ * the data changes, since any report may show any of it; they are also
+ * dropped when the day changes, since reports show 'today' and 'this
+ * week'.  Beyond that, the reports used least lately are dropped when
+ * the cache grows too big.
+ *
+ * The gtt_report_cache_key() routine returns the key for the indicated
+ *    report, to be freed with g_free().  It returns NULL if the report
+ *    should not be cached; for example, if the template can't be found.
+ *
+ * The gtt_report_cache_lookup() routine returns the html stored under
+ *    the key, or NULL if there is none.  The html belongs to the cache,
+ *    and is only good until the next call to the cache.
+ *
+ * The gtt_report_cache_add() routine stores html of length len under
+ *    the key.  The cache takes over both strings, and will g_free()
+ *    them.
+ *
+ * The gtt_report_cache_clear() routine drops all cached reports.  It
+ *    should be called when something other than the data changes what
+ *    the reports look like, such as the preferences.
+ *
+ * These are to be called from the main thread only.
+ */
+
+char *gtt_report_cache_key(const char *report, GttProject *, KvpFrame *, gboolean did_query);
+const char *gtt_report_cache_lookup(const char *key);
+void gtt_report_cache_add(char *key, char *html, size_t len);
+void gtt_report_cache_clear(void);
+
+#endif // GTT_REPORT_CACHE_H
@@ -0,0 +1,86 @@
+/*   shared, reference-counted strings for GnoTime
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "string-pool.h"
+
+/* The string is stored right behind its reference count, so
+ * that the count can be found from the string pointer. */
+typedef struct pool_entry_s
+{
+    guint refs;
+    char str[];
+} PoolEntry;
+
+#define POOL_ENTRY(s) ((PoolEntry *) ((s) - G_STRUCT_OFFSET(PoolEntry, str)))
+
+/* Maps string contents to the PoolEntry holding them */
+static GHashTable *pool = NULL;
+
+const char *gtt_string_pool_intern(const char *s)
+{
+    PoolEntry *entry;
+
+    if (!s)
+        return NULL;
+    if (!pool)
+        pool = g_hash_table_new(g_str_hash, g_str_equal);
+
+    entry = g_hash_table_lookup(pool, s);
+    if (!entry)
+    {
+        size_t len = strlen(s);
+        entry = g_malloc(sizeof(PoolEntry) + len + 1);
+        entry->refs = 0;
+        memcpy(entry->str, s, len + 1);
+        g_hash_table_insert(pool, entry->str, entry);
+    }
+    entry->refs++;
+    return entry->str;
+}
+
+const char *gtt_string_pool_ref(const char *s)
+{
+    if (!s)
+        return NULL;
+    POOL_ENTRY(s)->refs++;
+    return s;
+}
+
+void gtt_string_pool_unref(const char *s)
+{
+    PoolEntry *entry;
+
+    if (!s)
+        return;
+    entry = POOL_ENTRY(s);
+    g_return_if_fail(0 < entry->refs);
+
+    entry->refs--;
+    if (0 == entry->refs)
+    {
+        g_hash_table_remove(pool, entry->str);
+        g_free(entry);
+    }
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,47 @@
+/*   shared, reference-counted strings for GnoTime
+ *   Copyright (C) 2026 GnoTime contributors
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef GTT_STRING_POOL_H
+#define GTT_STRING_POOL_H
+
+/* The string pool keeps a single copy of each distinct string, shared
+ * by everyone who uses it.  Memos and notes repeat a lot: every new
+ * task starts out as "New Diary Entry", and recurring chores get the
+ * same memo over and over.  Two pooled strings with the same contents
+ * are the same pointer, so they can be compared with ==.
+ *
+ * The gtt_string_pool_intern() routine returns the pooled copy of
+ *    the string s, adding it to the pool if need be.  The caller owns
+ *    a reference to the returned string, and must give it up with
+ *    gtt_string_pool_unref() when done.  Pooled strings must not be
+ *    modified.  Returns NULL if s is NULL.
+ *
+ * The gtt_string_pool_ref() routine takes another reference to a
+ *    string that was returned by gtt_string_pool_intern(), without
+ *    having to look it up again.
+ *
+ * The gtt_string_pool_unref() routine gives up a reference.  The
+ *    string is freed when its last reference is gone.  It is safe to
+ *    pass NULL.
+ */
+
+const char *gtt_string_pool_intern(const char *s);
+const char *gtt_string_pool_ref(const char *s);
+void gtt_string_pool_unref(const char *s);
+
+#endif // GTT_STRING_POOL_H
@@ -82,7 +82,7 @@ gint zero_daily_counters(gpointer data)
 
 static gint file_save_timer_func(gpointer data)
 {
-    save_projects();
+    save_projects_in_background();
     return 1;
 }
 
@@ -0,0 +1,100 @@
+/*   Snapshots of the gtt in-memory project structures.
+ *   Copyright (C) 2001 Linas Vepstas
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* This is a PRIVATE header file for the data file writers only! Do not use! */
+
+#ifndef GTT_XML_GTT_P_H
+#define GTT_XML_GTT_P_H
+
+#include <glib.h>
+#include <qof.h>
+
+#include "file-compress.h"
+#include "proj.h"
+
+/* The contents of a GttXmlSnapshot, as taken by gtt_xml_snapshot_new().
+ * Nothing in here points back at the live projects, so that it can be
+ * read from any thread.  Texts in a mapped file are shared with the
+ * projects, as the file stays mapped for as long as it is held. */
+
+typedef struct snap_task_s
+{
+    GUID guid;
+    const char *memo;     /* from the string pool */
+    const char *notes;    /* from the string pool, unless in notes_source */
+    GBytes *notes_source; /* the mapped file the notes are in, or NULL */
+    int bill_unit;
+    GttBillable billable;
+    GttBillRate billrate;
+    GttBillStatus billstatus;
+    GArray *intervals;     /* copy of the task's GttIntervalRec's */
+    GArray *archived;      /* the ones older than archive_before, or NULL */
+    int archived_secs;     /* total of all of the archived intervals */
+    time_t archived_first; /* their earliest start and latest stop, */
+    time_t archived_last;  /*  or zero if not known */
+} SnapTask;
+
+typedef struct snap_project_s SnapProject;
+
+struct snap_project_s
+{
+    GUID guid;
+    char *title;
+    char *desc; /* these two point into their source, if set */
+    char *notes;
+    GBytes *desc_source;
+    GBytes *notes_source;
+    char *custid;
+    int id;
+
+    double billrate;
+    double overtime_rate;
+    double overover_rate;
+    double flat_fee;
+
+    int min_interval;
+    int auto_merge_interval;
+    int auto_merge_gap;
+
+    time_t estimated_start;
+    time_t estimated_end;
+    time_t due_date;
+    int sizing;
+    int percent_complete;
+    GttRank urgency;
+    GttRank importance;
+    GttProjectStatus status;
+
+    guint num_tasks;
+    SnapTask *tasks;
+    guint num_children;
+    SnapProject *children;
+};
+
+struct gtt_xml_snapshot_s
+{
+    guint num_projects;
+    SnapProject *projects;
+
+    time_t archive_before; /* intervals older than this go to archives */
+    GArray *archive_years; /* years whose archive files are rewritten */
+
+    GttCompression compression; /* of the data file */
+};
+
+#endif // GTT_XML_GTT_P_H
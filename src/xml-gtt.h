@@ -21,18 +21,33 @@
 
 #include <glib.h>
 
+#include "err-throw.h"
+
 /* The gtt_xml_write() routine will all gtt data to xml file.
  *    If an error occurs, one of the err-throw.h errors will
  *    be set.
  *
- * The gtt_xml_read_projects() will read a gtt XML file, and
- *    return a list of the projects that it found.  Note that
+ * The gtt_xml_read_projects() will read a gtt XML file, which
+ *    may be compressed, and return a list of the projects that it found.  Note that
  *    this list has *not* been mashed into the global list of
  *    projects that gtt maintains.
  *
  * The gtt_xml_read_file() routine will read a gtt XML file,
  *    merging the data into the global list of projects
  *    that gtt maintains.
+ *
+ * The gtt_xml_snapshot_new() routine takes a copy of the given
+ *    projects, and all of their tasks and intervals, as they
+ *    are right now.  Intervals that start before archive_before
+ *    are set aside for the archive files (see archive.h), and are
+ *    not written to the xml file; zero keeps them all.
+ *
+ * The gtt_xml_snapshot_write() routine writes the snapshot out
+ *    to an xml file, compressed as config_data_compression was set
+ *    when the snapshot was taken (see file-compress.h).  Unlike the
+ *    rest of gtt, it may be called from another thread; rather than
+ *    setting the err-throw.h error, it returns it.  The snapshot must
+ *    be taken and freed in the main thread.
  */
 
 void gtt_xml_read_file(const char *filename);
@@ -40,4 +55,10 @@ void gtt_xml_write_file(const char *filename);
 
 GList *gtt_xml_read_projects(const char *filename);
 
+typedef struct gtt_xml_snapshot_s GttXmlSnapshot;
+
+GttXmlSnapshot *gtt_xml_snapshot_new(GList *projects, time_t archive_before);
+GttErrCode gtt_xml_snapshot_write(GttXmlSnapshot *, const char *filename);
+void gtt_xml_snapshot_free(GttXmlSnapshot *);
+
 #endif // GTT_XML_H
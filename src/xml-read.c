@@ -19,13 +19,16 @@
 #include "config.h"
 
 #include <glib.h>
-#include <libxml/parser.h>
+#include <glib/gstdio.h>
+#include <libxml/xmlreader.h>
 #include <qof.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cur-proj.h"
 #include "err-throw.h"
+#include "file-compress.h"
 #include "gtt.h"
 #include "proj.h"
 #include "proj_p.h"
@@ -41,380 +44,1425 @@
  * Alas ...
  */
 
+/* The file is read with a streaming xmlTextReader, rather than by
+ * parsing it into a DOM tree first.  The projects, tasks and
+ * intervals are built as their elements go by; nothing else is kept
+ * but the C stack of the parse_*() routines below, one frame per
+ * level of nesting, the fields of the project or task being read at
+ * each level, and the text of the element being read.  Big files
+ * can instead have their top-level projects read on several threads
+ * at once, into plain records that the main thread then builds the
+ * projects out of; see read_parallel(). */
+
+typedef struct read_state_s
+{
+    xmlTextReaderPtr reader;
+    GString *text;   /* contents of the last simple element read */
+    gboolean build;  /* build the projects while reading; main thread only */
+    gboolean failed; /* the xml parser reported an error */
+    GttErrCode err;  /* the first error found in the data */
+} ReadState;
+
 /* =========================================================== */
+/* Element names are looked up in a perfect hash table, instead of
+ * being compared against every known name in turn.  The hash below
+ * has no collisions for the names in tag_names; adding a name may
+ * need new constants (tag_table_init() checks). */
 
-#define GET_TEXT(node)                                \
-    ({                                                \
-        char *sstr = NULL;                            \
-        xmlNodePtr text;                              \
-        text = node->xmlChildrenNode;                 \
-        if (!text)                                    \
-        {                                             \
-            gtt_err_set_code(GTT_FILE_CORRUPT);       \
-        }                                             \
-        else if (strcmp("text", (char *) text->name)) \
-        {                                             \
-            gtt_err_set_code(GTT_FILE_CORRUPT);       \
-        }                                             \
-        else                                          \
-            sstr = (char *) text->content;            \
-        sstr;                                         \
-    })
-
-#define GET_STR(SELF, FN, TOK)                           \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        FN(SELF, str);                                   \
-    }                                                    \
-    else
+typedef enum
+{
+    TAG_UNKNOWN = 0,
+    TAG_GTT,
+    TAG_PROJECT_LIST,
+    TAG_PROJECT,
+    TAG_TASK_LIST,
+    TAG_TASK,
+    TAG_INTERVAL_LIST,
+    TAG_INTERVAL,
 
-#define GET_DBL(SELF, FN, TOK)                           \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        double rate = atof(str);                         \
-        FN(SELF, rate);                                  \
-    }                                                    \
-    else
+    TAG_GUID,
+    TAG_TITLE,
+    TAG_DESC,
+    TAG_NOTES,
+    TAG_CUSTID,
+    TAG_BILLRATE,
+    TAG_OVERTIME_RATE,
+    TAG_OVEROVER_RATE,
+    TAG_FLAT_FEE,
+    TAG_MIN_INTERVAL,
+    TAG_AUTO_MERGE_INTERVAL,
+    TAG_AUTO_MERGE_GAP,
+    TAG_ID,
+    TAG_ESTIMATED_START,
+    TAG_ESTIMATED_END,
+    TAG_DUE_DATE,
+    TAG_SIZING,
+    TAG_PERCENT_COMPLETE,
+    TAG_URGENCY,
+    TAG_IMPORTANCE,
+    TAG_STATUS,
 
-#define GET_INT(SELF, FN, TOK)                           \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        int ival = atoi(str);                            \
-        FN(SELF, ival);                                  \
-    }                                                    \
-    else
+    TAG_MEMO,
+    TAG_BILL_UNIT,
+    TAG_BILLABLE,
+    TAG_BILLSTATUS,
+    TAG_ARCHIVED_SECS,
+    TAG_ARCHIVED_FIRST,
+    TAG_ARCHIVED_LAST,
 
-#define GET_TIM(SELF, FN, TOK)                           \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        time_t tval = atol(str);                         \
-        FN(SELF, tval);                                  \
-    }                                                    \
-    else
+    TAG_START,
+    TAG_STOP,
+    TAG_FUZZ,
+    TAG_RUNNING,
 
-#define GET_BOL(SELF, FN, TOK)                           \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        gboolean bval = atol(str);                       \
-        FN(SELF, bval);                                  \
-    }                                                    \
-    else
+    NUM_TAGS
+} GttTag;
 
-#define GET_GUID(SELF, FN, TOK)                          \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        GUID guid;                                       \
-        string_to_guid(str, &guid);                      \
-        FN(SELF, &guid);                                 \
-    }                                                    \
-    else
+static const char *tag_names[NUM_TAGS] = {
+    [TAG_UNKNOWN] = NULL,
+    [TAG_GTT] = "gtt",
+    [TAG_PROJECT_LIST] = "project-list",
+    [TAG_PROJECT] = "project",
+    [TAG_TASK_LIST] = "task-list",
+    [TAG_TASK] = "task",
+    [TAG_INTERVAL_LIST] = "interval-list",
+    [TAG_INTERVAL] = "interval",
+    [TAG_GUID] = "guid",
+    [TAG_TITLE] = "title",
+    [TAG_DESC] = "desc",
+    [TAG_NOTES] = "notes",
+    [TAG_CUSTID] = "custid",
+    [TAG_BILLRATE] = "billrate",
+    [TAG_OVERTIME_RATE] = "overtime_rate",
+    [TAG_OVEROVER_RATE] = "overover_rate",
+    [TAG_FLAT_FEE] = "flat_fee",
+    [TAG_MIN_INTERVAL] = "min_interval",
+    [TAG_AUTO_MERGE_INTERVAL] = "auto_merge_interval",
+    [TAG_AUTO_MERGE_GAP] = "auto_merge_gap",
+    [TAG_ID] = "id",
+    [TAG_ESTIMATED_START] = "estimated_start",
+    [TAG_ESTIMATED_END] = "estimated_end",
+    [TAG_DUE_DATE] = "due_date",
+    [TAG_SIZING] = "sizing",
+    [TAG_PERCENT_COMPLETE] = "percent_complete",
+    [TAG_URGENCY] = "urgency",
+    [TAG_IMPORTANCE] = "importance",
+    [TAG_STATUS] = "status",
+    [TAG_MEMO] = "memo",
+    [TAG_BILL_UNIT] = "bill_unit",
+    [TAG_BILLABLE] = "billable",
+    [TAG_BILLSTATUS] = "billstatus",
+    [TAG_ARCHIVED_SECS] = "archived_secs",
+    [TAG_ARCHIVED_FIRST] = "archived_first",
+    [TAG_ARCHIVED_LAST] = "archived_last",
+    [TAG_START] = "start",
+    [TAG_STOP] = "stop",
+    [TAG_FUZZ] = "fuzz",
+    [TAG_RUNNING] = "running",
+};
 
-#define GET_ENUM_3(SELF, FN, TOK, A, B, C)               \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        int ival = GTT_##A;                              \
-        if (!strcmp(#A, str))                            \
-            ival = GTT_##A;                              \
-        else if (!strcmp(#B, str))                       \
-            ival = GTT_##B;                              \
-        else if (!strcmp(#C, str))                       \
-            ival = GTT_##C;                              \
-        else                                             \
-            gtt_err_set_code(GTT_UNKNOWN_VALUE);         \
-        FN(SELF, ival);                                  \
-    }                                                    \
-    else
+#define TAG_TABLE_SIZE 128
 
-#define GET_ENUM_4(SELF, FN, TOK, A, B, C, D)            \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        int ival = GTT_##A;                              \
-        if (!strcmp(#A, str))                            \
-            ival = GTT_##A;                              \
-        else if (!strcmp(#B, str))                       \
-            ival = GTT_##B;                              \
-        else if (!strcmp(#C, str))                       \
-            ival = GTT_##C;                              \
-        else if (!strcmp(#D, str))                       \
-            ival = GTT_##D;                              \
-        else                                             \
-            gtt_err_set_code(GTT_UNKNOWN_VALUE);         \
-        FN(SELF, ival);                                  \
-    }                                                    \
-    else
+static guint8 tag_table[TAG_TABLE_SIZE];
 
-#define GET_ENUM_6(SELF, FN, TOK, A, B, C, D, E, F)      \
-    if (0 == strcmp(TOK, (char *) node->name))           \
-    {                                                    \
-        const char *str = (const char *) GET_TEXT(node); \
-        int ival = GTT_##A;                              \
-        if (!strcmp(#A, str))                            \
-            ival = GTT_##A;                              \
-        else if (!strcmp(#B, str))                       \
-            ival = GTT_##B;                              \
-        else if (!strcmp(#C, str))                       \
-            ival = GTT_##C;                              \
-        else if (!strcmp(#D, str))                       \
-            ival = GTT_##D;                              \
-        else if (!strcmp(#E, str))                       \
-            ival = GTT_##E;                              \
-        else if (!strcmp(#F, str))                       \
-            ival = GTT_##F;                              \
-        else                                             \
-            gtt_err_set_code(GTT_UNKNOWN_VALUE);         \
-        FN(SELF, ival);                                  \
-    }                                                    \
-    else
+static inline guint tag_hash(const char *name)
+{
+    size_t len = strlen(name);
+    return (len + 3 * name[0] + 24 * name[len / 2] + name[len - 1]) % TAG_TABLE_SIZE;
+}
+
+static void tag_table_init(void)
+{
+    static gboolean inited = FALSE;
+    int tag;
+
+    if (inited)
+        return;
+    inited = TRUE;
+
+    for (tag = TAG_UNKNOWN + 1; tag < NUM_TAGS; tag++)
+    {
+        guint h = tag_hash(tag_names[tag]);
+        g_assert(TAG_UNKNOWN == tag_table[h]);
+        tag_table[h] = tag;
+    }
+}
+
+/* Return the tag of the element the reader is sitting on */
+static GttTag node_tag(ReadState *rs)
+{
+    const char *name;
+    GttTag tag;
+
+    name = (const char *) xmlTextReaderConstLocalName(rs->reader);
+    if (!name || !name[0])
+        return TAG_UNKNOWN;
+
+    tag = tag_table[tag_hash(name)];
+    if (strcmp(name, tag_names[tag] ? tag_names[tag] : ""))
+        return TAG_UNKNOWN;
+    return tag;
+}
 
 /* =========================================================== */
 
-static GttInterval *parse_interval(xmlNodePtr interval)
+static gboolean read_node(ReadState *rs)
 {
-    xmlNodePtr node;
-    GttInterval *ivl = NULL;
+    int rc = xmlTextReaderRead(rs->reader);
+    if (0 > rc)
+        rs->failed = TRUE;
+    return (1 == rc);
+}
 
-    if (!interval)
+/* Move to the next child element of the element at the given
+ * depth.  Returns FALSE when the end of the element is reached. */
+static gboolean next_child(ReadState *rs, int depth)
+{
+    while (read_node(rs))
     {
-        gtt_err_set_code(GTT_FILE_CORRUPT);
-        return ivl;
+        int type = xmlTextReaderNodeType(rs->reader);
+        int dep = xmlTextReaderDepth(rs->reader);
+
+        if ((XML_READER_TYPE_END_ELEMENT == type) && (dep == depth))
+            return FALSE;
+        if ((XML_READER_TYPE_ELEMENT == type) && (dep == depth + 1))
+            return TRUE;
     }
+    return FALSE;
+}
+
+/* Loop over the child elements of the current element */
+#define FOREACH_CHILD(rs)                                        \
+    for (int depth_ = xmlTextReaderDepth((rs)->reader),          \
+             more_ = !xmlTextReaderIsEmptyElement((rs)->reader); \
+         more_ && (more_ = next_child((rs), depth_));)
 
-    if (strcmp("interval", (char *) interval->name))
+/* Skip over the current element, and everything inside of it */
+static void skip_element(ReadState *rs)
+{
+    int depth;
+
+    if (xmlTextReaderIsEmptyElement(rs->reader))
+        return;
+    depth = xmlTextReaderDepth(rs->reader);
+    while (read_node(rs))
     {
-        gtt_err_set_code(GTT_FILE_CORRUPT);
-        return ivl;
+        if ((XML_READER_TYPE_END_ELEMENT == xmlTextReaderNodeType(rs->reader))
+            && (depth == xmlTextReaderDepth(rs->reader)))
+            return;
     }
+}
+
+/* The errors are kept in the ReadState, rather than set right away,
+ * since the file may be read by several threads at once. */
+static void read_error(ReadState *rs, GttErrCode code)
+{
+    if (GTT_NO_ERR == rs->err)
+        rs->err = code;
+}
+
+/* Return the text held by the current element, and move past it.
+ * The string is only good until the next call. */
+static const char *read_text(ReadState *rs)
+{
+    gboolean got_text = FALSE;
+    int depth;
 
-    ivl = gtt_interval_new();
-    for (node = interval->xmlChildrenNode; node; node = node->next)
+    if (xmlTextReaderIsEmptyElement(rs->reader))
     {
-        if (node->type != XML_ELEMENT_NODE)
-            continue;
+        read_error(rs, GTT_FILE_CORRUPT);
+        return NULL;
+    }
+
+    g_string_truncate(rs->text, 0);
+    depth = xmlTextReaderDepth(rs->reader);
+    while (read_node(rs))
+    {
+        int type = xmlTextReaderNodeType(rs->reader);
+        int dep = xmlTextReaderDepth(rs->reader);
 
-        GET_TIM(ivl, gtt_interval_set_start, "start")
-        GET_TIM(ivl, gtt_interval_set_stop, "stop")
-        GET_TIM(ivl, gtt_interval_set_fuzz, "fuzz")
-        GET_BOL(ivl, gtt_interval_set_running, "running")
+        if ((XML_READER_TYPE_END_ELEMENT == type) && (dep == depth))
+            break;
+        if (dep != depth + 1)
+            continue;
+        if ((XML_READER_TYPE_TEXT == type) || (XML_READER_TYPE_CDATA == type)
+            || (XML_READER_TYPE_WHITESPACE == type)
+            || (XML_READER_TYPE_SIGNIFICANT_WHITESPACE == type))
         {
-            gtt_err_set_code(GTT_UNKNOWN_TOKEN);
+            g_string_append(rs->text, (const char *) xmlTextReaderConstValue(rs->reader));
+            got_text = TRUE;
         }
     }
-    return ivl;
+
+    if (!got_text)
+    {
+        read_error(rs, GTT_FILE_CORRUPT);
+        return NULL;
+    }
+    return rs->text->str;
 }
 
 /* =========================================================== */
+/* The fields of a project or task are read into these plain records
+ * first, and set on the real one once its element is done; see
+ * build_project().  There is a bit in present for each of the
+ * elements that were found.  When building while reading, the tasks,
+ * the intervals and the sub-projects go straight into the real task
+ * or project.  Otherwise they are kept in the record as well, to be
+ * built later, in the main thread. */
+
+#define TAG_BIT(TAG) (G_GUINT64_CONSTANT(1) << (TAG))
+#define HAS(REC, TAG) (0 != ((REC)->present & TAG_BIT(TAG)))
+
+typedef struct parsed_task_s
+{
+    guint64 present;
+    GUID guid;
+    char *memo;
+    char *notes;
+    int bill_unit;
+    int archived_secs;
+    time_t archived_first;
+    time_t archived_last;
+    GttBillable billable;
+    GttBillStatus billstatus;
+    GttBillRate billrate;
+    GttTask *tsk;      /* being built, or NULL */
+    GArray *intervals; /* of GttIntervalRec, as in the file, if not */
+} ParsedTask;
+
+typedef struct parsed_project_s
+{
+    guint64 present;
+    GUID guid;
+    char *title;
+    char *desc;
+    char *notes;
+    char *custid;
+    int id;
+
+    double billrate;
+    double overtime_rate;
+    double overover_rate;
+    double flat_fee;
+
+    int min_interval;
+    int auto_merge_interval;
+    int auto_merge_gap;
+
+    time_t estimated_start;
+    time_t estimated_end;
+    time_t due_date;
+    int sizing;
+    int percent_complete;
+    GttRank urgency;
+    GttRank importance;
+    GttProjectStatus status;
+
+    GttProject *prj;     /* being built, or NULL */
+    GArray *tasks;       /* of ParsedTask, if not */
+    GPtrArray *children; /* of ParsedProject, if not */
+} ParsedProject;
+
+#define GET_STR(VAR)                     \
+    {                                    \
+        const char *str = read_text(rs); \
+        g_free(VAR);                     \
+        VAR = g_strdup(str);             \
+    }
+
+#define GET_DBL(VAR)                     \
+    {                                    \
+        const char *str = read_text(rs); \
+        VAR = str ? atof(str) : 0.0;     \
+    }
+
+#define GET_INT(VAR)                     \
+    {                                    \
+        const char *str = read_text(rs); \
+        VAR = str ? atoi(str) : 0;       \
+    }
+
+#define GET_TIM(VAR)                     \
+    {                                    \
+        const char *str = read_text(rs); \
+        VAR = str ? atol(str) : 0;       \
+    }
+
+#define GET_GUID(VAR)                    \
+    {                                    \
+        const char *str = read_text(rs); \
+        string_to_guid(str, &VAR);       \
+    }
+
+#define GET_ENUM_3(VAR, A, B, C)               \
+    {                                          \
+        const char *str = read_text(rs);       \
+        VAR = GTT_##A;                         \
+        if (!str)                              \
+            VAR = GTT_##A;                     \
+        else if (!strcmp(#A, str))             \
+            VAR = GTT_##A;                     \
+        else if (!strcmp(#B, str))             \
+            VAR = GTT_##B;                     \
+        else if (!strcmp(#C, str))             \
+            VAR = GTT_##C;                     \
+        else                                   \
+            read_error(rs, GTT_UNKNOWN_VALUE); \
+    }
+
+#define GET_ENUM_4(VAR, A, B, C, D)            \
+    {                                          \
+        const char *str = read_text(rs);       \
+        VAR = GTT_##A;                         \
+        if (!str)                              \
+            VAR = GTT_##A;                     \
+        else if (!strcmp(#A, str))             \
+            VAR = GTT_##A;                     \
+        else if (!strcmp(#B, str))             \
+            VAR = GTT_##B;                     \
+        else if (!strcmp(#C, str))             \
+            VAR = GTT_##C;                     \
+        else if (!strcmp(#D, str))             \
+            VAR = GTT_##D;                     \
+        else                                   \
+            read_error(rs, GTT_UNKNOWN_VALUE); \
+    }
+
+#define GET_ENUM_6(VAR, A, B, C, D, E, F)      \
+    {                                          \
+        const char *str = read_text(rs);       \
+        VAR = GTT_##A;                         \
+        if (!str)                              \
+            VAR = GTT_##A;                     \
+        else if (!strcmp(#A, str))             \
+            VAR = GTT_##A;                     \
+        else if (!strcmp(#B, str))             \
+            VAR = GTT_##B;                     \
+        else if (!strcmp(#C, str))             \
+            VAR = GTT_##C;                     \
+        else if (!strcmp(#D, str))             \
+            VAR = GTT_##D;                     \
+        else if (!strcmp(#E, str))             \
+            VAR = GTT_##E;                     \
+        else if (!strcmp(#F, str))             \
+            VAR = GTT_##F;                     \
+        else                                   \
+            read_error(rs, GTT_UNKNOWN_VALUE); \
+    }
+
+/* =========================================================== */
+/* Intervals are read straight into a record, so that no
+ * GttInterval handles need to be created while loading. */
+
+static void rec_set_start(GttIntervalRec *rec, time_t start)
+{
+    rec->start = start;
+    if (start > rec->stop)
+        rec->stop = start;
+}
 
-static GttTask *parse_task(xmlNodePtr task)
+static void rec_set_stop(GttIntervalRec *rec, time_t stop)
 {
-    xmlNodePtr node;
-    GttTask *tsk = NULL;
+    rec->stop = stop;
+    if (stop < rec->start)
+        rec->start = stop;
+}
 
-    if (!task)
+static void parse_interval(ReadState *rs, GttIntervalRec *ivl)
+{
+    time_t tval;
+
+    memset(ivl, 0, sizeof(GttIntervalRec));
+    FOREACH_CHILD(rs)
     {
-        gtt_err_set_code(GTT_FILE_CORRUPT);
-        return tsk;
+        switch (node_tag(rs))
+        {
+        case TAG_START:
+            GET_TIM(tval);
+            rec_set_start(ivl, tval);
+            break;
+        case TAG_STOP:
+            GET_TIM(tval);
+            rec_set_stop(ivl, tval);
+            break;
+        case TAG_FUZZ:
+            GET_INT(ivl->fuzz);
+            break;
+        case TAG_RUNNING:
+            GET_TIM(tval);
+            ivl->running = (0 != tval);
+            break;
+        default:
+            read_error(rs, GTT_UNKNOWN_TOKEN);
+            skip_element(rs);
+        }
     }
+}
+
+/* =========================================================== */
 
-    if (strcmp("task", (char *) task->name))
+static void parse_task(ReadState *rs, ParsedTask *pt)
+{
+    memset(pt, 0, sizeof(ParsedTask));
+    if (rs->build)
+        pt->tsk = gtt_task_new();
+    else
+        pt->intervals = g_array_new(FALSE, FALSE, sizeof(GttIntervalRec));
+    FOREACH_CHILD(rs)
     {
-        gtt_err_set_code(GTT_FILE_CORRUPT);
-        return tsk;
+        GttTag tag = node_tag(rs);
+
+        pt->present |= TAG_BIT(tag);
+        switch (tag)
+        {
+        case TAG_GUID:
+            GET_GUID(pt->guid);
+            break;
+        case TAG_MEMO:
+            GET_STR(pt->memo);
+            break;
+        case TAG_NOTES:
+            GET_STR(pt->notes);
+            break;
+        case TAG_BILL_UNIT:
+            GET_INT(pt->bill_unit);
+            break;
+        case TAG_ARCHIVED_SECS:
+            GET_INT(pt->archived_secs);
+            break;
+        case TAG_ARCHIVED_FIRST:
+            GET_TIM(pt->archived_first);
+            break;
+        case TAG_ARCHIVED_LAST:
+            GET_TIM(pt->archived_last);
+            break;
+
+        case TAG_BILLABLE:
+            GET_ENUM_3(pt->billable, NOT_BILLABLE, BILLABLE, NO_CHARGE);
+            break;
+        case TAG_BILLSTATUS:
+            GET_ENUM_3(pt->billstatus, HOLD, BILL, PAID);
+            break;
+        case TAG_BILLRATE:
+            GET_ENUM_4(pt->billrate, REGULAR, OVERTIME, OVEROVER, FLAT_FEE);
+            break;
+
+        case TAG_INTERVAL_LIST:
+            FOREACH_CHILD(rs)
+            {
+                GttIntervalRec ival;
+                if (TAG_INTERVAL != node_tag(rs))
+                {
+                    read_error(rs, GTT_FILE_CORRUPT);
+                    skip_element(rs);
+                    continue;
+                }
+                parse_interval(rs, &ival);
+                if (pt->tsk)
+                    gtt_task_append_interval_rec(pt->tsk, &ival);
+                else
+                    g_array_append_val(pt->intervals, ival);
+            }
+            break;
+
+        default:
+            read_error(rs, GTT_UNKNOWN_TOKEN);
+            skip_element(rs);
+        }
     }
+}
+
+static void parsed_task_clear(ParsedTask *pt)
+{
+    g_free(pt->memo);
+    g_free(pt->notes);
+    if (pt->intervals)
+        g_array_free(pt->intervals, TRUE);
+}
+
+/* =========================================================== */
 
-    tsk = gtt_task_new();
-    for (node = task->xmlChildrenNode; node; node = node->next)
+static GttTask *build_task(ParsedTask *pt);
+static GttProject *build_project(ParsedProject *pp);
+static void parsed_project_free(ParsedProject *pp);
+
+static ParsedProject *parse_project(ReadState *rs)
+{
+    ParsedProject *pp;
+
+    pp = g_new0(ParsedProject, 1);
+    if (rs->build)
     {
-        if (node->type != XML_ELEMENT_NODE)
-            continue;
+        pp->prj = gtt_project_new();
+        gtt_project_freeze(pp->prj);
+    }
+    else
+    {
+        pp->tasks = g_array_new(FALSE, FALSE, sizeof(ParsedTask));
+        pp->children = g_ptr_array_new();
+    }
+    FOREACH_CHILD(rs)
+    {
+        GttTag tag = node_tag(rs);
 
-        GET_GUID(tsk, gtt_task_set_guid, "guid")
-        GET_STR(tsk, gtt_task_set_memo, "memo")
-        GET_STR(tsk, gtt_task_set_notes, "notes")
-        GET_INT(tsk, gtt_task_set_bill_unit, "bill_unit")
-
-        GET_ENUM_3(tsk, gtt_task_set_billable, "billable", NOT_BILLABLE, BILLABLE, NO_CHARGE)
-        GET_ENUM_3(tsk, gtt_task_set_billstatus, "billstatus", HOLD, BILL, PAID)
-        GET_ENUM_4(
-            tsk, gtt_task_set_billrate, "billrate", REGULAR, OVERTIME, OVEROVER, FLAT_FEE
-        )
-        if (0 == strcmp("interval-list", (char *) node->name))
+        pp->present |= TAG_BIT(tag);
+        switch (tag)
         {
-            xmlNodePtr tn;
-            for (tn = node->xmlChildrenNode; tn; tn = tn->next)
+        case TAG_GUID:
+            GET_GUID(pp->guid);
+            break;
+        case TAG_TITLE:
+            GET_STR(pp->title);
+            break;
+        case TAG_DESC:
+            GET_STR(pp->desc);
+            break;
+        case TAG_NOTES:
+            GET_STR(pp->notes);
+            break;
+        case TAG_CUSTID:
+            GET_STR(pp->custid);
+            break;
+
+        case TAG_BILLRATE:
+            GET_DBL(pp->billrate);
+            break;
+        case TAG_OVERTIME_RATE:
+            GET_DBL(pp->overtime_rate);
+            break;
+        case TAG_OVEROVER_RATE:
+            GET_DBL(pp->overover_rate);
+            break;
+        case TAG_FLAT_FEE:
+            GET_DBL(pp->flat_fee);
+            break;
+
+        case TAG_MIN_INTERVAL:
+            GET_INT(pp->min_interval);
+            break;
+        case TAG_AUTO_MERGE_INTERVAL:
+            GET_INT(pp->auto_merge_interval);
+            break;
+        case TAG_AUTO_MERGE_GAP:
+            GET_INT(pp->auto_merge_gap);
+            break;
+
+        case TAG_ID:
+            GET_INT(pp->id);
+            break;
+
+        case TAG_ESTIMATED_START:
+            GET_TIM(pp->estimated_start);
+            break;
+        case TAG_ESTIMATED_END:
+            GET_TIM(pp->estimated_end);
+            break;
+        case TAG_DUE_DATE:
+            GET_TIM(pp->due_date);
+            break;
+        case TAG_SIZING:
+            GET_INT(pp->sizing);
+            break;
+        case TAG_PERCENT_COMPLETE:
+            GET_INT(pp->percent_complete);
+            break;
+
+        case TAG_URGENCY:
+            GET_ENUM_4(pp->urgency, UNDEFINED, LOW, MEDIUM, HIGH);
+            break;
+        case TAG_IMPORTANCE:
+            GET_ENUM_4(pp->importance, UNDEFINED, LOW, MEDIUM, HIGH);
+            break;
+        case TAG_STATUS:
+            GET_ENUM_6(
+                pp->status, NO_STATUS, NOT_STARTED, IN_PROGRESS, ON_HOLD, CANCELLED, COMPLETED
+            );
+            break;
+
+        case TAG_TASK_LIST:
+            FOREACH_CHILD(rs)
             {
-                GttInterval *ival;
-                if (tn->type != XML_ELEMENT_NODE)
+                ParsedTask pt;
+                if (TAG_TASK != node_tag(rs))
+                {
+                    read_error(rs, GTT_FILE_CORRUPT);
+                    skip_element(rs);
                     continue;
+                }
+                parse_task(rs, &pt);
+                if (pp->prj)
+                {
+                    gtt_project_append_task(pp->prj, build_task(&pt));
+                    parsed_task_clear(&pt);
+                }
+                else
+                    g_array_append_val(pp->tasks, pt);
+            }
+            break;
 
-                ival = parse_interval(tn);
-                gtt_task_append_interval(tsk, ival);
+        case TAG_PROJECT_LIST:
+            FOREACH_CHILD(rs)
+            {
+                ParsedProject *child;
+                if (TAG_PROJECT != node_tag(rs))
+                {
+                    read_error(rs, GTT_FILE_CORRUPT);
+                    skip_element(rs);
+                    continue;
+                }
+                child = parse_project(rs);
+                if (pp->prj)
+                {
+                    gtt_project_append_project(pp->prj, build_project(child));
+                    parsed_project_free(child);
+                }
+                else
+                    g_ptr_array_add(pp->children, child);
             }
+            break;
+
+        default:
+            g_warning("unexpected node %s", xmlTextReaderConstLocalName(rs->reader));
+            read_error(rs, GTT_UNKNOWN_TOKEN);
+            skip_element(rs);
         }
-        else
+    }
+    return pp;
+}
+
+static void parsed_project_free(ParsedProject *pp)
+{
+    guint i;
+
+    if (pp->tasks)
+    {
+        for (i = 0; i < pp->tasks->len; i++)
         {
-            gtt_err_set_code(GTT_UNKNOWN_TOKEN);
+            parsed_task_clear(&g_array_index(pp->tasks, ParsedTask, i));
         }
+        g_array_free(pp->tasks, TRUE);
+    }
+    if (pp->children)
+    {
+        for (i = 0; i < pp->children->len; i++)
+        {
+            parsed_project_free(g_ptr_array_index(pp->children, i));
+        }
+        g_ptr_array_free(pp->children, TRUE);
+    }
+    g_free(pp->title);
+    g_free(pp->desc);
+    g_free(pp->notes);
+    g_free(pp->custid);
+    g_free(pp);
+}
+
+/* =========================================================== */
+/* Build the real tasks and projects out of what was read, or finish
+ * off the ones built while reading.  This is the only part of loading
+ * that touches anything global, so it is always done in the main
+ * thread.  Only the fields that were in the file are set; the others
+ * keep the defaults of a new project. */
+
+#define SET_IF(SELF, REC, TAG, FN, VAL) \
+    {                                   \
+        if (HAS(REC, TAG))              \
+            FN(SELF, VAL);              \
+    }
+
+static GttTask *build_task(ParsedTask *pt)
+{
+    GttTask *tsk;
+    guint i;
+
+    tsk = pt->tsk ? pt->tsk : gtt_task_new();
+    SET_IF(tsk, pt, TAG_GUID, gtt_task_set_guid, &pt->guid);
+    SET_IF(tsk, pt, TAG_MEMO, gtt_task_set_memo, pt->memo);
+    SET_IF(tsk, pt, TAG_NOTES, gtt_task_set_notes, pt->notes);
+    SET_IF(tsk, pt, TAG_BILL_UNIT, gtt_task_set_bill_unit, pt->bill_unit);
+    SET_IF(tsk, pt, TAG_ARCHIVED_SECS, gtt_task_set_archived_secs, pt->archived_secs);
+    if (HAS(pt, TAG_ARCHIVED_FIRST) && HAS(pt, TAG_ARCHIVED_LAST))
+        gtt_task_set_archived_span(tsk, pt->archived_first, pt->archived_last);
+    SET_IF(tsk, pt, TAG_BILLABLE, gtt_task_set_billable, pt->billable);
+    SET_IF(tsk, pt, TAG_BILLSTATUS, gtt_task_set_billstatus, pt->billstatus);
+    SET_IF(tsk, pt, TAG_BILLRATE, gtt_task_set_billrate, pt->billrate);
+
+    for (i = 0; pt->intervals && (i < pt->intervals->len); i++)
+    {
+        gtt_task_append_interval_rec(tsk, &g_array_index(pt->intervals, GttIntervalRec, i));
     }
     return tsk;
 }
 
+static GttProject *build_project(ParsedProject *pp)
+{
+    GttProject *prj;
+    guint i;
+
+    prj = pp->prj;
+    if (!prj)
+    {
+        prj = gtt_project_new();
+        gtt_project_freeze(prj);
+    }
+
+    SET_IF(prj, pp, TAG_GUID, gtt_project_set_guid, &pp->guid);
+    SET_IF(prj, pp, TAG_TITLE, gtt_project_set_title, pp->title);
+    SET_IF(prj, pp, TAG_DESC, gtt_project_set_desc, pp->desc);
+    SET_IF(prj, pp, TAG_NOTES, gtt_project_set_notes, pp->notes);
+    SET_IF(prj, pp, TAG_CUSTID, gtt_project_set_custid, pp->custid);
+
+    SET_IF(prj, pp, TAG_BILLRATE, gtt_project_set_billrate, pp->billrate);
+    SET_IF(prj, pp, TAG_OVERTIME_RATE, gtt_project_set_overtime_rate, pp->overtime_rate);
+    SET_IF(prj, pp, TAG_OVEROVER_RATE, gtt_project_set_overover_rate, pp->overover_rate);
+    SET_IF(prj, pp, TAG_FLAT_FEE, gtt_project_set_flat_fee, pp->flat_fee);
+
+    SET_IF(prj, pp, TAG_MIN_INTERVAL, gtt_project_set_min_interval, pp->min_interval);
+    SET_IF(
+        prj, pp, TAG_AUTO_MERGE_INTERVAL, gtt_project_set_auto_merge_interval,
+        pp->auto_merge_interval
+    );
+    SET_IF(prj, pp, TAG_AUTO_MERGE_GAP, gtt_project_set_auto_merge_gap, pp->auto_merge_gap);
+
+    SET_IF(prj, pp, TAG_ID, gtt_project_set_id, pp->id);
+
+    SET_IF(
+        prj, pp, TAG_ESTIMATED_START, gtt_project_set_estimated_start, pp->estimated_start
+    );
+    SET_IF(prj, pp, TAG_ESTIMATED_END, gtt_project_set_estimated_end, pp->estimated_end);
+    SET_IF(prj, pp, TAG_DUE_DATE, gtt_project_set_due_date, pp->due_date);
+    SET_IF(prj, pp, TAG_SIZING, gtt_project_set_sizing, pp->sizing);
+    SET_IF(
+        prj, pp, TAG_PERCENT_COMPLETE, gtt_project_set_percent_complete, pp->percent_complete
+    );
+
+    SET_IF(prj, pp, TAG_URGENCY, gtt_project_set_urgency, pp->urgency);
+    SET_IF(prj, pp, TAG_IMPORTANCE, gtt_project_set_importance, pp->importance);
+    SET_IF(prj, pp, TAG_STATUS, gtt_project_set_status, pp->status);
+
+    for (i = 0; pp->tasks && (i < pp->tasks->len); i++)
+    {
+        gtt_project_append_task(prj, build_task(&g_array_index(pp->tasks, ParsedTask, i)));
+    }
+    for (i = 0; pp->children && (i < pp->children->len); i++)
+    {
+        gtt_project_append_project(prj, build_project(g_ptr_array_index(pp->children, i)));
+    }
+
+    gtt_project_thaw(prj);
+    return prj;
+}
+
 /* =========================================================== */
 
-static GttProject *parse_project(xmlNodePtr project)
+/* Move to the first element of the document, which should be the
+ * <gtt> element.  Returns FALSE if there is none. */
+static gboolean find_root(ReadState *rs)
 {
-    xmlNodePtr node;
-    GttProject *prj = NULL;
+    while (read_node(rs))
+    {
+        if (XML_READER_TYPE_ELEMENT == xmlTextReaderNodeType(rs->reader))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Read the <gtt> element and the <project-list> inside of it, one
+ * top-level project at a time */
+static GList *parse_gtt(ReadState *rs)
+{
+    GList *prjs = NULL;
+
+    /* The file may be valid but empty */
+    if (!find_root(rs))
+        return NULL;
 
-    if (!project)
+    if (TAG_GTT != node_tag(rs))
     {
-        gtt_err_set_code(GTT_FILE_CORRUPT);
-        return prj;
+        read_error(rs, GTT_NOT_A_GTT_FILE);
+        return NULL;
     }
 
-    if (strcmp("project", (char *) project->name))
+    /* If no children, then no projects -- a clean slate */
+    if (xmlTextReaderIsEmptyElement(rs->reader) || !next_child(rs, 0))
+        return NULL;
+
+    if (TAG_PROJECT_LIST != node_tag(rs))
     {
-        gtt_err_set_code(GTT_FILE_CORRUPT);
-        return prj;
+        read_error(rs, GTT_FILE_CORRUPT);
+        return NULL;
     }
 
-    prj = gtt_project_new();
-    gtt_project_freeze(prj);
-    for (node = project->xmlChildrenNode; node; node = node->next)
+    FOREACH_CHILD(rs)
     {
-        if (node->type != XML_ELEMENT_NODE)
+        ParsedProject *pp;
+        if (TAG_PROJECT != node_tag(rs))
+        {
+            read_error(rs, GTT_FILE_CORRUPT);
+            skip_element(rs);
             continue;
+        }
+        pp = parse_project(rs);
+        prjs = g_list_prepend(prjs, build_project(pp));
+        parsed_project_free(pp);
+    }
+    return g_list_reverse(prjs);
+}
+
+/* =========================================================== */
+/* Big files are read in parallel.  The top-level projects don't
+ * depend on each other, so the file is cut up between them, and the
+ * pieces are parsed on a pool of threads.  Each piece is parsed on
+ * its own, wrapped in a copy of the <gtt> start tag, so that the
+ * namespace declarations still apply.  The main thread then builds
+ * the projects in their order in the file, as the pieces come in.
+ *
+ * This costs memory that the sequential reader doesn't need, so it
+ * is only done for plain files of at least PARALLEL_MIN_SIZE bytes;
+ * compressed and smaller files are always read sequentially.  The
+ * file is mapped, not copied, so the pages of it that have been
+ * parsed can be dropped again by the system.  What is kept is the
+ * records of the pieces that have been parsed but not built yet.
+ * A piece is cut at about PIECE_MAX_SIZE bytes of the file (unless
+ * one top-level project is bigger than that on its own), and at most
+ * PIECES_AHEAD pieces are handed to the threads ahead of the one
+ * being built, so there are never more than that many pieces' worth
+ * of records, whatever the size of the file. */
+
+#define PARALLEL_MIN_SIZE (512 * 1024)
+#define PIECE_MIN_SIZE (64 * 1024)
+#define PIECE_MAX_SIZE (4 * 1024 * 1024)
+#define PIECES_AHEAD(nthreads) (2 * (nthreads))
+
+typedef struct split_s
+{
+    const char *head; /* the <gtt> start tag */
+    gsize head_len;
+    const char *root_name; /* the qualified name of <gtt> */
+    gsize root_name_len;
+    GArray *projects; /* of Span, one per top-level project */
+} Split;
 
-        GET_GUID(prj, gtt_project_set_guid, "guid")
-        GET_STR(prj, gtt_project_set_title, "title")
-        GET_STR(prj, gtt_project_set_desc, "desc")
-        GET_STR(prj, gtt_project_set_notes, "notes")
-        GET_STR(prj, gtt_project_set_custid, "custid")
-
-        GET_DBL(prj, gtt_project_set_billrate, "billrate")
-        GET_DBL(prj, gtt_project_set_overtime_rate, "overtime_rate")
-        GET_DBL(prj, gtt_project_set_overover_rate, "overover_rate")
-        GET_DBL(prj, gtt_project_set_flat_fee, "flat_fee")
-
-        GET_INT(prj, gtt_project_set_min_interval, "min_interval")
-        GET_INT(prj, gtt_project_set_auto_merge_interval, "auto_merge_interval")
-        GET_INT(prj, gtt_project_set_auto_merge_gap, "auto_merge_gap")
-
-        GET_INT(prj, gtt_project_set_id, "id")
-
-        GET_TIM(prj, gtt_project_set_estimated_start, "estimated_start")
-        GET_TIM(prj, gtt_project_set_estimated_end, "estimated_end")
-        GET_TIM(prj, gtt_project_set_due_date, "due_date")
-        GET_INT(prj, gtt_project_set_sizing, "sizing")
-        GET_INT(prj, gtt_project_set_percent_complete, "percent_complete")
-
-        GET_ENUM_4(prj, gtt_project_set_urgency, "urgency", UNDEFINED, LOW, MEDIUM, HIGH)
-        GET_ENUM_4(prj, gtt_project_set_importance, "importance", UNDEFINED, LOW, MEDIUM, HIGH)
-        GET_ENUM_6(
-            prj, gtt_project_set_status, "status", NO_STATUS, NOT_STARTED, IN_PROGRESS, ON_HOLD,
-            CANCELLED, COMPLETED
-        )
-
-        if (0 == strcmp("task-list", (char *) node->name))
+typedef struct span_s
+{
+    const char *start;
+    gsize len;
+} Span;
+
+typedef struct piece_s
+{
+    Span span;            /* one or more top-level projects */
+    const char *parts[3]; /* head, span, tail */
+    gsize part_lens[3];
+    guint part; /* how far the parser has read */
+    gsize pos;
+
+    GPtrArray *prjs; /* of ParsedProject */
+    GttErrCode err;
+    gboolean failed;
+    gboolean done;
+} Piece;
+
+typedef struct parallel_read_s
+{
+    GMutex lock;
+    GCond cond; /* a piece is done */
+} ParallelRead;
+
+static gboolean is_blank(const char *p, const char *end)
+{
+    for (; p < end; p++)
+    {
+        if (!g_ascii_isspace(*p))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Does the name, minus its namespace prefix, match? */
+static gboolean local_name_is(const char *name, gsize len, const char *local)
+{
+    const char *colon = memchr(name, ':', len);
+
+    if (colon)
+    {
+        len -= colon + 1 - name;
+        name = colon + 1;
+    }
+    return (strlen(local) == len) && (0 == strncmp(name, local, len));
+}
+
+/* Find the end of the markup that starts at p, which is just past
+ * the closing delimiter, or NULL if there is none */
+static const char *find_after(const char *p, const char *end, const char *delim)
+{
+    gsize dlen = strlen(delim);
+
+    for (; p + dlen <= end; p++)
+    {
+        p = memchr(p, delim[0], end - p);
+        if (!p || p + dlen > end)
+            return NULL;
+        if (0 == memcmp(p, delim, dlen))
+            return p + dlen;
+    }
+    return NULL;
+}
+
+/* Find the '>' that closes the tag starting at p, skipping over
+ * quoted attribute values */
+static const char *find_tag_end(const char *p, const char *end)
+{
+    char quote = 0;
+
+    for (; p < end; p++)
+    {
+        if (quote)
         {
-            xmlNodePtr tn;
-            for (tn = node->xmlChildrenNode; tn; tn = tn->next)
+            if (*p == quote)
+                quote = 0;
+        }
+        else if (('"' == *p) || ('\'' == *p))
+            quote = *p;
+        else if ('>' == *p)
+            return p + 1;
+    }
+    return NULL;
+}
+
+/* Only the xml declaration's encoding matters; the pieces are parsed
+ * without it, as UTF-8. */
+static gboolean declaration_ok(const char *p, const char *end)
+{
+    const char *enc = g_strstr_len(p, end - p, "encoding");
+    const char *val, *close;
+
+    if (!enc)
+        return TRUE;
+    val = enc + strlen("encoding");
+    while ((val < end) && ('"' != *val) && ('\'' != *val))
+        val++;
+    if (val >= end)
+        return FALSE;
+    close = memchr(val + 1, *val, end - val - 1);
+    if (!close)
+        return FALSE;
+    return ((5 == close - val - 1) && (0 == g_ascii_strncasecmp(val + 1, "UTF-8", 5)))
+           || ((4 == close - val - 1) && (0 == g_ascii_strncasecmp(val + 1, "UTF8", 4)));
+}
+
+/* The length of the element name at p, which ends at a blank, a
+ * slash or the end of the tag */
+static gsize name_length(const char *p, const char *end)
+{
+    const char *q = p;
+
+    while ((q < end) && !g_ascii_isspace(*q) && ('/' != *q) && ('>' != *q))
+        q++;
+    return q - p;
+}
+
+static gboolean name_is(const char *name, gsize len, const char *other, gsize other_len)
+{
+    return (len == other_len) && (0 == memcmp(name, other, len));
+}
+
+/* Find the top-level projects, without really parsing the file.
+ * This only has to be good enough to cut the file in the right
+ * places; each piece is then parsed for real, and any damage in it
+ * is found then.  Anything out of the ordinary between the pieces
+ * makes it give up, and the file is read in one go instead, so that
+ * the errors are the same either way. */
+static gboolean split_file(const char *buf, gsize len, Split *split)
+{
+    const char *p = buf, *end = buf + len;
+    const char *list_name = NULL, *prj_start = NULL;
+    gsize list_name_len = 0;
+    int depth = 0;
+
+    /* Skip a UTF-8 byte order mark */
+    if ((3 <= len) && (0 == memcmp(p, "\xef\xbb\xbf", 3)))
+        p += 3;
+    buf = p;
+
+    while (p < end)
+    {
+        const char *lt, *name, *tag_end;
+        gsize name_len;
+        gboolean empty;
+
+        /* Text between the top-level projects must be blank */
+        lt = memchr(p, '<', end - p);
+        if (!lt)
+            lt = end;
+        if ((3 > depth) && !is_blank(p, lt))
+            return FALSE;
+        if (lt == end)
+            break;
+        if (end - lt < 2)
+            return FALSE;
+        p = lt;
+
+        if ('?' == p[1])
+        {
+            tag_end = find_after(p, end, "?>");
+            if (!tag_end || ((p == buf) && !declaration_ok(p, tag_end)))
+                return FALSE;
+            p = tag_end;
+            continue;
+        }
+        if ((end - p >= 4) && (0 == memcmp(p, "<!--", 4)))
+        {
+            p = find_after(p, end, "-->");
+            if (!p)
+                return FALSE;
+            continue;
+        }
+        if ((end - p >= 9) && (3 <= depth) && (0 == memcmp(p, "<![CDATA[", 9)))
+        {
+            p = find_after(p, end, "]]>");
+            if (!p)
+                return FALSE;
+            continue;
+        }
+
+        /* A DOCTYPE could define entities that the pieces won't know */
+        if ('!' == p[1])
+            return FALSE;
+
+        tag_end = find_tag_end(p, end);
+        if (!tag_end)
+            return FALSE;
+
+        if ('/' == p[1])
+        {
+            name = p + 2;
+            name_len = name_length(name, tag_end);
+            depth--;
+            if (2 == depth)
             {
-                GttTask *tsk;
-                tsk = parse_task(tn);
-                gtt_project_append_task(prj, tsk);
+                Span span = { prj_start, tag_end - prj_start };
+                g_array_append_val(split->projects, span);
             }
+            else if ((0 > depth)
+                     || ((1 == depth) && !name_is(name, name_len, list_name, list_name_len))
+                     || ((0 == depth)
+                         && !name_is(name, name_len, split->root_name, split->root_name_len)))
+                return FALSE;
+            p = tag_end;
+            continue;
         }
-        else if (0 == strcmp("project-list", (char *) node->name))
+
+        name = p + 1;
+        name_len = name_length(name, tag_end);
+        empty = ('/' == tag_end[-2]);
+        switch (depth)
         {
-            xmlNodePtr tn;
-            for (tn = node->xmlChildrenNode; tn; tn = tn->next)
+        case 0:
+            if (split->head || empty || !local_name_is(name, name_len, "gtt"))
+                return FALSE;
+            split->head = p;
+            split->head_len = tag_end - p;
+            split->root_name = name;
+            split->root_name_len = name_len;
+            split->projects = g_array_new(FALSE, FALSE, sizeof(Span));
+            break;
+        case 1:
+            if (list_name || empty || !local_name_is(name, name_len, "project-list")
+                || g_strstr_len(p, tag_end - p, "xmlns"))
+                return FALSE;
+            list_name = name;
+            list_name_len = name_len;
+            break;
+        case 2:
+            if (!local_name_is(name, name_len, "project"))
+                return FALSE;
+            prj_start = p;
+            if (empty)
             {
-                GttProject *child;
-                if (tn->type != XML_ELEMENT_NODE)
-                    continue;
-                child = parse_project(tn);
-                gtt_project_append_project(prj, child);
+                Span span = { prj_start, tag_end - prj_start };
+                g_array_append_val(split->projects, span);
             }
+            break;
         }
-        else
+        if (!empty)
+            depth++;
+        p = tag_end;
+    }
+
+    /* Not worth it for just one project */
+    return (0 == depth) && list_name && (2 <= split->projects->len);
+}
+
+static int piece_read_cb(void *context, char *buffer, int len)
+{
+    Piece *pc = context;
+    int n = 0;
+
+    while ((n < len) && (pc->part < 3))
+    {
+        gsize k = MIN((gsize) (len - n), pc->part_lens[pc->part] - pc->pos);
+        memcpy(buffer + n, pc->parts[pc->part] + pc->pos, k);
+        n += k;
+        pc->pos += k;
+        if (pc->pos == pc->part_lens[pc->part])
         {
-            g_warning("unexpected node %s", node->name);
-            gtt_err_set_code(GTT_UNKNOWN_TOKEN);
+            pc->part++;
+            pc->pos = 0;
         }
     }
-    gtt_project_thaw(prj);
-    return prj;
+    return n;
 }
 
-/* =========================================================== */
+static int piece_close_cb(void *context)
+{
+    return 0;
+}
 
-GList *gtt_xml_read_projects(const char *filename)
+/* Parse one piece of the file; this runs in a pool thread */
+static void parse_piece(gpointer data, gpointer user_data)
 {
-    GList *prjs = NULL;
-    xmlDocPtr doc;
-    xmlNodePtr root, project_list, project;
-    // xmlChar *version;
+    Piece *pc = data;
+    ParallelRead *pr = user_data;
+    ReadState rs;
 
-    LIBXML_TEST_VERSION;
-    xmlKeepBlanksDefault(0);
-    doc = xmlParseFile(filename);
+    rs.reader = xmlReaderForIO(
+        piece_read_cb, piece_close_cb, pc, NULL, NULL, XML_PARSE_NOBLANKS
+    );
+    rs.text = g_string_new(NULL);
+    rs.build = FALSE;
+    rs.failed = (NULL == rs.reader);
+    rs.err = GTT_NO_ERR;
 
-    if (!doc)
+    if (rs.reader && find_root(&rs))
     {
-        gtt_err_set_code(GTT_CANT_OPEN_FILE);
-        return NULL;
+        FOREACH_CHILD(&rs)
+        {
+            if (TAG_PROJECT != node_tag(&rs))
+            {
+                read_error(&rs, GTT_FILE_CORRUPT);
+                skip_element(&rs);
+                continue;
+            }
+            g_ptr_array_add(pc->prjs, parse_project(&rs));
+        }
+        while (read_node(&rs))
+            ;
     }
-    root = xmlDocGetRootElement(doc);
 
-    /* The doc may be null if the file is valid but empty */
-    if (!root)
+    if (rs.reader)
+        xmlFreeTextReader(rs.reader);
+    g_string_free(rs.text, TRUE);
+
+    g_mutex_lock(&pr->lock);
+    pc->err = rs.err;
+    pc->failed = rs.failed;
+    pc->done = TRUE;
+    g_cond_broadcast(&pr->cond);
+    g_mutex_unlock(&pr->lock);
+}
+
+/* Group the top-level projects into pieces of a reasonable size,
+ * a few for each thread, so that the threads stay busy */
+static GPtrArray *make_pieces(Split *split, gsize total, guint nthreads)
+{
+    GPtrArray *pieces = g_ptr_array_new();
+    gsize target = CLAMP(total / (4 * nthreads), PIECE_MIN_SIZE, PIECE_MAX_SIZE);
+    Piece *pc = NULL;
+    guint i;
+
+    for (i = 0; i < split->projects->len; i++)
     {
-        xmlFreeDoc(doc);
-        return NULL;
+        Span *span = &g_array_index(split->projects, Span, i);
+
+        if (pc && (pc->span.len < target))
+        {
+            pc->span.len = span->start + span->len - pc->span.start;
+            continue;
+        }
+        pc = g_new0(Piece, 1);
+        pc->span = *span;
+        pc->prjs = g_ptr_array_new();
+        g_ptr_array_add(pieces, pc);
     }
+    return pieces;
+}
+
+/* Returns FALSE if the file should be read the ordinary way instead */
+static gboolean read_parallel(const char *filename, GList **prjs_out, ReadState *rs)
+{
+    GStatBuf st;
+    GBytes *bytes;
+    const char *buf;
+    gsize len;
+    Split split;
+    GPtrArray *pieces;
+    GThreadPool *pool;
+    ParallelRead pr;
+    GList *prjs = NULL;
+    char *tail;
+    guint nthreads, pushed, i, j;
 
-    // version = xmlGetProp(root, (unsigned char *)"version");
-    if (!root->name || strcmp("gtt", (char *) root->name))
+    nthreads = g_get_num_processors();
+    if ((2 > nthreads) || g_stat(filename, &st) || (PARALLEL_MIN_SIZE > st.st_size))
+        return FALSE;
+
+    bytes = gtt_file_compress_map(filename);
+    if (!bytes)
+        return FALSE;
+    buf = g_bytes_get_data(bytes, &len);
+    memset(&split, 0, sizeof(Split));
+    if (!buf || !split_file(buf, len, &split))
     {
-        xmlFreeDoc(doc);
-        gtt_err_set_code(GTT_NOT_A_GTT_FILE);
-        return NULL;
+        if (split.projects)
+            g_array_free(split.projects, TRUE);
+        g_bytes_unref(bytes);
+        return FALSE;
     }
 
-    project_list = root->xmlChildrenNode;
+    tail = g_strdup_printf("</%.*s>", (int) split.root_name_len, split.root_name);
+    pieces = make_pieces(&split, len, nthreads);
+    g_array_free(split.projects, TRUE);
 
-    /* If no children, then no projects -- a clean slate */
-    if (!project_list)
+    /* Get the library set up here, rather than in some thread */
+    xmlInitParser();
+
+    g_mutex_init(&pr.lock);
+    g_cond_init(&pr.cond);
+    pool = g_thread_pool_new(parse_piece, &pr, MIN(nthreads, pieces->len), FALSE, NULL);
+
+    /* Build the projects in file order, while the next few pieces are
+     * parsed.  The errors are passed on in the same order, so that
+     * the first one in the file is the one reported. */
+    pushed = 0;
+    for (i = 0; i < pieces->len; i++)
     {
-        xmlFreeDoc(doc);
-        return NULL;
+        Piece *pc;
+
+        for (; (pushed < pieces->len) && (pushed <= i + PIECES_AHEAD(nthreads)); pushed++)
+        {
+            pc = g_ptr_array_index(pieces, pushed);
+            pc->parts[0] = split.head;
+            pc->part_lens[0] = split.head_len;
+            pc->parts[1] = pc->span.start;
+            pc->part_lens[1] = pc->span.len;
+            pc->parts[2] = tail;
+            pc->part_lens[2] = strlen(tail);
+            g_thread_pool_push(pool, pc, NULL);
+        }
+
+        pc = g_ptr_array_index(pieces, i);
+        g_mutex_lock(&pr.lock);
+        while (!pc->done)
+            g_cond_wait(&pr.cond, &pr.lock);
+        g_mutex_unlock(&pr.lock);
+
+        read_error(rs, pc->err);
+        rs->failed |= pc->failed;
+        for (j = 0; j < pc->prjs->len; j++)
+        {
+            ParsedProject *pp = g_ptr_array_index(pc->prjs, j);
+            if (!rs->failed)
+                prjs = g_list_prepend(prjs, build_project(pp));
+            parsed_project_free(pp);
+        }
+        g_ptr_array_free(pc->prjs, TRUE);
+        g_free(pc);
     }
 
-    if (strcmp("project-list", (char *) project_list->name))
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_ptr_array_free(pieces, TRUE);
+    g_mutex_clear(&pr.lock);
+    g_cond_clear(&pr.cond);
+    g_free(tail);
+    g_bytes_unref(bytes);
+
+    *prjs_out = g_list_reverse(prjs);
+    return TRUE;
+}
+
+/* =========================================================== */
+
+/* The file is read through the decompressor, a buffer at a time */
+
+static int read_cb(void *context, char *buffer, int len)
+{
+    return gtt_file_compress_in_read(context, buffer, len);
+}
+
+static int close_cb(void *context)
+{
+    gtt_file_compress_in_close(context);
+    return 0;
+}
+
+static GList *read_sequential(const char *filename, ReadState *rs)
+{
+    GttCompressIn *cin;
+    GList *prjs;
+
+    /* The reader closes cin, even if it fails to start */
+    cin = gtt_file_compress_in_open(filename);
+    rs->reader = NULL;
+    if (cin)
+        rs->reader = xmlReaderForIO(read_cb, close_cb, cin, filename, NULL, XML_PARSE_NOBLANKS);
+    if (!rs->reader)
     {
-        xmlFreeDoc(doc);
-        gtt_err_set_code(GTT_FILE_CORRUPT);
+        rs->failed = TRUE;
         return NULL;
     }
 
-    for (project = project_list->xmlChildrenNode; project; project = project->next)
+    /* Build the projects as they go by, rather than keeping records */
+    rs->build = TRUE;
+    prjs = parse_gtt(rs);
+
+    /* Read to the end, so that a damaged file is noticed even if
+     * the damage comes after the project list. */
+    if (!rs->failed)
     {
-        GttProject *prj;
-        if (project->type != XML_ELEMENT_NODE)
-            continue;
-        prj = parse_project(project);
-        prjs = g_list_append(prjs, prj);
+        while (read_node(rs))
+            ;
+    }
+
+    xmlFreeTextReader(rs->reader);
+    return prjs;
+}
+
+GList *gtt_xml_read_projects(const char *filename)
+{
+    GList *node, *prjs = NULL;
+    ReadState rs;
+
+    LIBXML_TEST_VERSION;
+    tag_table_init();
+
+    rs.reader = NULL;
+    rs.text = g_string_new(NULL);
+    rs.build = FALSE;
+    rs.failed = FALSE;
+    rs.err = GTT_NO_ERR;
+
+    gtt_project_bulk_load_begin();
+    if (!read_parallel(filename, &prjs, &rs))
+        prjs = read_sequential(filename, &rs);
+
+    if (GTT_NO_ERR != rs.err)
+        gtt_err_set_code(rs.err);
+
+    /* A file that isn't well-formed is not loaded at all, as with
+     * the DOM parser; throw away whatever was built before the error. */
+    if (rs.failed)
+    {
+        for (node = prjs; node; node = node->next)
+            gtt_project_destroy(node->data);
+        g_list_free(prjs);
+        prjs = NULL;
+        gtt_err_set_code(GTT_CANT_OPEN_FILE);
     }
+    gtt_project_bulk_load_commit();
 
-    xmlFreeDoc(doc);
+    g_string_free(rs.text, TRUE);
     return prjs;
 }
 
@@ -424,6 +1472,8 @@ void gtt_xml_read_file(const char *filename)
 {
     GList *node, *prjs = NULL;
 
+    /* The commit scrubs the new projects and computes their totals */
+    gtt_project_bulk_load_begin();
     prjs = gtt_xml_read_projects(filename);
 
     for (node = prjs; node; node = node->next)
@@ -431,9 +1481,8 @@ void gtt_xml_read_file(const char *filename)
         GttProject *prj = node->data;
         gtt_project_list_append(master_list, prj);
     }
-
-    /* recompute the cached counters */
-    gtt_project_list_compute_secs();
+    g_list_free(prjs);
+    gtt_project_bulk_load_commit();
 }
 
 /* ====================== END OF FILE =============== */
@@ -18,17 +18,20 @@
 
 #include "config.h"
 
-#include <libxml/tree.h>
+#include <libxml/xmlwriter.h>
 #include <qof.h>
 #include <stdio.h>
 
 #include "cur-proj.h"
 #include "err-throw.h"
+#include "file-compress.h"
 #include "gtt.h"
+#include "prefs.h"
 #include "proj.h"
+#include "proj_p.h"
+#include "string-pool.h"
 #include "xml-gtt.h"
-
-static xmlNodePtr gtt_project_list_to_dom_tree(GList *list);
+#include "xml-gtt-p.h"
 
 /* Note: most of this code is a tediously boring cut-n-paste
  * of the same thing over & over again, and could//should be
@@ -40,111 +43,121 @@ static xmlNodePtr gtt_project_list_to_dom_tree(GList *list);
  * Alas ...
  */
 
+/* The data is streamed out through an xmlTextWriter, element by
+ * element, rather than being built up into a DOM tree and then
+ * dumped.  Nothing is held in memory but the writer's output buffer
+ * and its stack of open elements.  The layout of the file is the
+ * same as that of the old DOM dump.
+ */
+
+typedef struct xml_out_s
+{
+    xmlTextWriterPtr writer;
+    gboolean failed; /* some write returned an error */
+} XmlOut;
+
+#define CHECK(CALL)             \
+    {                           \
+        if (0 > (CALL))         \
+            out->failed = TRUE; \
+    }
+
 /* ======================================================= */
 
-#define PUT_STR(TOK, VAL)                          \
-    {                                              \
-        const char *str = (VAL);                   \
-        if (str && 0 != str[0])                    \
-        {                                          \
-            node = xmlNewNode(NULL, BAD_CAST TOK); \
-            xmlNodeAddContent(node, BAD_CAST str); \
-            xmlAddChild(topnode, node);            \
-        }                                          \
+static void put_text(XmlOut *out, const char *tok, const char *str)
+{
+    if (str && str[0])
+    {
+        CHECK(xmlTextWriterWriteElement(out->writer, BAD_CAST tok, BAD_CAST str));
+    }
+    else
+    {
+        /* An empty element comes out as <tok/> */
+        CHECK(xmlTextWriterStartElement(out->writer, BAD_CAST tok));
+        CHECK(xmlTextWriterEndElement(out->writer));
+    }
+}
+
+#define PUT_STR(TOK, VAL)            \
+    {                                \
+        const char *str = (VAL);     \
+        if (str && 0 != str[0])      \
+        {                            \
+            put_text(out, TOK, str); \
+        }                            \
     }
 
 #define PUT_INT(TOK, VAL)                            \
     {                                                \
         char buff[80];                               \
         g_snprintf(buff, sizeof(buff), "%d", (VAL)); \
-        node = xmlNewNode(NULL, BAD_CAST TOK);       \
-        xmlNodeAddContent(node, BAD_CAST buff);      \
-        xmlAddChild(topnode, node);                  \
+        put_text(out, TOK, buff);                    \
     }
 
 #define PUT_LONG(TOK, VAL)                            \
     {                                                 \
         char buff[80];                                \
         g_snprintf(buff, sizeof(buff), "%ld", (VAL)); \
-        node = xmlNewNode(NULL, BAD_CAST TOK);        \
-        xmlNodeAddContent(node, BAD_CAST buff);       \
-        xmlAddChild(topnode, node);                   \
+        put_text(out, TOK, buff);                     \
     }
 
 #define PUT_DBL(TOK, VAL)                               \
     {                                                   \
         char buff[80];                                  \
         g_snprintf(buff, sizeof(buff), "%.18g", (VAL)); \
-        node = xmlNewNode(NULL, BAD_CAST TOK);          \
-        xmlNodeAddContent(node, BAD_CAST buff);         \
-        xmlAddChild(topnode, node);                     \
+        put_text(out, TOK, buff);                       \
     }
 
-#define PUT_GUID(TOK, VAL)                      \
-    {                                           \
-        char buff[80];                          \
-        guid_to_string_buff((VAL), buff);       \
-        node = xmlNewNode(NULL, BAD_CAST TOK);  \
-        xmlNodeAddContent(node, BAD_CAST buff); \
-        xmlAddChild(topnode, node);             \
+#define PUT_GUID(TOK, VAL)                \
+    {                                     \
+        char buff[80];                    \
+        guid_to_string_buff((VAL), buff); \
+        put_text(out, TOK, buff);         \
     }
 
-#define PUT_BOOL(TOK, VAL)                         \
-    {                                              \
-        gboolean boll = (VAL);                     \
-        node = xmlNewNode(NULL, BAD_CAST TOK);     \
-        if (boll)                                  \
-        {                                          \
-            xmlNodeAddContent(node, BAD_CAST "T"); \
-        }                                          \
-        else                                       \
-        {                                          \
-            xmlNodeAddContent(node, BAD_CAST "F"); \
-        }                                          \
-        xmlAddChild(topnode, node);                \
+#define PUT_BOOL(TOK, VAL)                    \
+    {                                         \
+        gboolean boll = (VAL);                \
+        put_text(out, TOK, boll ? "T" : "F"); \
     }
 
-#define PUT_ENUM_3(TOK, VAL, A, B, C)          \
-    {                                          \
-        const char *str = #A;                  \
-        switch (VAL)                           \
-        {                                      \
-        case GTT_##A:                          \
-            str = #A;                          \
-            break;                             \
-        case GTT_##B:                          \
-            str = #B;                          \
-            break;                             \
-        case GTT_##C:                          \
-            str = #C;                          \
-            break;                             \
-        }                                      \
-        node = xmlNewNode(NULL, BAD_CAST TOK); \
-        xmlNodeAddContent(node, BAD_CAST str); \
-        xmlAddChild(topnode, node);            \
+#define PUT_ENUM_3(TOK, VAL, A, B, C) \
+    {                                 \
+        const char *str = #A;         \
+        switch (VAL)                  \
+        {                             \
+        case GTT_##A:                 \
+            str = #A;                 \
+            break;                    \
+        case GTT_##B:                 \
+            str = #B;                 \
+            break;                    \
+        case GTT_##C:                 \
+            str = #C;                 \
+            break;                    \
+        }                             \
+        put_text(out, TOK, str);      \
     }
 
-#define PUT_ENUM_4(TOK, VAL, A, B, C, D)       \
-    {                                          \
-        const char *str = #A;                  \
-        switch (VAL)                           \
-        {                                      \
-        case GTT_##A:                          \
-            str = #A;                          \
-            break;                             \
-        case GTT_##B:                          \
-            str = #B;                          \
-            break;                             \
-        case GTT_##C:                          \
-            str = #C;                          \
-            break;                             \
-        case GTT_##D:                          \
-            str = #D;                          \
-            break;                             \
-        }                                      \
-        node = xmlNewNode(NULL, BAD_CAST TOK); \
-        xmlNodeAddContent(node, BAD_CAST str); \
-        xmlAddChild(topnode, node);            \
+#define PUT_ENUM_4(TOK, VAL, A, B, C, D) \
+    {                                    \
+        const char *str = #A;            \
+        switch (VAL)                     \
+        {                                \
+        case GTT_##A:                    \
+            str = #A;                    \
+            break;                       \
+        case GTT_##B:                    \
+            str = #B;                    \
+            break;                       \
+        case GTT_##C:                    \
+            str = #C;                    \
+            break;                       \
+        case GTT_##D:                    \
+            str = #D;                    \
+            break;                       \
+        }                                \
+        put_text(out, TOK, str);         \
     }
 
 #define PUT_ENUM_6(TOK, VAL, A, B, C, D, E, F) \
@@ -171,220 +184,397 @@ static xmlNodePtr gtt_project_list_to_dom_tree(GList *list);
             str = #F;                          \
             break;                             \
         }                                      \
-        node = xmlNewNode(NULL, BAD_CAST TOK); \
-        xmlNodeAddContent(node, BAD_CAST str); \
-        xmlAddChild(topnode, node);            \
+        put_text(out, TOK, str);               \
     }
 
-/* ======================================================= */
-
-/* convert one interval to a dom tree */
+#define START_ELEMENT(TOK) CHECK(xmlTextWriterStartElement(out->writer, BAD_CAST TOK))
+#define END_ELEMENT() CHECK(xmlTextWriterEndElement(out->writer))
 
-static xmlNodePtr gtt_xml_interval_to_dom_tree(GttInterval *ivl)
+/* ======================================================= */
+/* A snapshot is a compact copy of everything that goes into the
+ * file.  It is taken on the main thread, and can then be written out
+ * from any thread, while the projects themselves go on changing.
+ * Taking it is cheap: the intervals of a task are one memcpy, and the
+ * memos and notes are shared with the tasks through the string pool,
+ * or the mapped file they are in.
+ * It must also be freed on the main thread, since the string pool is
+ * not thread-safe. */
+
+static void snap_task(SnapTask *st, GttTask *task, time_t archive_before)
 {
-    xmlNodePtr node, topnode;
+    guint keep;
+
+    st->guid = *gtt_task_get_guid(task);
+    st->memo = gtt_string_pool_ref(task->memo);
+    if (task->notes_source)
+        st->notes_source = g_bytes_ref(task->notes_source);
+    st->notes = task->notes_source ? task->notes : gtt_string_pool_ref(task->notes);
+    st->bill_unit = task->bill_unit;
+    st->billable = task->billable;
+    st->billrate = task->billrate;
+    st->billstatus = task->billstatus;
+
+    st->archived_secs = task->archived_secs;
+    st->archived_first = task->archived_first;
+    st->archived_last = task->archived_last;
+
+    /* The intervals are newest first; the old ones are at the end.
+     * The span only stays known if it was known for the ones that
+     * are archived already. */
+    for (keep = task->intervals->len; keep; keep--)
+    {
+        GttIntervalRec *rec = &g_array_index(task->intervals, GttIntervalRec, keep - 1);
+        if (rec->start >= archive_before)
+            break;
+        if (0 == st->archived_secs)
+        {
+            st->archived_first = rec->start;
+            st->archived_last = rec->stop;
+        }
+        else if (st->archived_last)
+        {
+            st->archived_first = MIN(st->archived_first, rec->start);
+            st->archived_last = MAX(st->archived_last, rec->stop);
+        }
+        st->archived_secs += rec->stop - rec->start;
+    }
+    if (0 == st->archived_secs)
+        st->archived_first = st->archived_last = 0;
 
-    if (!ivl)
-        return NULL;
+    st->intervals = g_array_sized_new(FALSE, FALSE, sizeof(GttIntervalRec), keep);
+    g_array_append_vals(st->intervals, task->intervals->data, keep);
+    if (keep < task->intervals->len)
+    {
+        st->archived = g_array_sized_new(
+            FALSE, FALSE, sizeof(GttIntervalRec), task->intervals->len - keep
+        );
+        g_array_append_vals(
+            st->archived, &g_array_index(task->intervals, GttIntervalRec, keep),
+            task->intervals->len - keep
+        );
+    }
+}
 
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:interval");
+static void snap_project_list(
+    guint *num, SnapProject **sps, GList *list, time_t archive_before
+);
 
-    PUT_LONG("start", gtt_interval_get_start(ivl));
-    PUT_LONG("stop", gtt_interval_get_stop(ivl));
-    PUT_INT("fuzz", gtt_interval_get_fuzz(ivl));
-    PUT_BOOL("running", gtt_interval_is_running(ivl));
+static void snap_project(SnapProject *sp, GttProject *prj, time_t archive_before)
+{
+    GList *node;
+    guint i;
+
+    sp->guid = *gtt_project_get_guid(prj);
+    sp->title = g_strdup(prj->title);
+    sp->desc_source = prj->desc_source ? g_bytes_ref(prj->desc_source) : NULL;
+    sp->desc = prj->desc_source ? prj->desc : g_strdup(prj->desc);
+    sp->notes_source = prj->notes_source ? g_bytes_ref(prj->notes_source) : NULL;
+    sp->notes = prj->notes_source ? prj->notes : g_strdup(prj->notes);
+    sp->custid = g_strdup(prj->custid);
+    sp->id = prj->id;
+
+    sp->billrate = prj->billrate;
+    sp->overtime_rate = prj->overtime_rate;
+    sp->overover_rate = prj->overover_rate;
+    sp->flat_fee = prj->flat_fee;
+
+    sp->min_interval = prj->min_interval;
+    sp->auto_merge_interval = prj->auto_merge_interval;
+    sp->auto_merge_gap = prj->auto_merge_gap;
+
+    sp->estimated_start = prj->estimated_start;
+    sp->estimated_end = prj->estimated_end;
+    sp->due_date = prj->due_date;
+    sp->sizing = prj->sizing;
+    sp->percent_complete = prj->percent_complete;
+    sp->urgency = prj->urgency;
+    sp->importance = prj->importance;
+    sp->status = prj->status;
+
+    sp->num_tasks = g_list_length(prj->task_list);
+    sp->tasks = g_new0(SnapTask, sp->num_tasks);
+    for (i = 0, node = prj->task_list; node; i++, node = node->next)
+    {
+        snap_task(&sp->tasks[i], node->data, archive_before);
+    }
 
-    return topnode;
+    snap_project_list(&sp->num_children, &sp->children, prj->sub_projects, archive_before);
 }
 
-/* convert a list of gtt tasks into a DOM tree */
-static xmlNodePtr gtt_interval_list_to_dom_tree(GList *list)
+static void snap_project_list(
+    guint *num, SnapProject **sps, GList *list, time_t archive_before
+)
 {
-    GList *p;
-    xmlNodePtr topnode;
-    xmlNodePtr node;
+    GList *node;
+    guint i;
 
-    if (!list)
-        return NULL;
+    *num = g_list_length(list);
+    *sps = g_new0(SnapProject, *num);
+    for (i = 0, node = list; node; i++, node = node->next)
+    {
+        snap_project(&(*sps)[i], node->data, archive_before);
+    }
+}
 
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:interval-list");
+static void free_project_list(guint num, SnapProject *sps)
+{
+    guint i, j;
 
-    for (p = list; p; p = p->next)
+    for (i = 0; i < num; i++)
     {
-        GttInterval *ivl = p->data;
-        node = gtt_xml_interval_to_dom_tree(ivl);
-        xmlAddChild(topnode, node);
+        SnapProject *sp = &sps[i];
+        for (j = 0; j < sp->num_tasks; j++)
+        {
+            gtt_string_pool_unref(sp->tasks[j].memo);
+            if (sp->tasks[j].notes_source)
+                g_bytes_unref(sp->tasks[j].notes_source);
+            else
+                gtt_string_pool_unref(sp->tasks[j].notes);
+            g_array_free(sp->tasks[j].intervals, TRUE);
+            if (sp->tasks[j].archived)
+                g_array_free(sp->tasks[j].archived, TRUE);
+        }
+        g_free(sp->tasks);
+        free_project_list(sp->num_children, sp->children);
+        g_free(sp->title);
+        if (sp->desc_source)
+            g_bytes_unref(sp->desc_source);
+        else
+            g_free(sp->desc);
+        if (sp->notes_source)
+            g_bytes_unref(sp->notes_source);
+        else
+            g_free(sp->notes);
+        g_free(sp->custid);
     }
+    g_free(sps);
+}
 
-    return topnode;
+GttXmlSnapshot *gtt_xml_snapshot_new(GList *projects, time_t archive_before)
+{
+    GttXmlSnapshot *snap;
+
+    /* Get the library set up here, rather than in some thread */
+    xmlInitParser();
+
+    snap = g_new0(GttXmlSnapshot, 1);
+    snap->archive_before = archive_before;
+    snap->archive_years = g_array_new(FALSE, FALSE, sizeof(int));
+    snap->compression = config_data_compression;
+    if (!gtt_file_compress_available(snap->compression))
+        snap->compression = GTT_COMPRESS_NONE;
+    snap_project_list(&snap->num_projects, &snap->projects, projects, archive_before);
+    return snap;
+}
+
+void gtt_xml_snapshot_free(GttXmlSnapshot *snap)
+{
+    if (!snap)
+        return;
+    free_project_list(snap->num_projects, snap->projects);
+    g_array_free(snap->archive_years, TRUE);
+    g_free(snap);
 }
 
 /* ======================================================= */
 
-/* convert one task to a dom tree */
+static void gtt_xml_write_project_list(XmlOut *out, guint num, SnapProject *sps);
+
+/* write out one interval */
 
-static xmlNodePtr gtt_xml_task_to_dom_tree(GttTask *task)
+static void gtt_xml_write_interval(XmlOut *out, const GttIntervalRec *ivl)
 {
-    GList *p;
-    xmlNodePtr node, topnode;
+    START_ELEMENT("gtt:interval");
+
+    PUT_LONG("start", ivl->start);
+    PUT_LONG("stop", ivl->stop);
+    PUT_INT("fuzz", ivl->fuzz);
+    PUT_BOOL("running", ivl->running);
+
+    END_ELEMENT();
+}
+
+/* write out the intervals of a task */
+static void gtt_xml_write_interval_list(XmlOut *out, GArray *ivls)
+{
+    guint i;
+
+    if (!ivls || (0 == ivls->len))
+        return;
+
+    START_ELEMENT("gtt:interval-list");
+
+    for (i = 0; i < ivls->len; i++)
+    {
+        GttIntervalRec *ivl = &g_array_index(ivls, GttIntervalRec, i);
+        gtt_xml_write_interval(out, ivl);
+    }
 
-    if (!task)
-        return NULL;
+    END_ELEMENT();
+}
 
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:task");
+/* ======================================================= */
 
-    PUT_GUID("guid", gtt_task_get_guid(task));
-    PUT_STR("memo", gtt_task_get_memo(task));
-    PUT_STR("notes", gtt_task_get_notes(task));
-    PUT_INT("bill_unit", gtt_task_get_bill_unit(task));
+/* write out one task */
 
-    PUT_ENUM_3("billable", gtt_task_get_billable(task), BILLABLE, NOT_BILLABLE, NO_CHARGE);
-    PUT_ENUM_4("billrate", gtt_task_get_billrate(task), REGULAR, OVERTIME, OVEROVER, FLAT_FEE);
-    PUT_ENUM_3("billstatus", gtt_task_get_billstatus(task), HOLD, BILL, PAID);
+static void gtt_xml_write_task(XmlOut *out, const SnapTask *task)
+{
+    START_ELEMENT("gtt:task");
+
+    PUT_GUID("guid", &task->guid);
+    PUT_STR("memo", task->memo);
+    PUT_STR("notes", task->notes);
+    PUT_INT("bill_unit", task->bill_unit);
+    if (task->archived_secs)
+    {
+        PUT_INT("archived_secs", task->archived_secs);
+    }
+    if (task->archived_secs && task->archived_last)
+    {
+        PUT_LONG("archived_first", task->archived_first);
+        PUT_LONG("archived_last", task->archived_last);
+    }
+
+    PUT_ENUM_3("billable", task->billable, BILLABLE, NOT_BILLABLE, NO_CHARGE);
+    PUT_ENUM_4("billrate", task->billrate, REGULAR, OVERTIME, OVEROVER, FLAT_FEE);
+    PUT_ENUM_3("billstatus", task->billstatus, HOLD, BILL, PAID);
 
     /* add list of intervals */
-    p = gtt_task_get_intervals(task);
-    node = gtt_interval_list_to_dom_tree(p);
-    xmlAddChild(topnode, node);
+    gtt_xml_write_interval_list(out, task->intervals);
 
-    return topnode;
+    END_ELEMENT();
 }
 
-/* convert a list of gtt tasks into a DOM tree */
-static xmlNodePtr gtt_task_list_to_dom_tree(GList *list)
+/* write out a list of gtt tasks */
+static void gtt_xml_write_task_list(XmlOut *out, guint num, const SnapTask *tasks)
 {
-    GList *p;
-    xmlNodePtr topnode;
-    xmlNodePtr node;
+    guint i;
 
-    if (!list)
-        return NULL;
+    if (0 == num)
+        return;
 
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:task-list");
+    START_ELEMENT("gtt:task-list");
 
-    for (p = list; p; p = p->next)
+    for (i = 0; i < num; i++)
     {
-        GttTask *task = p->data;
-        node = gtt_xml_task_to_dom_tree(task);
-        xmlAddChild(topnode, node);
+        gtt_xml_write_task(out, &tasks[i]);
     }
 
-    return topnode;
+    END_ELEMENT();
 }
 
 /* ======================================================= */
 
-/* convert one project into a dom tree */
-static xmlNodePtr gtt_xml_project_to_dom_tree(GttProject *prj)
+/* write out one project */
+static void gtt_xml_write_project(XmlOut *out, SnapProject *prj)
 {
-    GList *children, *tasks;
-    xmlNodePtr node, topnode;
+    START_ELEMENT("gtt:project");
 
-    if (!prj)
-        return NULL;
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:project");
+    put_text(out, "title", prj->title);
 
-    node = xmlNewNode(NULL, BAD_CAST "title");
-    xmlNodeAddContent(node, BAD_CAST gtt_project_get_title(prj));
-    xmlAddChild(topnode, node);
+    PUT_GUID("guid", &prj->guid);
+    PUT_STR("desc", prj->desc);
+    PUT_STR("notes", prj->notes);
+    PUT_STR("custid", prj->custid);
 
-    PUT_GUID("guid", gtt_project_get_guid(prj));
-    PUT_STR("desc", gtt_project_get_desc(prj));
-    PUT_STR("notes", gtt_project_get_notes(prj));
-    PUT_STR("custid", gtt_project_get_custid(prj));
+    PUT_INT("id", prj->id);
 
-    PUT_INT("id", gtt_project_get_id(prj));
+    PUT_DBL("billrate", prj->billrate);
+    PUT_DBL("overtime_rate", prj->overtime_rate);
+    PUT_DBL("overover_rate", prj->overover_rate);
+    PUT_DBL("flat_fee", prj->flat_fee);
 
-    PUT_DBL("billrate", gtt_project_get_billrate(prj));
-    PUT_DBL("overtime_rate", gtt_project_get_overtime_rate(prj));
-    PUT_DBL("overover_rate", gtt_project_get_overover_rate(prj));
-    PUT_DBL("flat_fee", gtt_project_get_flat_fee(prj));
+    PUT_INT("min_interval", prj->min_interval);
+    PUT_INT("auto_merge_interval", prj->auto_merge_interval);
+    PUT_INT("auto_merge_gap", prj->auto_merge_gap);
 
-    PUT_INT("min_interval", gtt_project_get_min_interval(prj));
-    PUT_INT("auto_merge_interval", gtt_project_get_auto_merge_interval(prj));
-    PUT_INT("auto_merge_gap", gtt_project_get_auto_merge_gap(prj));
+    PUT_LONG("estimated_start", prj->estimated_start);
+    PUT_LONG("estimated_end", prj->estimated_end);
+    PUT_LONG("due_date", prj->due_date);
 
-    PUT_LONG("estimated_start", gtt_project_get_estimated_start(prj));
-    PUT_LONG("estimated_end", gtt_project_get_estimated_end(prj));
-    PUT_LONG("due_date", gtt_project_get_due_date(prj));
+    PUT_INT("sizing", prj->sizing);
+    PUT_INT("percent_complete", prj->percent_complete);
 
-    PUT_INT("sizing", gtt_project_get_sizing(prj));
-    PUT_INT("percent_complete", gtt_project_get_percent_complete(prj));
-
-    PUT_ENUM_4("urgency", gtt_project_get_urgency(prj), UNDEFINED, LOW, MEDIUM, HIGH);
-    PUT_ENUM_4("importance", gtt_project_get_importance(prj), UNDEFINED, LOW, MEDIUM, HIGH);
+    PUT_ENUM_4("urgency", prj->urgency, UNDEFINED, LOW, MEDIUM, HIGH);
+    PUT_ENUM_4("importance", prj->importance, UNDEFINED, LOW, MEDIUM, HIGH);
     PUT_ENUM_6(
-        "status", gtt_project_get_status(prj), NO_STATUS, NOT_STARTED, IN_PROGRESS, ON_HOLD,
-        CANCELLED, COMPLETED
+        "status", prj->status, NO_STATUS, NOT_STARTED, IN_PROGRESS, ON_HOLD, CANCELLED,
+        COMPLETED
     );
 
     /* handle tasks */
-    tasks = gtt_project_get_tasks(prj);
-    node = gtt_task_list_to_dom_tree(tasks);
-    xmlAddChild(topnode, node);
+    gtt_xml_write_task_list(out, prj->num_tasks, prj->tasks);
 
     /* handle sub-projects */
-    children = gtt_project_get_children(prj);
-    if (children)
-    {
-        node = gtt_project_list_to_dom_tree(children);
-        xmlAddChild(topnode, node);
-    }
+    gtt_xml_write_project_list(out, prj->num_children, prj->children);
 
-    return topnode;
+    END_ELEMENT();
 }
 
-/* convert a list of gtt projects into a DOM tree */
-static xmlNodePtr gtt_project_list_to_dom_tree(GList *list)
+/* write out a list of gtt projects */
+static void gtt_xml_write_project_list(XmlOut *out, guint num, SnapProject *sps)
 {
-    GList *p;
-    xmlNodePtr topnode;
-    xmlNodePtr node;
+    guint i;
 
-    if (!list)
-        return NULL;
+    if (0 == num)
+        return;
 
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:project-list");
+    START_ELEMENT("gtt:project-list");
 
-    for (p = list; p; p = p->next)
+    for (i = 0; i < num; i++)
     {
-        GttProject *prj = p->data;
-        node = gtt_xml_project_to_dom_tree(prj);
-        xmlAddChild(topnode, node);
+        gtt_xml_write_project(out, &sps[i]);
     }
 
-    return topnode;
+    END_ELEMENT();
 }
 
 /* ======================================================= */
 
-/* convert all gtt state into a DOM tree */
-static xmlNodePtr gtt_to_dom_tree(void)
+/* write out all gtt state */
+static void gtt_xml_write_all(XmlOut *out, GttXmlSnapshot *snap)
 {
-    xmlNodePtr topnode;
-    xmlNodePtr node;
-    // xmlNsPtr   ns;
+    /* No indentation; the old dump didn't have any either */
+    CHECK(xmlTextWriterSetIndent(out->writer, 0));
+    CHECK(xmlTextWriterStartDocument(out->writer, NULL, NULL, NULL));
 
-    topnode = xmlNewNode(NULL, BAD_CAST "gtt:gtt");
-    xmlSetProp(topnode, BAD_CAST "version", BAD_CAST "1.0.1");
+    START_ELEMENT("gtt:gtt");
 
-    // XXX TODO do we even need to call this?
-    // ns = xmlNewNs (topnode, BAD_CAST "file:" GTTDATADIR "/gtt.dtd", BAD_CAST "gtt");
-    xmlNewNs(topnode, BAD_CAST "file:" GTTDATADIR "/gtt.dtd", BAD_CAST "gtt");
+    // XXX TODO do we even need to write this?
+    CHECK(xmlTextWriterWriteAttribute(
+        out->writer, BAD_CAST "xmlns:gtt", BAD_CAST "file:" GTTDATADIR "/gtt.dtd"
+    ));
+    CHECK(xmlTextWriterWriteAttribute(out->writer, BAD_CAST "version", BAD_CAST "1.0.1"));
 
-    node = gtt_project_list_to_dom_tree(gtt_project_list_get_list(master_list));
-    if (node)
-        xmlAddChild(topnode, node);
+    gtt_xml_write_project_list(out, snap->num_projects, snap->projects);
 
-    return topnode;
+    END_ELEMENT();
+    CHECK(xmlTextWriterEndDocument(out->writer));
 }
 
-/* Write all gtt data to xml file */
+/* The libxml output buffer pushes its data through here, so that it
+ * is compressed on its way out, without another copy of the file. */
 
-void gtt_xml_write_file(const char *filename)
+static int write_cb(void *context, const char *buffer, int len)
+{
+    return gtt_file_compress_out_write(context, buffer, len) ? len : -1;
+}
+
+static int close_cb(void *context)
+{
+    /* The stream is finished by gtt_xml_snapshot_write() */
+    return 0;
+}
+
+/* Write a snapshot to xml file.  This may run in any thread,
+ * so errors are returned rather than set. */
+
+GttErrCode gtt_xml_snapshot_write(GttXmlSnapshot *snap, const char *filename)
 {
     char *tmpfilename;
-    xmlNodePtr topnode;
+    xmlOutputBufferPtr buf = NULL;
+    GttCompressOut *cout;
+    XmlOut out;
     FILE *fh;
     int rc;
 
@@ -393,17 +583,37 @@ void gtt_xml_write_file(const char *filename)
     g_free(tmpfilename);
     if (!fh)
     {
-        gtt_err_set_code(GTT_CANT_OPEN_FILE);
-        return;
+        return GTT_CANT_OPEN_FILE;
     }
 
-    topnode = gtt_to_dom_tree();
+    /* The output buffer flushes into the compressor, which writes
+     * into fh, but leaves it open */
+    cout = gtt_file_compress_out_new(fh, snap->compression);
+    if (cout)
+        buf = xmlOutputBufferCreateIO(write_cb, close_cb, cout, NULL);
+    out.writer = buf ? xmlNewTextWriter(buf) : NULL;
+    out.failed = (NULL == out.writer);
+    if (out.writer)
+    {
+        gtt_xml_write_all(&out, snap);
 
-    fprintf(fh, "<?xml version=\"1.0\"?>\n");
-    xmlElemDump(fh, NULL, topnode);
-    xmlFreeNode(topnode);
+        /* this also flushes and frees the output buffer */
+        xmlFreeTextWriter(out.writer);
+    }
+    else if (buf)
+    {
+        xmlOutputBufferClose(buf);
+    }
 
-    fprintf(fh, "\n");
+    /* An error in the final flush only shows up here */
+    if (cout && !gtt_file_compress_out_finish(cout))
+        out.failed = TRUE;
+
+    if (out.failed)
+    {
+        fclose(fh);
+        return GTT_CANT_WRITE_FILE;
+    }
 
     /* The algorithm we use here is to write to a tmp file,
      * make sure that the write succeeded, and only then
@@ -411,21 +621,17 @@ void gtt_xml_write_file(const char *filename)
      * certain errors (e.g. no room on disk) are not reported
      * until the fclose, which makes this an important code
      * to check.
-     * Sure wish there was a way of finding out if xmlElemDump
-     * suceeded ...
      */
     rc = fflush(fh);
     if (rc)
     {
-        gtt_err_set_code(GTT_CANT_WRITE_FILE);
-        return;
+        return GTT_CANT_WRITE_FILE;
     }
 
     rc = fclose(fh);
     if (rc)
     {
-        gtt_err_set_code(GTT_CANT_WRITE_FILE);
-        return;
+        return GTT_CANT_WRITE_FILE;
     }
 
     /* If we were truly paranoid, we could, at this point, try
@@ -442,9 +648,24 @@ void gtt_xml_write_file(const char *filename)
     g_free(tmpfilename);
     if (rc)
     {
-        gtt_err_set_code(GTT_CANT_WRITE_FILE);
-        return;
+        return GTT_CANT_WRITE_FILE;
     }
+    return GTT_NO_ERR;
+}
+
+/* Write all gtt data to xml file */
+
+void gtt_xml_write_file(const char *filename)
+{
+    GttXmlSnapshot *snap;
+    GttErrCode errcode;
+
+    snap = gtt_xml_snapshot_new(gtt_project_list_get_list(master_list), 0);
+    errcode = gtt_xml_snapshot_write(snap, filename);
+    gtt_xml_snapshot_free(snap);
+
+    if (GTT_NO_ERR != errcode)
+        gtt_err_set_code(errcode);
 }
 
 /* ===================== END OF FILE ================== */